@@ -1,10 +1,94 @@
 {
   "targets": [
     {
-      "target_name": "addon",
-      "sources": [ "cpp/addon.cc" ],
+      # the native pipeline without Node, shared by the addon and the
+      # standalone executables
+      "target_name": "calculate_core",
+      "type": "static_library",
+      "sources": [
+        "cpp/arrow_file.cc",
+        "cpp/base_cache.cc",
+        "cpp/batch_analysis.cc",
+        "cpp/block_index.cc",
+        "cpp/block_reader.cc",
+        "cpp/byte_source.cc",
+        "cpp/columnar_export.cc",
+        "cpp/diff_pipeline.cc",
+        "cpp/engine_pool.cc",
+        "cpp/epoch_aligner.cc",
+        "cpp/example_analysis.cc",
+        "cpp/job_control.cc",
+        "cpp/live_ingest.cc",
+        "cpp/mapped_file.cc",
+        "cpp/meas_epoch.cc",
+        "cpp/metrics.cc",
+        "cpp/packed_result.cc",
+        "cpp/pvt_analysis.cc",
+        "cpp/pvt_stats.cc",
+        "cpp/replay_scheduler.cc",
+        "cpp/rinex_conversion.cc",
+        "cpp/sbf_filter.cc",
+        "cpp/sbf_scanner.cc",
+        "cpp/sbf_stream.cc",
+        "cpp/scratch_arena.cc",
+        "cpp/sdk_error.cc",
+        "cpp/series_pyramid.cc",
+        "cpp/sharded_pvt.cc",
+        "cpp/stream_cache.cc",
+        "cpp/temp_space.cc",
+        "cpp/tracked_timeline.cc"
+      ],
       "include_dirs": ["cpp/ppsdk/includes"],
-      "libraries": ["<(module_root_dir)/cpp/ppsdk/library/ppsdk.lib"],
+      # linked into addon.node, so position independent; the MeasEpoch
+      # kernels match the scalar one only without fused multiply-adds
+      "cflags": ["-fPIC"],
+      "cflags_cc": ["-ffp-contract=off"],
+      "xcode_settings": {"OTHER_CPLUSPLUSFLAGS": ["-ffp-contract=off"]},
+      "direct_dependent_settings": {
+        "include_dirs": ["cpp", "cpp/ppsdk/includes"]
+      },
+      "link_settings": {
+        "libraries": ["<(module_root_dir)/cpp/ppsdk/library/ppsdk.lib"],
+        "conditions": [
+          ["OS=='win'", {"libraries": ["ws2_32.lib", "winmm.lib"]}]
+        ]
+      },
+    },
+    {
+      "target_name": "addon",
+      "dependencies": ["calculate_core"],
+      "sources": [
+        "cpp/addon.cc",
+        "cpp/analyze_many.cc",
+        "cpp/async_job.cc",
+        "cpp/base_finder.cc",
+        "cpp/block_iterator.cc",
+        "cpp/calculate_pvt_sharded.cc",
+        "cpp/convert_rinex.cc",
+        "cpp/decode_meas_epoch.cc",
+        "cpp/engine_profile.cc",
+        "cpp/epoch_alignment.cc",
+        "cpp/export_columnar.cc",
+        "cpp/filter_sbf.cc",
+        "cpp/job_binding.cc",
+        "cpp/live_receiver.cc",
+        "cpp/process_differential.cc",
+        "cpp/sbf_replay.cc",
+        "cpp/sbf_session.cc",
+        "cpp/scan_file.cc"
+      ],
+    },
+    {
+      "target_name": "sbf_bench",
+      "type": "executable",
+      "dependencies": ["calculate_core"],
+      "sources": ["cpp/sbf_bench.cc"],
+    },
+    {
+      "target_name": "sbf_daemon",
+      "type": "executable",
+      "dependencies": ["calculate_core"],
+      "sources": ["cpp/sbf_daemon.cc"],
     }
   ]
-} 
\ No newline at end of file
+}
@@ -3,12 +3,39 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "ssnsdk.h"
 #include "ssnerror.h"
 #include "ssnsbfstream.h"
 #include "ssnsbfanalyze.h"
 
+#include "analyze_many.h"
+#include "async_job.h"
+#include "base_finder.h"
+#include "block_iterator.h"
+#include "calculate_pvt_sharded.h"
+#include "convert_rinex.h"
+#include "decode_meas_epoch.h"
+#include "engine_profile.h"
+#include "epoch_alignment.h"
+#include "example_analysis.h"
+#include "export_columnar.h"
+#include "filter_sbf.h"
+#include "live_receiver.h"
+#include "metrics.h"
+#include "process_differential.h"
+#include "sbf_replay.h"
+#include "sbf_session.h"
+#include "sbf_stream.h"
+#include "scan_file.h"
+#include "scratch_arena.h"
+#include "stream_cache.h"
+#include "temp_space.h"
+#include "packed_result.h"
+#include "pvt_analysis.h"
+#include "tracked_timeline.h"
+
 
 namespace calculate {
 
@@ -18,100 +45,549 @@ using v8::Local;
 using v8::Object;
 using v8::Number;
 using v8::Value;
+using v8::Integer;
+using v8::Context;
+using v8::String;
+using v8::ArrayBuffer;
+using v8::Float64Array;
+using v8::Uint8Array;
+using v8::Uint32Array;
+using v8::Exception;
+using v8::BackingStore;
+
+// method to be exported, returns EXIT_SUCCESS or throws the SDK error
+void Method(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  ErrorTrail trail;
+  ssn_error_t rerror = AnalyzeExample();
+  if (!IsOk(rerror)) {
+    isolate->ThrowException(FailureError(isolate, DescribeError(rerror),
+                                         trail.Failure(rerror)));
+    return;
+  }
+  args.GetReturnValue().Set(EXIT_SUCCESS);
+}
+
+// runs AnalyzeExample() on the libuv thread pool so the main thread stays
+// responsive
+class AnalyzeJob : public AsyncJob {
+ public:
+  explicit AnalyzeJob(Isolate* isolate)
+      : AsyncJob(isolate, "calculate:analyze") {}
+
+ protected:
+  void Execute() override {
+    ssn_error_t rerror = AnalyzeExample();
+    if (!IsOk(rerror))
+      SetError(rerror);
+  }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    return Integer::New(isolate, EXIT_SUCCESS);
+  }
+};
+
+// method to be exported, resolves like executeSync returns and rejects with
+// the error it throws
+void MethodAsync(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  AnalyzeJob* job = new AnalyzeJob(isolate);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+// configureStreamCache({ maxBytes }) sets the memory budget of the stream cache
+void ConfigureStreamCache(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  if (args.Length() > 0 && args[0]->IsObject()) {
+    Local<Value> maxBytes = args[0].As<Object>()
+        ->Get(context, String::NewFromUtf8(isolate, "maxBytes").ToLocalChecked())
+        .ToLocalChecked();
+    if (maxBytes->IsNumber())
+      StreamCache::Instance().SetMaxBytes(
+          static_cast<uint64_t>(maxBytes.As<Number>()->Value()));
+  }
+}
+
+void ClearStreamCache(const FunctionCallbackInfo<Value>& args) {
+  StreamCache::Instance().Clear();
+}
+
+void GetStreamCacheStats(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+  StreamCache::Stats stats = StreamCache::Instance().GetStats();
+
+  Local<Object> out = Object::New(isolate);
+  auto set = [&](const char* key, uint64_t value) {
+    out->Set(context, String::NewFromUtf8(isolate, key).ToLocalChecked(),
+             Number::New(isolate, static_cast<double>(value))).Check();
+  };
+  set("hits", stats.hits);
+  set("misses", stats.misses);
+  set("evictions", stats.evictions);
+  set("entries", stats.entries);
+  set("bytes", stats.bytes);
+  set("maxBytes", stats.max_bytes);
+
+  args.GetReturnValue().Set(out);
+}
+
+// configureTempSpace({ directory, maxBytes }) sets the root of the PPSDK
+// temp directories and the spill budget, for SDK handles opened from now on
+void ConfigureTempSpace(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  TempSpaceSettings settings;
+  if (args.Length() > 0 && args[0]->IsObject()) {
+    Local<Object> options = args[0].As<Object>();
+    Local<Value> directory = options
+        ->Get(context, String::NewFromUtf8(isolate, "directory").ToLocalChecked())
+        .ToLocalChecked();
+    Local<Value> maxBytes = options
+        ->Get(context, String::NewFromUtf8(isolate, "maxBytes").ToLocalChecked())
+        .ToLocalChecked();
+    if (directory->IsString())
+      settings.directory = *String::Utf8Value(isolate, directory);
+    if (maxBytes->IsNumber())
+      settings.max_bytes =
+          static_cast<uint64_t>(maxBytes.As<Number>()->Value());
+  }
+  TempSpace::Instance().Configure(settings);
+}
+
+// getTempSpaceStats() -> { directory, bytes, peakBytes, maxBytes, handles,
+//                          fallbacks, waits, swept }
+void GetTempSpaceStats(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+  TempSpace::Stats stats = TempSpace::Instance().GetStats();
+
+  Local<Object> out = Object::New(isolate);
+  auto set = [&](const char* key, uint64_t value) {
+    out->Set(context, String::NewFromUtf8(isolate, key).ToLocalChecked(),
+             Number::New(isolate, static_cast<double>(value))).Check();
+  };
+  out->Set(context, String::NewFromUtf8(isolate, "directory").ToLocalChecked(),
+           String::NewFromUtf8(isolate, stats.directory.c_str())
+               .ToLocalChecked()).Check();
+  set("bytes", stats.bytes);
+  set("peakBytes", stats.peak_bytes);
+  set("maxBytes", stats.max_bytes);
+  set("handles", stats.handles);
+  set("fallbacks", stats.fallbacks);
+  set("waits", stats.waits);
+  set("swept", stats.swept);
+
+  args.GetReturnValue().Set(out);
+}
+
+// getScratchStats() -> { freshBytes, reusedBytes, resets, retainedBytes,
+//                        arenas } of the per-thread scratch arenas
+void GetScratchStats(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+  ScratchArena::Stats stats = ScratchArena::GetStats();
+
+  Local<Object> out = Object::New(isolate);
+  auto set = [&](const char* key, uint64_t value) {
+    out->Set(context, String::NewFromUtf8(isolate, key).ToLocalChecked(),
+             Number::New(isolate, static_cast<double>(value))).Check();
+  };
+  set("freshBytes", stats.fresh_bytes);
+  set("reusedBytes", stats.reused_bytes);
+  set("resets", stats.resets);
+  set("retainedBytes", stats.retained_bytes);
+  set("arenas", stats.arenas);
+
+  args.GetReturnValue().Set(out);
+}
+
+// getMetrics() -> { stages: { open: { calls, errors, warnings, wallMs,
+//                   cpuMs, maxWallMs, spillBytes, maxSpillBytes },
+//                   loadFile, analyze, merge, configure, calculatePVT,
+//                   writeToFile },
+//                   blocks, bytesRead, streamBytes, peakStreamBytes,
+//                   threads, tracing, traceEvents }
+void GetMetrics(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+  MetricsSnapshot metrics = SnapshotMetrics();
+
+  auto set = [&](Local<Object> target, const char* key, double value) {
+    target->Set(context, String::NewFromUtf8(isolate, key).ToLocalChecked(),
+                Number::New(isolate, value)).Check();
+  };
+
+  Local<Object> stages = Object::New(isolate);
+  for (int stage = 0; stage < kStageCount; ++stage) {
+    const StageMetrics& s = metrics.stages[stage];
+    Local<Object> entry = Object::New(isolate);
+    set(entry, "calls", static_cast<double>(s.calls));
+    set(entry, "errors", static_cast<double>(s.errors));
+    set(entry, "warnings", static_cast<double>(s.warnings));
+    set(entry, "wallMs", s.wall_ns / 1e6);
+    set(entry, "cpuMs", s.cpu_ns / 1e6);
+    set(entry, "maxWallMs", s.max_wall_ns / 1e6);
+    set(entry, "spillBytes", static_cast<double>(s.spill_bytes));
+    set(entry, "maxSpillBytes", static_cast<double>(s.max_spill_bytes));
+    stages->Set(context,
+                String::NewFromUtf8(isolate,
+                                    MetricStageName(stage)).ToLocalChecked(),
+                entry).Check();
+  }
+
+  Local<Object> out = Object::New(isolate);
+  out->Set(context, String::NewFromUtf8(isolate, "stages").ToLocalChecked(),
+           stages).Check();
+  set(out, "blocks", static_cast<double>(metrics.blocks));
+  set(out, "bytesRead", static_cast<double>(metrics.bytes_read));
+  set(out, "streamBytes", static_cast<double>(metrics.stream_bytes));
+  set(out, "peakStreamBytes", static_cast<double>(metrics.peak_stream_bytes));
+  set(out, "threads", static_cast<double>(metrics.threads));
+  out->Set(context, String::NewFromUtf8(isolate, "tracing").ToLocalChecked(),
+           v8::Boolean::New(isolate, metrics.tracing)).Check();
+  set(out, "traceEvents", static_cast<double>(metrics.trace_events));
+
+  args.GetReturnValue().Set(out);
+}
+
+// setTracing(enabled) starts / stops buffering Chrome trace events
+void SetTracing(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  EnableTracing(args.Length() > 0 && args[0]->BooleanValue(isolate));
+}
 
-// ppsdk example
-int analyze()
-{
-  ssn_hsdk_t        ssnsdkhandle;       // SSN SDK handle
-  ssn_hsbfstream_t  sbfstream;          // SBF stream handle
-  ssn_error_t       rerror;             // Assess the outcome of different functions (runtime)
-  ssn_error_t       cerror;             // Error occuring during the clean-up process
-
-  ssn_pvterror_percentages_t errorDistrib;  // PVT error percentages
-  size_t                     listSize;      // Size of list of tracked satellites
-  unsigned char*             buffer;        // List of tracked satellites
-  char                       inputFile[] = "input_file.sbf";
-
-  /* Create all handles */
-
-  rerror = SSNSDK_open(&ssnsdkhandle);
-  if (SSNERROR_GETCODE(rerror) != SSNERROR_WARNING_OK)
-    goto exit_error;
-
-  rerror = SSNSBFStream_open(ssnsdkhandle, &sbfstream);
-  if (SSNERROR_GETCODE(rerror) != SSNERROR_WARNING_OK)
-    goto clean_sdk;
-
-  /* The input SBF file is loaded */
-
-  rerror = SSNSBFStream_loadFile(sbfstream, inputFile, SSNSBFSTREAM_OPENOPTION_READONLY);
-  if (SSNERROR_GETCODE(rerror) != SSNERROR_WARNING_OK)
-    goto clean_sbf;
-
-  /* Get error percentages */
-
-  rerror = SSNSBFAnalyze_getPVTErrorPercentages(sbfstream, sbfid_ALL, &errorDistrib);
-  if (SSNERROR_GETCODE(rerror) != SSNERROR_WARNING_OK)
-    goto clean_sbf;
-
-  /*
-   * Get list of tracked satelllites via double-call:
-   *   1) Get size
-   *   2) Get list
-   */
-
-  rerror = SSNSBFAnalyze_listTrackedSatellites(sbfstream, 295766.0, &listSize, NULL);
-  if (SSNERROR_GETCODE(rerror) != SSNERROR_WARNING_OK)
-    goto clean_sbf;
-
-  if (listSize > 0)
-  {
-    buffer = (unsigned char*) malloc(listSize);
-    if (buffer != NULL)
-    {
-      rerror = SSNSBFAnalyze_listTrackedSatellites(sbfstream, 295766.0, &listSize, (ssn_tracked_satellites_t*) buffer);
-      if (SSNERROR_GETCODE(rerror) != SSNERROR_WARNING_OK)
-        goto free_memory;
+class WriteTraceJob : public AsyncJob {
+ public:
+  WriteTraceJob(Isolate* isolate, const std::string& path)
+      : AsyncJob(isolate, "calculate:writeTrace"), path_(path) {}
+
+ protected:
+  void Execute() override {
+    ssn_error_t rerror = WriteTraceFile(path_, &events_);
+    if (!IsOk(rerror))
+      SetError(rerror);
+  }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    return Number::New(isolate, static_cast<double>(events_));
+  }
+
+ private:
+  std::string path_;
+  size_t events_ = 0;
+};
+
+// writeTrace(path) -> Promise<number of events>, drains the trace buffer
+void WriteTrace(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+
+  if (args.Length() < 1 || !args[0]->IsString()) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate,
+        "writeTrace: path must be a string").ToLocalChecked()));
+    return;
+  }
+
+  String::Utf8Value path(isolate, args[0]);
+  WriteTraceJob* job = new WriteTraceJob(isolate, *path);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+// copies a column into a fresh ArrayBuffer owned by V8
+Local<ArrayBuffer> ToArrayBuffer(Isolate* isolate, const void* data,
+                                 size_t length) {
+  Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, length);
+  if (length > 0)
+    memcpy(buffer->Data(), data, length);
+  return buffer;
+}
+
+class TimelineJob : public StreamJob {
+ public:
+  TimelineJob(Isolate* isolate, const std::shared_ptr<SbfStream>& stream,
+              double start, double end, double step)
+      : StreamJob(isolate, "calculate:trackedSatellitesTimeline", stream),
+        start_(start), end_(end), step_(step) {}
+
+ protected:
+  ssn_error_t Query(ssn_hsbfstream_t sbfstream) override {
+    return CollectTrackedTimeline(sbfstream, start_, end_, step_, &timeline_);
+  }
+
+  // { epochs, offsets, svid, freqnr, signals }; signals holds two Uint32
+  // words (low, high) per row of the 64-bit signal mask
+  Local<Value> OnOK(Isolate* isolate) override {
+    Local<Context> context = isolate->GetCurrentContext();
+    Local<Object> out = Object::New(isolate);
+    size_t epochs = timeline_.epochs.size();
+    size_t rows = timeline_.svid.size();
+
+    auto set = [&](const char* key, Local<Value> value) {
+      out->Set(context, String::NewFromUtf8(isolate, key).ToLocalChecked(),
+               value).Check();
+    };
+
+    set("epochs", Float64Array::New(
+        ToArrayBuffer(isolate, timeline_.epochs.data(), epochs * sizeof(double)),
+        0, epochs));
+    set("offsets", Uint32Array::New(
+        ToArrayBuffer(isolate, timeline_.offsets.data(),
+                      timeline_.offsets.size() * sizeof(uint32_t)),
+        0, timeline_.offsets.size()));
+    set("svid", Uint8Array::New(
+        ToArrayBuffer(isolate, timeline_.svid.data(), rows), 0, rows));
+    set("freqnr", Uint8Array::New(
+        ToArrayBuffer(isolate, timeline_.freqnr.data(), rows), 0, rows));
+
+    Local<ArrayBuffer> signals = ArrayBuffer::New(isolate, rows * 8);
+    uint32_t* words = static_cast<uint32_t*>(signals->Data());
+    for (size_t i = 0; i < rows; ++i) {
+      words[2 * i] = static_cast<uint32_t>(timeline_.signals[i]);
+      words[2 * i + 1] = static_cast<uint32_t>(timeline_.signals[i] >> 32);
     }
+    set("signals", Uint32Array::New(signals, 0, rows * 2));
+
+    return out;
   }
 
-  /* Clean-up */
+ private:
+  double start_;
+  double end_;
+  double step_;
+  TrackedTimeline timeline_;
+};
 
-free_memory:
-  free(buffer);
+// trackedSatellitesTimeline(session, towStart, towEnd, step)
+void TrackedSatellitesTimeline(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
 
-clean_sbf:
+  if (args.Length() < 4 || !args[1]->IsNumber() || !args[2]->IsNumber() ||
+      !args[3]->IsNumber()) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate,
+        "trackedSatellitesTimeline(session, towStart, towEnd, step) expects "
+        "a session and three numbers").ToLocalChecked()));
+    return;
+  }
 
-  cerror = SSNSBFStream_close(sbfstream);
-  if (SSNERROR_GETCODE(cerror) != SSNERROR_WARNING_OK)
-    fprintf(stderr, "Error: %s\n", SSNError_getMessage(cerror));
+  std::shared_ptr<SbfStream> stream = SbfSession::StreamFrom(isolate, args[0]);
+  if (!stream)
+    return;
 
-clean_sdk:
+  double start = args[1].As<Number>()->Value();
+  double end = args[2].As<Number>()->Value();
+  double step = args[3].As<Number>()->Value();
 
-  cerror = SSNSDK_close(ssnsdkhandle);
-  if (SSNERROR_GETCODE(cerror) != SSNERROR_WARNING_OK)
-    fprintf(stderr, "Error: %s\n", SSNError_getMessage(cerror));
+  size_t epochs = TimelineEpochCount(start, end, step);
+  if (epochs == 0 || epochs > kMaxTimelineEpochs) {
+    isolate->ThrowException(Exception::RangeError(String::NewFromUtf8(isolate,
+        "trackedSatellitesTimeline: empty range, non-positive step or too "
+        "many epochs").ToLocalChecked()));
+    return;
+  }
+
+  TimelineJob* job = new TimelineJob(isolate, stream, start, end, step);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+// Runs the requested analyses and packs them (see packed_result.h) straight
+// into memory from the isolate's ArrayBuffer allocator. The buffer is
+// written on the worker thread and adopted by V8 without a copy; using the
+// isolate allocator keeps it inside Electron's V8 memory cage.
+class PackedAnalysisJob : public StreamJob {
+ public:
+  struct Range {
+    bool enabled = false;
+    double start = 0;
+    double end = 0;
+    double step = 0;
+  };
+
+  PackedAnalysisJob(Isolate* isolate, const std::shared_ptr<SbfStream>& stream)
+      : StreamJob(isolate, "calculate:analyzePacked", stream),
+        allocator_(isolate->GetArrayBufferAllocator()) {}
+
+  ~PackedAnalysisJob() override {
+    if (data_ != NULL)
+      allocator_->Free(data_, length_);
+  }
 
-  if (SSNERROR_GETCODE(rerror) != SSNERROR_WARNING_OK)
-    goto exit_error;
+  AnalysisOps ops;
+  Range tracked;
+  Range used;
+
+ protected:
+  ssn_error_t Query(ssn_hsbfstream_t sbfstream) override {
+    ssn_error_t rerror = SSNERROR_WARNING_OK;
+    PackedInput input;
+
+    rerror = AnalyzePVT(sbfstream, ops, &analysis_);
+    if (!IsOk(rerror))
+      return rerror;
+    if (analysis_.has_errors)
+      input.errors = &analysis_.errors;
+    if (analysis_.has_modes)
+      input.modes = &analysis_.modes;
+
+    if (tracked.enabled) {
+      rerror = CollectTrackedTimeline(sbfstream, tracked.start, tracked.end,
+                                      tracked.step, &tracked_);
+      if (!IsOk(rerror))
+        return rerror;
+      input.tracked = &tracked_;
+    }
 
-  return EXIT_SUCCESS;
+    if (used.enabled) {
+      rerror = CollectUsedTimeline(sbfstream, used.start, used.end, used.step,
+                                   &used_);
+      if (!IsOk(rerror))
+        return rerror;
+      input.used = &used_;
+    }
 
-exit_error:
+    length_ = PackedByteLength(input);
+    data_ = allocator_->Allocate(length_);
+    if (data_ == NULL)
+      return SSNERROR_CREATE(SSNERROR_SEVERITY_FAILURE, SSNERROR_MODULE_GENERAL,
+                             SSNERROR_SUBMODULE_GENERAL, SSNERROR_TYPE_GENERAL,
+                             SSNERROR_ERROR_OUTOFMEMORY);
 
-  fprintf(stderr, "Error: %s\n", SSNError_getMessage(rerror));
-  return EXIT_FAILURE;
+    WritePacked(input, data_);
+    return rerror;
+  }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    std::unique_ptr<BackingStore> store = ArrayBuffer::NewBackingStore(
+        data_, length_, FreePacked, allocator_);
+    data_ = NULL;
+    return ArrayBuffer::New(isolate, std::move(store));
+  }
+
+ private:
+  static void FreePacked(void* data, size_t length, void* allocator) {
+    static_cast<ArrayBuffer::Allocator*>(allocator)->Free(data, length);
+  }
+
+  ArrayBuffer::Allocator* allocator_;
+  void* data_ = NULL;
+  size_t length_ = 0;
+
+  PVTAnalysis analysis_;
+  TrackedTimeline tracked_;
+  UsedTimeline used_;
+};
+
+// reads { start, end, step } from options[key]; false when absent
+bool ReadRange(Isolate* isolate, Local<Object> options, const char* key,
+               PackedAnalysisJob::Range* range) {
+  Local<Context> context = isolate->GetCurrentContext();
+  Local<Value> value = options->Get(context,
+      String::NewFromUtf8(isolate, key).ToLocalChecked()).ToLocalChecked();
+  if (!value->IsObject())
+    return false;
+
+  auto number = [&](const char* name) {
+    Local<Value> field = value.As<Object>()->Get(context,
+        String::NewFromUtf8(isolate, name).ToLocalChecked()).ToLocalChecked();
+    return field->IsNumber() ? field.As<Number>()->Value() : 0.0;
+  };
+
+  range->start = number("start");
+  range->end = number("end");
+  range->step = number("step");
+  range->enabled = true;
+  return true;
 }
 
-// method to be exported
-void Method(const FunctionCallbackInfo<Value>& args) {
+// analyzePacked(session, { sbfid, errors, modes, tracked: { start, end, step },
+//                          used: { start, end, step } }) -> Promise<ArrayBuffer>
+void AnalyzePacked(const FunctionCallbackInfo<Value>& args) {
   Isolate* isolate = args.GetIsolate();
-  // return status code
-  args.GetReturnValue().Set(analyze());
+  Local<Context> context = isolate->GetCurrentContext();
+
+  std::shared_ptr<SbfStream> stream = SbfSession::StreamFrom(isolate, args[0]);
+  if (!stream)
+    return;
+
+  PackedAnalysisJob* job = new PackedAnalysisJob(isolate, stream);
+
+  if (args.Length() > 1 && args[1]->IsObject()) {
+    Local<Object> options = args[1].As<Object>();
+    auto flag = [&](const char* key) {
+      return options->Get(context,
+          String::NewFromUtf8(isolate, key).ToLocalChecked()).ToLocalChecked()
+          ->BooleanValue(isolate);
+    };
+    Local<Value> sbfid = options->Get(context,
+        String::NewFromUtf8(isolate, "sbfid").ToLocalChecked()).ToLocalChecked();
+
+    if (sbfid->IsNumber())
+      job->ops.sbfid =
+          static_cast<SBFID_t>(sbfid->Uint32Value(context).FromJust());
+    job->ops.errors = flag("errors");
+    job->ops.modes = flag("modes");
+    ReadRange(isolate, options, "tracked", &job->tracked);
+    ReadRange(isolate, options, "used", &job->used);
+  } else {
+    job->ops.errors = true;
+    job->ops.modes = true;
+  }
+
+  for (const PackedAnalysisJob::Range* range : { &job->tracked, &job->used }) {
+    size_t epochs = TimelineEpochCount(range->start, range->end, range->step);
+    if (range->enabled && (epochs == 0 || epochs > kMaxTimelineEpochs)) {
+      delete job;
+      isolate->ThrowException(Exception::RangeError(String::NewFromUtf8(isolate,
+          "analyzePacked: empty range, non-positive step or too many "
+          "epochs").ToLocalChecked()));
+      return;
+    }
+  }
+
+  args.GetReturnValue().Set(job->Queue());
 }
 
 void Initialize(Local<Object> exports) {
   NODE_SET_METHOD(exports, "executeSync", Method);
+  NODE_SET_METHOD(exports, "executeAsync", MethodAsync);
+  NODE_SET_METHOD(exports, "analyzeMany", AnalyzeMany);
+  NODE_SET_METHOD(exports, "calculatePVTSharded", CalculatePVTSharded);
+  NODE_SET_METHOD(exports, "scanFile", ScanFile);
+  NODE_SET_METHOD(exports, "exportColumnar", ExportColumnar);
+  NODE_SET_METHOD(exports, "decodeMeasEpoch", DecodeMeasEpoch);
+  NODE_SET_METHOD(exports, "filterSbf", FilterSbf);
+  NODE_SET_METHOD(exports, "convertRinex", ConvertRinex);
+  NODE_SET_METHOD(exports, "configureBaseFinder", ConfigureBaseFinder);
+  NODE_SET_METHOD(exports, "findBaseStations", FindBaseStations);
+  NODE_SET_METHOD(exports, "createBaseReference", CreateBaseReference);
+  NODE_SET_METHOD(exports, "prefetchBaseReference", PrefetchBaseReference);
+  NODE_SET_METHOD(exports, "clearBaseFinderCache", ClearBaseFinderCache);
+  NODE_SET_METHOD(exports, "getBaseFinderCacheStats",
+                  GetBaseFinderCacheStats);
+  NODE_SET_METHOD(exports, "processDifferential", ProcessDifferential);
+  NODE_SET_METHOD(exports, "configureStreamCache", ConfigureStreamCache);
+  NODE_SET_METHOD(exports, "clearStreamCache", ClearStreamCache);
+  NODE_SET_METHOD(exports, "getStreamCacheStats", GetStreamCacheStats);
+  NODE_SET_METHOD(exports, "getScratchStats", GetScratchStats);
+  NODE_SET_METHOD(exports, "configureTempSpace", ConfigureTempSpace);
+  NODE_SET_METHOD(exports, "getTempSpaceStats", GetTempSpaceStats);
+  NODE_SET_METHOD(exports, "registerEngineProfile", RegisterEngineProfile);
+  NODE_SET_METHOD(exports, "configureEnginePool", ConfigureEnginePool);
+  NODE_SET_METHOD(exports, "clearEnginePool", ClearEnginePool);
+  NODE_SET_METHOD(exports, "getEnginePoolStats", GetEnginePoolStats);
+  NODE_SET_METHOD(exports, "getMetrics", GetMetrics);
+  NODE_SET_METHOD(exports, "setTracing", SetTracing);
+  NODE_SET_METHOD(exports, "writeTrace", WriteTrace);
+  NODE_SET_METHOD(exports, "trackedSatellitesTimeline",
+                  TrackedSatellitesTimeline);
+  NODE_SET_METHOD(exports, "analyzePacked", AnalyzePacked);
+  SbfSession::Init(exports);
+  BlockIterator::Init(exports);
+  EpochAlignment::Init(exports);
+  LiveReceiver::Init(exports);
+  SbfReplay::Init(exports);
 }
 
 NODE_MODULE(NODE_GYP_MODULE_NAME, Initialize)
@@ -0,0 +1,250 @@
+#include "analyze_many.h"
+
+#include <uv.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "batch_analysis.h"
+#include "async_job.h"
+#include "job_binding.h"
+#include "sbf_session.h"
+#include "sbf_stream.h"
+#include "v8_util.h"
+
+namespace calculate {
+
+using v8::Array;
+using v8::Context;
+using v8::Exception;
+using v8::Function;
+using v8::FunctionCallbackInfo;
+using v8::Global;
+using v8::HandleScope;
+using v8::Isolate;
+using v8::Local;
+using v8::Number;
+using v8::Object;
+using v8::Promise;
+using v8::String;
+using v8::Value;
+
+namespace {
+
+// Owns a running BatchAnalysis and forwards its results to the main thread
+// through a uv_async_t. Deletes itself once the promise has been settled
+// and the async handle is closed.
+class AnalyzeManyJob : public node::AsyncResource {
+ public:
+  AnalyzeManyJob(Isolate* isolate, std::vector<std::string> paths,
+                 AnalysisOps ops, unsigned concurrency,
+                 Local<Value> on_result, Local<Value> options)
+      : node::AsyncResource(isolate, Object::New(isolate),
+                            "calculate:analyzeMany"),
+        isolate_(isolate), binding_(isolate, options),
+        batch_(new BatchAnalysis(std::move(paths), ops, concurrency,
+                                 binding_.control())) {
+    Local<Context> context = isolate->GetCurrentContext();
+    context_.Reset(isolate, context);
+    resolver_.Reset(isolate, Promise::Resolver::New(context).ToLocalChecked());
+    results_.Reset(isolate, Array::New(isolate));
+    if (on_result->IsFunction())
+      on_result_.Reset(isolate, on_result.As<Function>());
+    async_.data = this;
+  }
+
+  Local<Promise> Start() {
+    Local<Promise> promise = resolver_.Get(isolate_)->GetPromise();
+    uv_async_init(node::GetCurrentEventLoop(isolate_), &async_, OnAsync);
+
+    batch_->Start(
+        [this](FileResult&& result) {
+          {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.push_back(std::move(result));
+          }
+          uv_async_send(&async_);
+        },
+        [this]() {
+          {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_ = true;
+          }
+          uv_async_send(&async_);
+        });
+
+    return promise;
+  }
+
+ private:
+  ~AnalyzeManyJob() {
+    context_.Reset();
+    resolver_.Reset();
+    results_.Reset();
+    on_result_.Reset();
+  }
+
+  static void OnAsync(uv_async_t* handle) {
+    static_cast<AnalyzeManyJob*>(handle->data)->Drain();
+  }
+
+  static void OnClosed(uv_handle_t* handle) {
+    delete static_cast<AnalyzeManyJob*>(handle->data);
+  }
+
+  // uv_async_send coalesces, so take everything queued so far
+  void Drain() {
+    std::vector<FileResult> results;
+    bool done;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      results.swap(pending_);
+      done = done_;
+    }
+
+    HandleScope handle_scope(isolate_);
+    Local<Context> context = context_.Get(isolate_);
+    Context::Scope context_scope(context);
+    Local<Array> all = results_.Get(isolate_);
+
+    for (const FileResult& result : results) {
+      Local<Object> entry = ToObject(result);
+      all->Set(context, static_cast<uint32_t>(result.index), entry).Check();
+
+      if (!on_result_.IsEmpty()) {
+        Local<Value> argv[] = { entry };
+        MakeCallback(on_result_.Get(isolate_), 1, argv);
+      }
+    }
+
+    if (!done)
+      return;
+
+    // every worker has returned from Run(), so this join is immediate
+    batch_.reset();
+    binding_.Finish(isolate_);
+
+    {
+      CallbackScope callback_scope(this);
+      resolver_.Get(isolate_)->Resolve(context, all).Check();
+    }
+
+    uv_close(reinterpret_cast<uv_handle_t*>(&async_), OnClosed);
+  }
+
+  Local<Object> ToObject(const FileResult& result) {
+    Local<Context> context = isolate_->GetCurrentContext();
+    Local<Object> entry = Object::New(isolate_);
+
+    entry->Set(context, Key(isolate_, "index"),
+               Number::New(isolate_, static_cast<double>(result.index))).Check();
+    entry->Set(context, Key(isolate_, "path"),
+               String::NewFromUtf8(isolate_, result.path.c_str())
+                   .ToLocalChecked()).Check();
+    if (result.analysis.has_errors)
+      entry->Set(context, Key(isolate_, "errors"),
+                 PVTErrorObject(isolate_, result.analysis.errors)).Check();
+    if (result.analysis.has_modes)
+      entry->Set(context, Key(isolate_, "modes"),
+                 PVTModeObject(isolate_, result.analysis.modes)).Check();
+    if (!IsOk(result.error)) {
+      std::string message = result.cancelled ? "Job was cancelled"
+                                             : DescribeError(result.error);
+      entry->Set(context, Key(isolate_, "error"),
+                 String::NewFromUtf8(isolate_, message.c_str())
+                     .ToLocalChecked()).Check();
+      Local<Object> failure = Object::New(isolate_);
+      SetFailureFields(isolate_, failure, result.failure);
+      entry->Set(context, Key(isolate_, "failure"), failure).Check();
+    }
+    return entry;
+  }
+
+  Isolate* isolate_;
+  uv_async_t async_;
+  JobBinding binding_;
+  std::unique_ptr<BatchAnalysis> batch_;
+  Global<Context> context_;
+  Global<Promise::Resolver> resolver_;
+  Global<Array> results_;
+  Global<Function> on_result_;
+
+  std::mutex mutex_;
+  std::vector<FileResult> pending_;
+  bool done_ = false;
+};
+
+void ThrowTypeError(Isolate* isolate, const char* message) {
+  isolate->ThrowException(Exception::TypeError(Key(isolate, message)));
+}
+
+}
+
+void AnalyzeMany(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  if (args.Length() < 2 || !args[0]->IsArray() || !args[1]->IsArray()) {
+    ThrowTypeError(isolate, "analyzeMany(paths, ops, options) expects two "
+                            "arrays");
+    return;
+  }
+
+  Local<Array> list = args[0].As<Array>();
+  std::vector<std::string> paths;
+  paths.reserve(list->Length());
+  for (uint32_t i = 0; i < list->Length(); ++i) {
+    Local<Value> path = list->Get(context, i).ToLocalChecked();
+    if (!path->IsString()) {
+      ThrowTypeError(isolate, "analyzeMany: paths must be strings");
+      return;
+    }
+    paths.push_back(*String::Utf8Value(isolate, path));
+  }
+
+  AnalysisOps ops;
+  Local<Array> names = args[1].As<Array>();
+  for (uint32_t i = 0; i < names->Length(); ++i) {
+    std::string op = *String::Utf8Value(
+        isolate, names->Get(context, i).ToLocalChecked());
+    if (op == "errors") {
+      ops.errors = true;
+    } else if (op == "modes") {
+      ops.modes = true;
+    } else {
+      ThrowTypeError(isolate, "analyzeMany: ops may contain 'errors' and "
+                              "'modes'");
+      return;
+    }
+  }
+
+  unsigned concurrency = BatchAnalysis::DefaultConcurrency();
+  Local<Value> on_result = v8::Undefined(isolate);
+  // only the signal: per-file results already are the progress report
+  Local<Object> control = Object::New(isolate);
+
+  if (args.Length() > 2 && args[2]->IsObject()) {
+    Local<Object> options = args[2].As<Object>();
+    Local<Value> value =
+        options->Get(context, Key(isolate, "concurrency")).ToLocalChecked();
+    if (value->IsNumber() && value->Uint32Value(context).FromJust() > 0)
+      concurrency = value->Uint32Value(context).FromJust();
+
+    value = options->Get(context, Key(isolate, "sbfid")).ToLocalChecked();
+    if (value->IsNumber())
+      ops.sbfid = static_cast<SBFID_t>(value->Uint32Value(context).FromJust());
+
+    on_result = options->Get(context, Key(isolate, "onResult")).ToLocalChecked();
+    control->Set(context, Key(isolate, "signal"),
+                 options->Get(context, Key(isolate, "signal")).ToLocalChecked())
+        .Check();
+  }
+
+  AnalyzeManyJob* job = new AnalyzeManyJob(isolate, std::move(paths), ops,
+                                           concurrency, on_result, control);
+  args.GetReturnValue().Set(job->Start());
+}
+
+}
@@ -0,0 +1,22 @@
+#ifndef CALCULATE_ANALYZE_MANY_H
+#define CALCULATE_ANALYZE_MANY_H
+
+#include <node.h>
+
+namespace calculate {
+
+// analyzeMany(paths, ops, { concurrency, sbfid, onResult, signal })
+//   -> Promise<[{ index, path, errors?, modes?, error? }]>
+//
+// `ops` lists the queries to run per file ('errors', 'modes'). Files are
+// analysed by a pool of `concurrency` native threads (default: one per
+// core) and `onResult` is called with each file's entry as soon as it is
+// done, in completion order. A failing file sets `error` and `failure` (the
+// fields of a rejected job's error) on its entry and does not reject the
+// promise. Aborting `signal` stops the files in flight,
+// which report "Job was cancelled", and skips the remaining ones.
+void AnalyzeMany(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+}
+
+#endif
@@ -0,0 +1,467 @@
+#include "arrow_file.h"
+
+#include <algorithm>
+#include <filesystem>
+
+#include "sbf_stream.h"
+#include "sbf_util.h"
+
+namespace fs = std::filesystem;
+
+namespace calculate {
+
+namespace {
+
+// Schema.fbs / Message.fbs / File.fbs of the Arrow format
+const int16_t kMetadataV5 = 4;
+const uint8_t kTypeInt = 2;
+const uint8_t kTypeFloatingPoint = 3;
+const uint8_t kTypeUtf8 = 5;
+const int16_t kPrecisionSingle = 1;
+const int16_t kPrecisionDouble = 2;
+const uint8_t kHeaderSchema = 1;
+const uint8_t kHeaderDictionaryBatch = 2;
+const uint8_t kHeaderRecordBatch = 3;
+const uint32_t kContinuation = 0xffffffffu;
+const char kMagic[8] = {'A', 'R', 'R', 'O', 'W', '1', 0, 0};
+
+size_t Width(ArrowType type) {
+  switch (type) {
+    case kArrowInt8:
+    case kArrowUInt8:
+      return 1;
+    case kArrowInt16:
+    case kArrowUInt16:
+      return 2;
+    case kArrowInt32:
+    case kArrowUInt32:
+    case kArrowFloat32:
+      return 4;
+    default:
+      return 8;
+  }
+}
+
+size_t Pad8(size_t size) { return (size + 7) & ~static_cast<size_t>(7); }
+
+// Minimal FlatBuffers builder for the Arrow metadata. Like the reference
+// implementation it fills the buffer back to front, so children are built
+// before the tables pointing at them; a Ref is a position counted from the
+// end of the buffer.
+class FlatBuilder {
+ public:
+  typedef uint32_t Ref;
+
+  Ref String(const std::string& text) {
+    Align(text.size() + 1, 4);
+    Pad(1);
+    Prepend(text.data(), text.size());
+    Scalar(static_cast<uint32_t>(text.size()));
+    return used_;
+  }
+
+  Ref Refs(const std::vector<Ref>& refs) {
+    for (size_t i = refs.size(); i-- > 0;)
+      Offset(refs[i]);
+    Scalar(static_cast<uint32_t>(refs.size()));
+    return used_;
+  }
+
+  // vector of structs of 8-byte aligned fields
+  Ref Structs(const void* data, size_t count, size_t size) {
+    Align(count * size, 8);
+    Prepend(data, count * size);
+    Scalar(static_cast<uint32_t>(count));
+    return used_;
+  }
+
+  void StartTable() {
+    fields_.clear();
+    table_start_ = used_;
+  }
+
+  template <typename T>
+  void Add(uint16_t id, T value) {
+    Scalar(value);
+    fields_.push_back(FieldAt{id, used_});
+  }
+
+  void AddRef(uint16_t id, Ref ref) {
+    Offset(ref);
+    fields_.push_back(FieldAt{id, used_});
+  }
+
+  Ref EndTable() {
+    Scalar(static_cast<int32_t>(0));
+    Ref table = used_;
+
+    uint16_t slots = 0;
+    for (const FieldAt& field : fields_)
+      slots = std::max<uint16_t>(slots, field.id + 1);
+    std::vector<uint16_t> vtable(2 + slots, 0);
+    vtable[0] = static_cast<uint16_t>(vtable.size() * 2);
+    vtable[1] = static_cast<uint16_t>(table - table_start_);
+    for (const FieldAt& field : fields_)
+      vtable[2 + field.id] = static_cast<uint16_t>(table - field.at);
+    Prepend(vtable.data(), vtable.size() * 2);
+
+    // the table starts with the signed distance back to its vtable
+    int32_t vtable_offset = static_cast<int32_t>(used_ - table);
+    memcpy(At(table), &vtable_offset, sizeof(vtable_offset));
+    return table;
+  }
+
+  std::vector<uint8_t> Finish(Ref root) {
+    Align(4, min_align_);
+    Offset(root);
+    return std::vector<uint8_t>(At(used_), At(used_) + used_);
+  }
+
+ private:
+  struct FieldAt {
+    uint16_t id;
+    Ref at;
+  };
+
+  uint8_t* At(Ref ref) { return buffer_.data() + buffer_.size() - ref; }
+
+  void Grow(size_t size) {
+    if (used_ + size <= buffer_.size())
+      return;
+    std::vector<uint8_t> grown(
+        std::max(buffer_.size() * 2, used_ + size + 256));
+    if (used_ > 0)
+      memcpy(grown.data() + grown.size() - used_, At(used_), used_);
+    buffer_.swap(grown);
+  }
+
+  void Prepend(const void* data, size_t size) {
+    Grow(size);
+    used_ += static_cast<Ref>(size);
+    if (size > 0)
+      memcpy(At(used_), data, size);
+  }
+
+  void Pad(size_t size) {
+    Grow(size);
+    used_ += static_cast<Ref>(size);
+    if (size > 0)
+      memset(At(used_), 0, size);
+  }
+
+  // pads so that `size` more bytes end on an `alignment` boundary
+  void Align(size_t size, size_t alignment) {
+    min_align_ = std::max(min_align_, alignment);
+    Pad((alignment - (used_ + size) % alignment) % alignment);
+  }
+
+  template <typename T>
+  void Scalar(T value) {
+    Align(sizeof(T), sizeof(T));
+    Prepend(&value, sizeof(T));
+  }
+
+  void Offset(Ref ref) {
+    Align(4, 4);
+    Scalar(static_cast<uint32_t>(used_ + 4 - ref));
+  }
+
+  std::vector<uint8_t> buffer_;
+  Ref used_ = 0;
+  size_t min_align_ = 1;
+  Ref table_start_ = 0;
+  std::vector<FieldAt> fields_;
+};
+
+typedef FlatBuilder::Ref Ref;
+
+Ref IntType(FlatBuilder* b, int bits, bool is_signed) {
+  b->StartTable();
+  b->Add<int32_t>(0, bits);
+  b->Add<uint8_t>(1, is_signed ? 1 : 0);
+  return b->EndTable();
+}
+
+Ref FieldRef(FlatBuilder* b, const ArrowField& field) {
+  int bits = static_cast<int>(Width(field.type) * 8);
+  bool is_signed = field.type <= kArrowInt64;
+  bool floating = field.type == kArrowFloat32 || field.type == kArrowFloat64;
+
+  Ref name = b->String(field.name);
+  Ref children = b->Refs({});
+  Ref dictionary = 0;
+  uint8_t type_type;
+  Ref type;
+  if (field.dictionary >= 0) {
+    type_type = kTypeUtf8;
+    b->StartTable();
+    type = b->EndTable();
+    Ref index = IntType(b, bits, is_signed);
+    b->StartTable();
+    b->Add<int64_t>(0, field.dictionary);
+    b->AddRef(1, index);
+    b->Add<uint8_t>(2, 0);
+    dictionary = b->EndTable();
+  } else if (floating) {
+    type_type = kTypeFloatingPoint;
+    b->StartTable();
+    b->Add<int16_t>(0, field.type == kArrowFloat32 ? kPrecisionSingle
+                                                   : kPrecisionDouble);
+    type = b->EndTable();
+  } else {
+    type_type = kTypeInt;
+    type = IntType(b, bits, is_signed);
+  }
+
+  b->StartTable();
+  b->AddRef(0, name);
+  b->Add<uint8_t>(1, 1);
+  b->Add<uint8_t>(2, type_type);
+  b->AddRef(3, type);
+  if (field.dictionary >= 0)
+    b->AddRef(4, dictionary);
+  b->AddRef(5, children);
+  return b->EndTable();
+}
+
+Ref SchemaRef(FlatBuilder* b, const std::vector<ArrowField>& fields) {
+  std::vector<Ref> refs;
+  for (const ArrowField& field : fields)
+    refs.push_back(FieldRef(b, field));
+  Ref vector = b->Refs(refs);
+  b->StartTable();
+  b->Add<int16_t>(0, 0);  // little endian
+  b->AddRef(1, vector);
+  return b->EndTable();
+}
+
+std::vector<uint8_t> MessageBytes(FlatBuilder* b, uint8_t header_type,
+                                  Ref header, int64_t body_length) {
+  b->StartTable();
+  b->Add<int16_t>(0, kMetadataV5);
+  b->Add<uint8_t>(1, header_type);
+  b->AddRef(2, header);
+  b->Add<int64_t>(3, body_length);
+  return b->Finish(b->EndTable());
+}
+
+// Record batch body: buffers appended at 8-byte boundaries, described by
+// the FieldNode / Buffer structs of the message
+class Body {
+ public:
+  void AddNode(int64_t length, int64_t null_count) {
+    nodes_.push_back(length);
+    nodes_.push_back(null_count);
+  }
+
+  void AddBuffer(const void* data, size_t size) {
+    buffers_.push_back(static_cast<int64_t>(bytes_.size()));
+    buffers_.push_back(static_cast<int64_t>(size));
+    if (size > 0) {
+      const uint8_t* begin = static_cast<const uint8_t*>(data);
+      bytes_.insert(bytes_.end(), begin, begin + size);
+    }
+    bytes_.resize(Pad8(bytes_.size()), 0);
+  }
+
+  Ref RecordBatch(FlatBuilder* b, int64_t length) const {
+    Ref nodes = b->Structs(nodes_.data(), nodes_.size() / 2, 16);
+    Ref buffers = b->Structs(buffers_.data(), buffers_.size() / 2, 16);
+    b->StartTable();
+    b->Add<int64_t>(0, length);
+    b->AddRef(1, nodes);
+    b->AddRef(2, buffers);
+    return b->EndTable();
+  }
+
+  const std::vector<uint8_t>& bytes() const { return bytes_; }
+
+ private:
+  std::vector<int64_t> nodes_;
+  std::vector<int64_t> buffers_;
+  std::vector<uint8_t> bytes_;
+};
+
+}
+
+ArrowColumn::ArrowColumn(const ArrowField& field)
+    : field_(field), width_(Width(field.type)) {}
+
+void ArrowColumn::Resize(size_t rows) {
+  values_.resize(rows * width_);
+  valid_.resize(rows, 1);
+}
+
+void ArrowColumn::Clear() {
+  values_.clear();
+  valid_.clear();
+}
+
+ArrowFileWriter::~ArrowFileWriter() { Discard(); }
+
+void ArrowFileWriter::Discard() {
+  if (!out_.is_open())
+    return;
+  out_.close();
+  std::error_code ec;
+  fs::remove(fs::u8path(temp_), ec);
+}
+
+ssn_error_t ArrowFileWriter::Open(const std::string& path,
+                                  const std::vector<ArrowField>& fields) {
+  Discard();
+  path_ = path;
+  temp_ = path + ".tmp";
+  fields_ = fields;
+  position_ = 0;
+  dictionary_blocks_.clear();
+  batch_blocks_.clear();
+
+  out_.open(fs::u8path(temp_), std::ios::binary | std::ios::trunc);
+  if (!out_.is_open())
+    return GeneralError(SSNERROR_ERROR_FILEOPEN);
+  out_.write(kMagic, sizeof(kMagic));
+  position_ = sizeof(kMagic);
+
+  FlatBuilder b;
+  Ref schema = SchemaRef(&b, fields_);
+  Block block;
+  return WriteMessage(MessageBytes(&b, kHeaderSchema, schema, 0), {}, &block);
+}
+
+ssn_error_t ArrowFileWriter::WriteDictionary(
+    int64_t id, const std::vector<std::string>& values) {
+  std::vector<int32_t> offsets(1, 0);
+  std::string data;
+  for (const std::string& value : values) {
+    data += value;
+    offsets.push_back(static_cast<int32_t>(data.size()));
+  }
+
+  Body body;
+  body.AddNode(static_cast<int64_t>(values.size()), 0);
+  body.AddBuffer(nullptr, 0);
+  body.AddBuffer(offsets.data(), offsets.size() * sizeof(int32_t));
+  body.AddBuffer(data.data(), data.size());
+
+  FlatBuilder b;
+  Ref batch = body.RecordBatch(&b, static_cast<int64_t>(values.size()));
+  b.StartTable();
+  b.Add<int64_t>(0, id);
+  b.AddRef(1, batch);
+  b.Add<uint8_t>(2, 0);
+  Ref header = b.EndTable();
+
+  Block block;
+  ssn_error_t rerror = WriteMessage(
+      MessageBytes(&b, kHeaderDictionaryBatch, header,
+                   static_cast<int64_t>(body.bytes().size())),
+      body.bytes(), &block);
+  if (IsOk(rerror))
+    dictionary_blocks_.push_back(block);
+  return rerror;
+}
+
+ssn_error_t ArrowFileWriter::WriteBatch(
+    const std::vector<ArrowColumn>& columns) {
+  if (columns.size() != fields_.size())
+    return GeneralError(SSNERROR_ERROR_INVALIDARG);
+  int64_t length = columns.empty() ? 0 : columns[0].size();
+
+  Body body;
+  std::vector<uint8_t> bitmap;
+  for (const ArrowColumn& column : columns) {
+    if (static_cast<int64_t>(column.size()) != length)
+      return GeneralError(SSNERROR_ERROR_INVALIDARG);
+
+    const uint8_t* valid = column.Validity();
+    int64_t null_count = 0;
+    bitmap.assign((length + 7) / 8, 0);
+    for (int64_t i = 0; i < length; ++i) {
+      bitmap[i >> 3] |= static_cast<uint8_t>(valid[i] << (i & 7));
+      null_count += valid[i] ^ 1;
+    }
+
+    body.AddNode(length, null_count);
+    // a column without nulls may leave the bitmap out
+    body.AddBuffer(bitmap.data(), null_count > 0 ? bitmap.size() : 0);
+    body.AddBuffer(column.Bytes(), length * Width(column.field().type));
+  }
+
+  FlatBuilder b;
+  Ref header = body.RecordBatch(&b, length);
+  Block block;
+  ssn_error_t rerror = WriteMessage(
+      MessageBytes(&b, kHeaderRecordBatch, header,
+                   static_cast<int64_t>(body.bytes().size())),
+      body.bytes(), &block);
+  if (IsOk(rerror))
+    batch_blocks_.push_back(block);
+  return rerror;
+}
+
+ssn_error_t ArrowFileWriter::WriteMessage(const std::vector<uint8_t>& metadata,
+                                          const std::vector<uint8_t>& body,
+                                          Block* block) {
+  if (!out_.is_open())
+    return GeneralError(SSNERROR_ERROR_FILEWRITE);
+
+  // continuation marker and length, then the FlatBuffer padded so that
+  // the body starts 8-byte aligned
+  size_t padded = Pad8(8 + metadata.size());
+  int32_t length = static_cast<int32_t>(padded - 8);
+  static const char zeros[8] = {};
+
+  out_.write(reinterpret_cast<const char*>(&kContinuation), 4);
+  out_.write(reinterpret_cast<const char*>(&length), 4);
+  out_.write(reinterpret_cast<const char*>(metadata.data()), metadata.size());
+  out_.write(zeros, padded - 8 - metadata.size());
+  out_.write(reinterpret_cast<const char*>(body.data()), body.size());
+  if (!out_.good())
+    return GeneralError(SSNERROR_ERROR_FILEWRITE);
+
+  block->offset = position_;
+  block->metadata_length = static_cast<int32_t>(padded);
+  block->padding = 0;
+  block->body_length = static_cast<int64_t>(body.size());
+  position_ += static_cast<int64_t>(padded + body.size());
+  return SSNERROR_WARNING_OK;
+}
+
+ssn_error_t ArrowFileWriter::Finish() {
+  if (!out_.is_open())
+    return GeneralError(SSNERROR_ERROR_FILEWRITE);
+
+  FlatBuilder b;
+  Ref schema = SchemaRef(&b, fields_);
+  Ref dictionaries = b.Structs(dictionary_blocks_.data(),
+                               dictionary_blocks_.size(), sizeof(Block));
+  Ref batches =
+      b.Structs(batch_blocks_.data(), batch_blocks_.size(), sizeof(Block));
+  b.StartTable();
+  b.Add<int16_t>(0, kMetadataV5);
+  b.AddRef(1, schema);
+  b.AddRef(2, dictionaries);
+  b.AddRef(3, batches);
+  std::vector<uint8_t> footer = b.Finish(b.EndTable());
+
+  // end-of-stream marker, footer, its length and the closing magic
+  const uint32_t eos[2] = {kContinuation, 0};
+  int32_t footer_length = static_cast<int32_t>(footer.size());
+  out_.write(reinterpret_cast<const char*>(eos), sizeof(eos));
+  out_.write(reinterpret_cast<const char*>(footer.data()), footer.size());
+  out_.write(reinterpret_cast<const char*>(&footer_length), 4);
+  out_.write(kMagic, 6);
+  out_.close();
+
+  std::error_code ec;
+  if (!out_.fail())
+    fs::rename(fs::u8path(temp_), fs::u8path(path_), ec);
+  if (out_.fail() || ec) {
+    fs::remove(fs::u8path(temp_), ec);
+    return GeneralError(SSNERROR_ERROR_FILEWRITE);
+  }
+  return SSNERROR_WARNING_OK;
+}
+
+}
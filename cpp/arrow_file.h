@@ -0,0 +1,124 @@
+#ifndef CALCULATE_ARROW_FILE_H
+#define CALCULATE_ARROW_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "ssnerror.h"
+
+namespace calculate {
+
+enum ArrowType {
+  kArrowInt8,
+  kArrowInt16,
+  kArrowInt32,
+  kArrowInt64,
+  kArrowUInt8,
+  kArrowUInt16,
+  kArrowUInt32,
+  kArrowUInt64,
+  kArrowFloat32,
+  kArrowFloat64,
+};
+
+struct ArrowField {
+  std::string name;
+  ArrowType type;
+  // id of the Utf8 dictionary the values index into, -1 for plain values;
+  // `type` is the (signed) index type then
+  int64_t dictionary = -1;
+};
+
+// Rows of one column for the record batch in hand. Values are stored
+// unpacked with one validity byte per row; the writer packs the bitmap.
+class ArrowColumn {
+ public:
+  explicit ArrowColumn(const ArrowField& field);
+
+  const ArrowField& field() const { return field_; }
+  size_t size() const { return valid_.size(); }
+
+  template <typename T>
+  void Append(T value, bool valid = true) {
+    size_t at = values_.size();
+    values_.resize(at + sizeof(T));
+    memcpy(&values_[at], &value, sizeof(T));
+    valid_.push_back(valid ? 1 : 0);
+  }
+
+  // Resize() then Values<T>() / Validity() fill a column in one loop
+  void Resize(size_t rows);
+  template <typename T>
+  T* Values() { return reinterpret_cast<T*>(values_.data()); }
+  const uint8_t* Bytes() const { return values_.data(); }
+  uint8_t* Validity() { return valid_.data(); }
+  const uint8_t* Validity() const { return valid_.data(); }
+
+  void Clear();
+
+ private:
+  ArrowField field_;
+  size_t width_;
+  std::vector<uint8_t> values_;
+  std::vector<uint8_t> valid_;
+};
+
+// Writer of the Arrow IPC file format (Feather v2): the schema, Utf8
+// dictionaries and record batches as encapsulated FlatBuffers messages,
+// then the footer indexing them. pyarrow.ipc.open_file, polars, DuckDB and
+// the Arrow C++/JS readers load it without conversion.
+//
+// The file is written beside `path` and renamed into place by Finish(), so
+// readers never see a partial one; it is removed if Finish() is not
+// reached. No compression; little-endian hosts only, like the SBF structs.
+class ArrowFileWriter {
+ public:
+  ArrowFileWriter() = default;
+  ~ArrowFileWriter();
+
+  ArrowFileWriter(const ArrowFileWriter&) = delete;
+  void operator=(const ArrowFileWriter&) = delete;
+
+  ssn_error_t Open(const std::string& path,
+                   const std::vector<ArrowField>& fields);
+
+  // Dictionaries go before the first batch
+  ssn_error_t WriteDictionary(int64_t id,
+                              const std::vector<std::string>& values);
+
+  // One record batch; `columns` follow the schema order
+  ssn_error_t WriteBatch(const std::vector<ArrowColumn>& columns);
+
+  ssn_error_t Finish();
+
+  uint64_t batches() const { return batch_blocks_.size(); }
+
+ private:
+  struct Block {
+    int64_t offset;
+    int32_t metadata_length;
+    int32_t padding;
+    int64_t body_length;
+  };
+
+  ssn_error_t WriteMessage(const std::vector<uint8_t>& metadata,
+                           const std::vector<uint8_t>& body, Block* block);
+  void Discard();
+
+  std::string path_;
+  std::string temp_;
+  std::ofstream out_;
+  int64_t position_ = 0;
+  std::vector<ArrowField> fields_;
+  std::vector<Block> dictionary_blocks_;
+  std::vector<Block> batch_blocks_;
+};
+
+}
+
+#endif
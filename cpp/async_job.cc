@@ -0,0 +1,150 @@
+#include "async_job.h"
+
+#include "job_control.h"
+#include "sbf_stream.h"
+#include "scratch_arena.h"
+#include "v8_util.h"
+
+namespace calculate {
+
+using v8::Array;
+using v8::Boolean;
+using v8::Context;
+using v8::Exception;
+using v8::HandleScope;
+using v8::Isolate;
+using v8::Local;
+using v8::Number;
+using v8::Object;
+using v8::Promise;
+using v8::Value;
+
+void SetFailureFields(Isolate* isolate, Local<Object> target,
+                      const SdkFailure& failure) {
+  Local<Context> context = isolate->GetCurrentContext();
+  auto set = [&](const char* key, Local<Value> value) {
+    target->Set(context, Key(isolate, key), value).Check();
+  };
+
+  set("code", Number::New(isolate, SSNERROR_GETCODE(failure.error)));
+  set("error", Number::New(isolate, static_cast<uint32_t>(failure.error)));
+  set("severity", Key(isolate, SSNERROR_GETSTATUS(failure.error)
+                                   ? "warning" : "failure"));
+  const char* module = SSNError_getModule(failure.error);
+  if (module != NULL && *module != '\0')
+    set("module", Key(isolate, module));
+  if (failure.stage != nullptr)
+    set("stage", Key(isolate, failure.stage));
+  if (failure.call != nullptr)
+    set("call", Key(isolate, failure.call));
+  set("kind", Key(isolate, ErrorKindName(failure.kind())));
+  set("retryable", Boolean::New(isolate, failure.retryable()));
+
+  Local<Array> warnings = Array::New(isolate,
+                                     static_cast<int>(failure.warnings.size()));
+  for (size_t i = 0; i < failure.warnings.size(); ++i) {
+    const SdkWarning& warning = failure.warnings[i];
+    Local<Object> entry = Object::New(isolate);
+    entry->Set(context, Key(isolate, "code"),
+               Number::New(isolate, SSNERROR_GETCODE(warning.error))).Check();
+    entry->Set(context, Key(isolate, "message"),
+               Key(isolate, SSNError_getMessage(warning.error))).Check();
+    entry->Set(context, Key(isolate, "count"),
+               Number::New(isolate, static_cast<double>(warning.count)))
+        .Check();
+    warnings->Set(context, static_cast<uint32_t>(i), entry).Check();
+  }
+  set("warnings", warnings);
+}
+
+Local<Value> FailureError(Isolate* isolate, const std::string& message,
+                          const SdkFailure& failure) {
+  Local<Value> error = Exception::Error(Key(isolate, message.c_str()));
+  SetFailureFields(isolate, error.As<Object>(), failure);
+  return error;
+}
+
+AsyncJob::AsyncJob(Isolate* isolate, const char* name)
+    : node::AsyncResource(isolate, Object::New(isolate), name),
+      isolate_(isolate) {
+  Local<Context> context = isolate->GetCurrentContext();
+  context_.Reset(isolate, context);
+  resolver_.Reset(isolate, Promise::Resolver::New(context).ToLocalChecked());
+  request_.data = this;
+}
+
+AsyncJob::~AsyncJob() {
+  context_.Reset();
+  resolver_.Reset();
+}
+
+Local<Promise> AsyncJob::Queue() {
+  Local<Promise> promise = resolver_.Get(isolate_)->GetPromise();
+  uv_queue_work(node::GetCurrentEventLoop(isolate_), &request_,
+                DoExecute, DoComplete);
+  return promise;
+}
+
+void AsyncJob::SetError(const std::string& message) {
+  error_ = message.empty() ? "Unknown error" : message;
+  has_failure_ = false;
+}
+
+void AsyncJob::SetError(ssn_error_t error) {
+  ErrorTrail* trail = ErrorTrail::Current();
+  if (trail != nullptr) {
+    failure_ = trail->Failure(error);
+  } else {
+    failure_ = SdkFailure();
+    failure_.error = error;
+  }
+  SetError(DescribeError(error));
+  has_failure_ = true;
+}
+
+void AsyncJob::SetCancelled() {
+  failure_ = SdkFailure();
+  failure_.error = CancelledError();
+  failure_.cancelled = true;
+  SetError("Job was cancelled");
+  has_failure_ = true;
+}
+
+void AsyncJob::DoExecute(uv_work_t* request) {
+  AsyncJob* job = static_cast<AsyncJob*>(request->data);
+  // the worker's scratch arena is reset once the job is done with it
+  ScratchScope scratch;
+  ErrorTrail trail;
+  job->Execute();
+}
+
+void AsyncJob::DoComplete(uv_work_t* request, int status) {
+  AsyncJob* job = static_cast<AsyncJob*>(request->data);
+  Isolate* isolate = job->isolate_;
+
+  {
+    HandleScope handle_scope(isolate);
+    Local<Context> context = job->context_.Get(isolate);
+    Context::Scope context_scope(context);
+    // Drains the microtask queue on exit so `await`ers resume right away
+    CallbackScope callback_scope(job);
+
+    Local<Promise::Resolver> resolver = job->resolver_.Get(isolate);
+    if (status == UV_ECANCELED)
+      job->SetCancelled();
+    job->OnSettle(isolate);
+
+    if (job->HasError()) {
+      Local<Value> error = job->has_failure_
+          ? FailureError(isolate, job->error_, job->failure_)
+          : Exception::Error(Key(isolate, job->error_.c_str()));
+      resolver->Reject(context, error).Check();
+    } else {
+      resolver->Resolve(context, job->OnOK(isolate)).Check();
+    }
+  }
+
+  delete job;
+}
+
+}
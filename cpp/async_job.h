@@ -0,0 +1,74 @@
+#ifndef CALCULATE_ASYNC_JOB_H
+#define CALCULATE_ASYNC_JOB_H
+
+#include <node.h>
+#include <uv.h>
+
+#include <string>
+
+#include "sdk_error.h"
+
+namespace calculate {
+
+// Sets the fields of a structured SDK error on `target`: code
+// (SSNERROR_GETCODE), error (the full ssn_error_t), severity ("warning" |
+// "failure"), module, stage and call when known, kind (ErrorKindName),
+// retryable and warnings ([{ code, message, count }])
+void SetFailureFields(v8::Isolate* isolate, v8::Local<v8::Object> target,
+                      const SdkFailure& failure);
+
+// An Error with `message` and the fields of SetFailureFields()
+v8::Local<v8::Value> FailureError(v8::Isolate* isolate,
+                                  const std::string& message,
+                                  const SdkFailure& failure);
+
+// Base class for work that runs on the libuv thread pool and settles a
+// Promise on the main thread once it is done.
+//
+// Execute() runs on a worker thread and must not touch V8. OnOK() runs on the
+// main thread after a successful Execute() and builds the resolution value.
+// Calling SetError() from Execute() rejects the promise instead; an SDK
+// error rejects with the fields of SetFailureFields(), taken from the
+// ErrorTrail that is open around every Execute().
+class AsyncJob : public node::AsyncResource {
+ public:
+  AsyncJob(v8::Isolate* isolate, const char* name);
+  virtual ~AsyncJob();
+
+  AsyncJob(const AsyncJob&) = delete;
+  void operator=(const AsyncJob&) = delete;
+
+  // Queues the job and returns the promise it will settle. The job deletes
+  // itself after the promise has been settled.
+  v8::Local<v8::Promise> Queue();
+
+ protected:
+  virtual void Execute() = 0;
+  virtual v8::Local<v8::Value> OnOK(v8::Isolate* isolate) = 0;
+  // Main thread, right before the promise settles either way
+  virtual void OnSettle(v8::Isolate* isolate) {}
+
+  void SetError(const std::string& message);
+  void SetError(ssn_error_t error);
+  // rejects with "Job was cancelled" and kind "cancelled"
+  void SetCancelled();
+  bool HasError() const { return !error_.empty(); }
+
+  v8::Isolate* isolate() const { return isolate_; }
+
+ private:
+  static void DoExecute(uv_work_t* request);
+  static void DoComplete(uv_work_t* request, int status);
+
+  uv_work_t request_;
+  v8::Isolate* isolate_;
+  v8::Global<v8::Context> context_;
+  v8::Global<v8::Promise::Resolver> resolver_;
+  std::string error_;
+  SdkFailure failure_;
+  bool has_failure_ = false;
+};
+
+}
+
+#endif
@@ -0,0 +1,631 @@
+#include "base_cache.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "sbfdef.h"
+#include "ssnbasefinder.h"
+#include "ssnsbfstream.h"
+
+#include "job_control.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "sbf_scanner.h"
+#include "sbf_stream.h"
+#include "sbf_util.h"
+
+namespace fs = std::filesystem;
+
+namespace calculate {
+
+namespace {
+
+const char kStationsFile[] = "stations.tsv";
+const char kReferenceFile[] = "reference.sbf";
+const char kReferenceInfo[] = "reference.tsv";
+const char kRinexDirectory[] = "rinex";
+
+// windows are widened to whole hours, the granularity reference data is
+// published in, so a slightly different crop of a session still hits
+const double kWindowQuantum = 3600.0;
+const double kSecondsPerDay = 86400.0;
+const double kDegreesPerRadian = 57.295779513082320876;
+
+// 1e-4 degrees is about 11 m; the station choice does not change within it
+const char kPositionFormat[] = "%.4f,%.4f";
+
+void Window(const BaseQuery& query, double* begin, double* end) {
+  *begin = floor(query.begin / kWindowQuantum) * kWindowQuantum;
+  *end = ceil(query.end / kWindowQuantum) * kWindowQuantum;
+  if (*end <= *begin)
+    *end = *begin + kWindowQuantum;
+}
+
+// FNV-1a over the canonical form of everything that decides the result;
+// the proxy settings and the SBF file name do not
+std::string QueryKey(const BaseQuery& query) {
+  char buffer[128];
+  double begin, end;
+  Window(query, &begin, &end);
+
+  std::string text = "v1";
+  snprintf(buffer, sizeof(buffer), kPositionFormat, query.latitude,
+           query.longitude);
+  text += '|';
+  text += buffer;
+  snprintf(buffer, sizeof(buffer), "|%.0f|%.0f|%u|%u|", begin, end,
+           query.constellations, query.radius);
+  text += buffer;
+  text += query.station + '\t' + query.provider;
+
+  std::vector<std::pair<std::string, std::string>> blacklist = query.blacklist;
+  std::sort(blacklist.begin(), blacklist.end());
+  for (const auto& entry : blacklist)
+    text += '|' + entry.first + '\t' + entry.second;
+
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : text) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  snprintf(buffer, sizeof(buffer), "%016llx",
+           static_cast<unsigned long long>(hash));
+  return buffer;
+}
+
+bool IsEntryName(const std::string& name) {
+  return name.size() == 16 &&
+         name.find_first_not_of("0123456789abcdef") == std::string::npos;
+}
+
+// first valid position of a PVTGeodetic block in an SBF file, walked in
+// place with the same framing as ScanSbf()
+bool ReadPosition(const uint8_t* data, size_t size, BaseQuery* query) {
+  const size_t needed = offsetof(PVTGeodetic_2_0_t, Alt) + sizeof(double);
+  const uint16_t number = SBF_ID_TO_NUMBER(sbfid_PVTGeodetic_2_0);
+  SbfWalker walker(data, size);
+  uint16_t length;
+
+  while (const uint8_t* block = walker.Next(&length)) {
+    uint16_t id;
+    memcpy(&id, block + 4, sizeof(id));
+    if (SBF_ID_TO_NUMBER(id) != number || length < needed ||
+        block[offsetof(PVTGeodetic_2_0_t, Error)] != 0)
+      continue;
+
+    double lat, lon, alt;
+    memcpy(&lat, block + offsetof(PVTGeodetic_2_0_t, Lat), sizeof(lat));
+    memcpy(&lon, block + offsetof(PVTGeodetic_2_0_t, Lon), sizeof(lon));
+    memcpy(&alt, block + offsetof(PVTGeodetic_2_0_t, Alt), sizeof(alt));
+    if (lat != F64_NOTVALID && lon != F64_NOTVALID && alt != F64_NOTVALID) {
+      query->latitude = lat * kDegreesPerRadian;
+      query->longitude = lon * kDegreesPerRadian;
+      query->altitude = alt;
+      query->has_position = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+void CopyStation(const ssn_basefinder_station_info_t& info,
+                 BaseStation* station) {
+  station->name = info.name != NULL ? info.name : "";
+  station->provider = info.provider != NULL ? info.provider : "";
+  station->latitude = info.latitude;
+  station->longitude = info.longitude;
+  station->altitude = info.altitude;
+  station->distance = info.distance;
+  station->constellations = info.constellations;
+  station->receiver_type = info.receiverType != NULL ? info.receiverType : "";
+}
+
+// one station per line, tab separated; station names never hold tabs
+std::string StationLine(const BaseStation& station) {
+  std::ostringstream out;
+  out.precision(17);
+  out << station.name << '\t' << station.provider << '\t'
+      << station.latitude << '\t' << station.longitude << '\t'
+      << station.altitude << '\t' << station.distance << '\t'
+      << station.constellations << '\t' << station.receiver_type << '\n';
+  return out.str();
+}
+
+bool ParseStation(const std::string& line, BaseStation* station) {
+  std::vector<std::string> fields;
+  size_t start = 0;
+  for (;;) {
+    size_t tab = line.find('\t', start);
+    fields.push_back(line.substr(start, tab - start));
+    if (tab == std::string::npos)
+      break;
+    start = tab + 1;
+  }
+  if (fields.size() < 8)
+    return false;
+
+  station->name = fields[0];
+  station->provider = fields[1];
+  station->latitude = atof(fields[2].c_str());
+  station->longitude = atof(fields[3].c_str());
+  station->altitude = atof(fields[4].c_str());
+  station->distance = atof(fields[5].c_str());
+  station->constellations = atoi(fields[6].c_str());
+  station->receiver_type = fields[7];
+  return true;
+}
+
+// writes to a temporary file and renames, so readers see all or nothing
+bool WriteAtomically(const fs::path& path, const std::string& text) {
+  fs::path temp = path;
+  temp += ".tmp";
+  bool written;
+  {
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    out << text;
+    written = out.good();
+  }
+
+  std::error_code ec;
+  if (written)
+    fs::rename(temp, path, ec);
+  if (!written || ec) {
+    fs::remove(temp, ec);
+    return false;
+  }
+  return true;
+}
+
+bool ReadStations(const fs::path& path, std::vector<BaseStation>* stations) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    return false;
+
+  stations->clear();
+  std::string line;
+  while (std::getline(in, line)) {
+    BaseStation station;
+    if (!ParseStation(line, &station))
+      return false;
+    stations->push_back(station);
+  }
+  return true;
+}
+
+// reference.tsv: the station line, then constellations, interval, begin
+// and end of the reference data
+bool ReadReferenceInfo(const fs::path& entry, BaseReference* reference) {
+  std::error_code ec;
+  if (!fs::exists(entry / kReferenceFile, ec))
+    return false;
+
+  std::ifstream in(entry / kReferenceInfo, std::ios::binary);
+  std::string line;
+  if (!in || !std::getline(in, line) ||
+      !ParseStation(line, &reference->station))
+    return false;
+  return static_cast<bool>(in >> reference->constellations >>
+                           reference->interval >> reference->begin >>
+                           reference->end);
+}
+
+// An SDK handle and a BaseFinder set up for one query
+class Finder {
+ public:
+  ~Finder() {
+    if (control_ != nullptr)
+      control_->DetachBaseFinder(finder_);
+    if (finder_open_)
+      SSNBaseFinder_close(&finder_);
+    if (sdk_open_)
+      CloseSdk(sdk_);
+  }
+
+  ssn_error_t Open(const BaseQuery& query, const BaseCache::Settings& settings,
+                   const fs::path& entry, JobControl* control,
+                   unsigned part = 0) {
+    ssn_error_t rerror = OpenSdk(&sdk_);
+    if (!IsOk(rerror))
+      return rerror;
+    sdk_open_ = true;
+
+    rerror = SSNBaseFinder_open(sdk_, &finder_);
+    if (!IsOk(rerror))
+      return rerror;
+    finder_open_ = true;
+    if (control != nullptr) {
+      control->AttachBaseFinder(finder_, part);
+      control_ = control;
+    }
+
+    // setSbfInput resets the position and window, so it goes first
+    if (!query.sbf_file.empty())
+      rerror = SSNBaseFinder_setSbfInput(finder_, query.sbf_file.c_str());
+
+    double begin, end;
+    Window(query, &begin, &end);
+    if (IsOk(rerror))
+      rerror = SSNBaseFinder_setPositionGeodetic(
+          finder_, query.latitude, query.longitude, query.altitude);
+    if (IsOk(rerror))
+      rerror = SSNBaseFinder_setBeginTime(finder_, begin);
+    if (IsOk(rerror))
+      rerror = SSNBaseFinder_setEndTime(finder_, end);
+
+    if (IsOk(rerror) && !settings.proxy.empty())
+      rerror = SSNBaseFinder_setProxy(finder_, settings.proxy.c_str());
+    if (IsOk(rerror) && !settings.no_proxy_hosts.empty()) {
+      std::vector<const char*> hosts;
+      for (const std::string& host : settings.no_proxy_hosts)
+        hosts.push_back(host.c_str());
+      rerror = SSNBaseFinder_setNoProxyHosts(finder_, hosts.data(),
+                                             hosts.size());
+    }
+
+    if (IsOk(rerror) && query.constellations != 0)
+      rerror = SSNBaseFinder_setPreferredConstellations(
+          finder_,
+          static_cast<ssn_basefinder_constellations_t>(query.constellations));
+    if (IsOk(rerror) && query.radius != 0)
+      rerror = SSNBaseFinder_setSearchRadius(finder_, query.radius);
+    if (IsOk(rerror) && !query.blacklist.empty()) {
+      std::vector<ssn_basefinder_blacklist_info_t> blacklist;
+      for (const auto& entry : query.blacklist)
+        blacklist.push_back({entry.first.c_str(), entry.second.c_str()});
+      rerror = SSNBaseFinder_setBlacklistedStations(finder_, blacklist.data(),
+                                                    blacklist.size());
+    }
+    if (IsOk(rerror) && !query.station.empty()) {
+      ssn_basefinder_station_id_t station = {query.station.c_str(),
+                                             query.provider.c_str()};
+      rerror = SSNBaseFinder_setManualStation(finder_, &station);
+    }
+
+    if (IsOk(rerror)) {
+      std::string rinex = (entry / kRinexDirectory).u8string();
+      rerror = SSNBaseFinder_setRinexDirectory(finder_, rinex.c_str());
+    }
+    return rerror;
+  }
+
+  ssn_hbasefinder_t handle() const { return finder_; }
+
+ private:
+  ssn_hsdk_t sdk_;
+  ssn_hbasefinder_t finder_;
+  bool sdk_open_ = false;
+  bool finder_open_ = false;
+  JobControl* control_ = nullptr;
+};
+
+ssn_error_t CreateStationList(const BaseQuery& query,
+                              const BaseCache::Settings& settings,
+                              const fs::path& entry,
+                              std::vector<BaseStation>* stations,
+                              JobControl* control) {
+  Finder finder;
+  ssn_error_t rerror = finder.Open(query, settings, entry, control);
+  if (!IsOk(rerror))
+    return rerror;
+
+  ssn_basefinder_station_info_list_t list = {NULL, 0};
+  rerror = SSNBaseFinder_createStationList(finder.handle(), &list);
+  if (!IsOk(rerror))
+    return rerror;
+
+  std::string text;
+  stations->resize(list.size);
+  for (size_t i = 0; i < list.size; ++i) {
+    CopyStation(list.stations[i], &(*stations)[i]);
+    text += StationLine((*stations)[i]);
+  }
+  SSNBaseFinder_freeStationList(finder.handle(), &list);
+
+  // an unwritable cache only costs the next lookup
+  WriteAtomically(entry / kStationsFile, text);
+  return rerror;
+}
+
+ssn_error_t CreateReference(const BaseQuery& query,
+                            const BaseCache::Settings& settings,
+                            const fs::path& entry, BaseReference* reference,
+                            JobControl* control, unsigned part) {
+  Finder finder;
+  ssn_error_t rerror = finder.Open(query, settings, entry, control, part);
+  if (!IsOk(rerror))
+    return rerror;
+
+  ssn_hsbfstream_t sbfstream;
+  ssn_basefinder_sbf_result_t result;
+  rerror = SSNBaseFinder_createSBF(finder.handle(), &sbfstream, &result);
+  if (!IsOk(rerror))
+    return rerror;
+
+  CopyStation(result.station, &reference->station);
+  reference->constellations = result.constellations;
+  reference->interval = result.sbfInterval;
+  SSNBaseFinder_freeSbfResult(finder.handle(), &result);
+
+  fs::path path = entry / kReferenceFile;
+  fs::path temp = path;
+  temp += ".tmp";
+  std::string name = temp.u8string();
+  std::vector<char> filename(name.begin(), name.end());
+  filename.push_back('\0');
+  if (control != nullptr)
+    control->AttachStream(sbfstream, part);
+  {
+    StageTimer timer(kStageWriteToFile);
+    rerror = timer.Done(SSNSBFStream_writeToFile(sbfstream, filename.data()));
+  }
+  if (control != nullptr)
+    control->DetachStream(sbfstream);
+  SSNSBFStream_close(sbfstream);
+
+  std::error_code ec;
+  if (IsOk(rerror))
+    fs::rename(temp, path, ec);
+  if (!IsOk(rerror) || ec) {
+    fs::remove(temp, ec);
+    return IsOk(rerror) ? GeneralError(SSNERROR_ERROR_FILEOPEN) : rerror;
+  }
+
+  std::ostringstream info;
+  info.precision(17);
+  info << StationLine(reference->station) << reference->constellations
+       << '\n' << reference->interval << '\n' << reference->begin << '\n'
+       << reference->end << '\n';
+  if (!WriteAtomically(entry / kReferenceInfo, info.str()))
+    return GeneralError(SSNERROR_ERROR_FILEOPEN);
+  return rerror;
+}
+
+// `query` at the same site `days` later; the window must be resolved, and
+// the SBF file no longer covers it
+BaseQuery ShiftQuery(const BaseQuery& query, int days) {
+  BaseQuery shifted = query;
+  if (days != 0)
+    shifted.sbf_file.clear();
+  shifted.begin += days * kSecondsPerDay;
+  shifted.end += days * kSecondsPerDay;
+  return shifted;
+}
+
+}
+
+ssn_error_t ResolveBaseQuery(BaseQuery* query) {
+  bool needs_window = query->begin == 0.0 && query->end == 0.0;
+  if (!query->sbf_file.empty() && (!query->has_position || needs_window)) {
+    MappedFile file;
+    if (!file.Open(query->sbf_file))
+      return GeneralError(SSNERROR_ERROR_FILEOPEN);
+
+    if (!query->has_position &&
+        !ReadPosition(file.data(), file.size(), query))
+      return GeneralError(SSNERROR_ERROR_NOPVT);
+
+    if (needs_window) {
+      ScanStats stats;
+      ssn_error_t rerror =
+          ScanSbf(file.data(), file.size(), ScanOptions(), &stats);
+      if (!IsOk(rerror))
+        return rerror;
+      if (stats.epochs == 0)
+        return GeneralError(SSNERROR_ERROR_INVALIDSBFFILE);
+      query->begin = stats.first_time;
+      query->end = stats.last_time;
+    }
+  }
+
+  if (!query->has_position || query->end < query->begin)
+    return GeneralError(SSNERROR_ERROR_INVALIDARG);
+  return SSNERROR_WARNING_OK;
+}
+
+BaseCache& BaseCache::Instance() {
+  static BaseCache cache;
+  return cache;
+}
+
+BaseCache::~BaseCache() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    if (prefetch_control_ != nullptr)
+      prefetch_control_->Cancel();
+  }
+  queue_ready_.notify_all();
+  if (prefetcher_.joinable())
+    prefetcher_.join();
+}
+
+void BaseCache::Configure(const Settings& settings) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  settings_ = settings;
+}
+
+BaseCache::Settings BaseCache::CurrentSettings() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Settings settings = settings_;
+  if (settings.directory.empty()) {
+    std::error_code ec;
+    settings.directory =
+        (fs::temp_directory_path(ec) / "calculate-basefinder").u8string();
+  }
+  return settings;
+}
+
+bool BaseCache::Claim(const std::string& key, JobControl* control) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (in_flight_.count(key) != 0) {
+    if (control != nullptr && control->cancelled())
+      return false;
+    released_.wait_for(lock, std::chrono::milliseconds(100));
+  }
+  in_flight_.insert(key);
+  return true;
+}
+
+void BaseCache::Release(const std::string& key) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_flight_.erase(key);
+  }
+  released_.notify_all();
+}
+
+ssn_error_t BaseCache::Stations(const BaseQuery& query,
+                                std::vector<BaseStation>* stations,
+                                bool* cached, JobControl* control) {
+  BaseQuery resolved = query;
+  ssn_error_t rerror = ResolveBaseQuery(&resolved);
+  if (!IsOk(rerror))
+    return rerror;
+
+  Settings settings = CurrentSettings();
+  std::string key = QueryKey(resolved);
+  fs::path entry = fs::u8path(settings.directory) / key;
+
+  if (!Claim(key, control))
+    return CancelledError();
+
+  *cached = ReadStations(entry / kStationsFile, stations);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++(*cached ? hits_ : misses_);
+  }
+  if (!*cached) {
+    std::error_code ec;
+    fs::create_directories(entry, ec);
+    rerror = CreateStationList(resolved, settings, entry, stations, control);
+  }
+
+  Release(key);
+  return rerror;
+}
+
+ssn_error_t BaseCache::Reference(const BaseQuery& query,
+                                 BaseReference* reference,
+                                 JobControl* control, unsigned part) {
+  return GetReference(query, reference, control, part, false);
+}
+
+ssn_error_t BaseCache::GetReference(const BaseQuery& query,
+                                    BaseReference* reference,
+                                    JobControl* control, unsigned part,
+                                    bool prefetch) {
+  BaseQuery resolved = query;
+  ssn_error_t rerror = ResolveBaseQuery(&resolved);
+  if (!IsOk(rerror))
+    return rerror;
+
+  Settings settings = CurrentSettings();
+  *reference = BaseReference();
+  reference->key = QueryKey(resolved);
+  fs::path entry = fs::u8path(settings.directory) / reference->key;
+  reference->path = (entry / kReferenceFile).u8string();
+  Window(resolved, &reference->begin, &reference->end);
+
+  if (!Claim(reference->key, control))
+    return CancelledError();
+
+  reference->cached = ReadReferenceInfo(entry, reference);
+  if (!prefetch) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++(reference->cached ? hits_ : misses_);
+  }
+  if (!reference->cached) {
+    std::error_code ec;
+    fs::create_directories(entry / kRinexDirectory, ec);
+    rerror = CreateReference(resolved, settings, entry, reference, control,
+                             part);
+  }
+
+  Release(reference->key);
+  return rerror;
+}
+
+void BaseCache::Prefetch(const BaseQuery& query, int days) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_)
+      return;
+    queue_.emplace_back(query, days);
+    if (!prefetcher_.joinable())
+      prefetcher_ = std::thread(&BaseCache::PrefetchLoop, this);
+  }
+  queue_ready_.notify_one();
+}
+
+void BaseCache::PrefetchLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    queue_ready_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+    if (stopping_)
+      return;
+
+    BaseQuery query = std::move(queue_.front().first);
+    int days = queue_.front().second;
+    queue_.pop_front();
+    JobControl control;
+    prefetch_control_ = &control;
+    lock.unlock();
+
+    BaseReference reference;
+    ssn_error_t rerror = ResolveBaseQuery(&query);
+    if (IsOk(rerror))
+      rerror = GetReference(ShiftQuery(query, days), &reference, &control, 0,
+                            true);
+
+    lock.lock();
+    prefetch_control_ = nullptr;
+    if (!IsOk(rerror))
+      ++prefetch_failed_;
+    else if (!reference.cached)
+      ++prefetched_;
+  }
+}
+
+void BaseCache::Clear() {
+  Settings settings = CurrentSettings();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  queue_.clear();
+  if (prefetch_control_ != nullptr)
+    prefetch_control_->Cancel();
+
+  // entries being written stay; the lock keeps new ones from starting
+  std::error_code ec;
+  for (fs::directory_iterator it(fs::u8path(settings.directory), ec), last;
+       !ec && it != last; it.increment(ec)) {
+    std::string name = it->path().filename().u8string();
+    std::error_code remove_ec;
+    if (IsEntryName(name) && in_flight_.count(name) == 0)
+      fs::remove_all(it->path(), remove_ec);
+  }
+}
+
+BaseCache::Stats BaseCache::GetStats() {
+  Settings settings = CurrentSettings();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats;
+  stats.hits = hits_;
+  stats.misses = misses_;
+  stats.prefetched = prefetched_;
+  stats.prefetch_failed = prefetch_failed_;
+  stats.queued = queue_.size();
+  stats.directory = settings.directory;
+  return stats;
+}
+
+}
@@ -0,0 +1,160 @@
+#ifndef CALCULATE_BASE_CACHE_H
+#define CALCULATE_BASE_CACHE_H
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ssnerror.h"
+
+namespace calculate {
+
+class JobControl;
+
+// What SSNBaseFinder is asked for: the rover site, the time window and the
+// reference constellations
+struct BaseQuery {
+  // rover SBF file; fills in the position (first valid PVTGeodetic) and the
+  // window (first / last MeasEpoch) that are not given explicitly, and is
+  // handed to SSNBaseFinder_setSbfInput for its signal detection
+  std::string sbf_file;
+  bool has_position = false;
+  double latitude = 0.0;       // degrees
+  double longitude = 0.0;
+  double altitude = 0.0;       // m
+  double begin = 0.0;          // GNSS seconds, both 0 to take them from
+  double end = 0.0;            // sbf_file
+  uint32_t constellations = 0; // SSNBASEFINDER_* bits, 0 for the SDK default
+  uint32_t radius = 0;         // search radius in km, 0 for the SDK default
+  std::string station;         // manual station, empty to search
+  std::string provider;
+  // stations to skip as (provider, name); an empty provider matches any
+  std::vector<std::pair<std::string, std::string>> blacklist;
+};
+
+struct BaseStation {
+  std::string name;
+  std::string provider;
+  double latitude = 0.0;
+  double longitude = 0.0;
+  double altitude = 0.0;
+  double distance = 0.0;
+  int constellations = 0;
+  std::string receiver_type;
+};
+
+// Reference data of one query, kept in the cache
+struct BaseReference {
+  std::string key;
+  std::string path;            // reference SBF file
+  BaseStation station;
+  int constellations = 0;
+  double interval = 0.0;       // SBF interval of the reference data
+  double begin = 0.0;          // window the data was requested for
+  double end = 0.0;
+  bool cached = false;         // served without going to the network
+};
+
+// Fills in the position and window of `query` from its sbf_file; a no-op
+// for queries that have both
+ssn_error_t ResolveBaseQuery(BaseQuery* query);
+
+// Process-wide, content-addressed disk cache in front of SSNBaseFinder.
+//
+// Every createStationList / createSBF goes out over the network, and
+// reprocessing a site downloads the same RINEX reference data again. Here
+// a query is keyed by a hash of its rounded position, its window widened
+// to whole hours, its constellations, radius, manual station and blacklist;
+// the entry directory <directory>/<key> holds the station list, the
+// reference SBF and, through SSNBaseFinder_setRinexDirectory, the RINEX
+// files it was made from. Files are written to a temporary name and
+// renamed, so a crash never leaves a half-written entry. The key ignores
+// the rover's signal set, which SSNBaseFinder also weighs when it reads
+// an SBF input.
+//
+// Prefetch() queues queries for one background thread, typically the next
+// day while the current one is processing. A query that is already being
+// fetched, in the foreground or by the prefetcher, is waited for instead of
+// downloaded twice.
+class BaseCache {
+ public:
+  struct Settings {
+    std::string directory;     // empty for <temp>/calculate-basefinder
+    std::string proxy;
+    std::vector<std::string> no_proxy_hosts;
+  };
+
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t prefetched;
+    uint64_t prefetch_failed;
+    uint64_t queued;
+    std::string directory;
+  };
+
+  static BaseCache& Instance();
+
+  ~BaseCache();
+
+  void Configure(const Settings& settings);
+
+  // Stations matching `query`, from the cache or SSNBaseFinder
+  ssn_error_t Stations(const BaseQuery& query,
+                       std::vector<BaseStation>* stations, bool* cached,
+                       JobControl* control = nullptr);
+
+  // Reference SBF for `query`, from the cache or SSNBaseFinder_createSBF;
+  // a download reports to progress part `part` of `control`
+  ssn_error_t Reference(const BaseQuery& query, BaseReference* reference,
+                        JobControl* control = nullptr, unsigned part = 0);
+
+  // Queues the reference data of `query`, moved by `days`, for the prefetch
+  // thread. An entry that is already cached by the time its turn comes
+  // costs nothing, so the same query may be queued more than once.
+  void Prefetch(const BaseQuery& query, int days = 0);
+
+  // Drops the queue, cancels the prefetch in flight and removes the cached
+  // entries that are not being written
+  void Clear();
+
+  Stats GetStats();
+
+ private:
+  BaseCache() = default;
+
+  // settings_ with the default directory filled in
+  Settings CurrentSettings();
+  // waits until no one else works on the entry `key`, then claims it;
+  // false when `control` was cancelled meanwhile
+  bool Claim(const std::string& key, JobControl* control);
+  void Release(const std::string& key);
+  ssn_error_t GetReference(const BaseQuery& query, BaseReference* reference,
+                           JobControl* control, unsigned part, bool prefetch);
+  void PrefetchLoop();
+
+  std::mutex mutex_;
+  std::condition_variable released_;
+  std::condition_variable queue_ready_;
+  Settings settings_;
+  std::set<std::string> in_flight_;
+  std::deque<std::pair<BaseQuery, int>> queue_;
+  std::thread prefetcher_;
+  JobControl* prefetch_control_ = nullptr;
+  bool stopping_ = false;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t prefetched_ = 0;
+  uint64_t prefetch_failed_ = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,292 @@
+#include "base_finder.h"
+
+#include <string>
+#include <vector>
+
+#include "async_job.h"
+#include "base_cache.h"
+#include "job_binding.h"
+#include "sbf_stream.h"
+#include "v8_util.h"
+
+namespace calculate {
+
+using v8::Array;
+using v8::Boolean;
+using v8::Context;
+using v8::Exception;
+using v8::FunctionCallbackInfo;
+using v8::Isolate;
+using v8::Local;
+using v8::Number;
+using v8::Object;
+using v8::String;
+using v8::Value;
+
+namespace {
+
+void SetString(Isolate* isolate, Local<Object> target, const char* key,
+               const std::string& value) {
+  Set(isolate, target, key,
+      String::NewFromUtf8(isolate, value.c_str()).ToLocalChecked());
+}
+
+Local<Value> Option(Isolate* isolate, Local<Object> options, const char* key) {
+  return options->Get(isolate->GetCurrentContext(), Key(isolate, key))
+      .ToLocalChecked();
+}
+
+bool OptionString(Isolate* isolate, Local<Object> options, const char* key,
+                  std::string* out) {
+  Local<Value> value = Option(isolate, options, key);
+  if (!value->IsString())
+    return false;
+  *out = *String::Utf8Value(isolate, value);
+  return true;
+}
+
+bool OptionNumber(Isolate* isolate, Local<Object> options, const char* key,
+                  double* out) {
+  Local<Value> value = Option(isolate, options, key);
+  if (!value->IsNumber())
+    return false;
+  *out = value.As<Number>()->Value();
+  return true;
+}
+
+Local<Object> StationObject(Isolate* isolate, const BaseStation& station) {
+  Local<Object> out = Object::New(isolate);
+  SetString(isolate, out, "name", station.name);
+  SetString(isolate, out, "provider", station.provider);
+  SetNumber(isolate, out, "latitude", station.latitude);
+  SetNumber(isolate, out, "longitude", station.longitude);
+  SetNumber(isolate, out, "altitude", station.altitude);
+  SetNumber(isolate, out, "distance", station.distance);
+  SetNumber(isolate, out, "constellations", station.constellations);
+  SetString(isolate, out, "receiverType", station.receiver_type);
+  return out;
+}
+
+class StationsJob : public AsyncJob {
+ public:
+  StationsJob(Isolate* isolate, const BaseQuery& query, Local<Value> binding)
+      : AsyncJob(isolate, "calculate:findBaseStations"), query_(query),
+        binding_(isolate, binding) {}
+
+ protected:
+  void Execute() override {
+    JobControl* control = binding_.control();
+    ssn_error_t rerror = control->cancelled()
+        ? CancelledError()
+        : BaseCache::Instance().Stations(query_, &stations_, &cached_,
+                                         control);
+    if (control->cancelled())
+      SetCancelled();
+    else if (!IsOk(rerror))
+      SetError(rerror);
+  }
+
+  void OnSettle(Isolate* isolate) override { binding_.Finish(isolate); }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    Local<Context> context = isolate->GetCurrentContext();
+    Local<Array> stations =
+        Array::New(isolate, static_cast<int>(stations_.size()));
+    for (size_t i = 0; i < stations_.size(); ++i)
+      stations->Set(context, static_cast<uint32_t>(i),
+                    StationObject(isolate, stations_[i])).Check();
+
+    Local<Object> out = Object::New(isolate);
+    Set(isolate, out, "cached", Boolean::New(isolate, cached_));
+    Set(isolate, out, "stations", stations);
+    return out;
+  }
+
+ private:
+  BaseQuery query_;
+  std::vector<BaseStation> stations_;
+  bool cached_ = false;
+  JobBinding binding_;
+};
+
+class ReferenceJob : public AsyncJob {
+ public:
+  ReferenceJob(Isolate* isolate, const BaseQuery& query, int prefetch_days,
+               Local<Value> binding)
+      : AsyncJob(isolate, "calculate:createBaseReference"), query_(query),
+        prefetch_days_(prefetch_days), binding_(isolate, binding) {}
+
+ protected:
+  void Execute() override {
+    JobControl* control = binding_.control();
+    BaseCache& cache = BaseCache::Instance();
+    ssn_error_t rerror = control->cancelled() ? CancelledError()
+                                              : ResolveBaseQuery(&query_);
+
+    // the following days download while this one does, and while the
+    // caller processes it
+    for (int day = 1; IsOk(rerror) && day <= prefetch_days_; ++day)
+      cache.Prefetch(query_, day);
+
+    if (IsOk(rerror))
+      rerror = cache.Reference(query_, &reference_, control);
+    if (control->cancelled())
+      SetCancelled();
+    else if (!IsOk(rerror))
+      SetError(rerror);
+  }
+
+  void OnSettle(Isolate* isolate) override { binding_.Finish(isolate); }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    Local<Object> out = Object::New(isolate);
+    SetString(isolate, out, "key", reference_.key);
+    SetString(isolate, out, "path", reference_.path);
+    Set(isolate, out, "cached", Boolean::New(isolate, reference_.cached));
+    Set(isolate, out, "station", StationObject(isolate, reference_.station));
+    SetNumber(isolate, out, "constellations", reference_.constellations);
+    SetNumber(isolate, out, "interval", reference_.interval);
+    SetNumber(isolate, out, "begin", reference_.begin);
+    SetNumber(isolate, out, "end", reference_.end);
+    return out;
+  }
+
+ private:
+  BaseQuery query_;
+  int prefetch_days_;
+  BaseReference reference_;
+  JobBinding binding_;
+};
+
+}
+
+bool ReadBaseQuery(Isolate* isolate, Local<Value> value, BaseQuery* query,
+                   bool require_site) {
+  Local<Context> context = isolate->GetCurrentContext();
+  if (!value->IsObject()) {
+    isolate->ThrowException(Exception::TypeError(Key(isolate,
+        "Base station query must be an object")));
+    return false;
+  }
+
+  Local<Object> object = value.As<Object>();
+  OptionString(isolate, object, "sbfFile", &query->sbf_file);
+  query->has_position =
+      OptionNumber(isolate, object, "latitude", &query->latitude) &&
+      OptionNumber(isolate, object, "longitude", &query->longitude);
+  OptionNumber(isolate, object, "altitude", &query->altitude);
+  if (require_site && query->sbf_file.empty() && !query->has_position) {
+    isolate->ThrowException(Exception::TypeError(Key(isolate,
+        "Base station query needs sbfFile or latitude / longitude")));
+    return false;
+  }
+
+  OptionNumber(isolate, object, "begin", &query->begin);
+  OptionNumber(isolate, object, "end", &query->end);
+  double number;
+  if (OptionNumber(isolate, object, "constellations", &number))
+    query->constellations = static_cast<uint32_t>(number);
+  if (OptionNumber(isolate, object, "radius", &number))
+    query->radius = static_cast<uint32_t>(number);
+
+  Local<Value> station = Option(isolate, object, "station");
+  if (station->IsObject() &&
+      OptionString(isolate, station.As<Object>(), "name", &query->station))
+    OptionString(isolate, station.As<Object>(), "provider", &query->provider);
+
+  Local<Value> blacklist = Option(isolate, object, "blacklist");
+  if (blacklist->IsArray()) {
+    Local<Array> list = blacklist.As<Array>();
+    for (uint32_t i = 0; i < list->Length(); ++i) {
+      Local<Value> entry = list->Get(context, i).ToLocalChecked();
+      if (!entry->IsObject())
+        continue;
+      std::pair<std::string, std::string> item;
+      OptionString(isolate, entry.As<Object>(), "provider", &item.first);
+      OptionString(isolate, entry.As<Object>(), "station", &item.second);
+      query->blacklist.push_back(item);
+    }
+  }
+  return true;
+}
+
+void ConfigureBaseFinder(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  BaseCache::Settings settings;
+  if (args.Length() > 0 && args[0]->IsObject()) {
+    Local<Object> object = args[0].As<Object>();
+    OptionString(isolate, object, "directory", &settings.directory);
+    OptionString(isolate, object, "proxy", &settings.proxy);
+    Local<Value> hosts = Option(isolate, object, "noProxyHosts");
+    if (hosts->IsArray()) {
+      Local<Array> list = hosts.As<Array>();
+      for (uint32_t i = 0; i < list->Length(); ++i)
+        settings.no_proxy_hosts.push_back(*String::Utf8Value(
+            isolate, list->Get(context, i).ToLocalChecked()));
+    }
+  }
+  BaseCache::Instance().Configure(settings);
+}
+
+void FindBaseStations(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+
+  BaseQuery query;
+  if (!ReadBaseQuery(isolate, args[0], &query, true))
+    return;
+
+  StationsJob* job = new StationsJob(isolate, query, args[1]);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+void CreateBaseReference(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+
+  BaseQuery query;
+  if (!ReadBaseQuery(isolate, args[0], &query, true))
+    return;
+
+  double days = 0;
+  if (args.Length() > 1 && args[1]->IsObject())
+    OptionNumber(isolate, args[1].As<Object>(), "prefetchDays", &days);
+
+  ReferenceJob* job =
+      new ReferenceJob(isolate, query, static_cast<int>(days), args[1]);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+void PrefetchBaseReference(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+
+  BaseQuery query;
+  if (!ReadBaseQuery(isolate, args[0], &query, true))
+    return;
+
+  int days = 0;
+  if (args.Length() > 1 && args[1]->IsNumber())
+    days = static_cast<int>(args[1].As<Number>()->Value());
+  BaseCache::Instance().Prefetch(query, days);
+}
+
+void ClearBaseFinderCache(const FunctionCallbackInfo<Value>& args) {
+  BaseCache::Instance().Clear();
+}
+
+void GetBaseFinderCacheStats(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  BaseCache::Stats stats = BaseCache::Instance().GetStats();
+
+  Local<Object> out = Object::New(isolate);
+  SetNumber(isolate, out, "hits", static_cast<double>(stats.hits));
+  SetNumber(isolate, out, "misses", static_cast<double>(stats.misses));
+  SetNumber(isolate, out, "prefetched", static_cast<double>(stats.prefetched));
+  SetNumber(isolate, out, "prefetchFailed",
+            static_cast<double>(stats.prefetch_failed));
+  SetNumber(isolate, out, "queued", static_cast<double>(stats.queued));
+  SetString(isolate, out, "directory", stats.directory);
+  args.GetReturnValue().Set(out);
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef CALCULATE_BASE_FINDER_H
+#define CALCULATE_BASE_FINDER_H
+
+#include <node.h>
+
+#include "base_cache.h"
+
+namespace calculate {
+
+// Base-station lookups through the BaseCache. A query is
+//
+//   { sbfFile, latitude, longitude, altitude, begin, end, constellations,
+//     radius, station: { name, provider },
+//     blacklist: [{ provider, station }] }
+//
+// with either sbfFile or latitude / longitude (degrees). begin / end are
+// GNSS seconds and default to the MeasEpoch span of sbfFile;
+// constellations is a bitwise-or of the SSNBASEFINDER_* values (GPS 1,
+// GLONASS 2, Galileo 4, BeiDou 8, SBAS 16, QZSS 32, IRNSS 64).
+
+// Reads a query object into `query`; throws a TypeError and returns false
+// when it is no object, or names no site and `require_site` is set
+bool ReadBaseQuery(v8::Isolate* isolate, v8::Local<v8::Value> value,
+                   BaseQuery* query, bool require_site);
+
+// configureBaseFinder({ directory, proxy, noProxyHosts })
+void ConfigureBaseFinder(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+// findBaseStations(query, { onProgress, signal })
+//   -> Promise<{ cached, stations: [{ name, provider, latitude, longitude,
+//                altitude, distance, constellations, receiverType }] }>
+void FindBaseStations(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+// createBaseReference(query, { prefetchDays, onProgress, signal })
+//   -> Promise<{ key, path, cached, station, constellations, interval,
+//                begin, end }>
+//
+// `path` is the reference SBF in the cache, to be opened like any other
+// file. prefetchDays (default 0) queues that many following days of the
+// same site for the prefetch thread as soon as the job starts.
+void CreateBaseReference(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+// prefetchBaseReference(query, days = 0) queues the reference data
+// `days` after `query` for the prefetch thread
+void PrefetchBaseReference(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+void ClearBaseFinderCache(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+// getBaseFinderCacheStats()
+//   -> { hits, misses, prefetched, prefetchFailed, queued, directory }
+void GetBaseFinderCacheStats(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+}
+
+#endif
@@ -0,0 +1,93 @@
+#include "batch_analysis.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "sbf_stream.h"
+
+namespace calculate {
+
+BatchAnalysis::BatchAnalysis(std::vector<std::string> paths, AnalysisOps ops,
+                             unsigned concurrency, JobControl* control)
+    : paths_(std::move(paths)), ops_(ops), control_(control) {
+  size_t workers = std::min<size_t>(std::max(concurrency, 1u), paths_.size());
+  concurrency_ = static_cast<unsigned>(std::max<size_t>(workers, 1));
+}
+
+BatchAnalysis::~BatchAnalysis() {
+  for (std::thread& thread : threads_) {
+    if (thread.joinable())
+      thread.join();
+  }
+}
+
+unsigned BatchAnalysis::DefaultConcurrency() {
+  unsigned cores = std::thread::hardware_concurrency();
+  return cores > 0 ? cores : 4;
+}
+
+void BatchAnalysis::Start(ResultFn on_result, DoneFn on_done) {
+  on_result_ = std::move(on_result);
+  on_done_ = std::move(on_done);
+
+  if (paths_.empty()) {
+    on_done_();
+    return;
+  }
+
+  running_ = concurrency_;
+  threads_.reserve(concurrency_);
+  for (unsigned i = 0; i < concurrency_; ++i)
+    threads_.emplace_back(&BatchAnalysis::Run, this);
+}
+
+void BatchAnalysis::Run() {
+  ssn_hsdk_t sdk;
+  SdkFailure sdkfailure;
+  ssn_error_t sdkerror;
+  {
+    ErrorTrail trail;
+    sdkerror = OpenSdk(&sdk);
+    sdkfailure = trail.Failure(sdkerror);
+  }
+
+  for (;;) {
+    size_t index = next_++;
+    if (index >= paths_.size() || cancelled())
+      break;
+
+    FileResult result;
+    result.index = index;
+    result.path = paths_[index];
+
+    if (IsOk(sdkerror)) {
+      Analyze(sdk, &result);
+    } else {
+      result.error = sdkerror;
+      result.failure = sdkfailure;
+    }
+
+    on_result_(std::move(result));
+  }
+
+  if (IsOk(sdkerror))
+    CloseSdk(sdk);
+
+  if (--running_ == 0)
+    on_done_();
+}
+
+void BatchAnalysis::Analyze(ssn_hsdk_t sdk, FileResult* result) {
+  ErrorTrail trail;
+  std::shared_ptr<SbfStream> stream;
+  ssn_error_t rerror = SbfStream::Open(sdk, result->path, &stream, control_);
+  if (IsOk(rerror))
+    rerror = AnalyzePVT(stream->handle(), ops_, &result->analysis, control_);
+
+  result->cancelled = cancelled();
+  result->error = result->cancelled ? CancelledError() : rerror;
+  result->failure = trail.Failure(result->error);
+  result->failure.cancelled = result->cancelled;
+}
+
+}
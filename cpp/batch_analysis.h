@@ -0,0 +1,83 @@
+#ifndef CALCULATE_BATCH_ANALYSIS_H
+#define CALCULATE_BATCH_ANALYSIS_H
+
+#include <stddef.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "job_control.h"
+#include "pvt_analysis.h"
+#include "sdk_error.h"
+
+namespace calculate {
+
+// Outcome for one file; `error` is the first failing SDK call
+struct FileResult {
+  size_t index = 0;
+  std::string path;
+  ssn_error_t error = SSNERROR_WARNING_OK;
+  SdkFailure failure;       // `error` with its stage and warnings
+  bool cancelled = false;
+  PVTAnalysis analysis;
+};
+
+// Runs AnalyzePVT() over a list of files on a fixed number of native threads.
+//
+// Every worker opens its own SDK handle and loads each file it picks up into
+// a private stream, so no handle is ever shared between threads and files
+// bypass the stream cache. Workers pull the next unclaimed file until the
+// list is drained, so a slow file does not hold up the others.
+class BatchAnalysis {
+ public:
+  typedef std::function<void(FileResult&&)> ResultFn;
+  typedef std::function<void()> DoneFn;
+
+  // `control`, when given, cancels the loads and queries in flight and
+  // keeps the workers from picking up further files
+  BatchAnalysis(std::vector<std::string> paths, AnalysisOps ops,
+                unsigned concurrency, JobControl* control = nullptr);
+
+  // Joins the workers; Cancel() first to stop early
+  ~BatchAnalysis();
+
+  BatchAnalysis(const BatchAnalysis&) = delete;
+  void operator=(const BatchAnalysis&) = delete;
+
+  // Starts the workers. `on_result` is called from a worker thread as each
+  // file completes, `on_done` once from the last worker to finish.
+  void Start(ResultFn on_result, DoneFn on_done);
+
+  // Files not yet picked up are skipped
+  void Cancel() { cancelled_ = true; }
+  bool cancelled() const {
+    return cancelled_ || (control_ != nullptr && control_->cancelled());
+  }
+
+  unsigned concurrency() const { return concurrency_; }
+
+  // Default pool size: one worker per hardware thread
+  static unsigned DefaultConcurrency();
+
+ private:
+  void Run();
+  void Analyze(ssn_hsdk_t sdk, FileResult* result);
+
+  std::vector<std::string> paths_;
+  AnalysisOps ops_;
+  unsigned concurrency_;
+  JobControl* control_;
+  ResultFn on_result_;
+  DoneFn on_done_;
+  std::atomic<size_t> next_{0};
+  std::atomic<unsigned> running_{0};
+  std::atomic<bool> cancelled_{false};
+  std::vector<std::thread> threads_;
+};
+
+}
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef CALCULATE_BLOCK_DISPATCH_H
+#define CALCULATE_BLOCK_DISPATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <array>
+
+#include "sbfdef.h"
+
+namespace calculate {
+
+// Typed view of one SBF block in place, for the struct `T` of sbfdef.h.
+//
+// `T` describes the newest revision a handler knows; older revisions and
+// blocks cut short by their Length simply lack the trailing fields, so
+// read a field past the fixed header only once Has() says it is there.
+// The structs are packed to 4 bytes, so fields read directly off the view.
+template <typename T>
+class BlockView {
+ public:
+  BlockView(const T* block, uint16_t length) : block_(block), length_(length) {}
+
+  const T* operator->() const { return block_; }
+  const T& operator*() const { return *block_; }
+  const uint8_t* bytes() const {
+    return reinterpret_cast<const uint8_t*>(block_);
+  }
+  uint16_t length() const { return length_; }
+  unsigned revision() const { return SBF_ID_TO_REV(block_->Header.ID); }
+
+  // true when the block holds all of `member`, as in
+  // view.Has(&PVTGeodetic_2_2_t::HAccuracy). A member pointer rather than a
+  // reference, which would bind a packed double to a temporary copy.
+  template <typename F>
+  bool Has(F T::*member) const {
+    size_t offset =
+        reinterpret_cast<const uint8_t*>(&(block_->*member)) - bytes();
+    return offset + sizeof(F) <= length_;
+  }
+
+ private:
+  const T* block_;
+  uint16_t length_;
+};
+
+// One dispatch table entry: blocks with the number of `Id` and a revision
+// from that of `Id` up go to the handler's On(const BlockView<T>&). A
+// later entry for the same number with a higher revision takes over from
+// its revision on.
+template <SBFID_t Id, typename T>
+struct OnBlock {
+  static constexpr uint16_t kId = Id;
+  using Type = T;
+};
+
+// Block handlers bound at compile time.
+//
+//   struct Stats {
+//     void On(const BlockView<PVTGeodetic_2_2_t>& pvt);
+//     void On(const BlockView<DOP_2_0_t>& dop);
+//   };
+//   BlockDispatcher<Stats, OnBlock<sbfid_PVTGeodetic_2_0, PVTGeodetic_2_2_t>,
+//                   OnBlock<sbfid_DOP_2_0, DOP_2_0_t>> dispatch(&stats);
+//   while (const uint8_t* block = walker.Next(&length))
+//     dispatch(block, length);
+//
+// The block number and revision index constexpr tables of entry slots, and
+// the slot a constexpr array of thunks, each of which makes its BlockView
+// and calls the handler's overload directly: two table loads and one
+// indirect call per block, no virtual or std::function in between. Blocks
+// are viewed where they lie; one not aligned for `T` (after resynchronising
+// on a damaged stream) is copied into an aligned per-thread buffer first.
+template <typename Handler, typename... Entries>
+class BlockDispatcher {
+ public:
+  static_assert(sizeof...(Entries) < 255, "too many block handlers");
+
+  explicit BlockDispatcher(Handler* handler) : handler_(handler) {}
+
+  // true when a handler took the block; `length` is its SBF Length
+  bool operator()(const uint8_t* block, uint16_t length) const {
+    uint16_t id;
+    memcpy(&id, block + 4, sizeof(id));
+    uint8_t slot = Slot(id);
+    if (slot == 0)
+      return false;
+    kThunks[slot](handler_, block, length);
+    return true;
+  }
+
+  // whether blocks with `id` reach a handler
+  static constexpr bool Handles(uint16_t id) { return Slot(id) != 0; }
+
+ private:
+  using Thunk = void (*)(Handler*, const uint8_t*, uint16_t);
+
+  // block number -> group of the numbers handled, group and revision ->
+  // entry slot (0 for none); group 0 handles nothing
+  struct Table {
+    std::array<uint8_t, 0x2000> groups;
+    std::array<std::array<uint8_t, 8>, sizeof...(Entries) + 1> slots;
+  };
+
+  static constexpr uint8_t Slot(uint16_t id) {
+    return kTable.slots[kTable.groups[SBF_ID_TO_NUMBER(id)]]
+                       [SBF_ID_TO_REV(id)];
+  }
+
+  template <typename T>
+  static void Call(Handler* handler, const uint8_t* block, uint16_t length) {
+    if (reinterpret_cast<uintptr_t>(block) % alignof(T) != 0) {
+      alignas(T) thread_local uint8_t aligned[MAX_SBFSIZE + 1];
+      memcpy(aligned, block, length);
+      block = aligned;
+    }
+    handler->On(BlockView<T>(reinterpret_cast<const T*>(block), length));
+  }
+
+  static constexpr Table MakeTable() {
+    constexpr uint16_t ids[] = {Entries::kId...};
+    Table table{};
+    // first revision each slot was filled for, plus one, so that the
+    // highest entry at or below a revision wins whatever the entry order
+    std::array<std::array<uint8_t, 8>, sizeof...(Entries) + 1> filled{};
+    size_t groups = 0;
+    for (size_t e = 0; e < sizeof...(Entries); ++e) {
+      unsigned number = SBF_ID_TO_NUMBER(ids[e]);
+      if (table.groups[number] == 0)
+        table.groups[number] = static_cast<uint8_t>(++groups);
+      size_t group = table.groups[number];
+      unsigned first = SBF_ID_TO_REV(ids[e]);
+      for (unsigned revision = first; revision < 8; ++revision) {
+        if (filled[group][revision] <= first) {
+          table.slots[group][revision] = static_cast<uint8_t>(e + 1);
+          filled[group][revision] = static_cast<uint8_t>(first + 1);
+        }
+      }
+    }
+    return table;
+  }
+
+  static constexpr Table kTable = MakeTable();
+  static constexpr Thunk kThunks[] = {nullptr,
+                                      &Call<typename Entries::Type>...};
+
+  Handler* handler_;
+};
+
+}
+
+#endif
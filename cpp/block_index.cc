@@ -0,0 +1,354 @@
+#include "block_index.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+#include "job_control.h"
+#include "sbf_stream.h"
+#include "sbf_util.h"
+
+namespace calculate {
+
+namespace fs = std::filesystem;
+
+static_assert(sizeof(BlockIndexHeader) == 48, "BlockIndexHeader layout");
+static_assert(sizeof(BlockIndexEntry) == 12, "BlockIndexEntry layout");
+
+namespace {
+
+const uint64_t kUntimed = UINT64_MAX;
+
+// blocks between two cancellation checks / progress reports
+const uint32_t kScanReportBlocks = 4096;
+
+uint64_t TimeKey(const BlockIndexEntry& entry) {
+  if (entry.tow == kTowDoNotUse || entry.wnc == kWncDoNotUse)
+    return kUntimed;
+  return static_cast<uint64_t>(entry.wnc) * 604800000ull + entry.tow;
+}
+
+bool ByTime(const BlockIndexEntry& a, const BlockIndexEntry& b) {
+  uint64_t ka = TimeKey(a), kb = TimeKey(b);
+  return ka != kb ? ka < kb : a.offset < b.offset;
+}
+
+int64_t LastWriteTime(const std::string& path) {
+  std::error_code ec;
+  fs::file_time_type mtime = fs::last_write_time(fs::u8path(path), ec);
+  return ec ? 0 : static_cast<int64_t>(mtime.time_since_epoch().count());
+}
+
+size_t FileBytes(uint32_t entries) {
+  return sizeof(BlockIndexHeader) +
+         static_cast<size_t>(entries) *
+             (sizeof(BlockIndexEntry) + sizeof(uint32_t));
+}
+
+}
+
+std::string BlockIndex::SidecarPath(const std::string& path) {
+  return path + ".sbfidx";
+}
+
+ssn_error_t BlockIndex::Load(const std::string& path,
+                             ssn_hsbfstream_t sbfstream,
+                             JobControl* control) {
+  ssn_error_t rerror;
+  uint32_t size = 0;
+  uint32_t from = 0;
+  bool extend = false;
+
+  index_path_ = SidecarPath(path);
+  int64_t mtime = LastWriteTime(path);
+
+  rerror = SSNSBFStream_getSize(sbfstream, &size);
+  if (!IsOk(rerror))
+    return rerror;
+
+  entries_.clear();
+  origin_ = kBuilt;
+
+  if (MapSidecar(size, mtime, &extend)) {
+    if (!extend) {
+      origin_ = kReused;
+      return SSNERROR_WARNING_OK;
+    }
+
+    // only extend when the last indexed block is still where it was
+    std::vector<uint8_t> scratch(MAX_SBFSIZE);
+    VoidBlock_t* block = reinterpret_cast<VoidBlock_t*>(scratch.data());
+    rerror = SSNSBFStream_setPosition(sbfstream, header_.last_offset);
+    if (IsOk(rerror))
+      rerror = SSNSBFStream_getNextBlock(sbfstream, block);
+
+    if (IsOk(rerror) && block->CRC == header_.last_crc &&
+        block->ID == header_.last_id) {
+      entries_.assign(table_, table_ + count_);
+      from = header_.indexed_bytes;
+      origin_ = kExtended;
+    }
+  }
+
+  if (origin_ == kBuilt)
+    header_ = BlockIndexHeader();
+
+  // the sidecar is about to be replaced, and Windows cannot replace a file
+  // that is still mapped
+  size_t sorted = entries_.size();
+  map_.Close();
+  table_ = nullptr;
+  by_id_table_ = nullptr;
+  count_ = 0;
+
+  rerror = Scan(sbfstream, from, size, control);
+  if (!IsOk(rerror)) {
+    entries_.clear();
+    return rerror;
+  }
+
+  // appended blocks are mostly later than the indexed ones, so sorting the
+  // tail and merging beats a full sort
+  std::sort(entries_.begin() + sorted, entries_.end(), ByTime);
+  std::inplace_merge(entries_.begin(), entries_.begin() + sorted,
+                     entries_.end(), ByTime);
+
+  Publish(size, mtime);
+  return SSNERROR_WARNING_OK;
+}
+
+bool BlockIndex::MapSidecar(uint64_t stream_size, int64_t mtime,
+                            bool* extend) {
+  if (!map_.Open(index_path_))
+    return false;
+
+  if (map_.size() < sizeof(BlockIndexHeader)) {
+    map_.Close();
+    return false;
+  }
+
+  const BlockIndexHeader* header =
+      reinterpret_cast<const BlockIndexHeader*>(map_.data());
+  if (header->magic != kBlockIndexMagic ||
+      header->version != kBlockIndexVersion ||
+      map_.size() != FileBytes(header->entry_count)) {
+    map_.Close();
+    return false;
+  }
+
+  if (header->source_size == stream_size && header->source_mtime == mtime) {
+    *extend = false;
+  } else if (header->source_size < stream_size && header->entry_count > 0 &&
+             header->indexed_bytes <= stream_size) {
+    *extend = true;
+  } else {
+    map_.Close();
+    return false;
+  }
+
+  header_ = *header;
+  count_ = header->entry_count;
+  table_ = reinterpret_cast<const BlockIndexEntry*>(
+      map_.data() + sizeof(BlockIndexHeader));
+  by_id_table_ = reinterpret_cast<const uint32_t*>(table_ + count_);
+  return true;
+}
+
+ssn_error_t BlockIndex::Scan(ssn_hsbfstream_t sbfstream, uint32_t from,
+                             uint64_t stream_size, JobControl* control) {
+  ssn_error_t rerror;
+  std::vector<uint8_t> scratch(MAX_SBFSIZE);
+  VoidBlock_t* block = reinterpret_cast<VoidBlock_t*>(scratch.data());
+  const TimeHeader_t* timed = reinterpret_cast<const TimeHeader_t*>(block);
+  uint32_t blocks = 0;
+
+  rerror = from == 0 ? SSNSBFStream_rewind(sbfstream)
+                     : SSNSBFStream_setPosition(sbfstream, from);
+  if (!IsOk(rerror))
+    return rerror;
+
+  for (;;) {
+    uint32_t offset = 0;
+    rerror = SSNSBFStream_getPosition(sbfstream, &offset);
+    if (!IsOk(rerror))
+      return rerror;
+
+    rerror = SSNSBFStream_getNextBlock(sbfstream, block);
+    if (IsEndOfStream(rerror))
+      break;
+    if (!IsOk(rerror))
+      return rerror;
+
+    BlockIndexEntry entry;
+    entry.id = block->ID;
+    entry.offset = offset;
+    if (block->Length >= sizeof(TimeHeader_t)) {
+      entry.tow = timed->TOW;
+      entry.wnc = timed->WNc;
+    } else {
+      entry.tow = kTowDoNotUse;
+      entry.wnc = kWncDoNotUse;
+    }
+    entries_.push_back(entry);
+
+    header_.last_offset = offset;
+    header_.last_crc = block->CRC;
+    header_.last_id = block->ID;
+
+    if (control != nullptr && ++blocks % kScanReportBlocks == 0) {
+      if (control->cancelled())
+        return CancelledError();
+      if (stream_size > 0)
+        control->Report(0, static_cast<float>(offset * 100.0 / stream_size));
+    }
+  }
+
+  rerror = SSNSBFStream_getPosition(sbfstream, &header_.indexed_bytes);
+  if (!IsOk(rerror))
+    return rerror;
+
+  if (control != nullptr)
+    control->Report(0, 100.0f);
+  return SSNERROR_WARNING_OK;
+}
+
+void BlockIndex::Publish(uint64_t stream_size, int64_t mtime) {
+  by_id_.resize(entries_.size());
+  for (size_t i = 0; i < by_id_.size(); ++i)
+    by_id_[i] = static_cast<uint32_t>(i);
+  std::sort(by_id_.begin(), by_id_.end(), [this](uint32_t a, uint32_t b) {
+    uint16_t na = SBF_ID_TO_NUMBER(entries_[a].id);
+    uint16_t nb = SBF_ID_TO_NUMBER(entries_[b].id);
+    return na != nb ? na < nb : a < b;
+  });
+
+  header_.magic = kBlockIndexMagic;
+  header_.version = kBlockIndexVersion;
+  header_.entry_count = static_cast<uint32_t>(entries_.size());
+  header_.source_size = stream_size;
+  header_.source_mtime = mtime;
+
+  // write to a temporary file and rename, so a reader never maps a
+  // half-written index
+  std::string temp = index_path_ + ".tmp";
+  bool written;
+  {
+    std::ofstream out(fs::u8path(temp), std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    out.write(reinterpret_cast<const char*>(entries_.data()),
+              entries_.size() * sizeof(BlockIndexEntry));
+    out.write(reinterpret_cast<const char*>(by_id_.data()),
+              by_id_.size() * sizeof(uint32_t));
+    written = out.good();
+  }
+
+  std::error_code ec;
+  if (written)
+    fs::rename(fs::u8path(temp), fs::u8path(index_path_), ec);
+  if (!written || ec)
+    fs::remove(fs::u8path(temp), ec);
+  else if (map_.Open(index_path_) &&
+           map_.size() == FileBytes(header_.entry_count)) {
+    count_ = header_.entry_count;
+    table_ = reinterpret_cast<const BlockIndexEntry*>(
+        map_.data() + sizeof(BlockIndexHeader));
+    by_id_table_ = reinterpret_cast<const uint32_t*>(table_ + count_);
+    std::vector<BlockIndexEntry>().swap(entries_);
+    std::vector<uint32_t>().swap(by_id_);
+    return;
+  }
+
+  // not persisted, serve lookups from memory
+  map_.Close();
+  count_ = entries_.size();
+  table_ = entries_.data();
+  by_id_table_ = by_id_.data();
+}
+
+const BlockIndexEntry* BlockIndex::Find(double gnsstime, SBFID_t sbfid) const {
+  if (count_ == 0 || !(gnsstime >= 0.0))
+    return nullptr;
+
+  uint64_t key = static_cast<uint64_t>(llround(gnsstime * 1000.0));
+  auto before = [](const BlockIndexEntry& entry, uint64_t key) {
+    return TimeKey(entry) < key;
+  };
+
+  const BlockIndexEntry* found;
+  if (sbfid == sbfid_ALL) {
+    found = std::lower_bound(table_, table_ + count_, key, before);
+    if (found == table_ + count_)
+      return nullptr;
+  } else {
+    uint16_t number = SBF_ID_TO_NUMBER(sbfid);
+    auto number_of = [this](uint32_t i) {
+      return SBF_ID_TO_NUMBER(table_[i].id);
+    };
+    const uint32_t* first = std::lower_bound(
+        by_id_table_, by_id_table_ + count_, number,
+        [&](uint32_t i, uint16_t n) { return number_of(i) < n; });
+    const uint32_t* last = std::upper_bound(
+        first, by_id_table_ + count_, number,
+        [&](uint16_t n, uint32_t i) { return n < number_of(i); });
+
+    // within one block number the entries are in time order
+    const uint32_t* hit = std::lower_bound(
+        first, last, key,
+        [&](uint32_t i, uint64_t k) { return before(table_[i], k); });
+    if (hit == last)
+      return nullptr;
+    found = table_ + *hit;
+  }
+
+  return TimeKey(*found) == kUntimed ? nullptr : found;
+}
+
+ssn_error_t FindBlockPosition(ssn_hsbfstream_t sbfstream,
+                              const BlockIndex* index, double gnsstime,
+                              SBFID_t sbfid, uint32_t* position, bool* found) {
+  *found = false;
+
+  if (index != nullptr) {
+    const BlockIndexEntry* entry = index->Find(gnsstime, sbfid);
+    if (entry != nullptr) {
+      *position = entry->offset;
+      *found = true;
+    }
+    return SSNERROR_WARNING_OK;
+  }
+
+  ssn_error_t rerror;
+  std::vector<uint8_t> scratch(MAX_SBFSIZE);
+  VoidBlock_t* block = reinterpret_cast<VoidBlock_t*>(scratch.data());
+
+  // the SDK searches onwards from the current position, which any other
+  // query on the shared stream may have left past the block
+  rerror = SSNSBFStream_rewind(sbfstream);
+  if (!IsOk(rerror))
+    return rerror;
+
+  rerror = SSNSBFStream_getNextBlockByGNSSTime(sbfstream, gnsstime, block);
+  if (IsOk(rerror) && sbfid != sbfid_ALL &&
+      SBF_ID_TO_NUMBER(block->ID) != SBF_ID_TO_NUMBER(sbfid))
+    rerror = SSNSBFStream_getNextBlockByID(sbfstream, sbfid, block);
+  if (IsEndOfStream(rerror))
+    return SSNERROR_WARNING_OK;
+  if (!IsOk(rerror))
+    return rerror;
+
+  // blocks are contiguous, so the block starts its length before the
+  // position the SDK moved on to
+  uint32_t after = 0;
+  rerror = SSNSBFStream_getPosition(sbfstream, &after);
+  if (!IsOk(rerror))
+    return rerror;
+
+  *position = after - block->Length;
+  *found = true;
+  return rerror;
+}
+
+}
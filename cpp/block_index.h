@@ -0,0 +1,131 @@
+#ifndef CALCULATE_BLOCK_INDEX_H
+#define CALCULATE_BLOCK_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "sbfdef.h"
+#include "ssnsbfstream.h"
+
+#include "mapped_file.h"
+
+namespace calculate {
+
+class JobControl;
+
+/*
+ * Sidecar block index "<file>.sbfidx" (version 1), little endian
+ *
+ *   offset 0   BlockIndexHeader
+ *   offset 48  BlockIndexEntry[entry_count]   sorted by (WNc, TOW, offset)
+ *   ...        uint32_t by_id[entry_count]     entry numbers sorted by
+ *                                              (SBF block number, entry)
+ *
+ * Blocks without a valid time (TOW or WNc "do not use") sort after every
+ * timed block. Offsets are SSNSBFStream_getPosition() values, which the SDK
+ * keeps in 32 bits.
+ */
+
+const uint32_t kBlockIndexMagic = 0x58464253;  // "SBFX"
+const uint16_t kBlockIndexVersion = 1;
+
+#pragma pack(push, 4)
+
+typedef struct
+{
+  uint32_t  magic;          // kBlockIndexMagic
+  uint16_t  version;        // kBlockIndexVersion
+  uint16_t  reserved;
+  uint32_t  entry_count;
+  uint32_t  indexed_bytes;  // stream position after the last indexed block
+  uint64_t  source_size;    // SSNSBFStream_getSize() of the indexed stream
+  int64_t   source_mtime;   // last write time of the SBF file
+  uint32_t  last_offset;    // offset of the last indexed block
+  uint16_t  last_crc;       // its CRC and ID, checked before extending
+  uint16_t  last_id;
+  uint32_t  reserved2[2];
+} BlockIndexHeader;
+
+typedef struct
+{
+  uint32_t  tow;            // ms, as in the block header
+  uint16_t  wnc;
+  uint16_t  id;             // block ID including the revision bits
+  uint32_t  offset;
+} BlockIndexEntry;
+
+#pragma pack(pop)
+
+// Sorted (time, block ID, offset) index of an SBF stream, for O(log n)
+// seeks with SSNSBFStream_setPosition instead of the linear
+// getNextBlockByGNSSTime / getNextBlockByID scans.
+//
+// The index is persisted next to the SBF file and memory-mapped when it is
+// reused. It is rebuilt when the file changed, and extended from
+// indexed_bytes when the stream only grew. When the sidecar cannot be
+// written (read-only media) the index lives in memory only.
+class BlockIndex {
+ public:
+  enum Origin { kReused, kExtended, kBuilt };
+
+  BlockIndex() = default;
+
+  BlockIndex(const BlockIndex&) = delete;
+  void operator=(const BlockIndex&) = delete;
+
+  // Maps the sidecar of `path`, or (re)builds it from `sbfstream`, which
+  // must hold `path` loaded. The caller holds the stream's mutex; the
+  // stream position is left undefined. `control` receives the scan
+  // progress and can abort it.
+  ssn_error_t Load(const std::string& path, ssn_hsbfstream_t sbfstream,
+                   JobControl* control = nullptr);
+
+  // First block at or after `gnsstime` (seconds) whose block number matches
+  // `sbfid`, or any block for sbfid_ALL. Null when there is none.
+  const BlockIndexEntry* Find(double gnsstime, SBFID_t sbfid) const;
+
+  size_t size() const { return count_; }
+  Origin origin() const { return origin_; }
+  bool persisted() const { return map_.is_open(); }
+  const std::string& path() const { return index_path_; }
+
+  static std::string SidecarPath(const std::string& path);
+
+ private:
+  // Checks the mapped sidecar against the stream; leaves it mapped and
+  // returns true when it can be used as is or extended
+  bool MapSidecar(uint64_t stream_size, int64_t mtime, bool* extend);
+
+  ssn_error_t Scan(ssn_hsbfstream_t sbfstream, uint32_t from,
+                   uint64_t stream_size, JobControl* control);
+  void Publish(uint64_t stream_size, int64_t mtime);
+
+  MappedFile map_;
+  std::string index_path_;
+  BlockIndexHeader header_ = {};
+
+  // in-memory tables, used while building and when not persisted
+  std::vector<BlockIndexEntry> entries_;
+  std::vector<uint32_t> by_id_;
+
+  const BlockIndexEntry* table_ = nullptr;
+  const uint32_t* by_id_table_ = nullptr;
+  size_t count_ = 0;
+  Origin origin_ = kBuilt;
+};
+
+// Stream position of the first block at or after `gnsstime` matching
+// `sbfid`. Uses `index` when given and falls back otherwise to a linear
+// SSNSBFStream_getNextBlockByGNSSTime scan from the rewound stream, which
+// leaves the stream positioned after the block. `found` is false when
+// there is no such block. The caller holds the stream's mutex.
+ssn_error_t FindBlockPosition(ssn_hsbfstream_t sbfstream,
+                              const BlockIndex* index, double gnsstime,
+                              SBFID_t sbfid, uint32_t* position, bool* found);
+
+}
+
+#endif
@@ -0,0 +1,257 @@
+#include "block_iterator.h"
+
+#include "block_index.h"
+#include "sbf_session.h"
+
+namespace calculate {
+
+using v8::ArrayBuffer;
+using v8::Boolean;
+using v8::Context;
+using v8::DataView;
+using v8::Exception;
+using v8::Function;
+using v8::FunctionCallbackInfo;
+using v8::FunctionTemplate;
+using v8::Isolate;
+using v8::Local;
+using v8::Number;
+using v8::Object;
+using v8::String;
+using v8::Uint32Array;
+using v8::Undefined;
+using v8::Value;
+
+namespace {
+
+const uint32_t kDefaultBatchBlocks = 256;
+const uint32_t kMaxBatchBlocks = 65536;
+const uint32_t kDefaultSlots = 4;
+const uint32_t kMaxSlots = 64;
+
+Local<String> Message(Isolate* isolate, const char* message) {
+  return String::NewFromUtf8(isolate, message).ToLocalChecked();
+}
+
+class BlockBatchJob : public StreamJob {
+ public:
+  BlockBatchJob(Isolate* isolate, const std::shared_ptr<SbfStream>& stream,
+                const std::shared_ptr<BlockIterator::State>& state)
+      : StreamJob(isolate, "calculate:BlockIterator.next", stream),
+        state_(state) {
+    state_->busy = true;
+  }
+
+  // runs on the main thread once the promise has settled
+  ~BlockBatchJob() override { state_->busy = false; }
+
+ protected:
+  ssn_error_t Query(ssn_hsbfstream_t sbfstream) override {
+    return state_->reader.ReadBatch(sbfstream, state_->ring,
+                                    state_->ring_bytes, state_->offsets,
+                                    state_->max_blocks, &count_);
+  }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    return Number::New(isolate, count_);
+  }
+
+ private:
+  std::shared_ptr<BlockIterator::State> state_;
+  uint32_t count_ = 0;
+};
+
+// Moves the reader to the first matching block at or after a GNSS time
+class BlockSeekJob : public StreamJob {
+ public:
+  BlockSeekJob(Isolate* isolate, const std::shared_ptr<SbfStream>& stream,
+               const std::shared_ptr<BlockIterator::State>& state,
+               double gnsstime)
+      : StreamJob(isolate, "calculate:BlockIterator.seek", stream),
+        state_(state), gnsstime_(gnsstime) {
+    state_->busy = true;
+  }
+
+  ~BlockSeekJob() override { state_->busy = false; }
+
+ protected:
+  ssn_error_t Query(ssn_hsbfstream_t sbfstream) override {
+    uint32_t position = 0;
+    ssn_error_t rerror = FindBlockPosition(
+        sbfstream, stream_->index().get(), gnsstime_,
+        state_->reader.sbfid(), &position, &found_);
+    if (IsOk(rerror) && found_)
+      state_->reader.Seek(position);
+    return rerror;
+  }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    return Boolean::New(isolate, found_);
+  }
+
+ private:
+  std::shared_ptr<BlockIterator::State> state_;
+  double gnsstime_;
+  bool found_ = false;
+};
+
+uint32_t OptionUint32(Isolate* isolate, Local<Object> options, const char* key,
+                      uint32_t fallback) {
+  Local<Context> context = isolate->GetCurrentContext();
+  Local<Value> value = options->Get(context,
+      String::NewFromUtf8(isolate, key).ToLocalChecked()).ToLocalChecked();
+  return value->IsNumber() ? value->Uint32Value(context).FromJust() : fallback;
+}
+
+void DefineReadOnly(Isolate* isolate, Local<Object> target, const char* key,
+                    Local<Value> value) {
+  target->DefineOwnProperty(isolate->GetCurrentContext(),
+      String::NewFromUtf8(isolate, key).ToLocalChecked(), value,
+      v8::ReadOnly).Check();
+}
+
+}
+
+void BlockIterator::Init(Local<Object> exports) {
+  Isolate* isolate = exports->GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(isolate, New);
+  tpl->SetClassName(
+      String::NewFromUtf8(isolate, "BlockIterator").ToLocalChecked());
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "next", Next);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "rewind", Rewind);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "seek", Seek);
+
+  Local<Function> constructor = tpl->GetFunction(context).ToLocalChecked();
+  exports->Set(context,
+               String::NewFromUtf8(isolate, "BlockIterator").ToLocalChecked(),
+               constructor).Check();
+}
+
+// new BlockIterator(session, { sbfid, skip, batch, slots })
+//
+//   sbfid  block type to return, every block when omitted
+//   skip   blocks skipped after each returned block (decimation), 0..255
+//   batch  most blocks per next(), default 256
+//   slots  ring size in MAX_SBFSIZE slots, default 4
+void BlockIterator::New(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+
+  if (!args.IsConstructCall()) {
+    isolate->ThrowException(Exception::TypeError(Message(isolate,
+        "BlockIterator must be called with new")));
+    return;
+  }
+
+  std::shared_ptr<SbfStream> stream = SbfSession::StreamFrom(isolate, args[0]);
+  if (!stream)
+    return;
+
+  SBFID_t sbfid = sbfid_ALL;
+  uint32_t skip = 0;
+  uint32_t batch = kDefaultBatchBlocks;
+  uint32_t slots = kDefaultSlots;
+
+  if (args.Length() > 1 && args[1]->IsObject()) {
+    Local<Object> options = args[1].As<Object>();
+    sbfid = static_cast<SBFID_t>(OptionUint32(isolate, options, "sbfid",
+                                              sbfid_ALL));
+    skip = OptionUint32(isolate, options, "skip", skip);
+    batch = OptionUint32(isolate, options, "batch", batch);
+    slots = OptionUint32(isolate, options, "slots", slots);
+  }
+
+  if (skip > 255 || batch == 0 || batch > kMaxBatchBlocks || slots == 0 ||
+      slots > kMaxSlots) {
+    isolate->ThrowException(Exception::RangeError(Message(isolate,
+        "BlockIterator: skip must be 0..255, batch 1..65536 and "
+        "slots 1..64")));
+    return;
+  }
+
+  std::shared_ptr<State> state =
+      std::make_shared<State>(sbfid, static_cast<uint8_t>(skip));
+  size_t offsets_bytes = ((batch + 1) * sizeof(uint32_t) + 7) & ~size_t(7);
+
+  state->max_blocks = batch;
+  state->ring_bytes = slots * kBlockSlotBytes;
+
+  Local<ArrayBuffer> buffer =
+      ArrayBuffer::New(isolate, offsets_bytes + state->ring_bytes);
+  state->store = buffer->GetBackingStore();
+  state->offsets = static_cast<uint32_t*>(state->store->Data());
+  state->ring = static_cast<uint8_t*>(state->store->Data()) + offsets_bytes;
+
+  BlockIterator* iterator = new BlockIterator();
+  iterator->stream_ = stream;
+  iterator->state_ = state;
+  iterator->Wrap(args.This());
+
+  DefineReadOnly(isolate, args.This(), "buffer", buffer);
+  DefineReadOnly(isolate, args.This(), "offsets",
+                 Uint32Array::New(buffer, 0, batch + 1));
+  DefineReadOnly(isolate, args.This(), "blocks",
+                 DataView::New(buffer, offsets_bytes, state->ring_bytes));
+  args.GetReturnValue().Set(args.This());
+}
+
+// next() -> Promise<number>, the blocks in the refilled ring; 0 at the end
+void BlockIterator::Next(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  BlockIterator* iterator = ObjectWrap::Unwrap<BlockIterator>(args.Holder());
+
+  if (iterator->state_->busy) {
+    isolate->ThrowException(Exception::Error(Message(isolate,
+        "BlockIterator: next() is already pending")));
+    return;
+  }
+
+  BlockBatchJob* job =
+      new BlockBatchJob(isolate, iterator->stream_, iterator->state_);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+void BlockIterator::Rewind(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  BlockIterator* iterator = ObjectWrap::Unwrap<BlockIterator>(args.Holder());
+
+  if (iterator->state_->busy) {
+    isolate->ThrowException(Exception::Error(Message(isolate,
+        "BlockIterator: cannot rewind while next() is pending")));
+    return;
+  }
+
+  iterator->state_->reader.Rewind();
+  args.GetReturnValue().Set(Undefined(isolate));
+}
+
+// seek(gnsstime) -> Promise<boolean>; the next() after a successful seek
+// starts at the first matching block at or after gnsstime. O(log n) once
+// session.buildIndex() has run, a linear SDK scan before that. Resolves
+// false and leaves the position alone when there is no such block.
+void BlockIterator::Seek(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  BlockIterator* iterator = ObjectWrap::Unwrap<BlockIterator>(args.Holder());
+
+  if (args.Length() < 1 || !args[0]->IsNumber()) {
+    isolate->ThrowException(Exception::TypeError(Message(isolate,
+        "BlockIterator: seek(gnsstime) expects a number")));
+    return;
+  }
+
+  if (iterator->state_->busy) {
+    isolate->ThrowException(Exception::Error(Message(isolate,
+        "BlockIterator: cannot seek while next() is pending")));
+    return;
+  }
+
+  BlockSeekJob* job = new BlockSeekJob(isolate, iterator->stream_,
+                                       iterator->state_,
+                                       args[0].As<Number>()->Value());
+  args.GetReturnValue().Set(job->Queue());
+}
+
+}
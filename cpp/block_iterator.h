@@ -0,0 +1,63 @@
+#ifndef CALCULATE_BLOCK_ITERATOR_H
+#define CALCULATE_BLOCK_ITERATOR_H
+
+#include <node.h>
+#include <node_object_wrap.h>
+
+#include <memory>
+
+#include "block_reader.h"
+#include "sbf_stream.h"
+
+namespace calculate {
+
+// JS-visible raw block iterator over a loaded SbfSession.
+//
+//   const it = new BlockIterator(session, { sbfid: 4027, skip: 9, batch: 256 })
+//   for (let n = await it.next(); n > 0; n = await it.next()) {
+//     for (let i = 0; i < n; i++) {
+//       const block = new DataView(it.blocks.buffer,
+//           it.blocks.byteOffset + it.offsets[i], it.offsets[i + 1] - it.offsets[i])
+//     }
+//   }
+//
+// seek(gnsstime) moves the iterator to the first matching block at or after
+// a GNSS time, through the session's block index when it has one.
+//
+// `offsets` and `blocks` are views over one ArrayBuffer allocated when the
+// iterator is created and refilled by every next(), so a full scan costs a
+// single allocation and one promise per batch. The views must not be read
+// while a next() is pending.
+class BlockIterator : public node::ObjectWrap {
+ public:
+  static void Init(v8::Local<v8::Object> exports);
+
+  // State shared with an in-flight batch job, so a collected iterator does
+  // not pull the ring out from under the worker
+  struct State {
+    State(SBFID_t sbfid, uint8_t skip) : reader(sbfid, skip) {}
+
+    BlockReader reader;
+    std::shared_ptr<v8::BackingStore> store;
+    uint32_t* offsets = nullptr;
+    uint8_t* ring = nullptr;
+    size_t ring_bytes = 0;
+    uint32_t max_blocks = 0;
+    bool busy = false;
+  };
+
+ private:
+  BlockIterator() = default;
+
+  static void New(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Next(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Rewind(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Seek(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+  std::shared_ptr<SbfStream> stream_;
+  std::shared_ptr<State> state_;
+};
+
+}
+
+#endif
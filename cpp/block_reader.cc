@@ -0,0 +1,77 @@
+#include "block_reader.h"
+
+#include "sbf_stream.h"
+#include "sbf_util.h"
+
+namespace calculate {
+
+namespace {
+
+size_t Align8(size_t value) {
+  return (value + 7) & ~static_cast<size_t>(7);
+}
+
+}
+
+ssn_error_t BlockReader::ReadBatch(ssn_hsbfstream_t sbfstream, uint8_t* ring,
+                                   size_t ring_bytes, uint32_t* offsets,
+                                   uint32_t max_blocks, uint32_t* count) {
+  ssn_error_t rerror;
+  size_t used = 0;
+
+  *count = 0;
+  offsets[0] = 0;
+  if (done_)
+    return SSNERROR_WARNING_OK;
+
+  // the handle is shared, so pick up where this reader left off
+  rerror = started_ ? SSNSBFStream_setPosition(sbfstream, position_)
+                    : SSNSBFStream_rewind(sbfstream);
+  if (!IsOk(rerror))
+    return rerror;
+  started_ = true;
+
+  rerror = SSNSBFStream_setNextBlockOffset(sbfstream, skip_);
+  if (!IsOk(rerror))
+    return rerror;
+
+  while (*count < max_blocks && ring_bytes - used >= MAX_SBFSIZE) {
+    VoidBlock_t* block = reinterpret_cast<VoidBlock_t*>(ring + used);
+
+    rerror = sbfid_ == sbfid_ALL
+        ? SSNSBFStream_getNextBlock(sbfstream, block)
+        : SSNSBFStream_getNextBlockByID(sbfstream, sbfid_, block);
+
+    if (IsEndOfStream(rerror)) {
+      done_ = true;
+      rerror = SSNERROR_WARNING_OK;
+      break;
+    }
+    if (!IsOk(rerror))
+      break;
+
+    used += Align8(block->Length);
+    offsets[++*count] = static_cast<uint32_t>(used);
+  }
+
+  if (IsOk(rerror) && !done_)
+    rerror = SSNSBFStream_getPosition(sbfstream, &position_);
+
+  // leave the shared handle the way the other queries expect it
+  ssn_error_t oerror = SSNSBFStream_setNextBlockOffset(sbfstream, 0);
+  return IsOk(rerror) ? oerror : rerror;
+}
+
+void BlockReader::Rewind() {
+  position_ = 0;
+  started_ = false;
+  done_ = false;
+}
+
+void BlockReader::Seek(uint32_t position) {
+  position_ = position;
+  started_ = true;
+  done_ = false;
+}
+
+}
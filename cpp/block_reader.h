@@ -0,0 +1,56 @@
+#ifndef CALCULATE_BLOCK_READER_H
+#define CALCULATE_BLOCK_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sbfdef.h"
+#include "ssnsbfstream.h"
+
+namespace calculate {
+
+// one ring slot, MAX_SBFSIZE rounded up so slots stay 8-byte aligned
+const size_t kBlockSlotBytes = 65536;
+
+// Raw SBF block access over a shared stream, one batch at a time.
+//
+// Blocks are read straight into a caller-owned ring buffer, packed back to
+// back on 8-byte boundaries; a batch ends after `max_blocks` blocks or when
+// less than one slot of room is left. The reader remembers the stream
+// position between batches, so several readers (and the analyze queries)
+// can share one cached stream handle. The caller must hold the stream's
+// mutex around ReadBatch().
+class BlockReader {
+ public:
+  // `sbfid` selects one block type (sbfid_ALL for every block); `skip`
+  // makes the reader return every (skip + 1)th block via
+  // SSNSBFStream_setNextBlockOffset
+  BlockReader(SBFID_t sbfid, uint8_t skip) : sbfid_(sbfid), skip_(skip) {}
+
+  // Reads the next batch into `ring`. Block i occupies
+  // ring[offsets[i], offsets[i + 1]), so `offsets` needs max_blocks + 1
+  // entries. `count` is 0 once the end of the stream has been reached.
+  ssn_error_t ReadBatch(ssn_hsbfstream_t sbfstream, uint8_t* ring,
+                        size_t ring_bytes, uint32_t* offsets,
+                        uint32_t max_blocks, uint32_t* count);
+
+  // Starts over from the first block
+  void Rewind();
+
+  // Continues from stream position `position`, a block boundary
+  void Seek(uint32_t position);
+
+  SBFID_t sbfid() const { return sbfid_; }
+  bool done() const { return done_; }
+
+ private:
+  SBFID_t  sbfid_;
+  uint8_t  skip_;
+  uint32_t position_ = 0;
+  bool     started_ = false;
+  bool     done_ = false;
+};
+
+}
+
+#endif
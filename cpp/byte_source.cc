@@ -0,0 +1,377 @@
+#include "byte_source.h"
+
+#include <string.h>
+
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+namespace calculate {
+
+namespace {
+
+// connection attempts give up after this long
+const int kConnectTimeoutMs = 5000;
+
+#ifdef _WIN32
+
+typedef SOCKET Socket;
+const Socket kNoSocket = INVALID_SOCKET;
+
+void CloseSocket(Socket socket) { closesocket(socket); }
+
+bool SetNonBlocking(Socket socket, bool enable) {
+  u_long mode = enable ? 1 : 0;
+  return ioctlsocket(socket, FIONBIO, &mode) == 0;
+}
+
+std::string LastSocketError(const char* what) {
+  return std::string(what) + " failed (WSA error " +
+         std::to_string(WSAGetLastError()) + ")";
+}
+
+// WSAStartup once per process; never torn down, the addon lives until exit
+bool StartWinsock() {
+  static bool started = [] {
+    WSADATA data;
+    return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+  }();
+  return started;
+}
+
+#else
+
+typedef int Socket;
+const Socket kNoSocket = -1;
+
+void CloseSocket(Socket socket) { close(socket); }
+
+bool SetNonBlocking(Socket socket, bool enable) {
+  int flags = fcntl(socket, F_GETFL, 0);
+  if (flags < 0)
+    return false;
+  flags = enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+  return fcntl(socket, F_SETFL, flags) == 0;
+}
+
+std::string LastSocketError(const char* what) {
+  return std::string(what) + " failed: " + strerror(errno);
+}
+
+bool StartWinsock() { return true; }
+
+#endif
+
+// Waits up to `ms` for `socket` to become readable (or writable)
+int WaitSocket(Socket socket, bool write, int ms) {
+  fd_set set;
+  FD_ZERO(&set);
+  FD_SET(socket, &set);
+  struct timeval timeout;
+  timeout.tv_sec = ms / 1000;
+  timeout.tv_usec = (ms % 1000) * 1000;
+  return select(static_cast<int>(socket + 1), write ? NULL : &set,
+                write ? &set : NULL, NULL, &timeout);
+}
+
+class TcpSource : public ByteSource {
+ public:
+  TcpSource(const std::string& host, uint16_t port)
+      : host_(host), port_(port) {}
+  ~TcpSource() override { Close(); }
+
+  bool Open(const std::atomic<bool>& stop, std::string* error) override {
+    Close();
+    if (!StartWinsock()) {
+      *error = "WSAStartup failed";
+      return false;
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* found = NULL;
+    std::string service = std::to_string(port_);
+    int rc = getaddrinfo(host_.c_str(), service.c_str(), &hints, &found);
+    if (rc != 0 || found == NULL) {
+      *error = "Cannot resolve " + host_;
+      return false;
+    }
+
+    for (struct addrinfo* ai = found; ai != NULL && !stop; ai = ai->ai_next) {
+      Socket socket = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (socket == kNoSocket)
+        continue;
+
+      // non-blocking connect, so a dead address does not hold up stop()
+      SetNonBlocking(socket, true);
+      ::connect(socket, ai->ai_addr, static_cast<int>(ai->ai_addrlen));
+
+      bool connected = false;
+      for (int waited = 0; waited < kConnectTimeoutMs && !stop;
+           waited += kByteSourcePollMs) {
+        int ready = WaitSocket(socket, true, kByteSourcePollMs);
+        if (ready < 0)
+          break;
+        if (ready == 0)
+          continue;
+
+        int so_error = 0;
+        socklen_t length = sizeof(so_error);
+        getsockopt(socket, SOL_SOCKET, SO_ERROR,
+                   reinterpret_cast<char*>(&so_error), &length);
+        connected = so_error == 0;
+        break;
+      }
+
+      if (connected) {
+        SetNonBlocking(socket, false);
+        socket_ = socket;
+        break;
+      }
+      CloseSocket(socket);
+    }
+    freeaddrinfo(found);
+
+    if (socket_ == kNoSocket) {
+      *error = "Cannot connect to " + Describe();
+      return false;
+    }
+    return true;
+  }
+
+  int Read(uint8_t* data, size_t size, std::string* error) override {
+    int ready = WaitSocket(socket_, false, kByteSourcePollMs);
+    if (ready == 0)
+      return 0;
+    if (ready < 0) {
+      *error = LastSocketError("select");
+      return -1;
+    }
+
+    int received = recv(socket_, reinterpret_cast<char*>(data),
+                        static_cast<int>(size), 0);
+    if (received == 0) {
+      *error = Describe() + " closed the connection";
+      return -1;
+    }
+    if (received < 0) {
+      *error = LastSocketError("recv");
+      return -1;
+    }
+    return received;
+  }
+
+  void Close() override {
+    if (socket_ != kNoSocket)
+      CloseSocket(socket_);
+    socket_ = kNoSocket;
+  }
+
+  std::string Describe() const override {
+    return "tcp://" + host_ + ":" + std::to_string(port_);
+  }
+
+ private:
+  std::string host_;
+  uint16_t port_;
+  Socket socket_ = kNoSocket;
+};
+
+#ifdef _WIN32
+
+class SerialSource : public ByteSource {
+ public:
+  SerialSource(const std::string& device, uint32_t baud)
+      : device_(device), baud_(baud) {}
+  ~SerialSource() override { Close(); }
+
+  bool Open(const std::atomic<bool>& stop, std::string* error) override {
+    Close();
+
+    // COM10 and up only open through the device namespace
+    std::string name = device_.compare(0, 4, "\\\\.\\") == 0
+        ? device_ : "\\\\.\\" + device_;
+    HANDLE port = CreateFileA(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0,
+                              NULL, OPEN_EXISTING, 0, NULL);
+    if (port == INVALID_HANDLE_VALUE) {
+      *error = "Cannot open " + device_ + " (error " +
+               std::to_string(GetLastError()) + ")";
+      return false;
+    }
+
+    DCB dcb;
+    memset(&dcb, 0, sizeof(dcb));
+    dcb.DCBlength = sizeof(dcb);
+    GetCommState(port, &dcb);
+    dcb.BaudRate = baud_;
+    dcb.ByteSize = 8;
+    dcb.Parity = NOPARITY;
+    dcb.StopBits = ONESTOPBIT;
+    dcb.fBinary = TRUE;
+    dcb.fOutxCtsFlow = FALSE;
+    dcb.fRtsControl = RTS_CONTROL_ENABLE;
+    dcb.fOutX = FALSE;
+    dcb.fInX = FALSE;
+
+    // return whatever arrived after at most one poll interval
+    COMMTIMEOUTS timeouts;
+    memset(&timeouts, 0, sizeof(timeouts));
+    timeouts.ReadIntervalTimeout = MAXDWORD;
+    timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+    timeouts.ReadTotalTimeoutConstant = kByteSourcePollMs;
+
+    if (!SetCommState(port, &dcb) || !SetCommTimeouts(port, &timeouts)) {
+      *error = "Cannot configure " + device_;
+      CloseHandle(port);
+      return false;
+    }
+
+    port_ = port;
+    return true;
+  }
+
+  int Read(uint8_t* data, size_t size, std::string* error) override {
+    DWORD received = 0;
+    if (!ReadFile(port_, data, static_cast<DWORD>(size), &received, NULL)) {
+      *error = "Reading " + device_ + " failed (error " +
+               std::to_string(GetLastError()) + ")";
+      return -1;
+    }
+    return static_cast<int>(received);
+  }
+
+  void Close() override {
+    if (port_ != INVALID_HANDLE_VALUE)
+      CloseHandle(port_);
+    port_ = INVALID_HANDLE_VALUE;
+  }
+
+  std::string Describe() const override { return "serial://" + device_; }
+
+ private:
+  std::string device_;
+  uint32_t baud_;
+  HANDLE port_ = INVALID_HANDLE_VALUE;
+};
+
+#else
+
+bool BaudConstant(uint32_t baud, speed_t* speed) {
+  switch (baud) {
+    case 9600: *speed = B9600; return true;
+    case 19200: *speed = B19200; return true;
+    case 38400: *speed = B38400; return true;
+    case 57600: *speed = B57600; return true;
+    case 115200: *speed = B115200; return true;
+    case 230400: *speed = B230400; return true;
+#ifdef B460800
+    case 460800: *speed = B460800; return true;
+#endif
+#ifdef B921600
+    case 921600: *speed = B921600; return true;
+#endif
+    default: return false;
+  }
+}
+
+class SerialSource : public ByteSource {
+ public:
+  SerialSource(const std::string& device, uint32_t baud)
+      : device_(device), baud_(baud) {}
+  ~SerialSource() override { Close(); }
+
+  bool Open(const std::atomic<bool>& stop, std::string* error) override {
+    Close();
+
+    speed_t speed;
+    if (!BaudConstant(baud_, &speed)) {
+      *error = "Unsupported baud rate " + std::to_string(baud_);
+      return false;
+    }
+
+    int fd = open(device_.c_str(), O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+      *error = "Cannot open " + device_ + ": " + strerror(errno);
+      return false;
+    }
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+      *error = "Cannot configure " + device_ + ": " + strerror(errno);
+      close(fd);
+      return false;
+    }
+
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~CRTSCTS;
+    // return whatever arrived after at most one poll interval
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = kByteSourcePollMs / 100;
+
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+      *error = "Cannot configure " + device_ + ": " + strerror(errno);
+      close(fd);
+      return false;
+    }
+
+    fd_ = fd;
+    return true;
+  }
+
+  int Read(uint8_t* data, size_t size, std::string* error) override {
+    ssize_t received = read(fd_, data, size);
+    if (received < 0) {
+      if (errno == EINTR || errno == EAGAIN)
+        return 0;
+      *error = "Reading " + device_ + " failed: " + strerror(errno);
+      return -1;
+    }
+    return static_cast<int>(received);
+  }
+
+  void Close() override {
+    if (fd_ >= 0)
+      close(fd_);
+    fd_ = -1;
+  }
+
+  std::string Describe() const override { return "serial://" + device_; }
+
+ private:
+  std::string device_;
+  uint32_t baud_;
+  int fd_ = -1;
+};
+
+#endif
+
+}
+
+std::unique_ptr<ByteSource> NewTcpSource(const std::string& host,
+                                         uint16_t port) {
+  return std::unique_ptr<ByteSource>(new TcpSource(host, port));
+}
+
+std::unique_ptr<ByteSource> NewSerialSource(const std::string& device,
+                                            uint32_t baud) {
+  return std::unique_ptr<ByteSource>(new SerialSource(device, baud));
+}
+
+}
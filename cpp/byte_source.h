@@ -0,0 +1,47 @@
+#ifndef CALCULATE_BYTE_SOURCE_H
+#define CALCULATE_BYTE_SOURCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+namespace calculate {
+
+// Blocking byte input from a receiver, used by LiveIngest on its I/O
+// thread. Open() and Read() wait at most kByteSourcePollMs at a time, so the
+// caller can notice a stop request in between.
+class ByteSource {
+ public:
+  virtual ~ByteSource() = default;
+
+  // Connects / opens the port; gives up when `stop` is set. Returns false
+  // with `error` set on failure.
+  virtual bool Open(const std::atomic<bool>& stop, std::string* error) = 0;
+
+  // Bytes read into `data`, 0 when nothing arrived within the poll
+  // interval, -1 when the connection was closed or failed (`error` set)
+  virtual int Read(uint8_t* data, size_t size, std::string* error) = 0;
+
+  virtual void Close() = 0;
+
+  // "tcp://host:port" or "serial://device"
+  virtual std::string Describe() const = 0;
+};
+
+const int kByteSourcePollMs = 200;
+
+// TCP client, e.g. an IP server port of the receiver (sno, ips1)
+std::unique_ptr<ByteSource> NewTcpSource(const std::string& host,
+                                         uint16_t port);
+
+// Serial port, 8N1 without flow control: "COM3" on Windows, "/dev/ttyACM0"
+// elsewhere
+std::unique_ptr<ByteSource> NewSerialSource(const std::string& device,
+                                            uint32_t baud);
+
+}
+
+#endif
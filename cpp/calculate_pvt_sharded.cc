@@ -0,0 +1,140 @@
+#include "calculate_pvt_sharded.h"
+
+#include <string>
+
+#include "engine_profile.h"
+#include "job_binding.h"
+#include "sbf_session.h"
+#include "sharded_pvt.h"
+#include "v8_util.h"
+
+namespace calculate {
+
+using v8::Array;
+using v8::Context;
+using v8::Exception;
+using v8::FunctionCallbackInfo;
+using v8::Isolate;
+using v8::Local;
+using v8::Number;
+using v8::Object;
+using v8::String;
+using v8::Value;
+
+namespace {
+
+class ShardedPVTJob : public StreamJob {
+ public:
+  ShardedPVTJob(Isolate* isolate, const std::shared_ptr<SbfStream>& stream,
+                const ShardedPVTOptions& options, Local<Value> binding)
+      : StreamJob(isolate, "calculate:calculatePVTSharded", stream),
+        options_(options), binding_(isolate, binding) {}
+
+ protected:
+  void Execute() override {
+    StreamJob::Execute();
+    if (binding_.control()->cancelled())
+      SetCancelled();
+  }
+
+  ssn_error_t Query(ssn_hsbfstream_t sbfstream) override {
+    if (binding_.control()->cancelled())
+      return CancelledError();
+    return RunShardedPVT(sbfstream, options_, &result_, binding_.control());
+  }
+
+  void OnSettle(Isolate* isolate) override { binding_.Finish(isolate); }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    Local<Context> context = isolate->GetCurrentContext();
+    Local<Object> out = Object::New(isolate);
+    Local<Array> shards = Array::New(isolate,
+                                     static_cast<int>(result_.shards.size()));
+
+    for (size_t i = 0; i < result_.shards.size(); ++i) {
+      const PVTShard& shard = result_.shards[i];
+      Local<Object> entry = Object::New(isolate);
+      SetNumber(isolate, entry, "start", shard.start);
+      SetNumber(isolate, entry, "end", shard.end);
+      SetNumber(isolate, entry, "seconds", shard.seconds);
+      shards->Set(context, static_cast<uint32_t>(i), entry).Check();
+    }
+
+    SetNumber(isolate, out, "seconds", result_.seconds);
+    out->Set(context, Key(isolate, "shards"), shards).Check();
+
+    if (result_.validated) {
+      const PVTValidation& v = result_.validation;
+      Local<Object> validation = Object::New(isolate);
+      SetNumber(isolate, validation, "shardedEpochs", v.sharded_epochs);
+      SetNumber(isolate, validation, "referenceEpochs", v.reference_epochs);
+      SetNumber(isolate, validation, "matched", v.matched);
+      SetNumber(isolate, validation, "missing", v.missing);
+      SetNumber(isolate, validation, "extra", v.extra);
+      SetNumber(isolate, validation, "modeMismatches", v.mode_mismatches);
+      SetNumber(isolate, validation, "maxError", v.max_error);
+      SetNumber(isolate, validation, "rmsError", v.rms_error);
+      SetNumber(isolate, validation, "referenceSeconds", v.reference_seconds);
+      SetNumber(isolate, validation, "speedup",
+                result_.seconds > 0 ? v.reference_seconds / result_.seconds
+                                    : 0.0);
+      out->Set(context, Key(isolate, "validation"), validation).Check();
+    }
+
+    return out;
+  }
+
+ private:
+  ShardedPVTOptions options_;
+  ShardedPVTResult result_;
+  JobBinding binding_;
+};
+
+}
+
+void CalculatePVTSharded(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  std::shared_ptr<SbfStream> stream = SbfSession::StreamFrom(isolate, args[0]);
+  if (!stream)
+    return;
+
+  ShardedPVTOptions options;
+
+  if (args.Length() > 1 && args[1]->IsObject()) {
+    Local<Object> object = args[1].As<Object>();
+    auto get = [&](const char* key) {
+      return object->Get(context, Key(isolate, key)).ToLocalChecked();
+    };
+
+    Local<Value> value = get("shards");
+    if (value->IsNumber())
+      options.shards = value->Uint32Value(context).FromJust();
+    value = get("warmup");
+    if (value->IsNumber())
+      options.warmup = value.As<Number>()->Value();
+    value = get("options");
+    if (value->IsNumber())
+      options.engine_options = value->Uint32Value(context).FromJust();
+    value = get("output");
+    if (value->IsString())
+      options.output = *String::Utf8Value(isolate, value);
+    options.validate = get("validate")->BooleanValue(isolate);
+
+    if (!ReadEngineProfile(isolate, object, "calculatePVTSharded",
+                           &options.profile))
+      return;
+  }
+
+  if (!(options.warmup >= 0)) {
+    isolate->ThrowException(Exception::RangeError(Key(isolate,
+        "calculatePVTSharded: warmup must not be negative")));
+    return;
+  }
+
+  ShardedPVTJob* job = new ShardedPVTJob(isolate, stream, options, args[1]);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+}
@@ -0,0 +1,26 @@
+#ifndef CALCULATE_CALCULATE_PVT_SHARDED_H
+#define CALCULATE_CALCULATE_PVT_SHARDED_H
+
+#include <node.h>
+
+namespace calculate {
+
+// calculatePVTSharded(session, { shards, warmup, options, profile,
+//                                commands, output, validate, onProgress,
+//                                signal })
+//   -> Promise<{ seconds, shards: [{ start, end, seconds }],
+//                validation?: { matched, missing, extra, modeMismatches,
+//                               maxError, rmsError, ... } }>
+//
+// Recomputes the PVT of the session's file with one post-processing engine
+// per time shard (see sharded_pvt.h). `options` are ssn_ppengine_options_t
+// flags, `profile` an engine profile registered by name or `commands` ASCII
+// commands applied to every engine (see engine_profile.h) and `output` the
+// file the stitched result is written to. With `validate` the full file is
+// also processed by a single engine and compared against the stitched
+// output. onProgress / signal work as described in job_binding.h.
+void CalculatePVTSharded(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+}
+
+#endif
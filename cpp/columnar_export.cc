@@ -0,0 +1,425 @@
+#include "columnar_export.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "sbfdef.h"
+
+#include "arrow_file.h"
+#include "job_control.h"
+#include "mapped_file.h"
+#include "meas_epoch.h"
+#include "sbf_scanner.h"
+#include "sbf_stream.h"
+#include "sbf_util.h"
+
+namespace calculate {
+
+namespace {
+
+// bytes between two cancellation checks / progress reports
+const size_t kExportReportBytes = 16 * 1024 * 1024;
+
+const int64_t kSvidDictionary = 0;
+const int64_t kSignalDictionary = 1;
+
+uint16_t Load16(const uint8_t* p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+std::vector<std::string> Names(int count, std::string (*name)(int)) {
+  std::vector<std::string> names;
+  for (int i = 0; i < count; ++i)
+    names.push_back(name(i));
+  return names;
+}
+
+bool IsDoNotUse(uint8_t value) { return value == 255; }
+bool IsDoNotUse(uint16_t value) { return value == 65535; }
+bool IsDoNotUse(uint32_t value) { return value == 4294967295u; }
+bool IsDoNotUse(float value) { return value == F32_NOTVALID; }
+bool IsDoNotUse(double value) { return value == F64_NOTVALID; }
+
+// Record batches of one output file
+struct Table {
+  ssn_error_t Open(const std::string& path,
+                   const std::vector<ArrowField>& fields) {
+    columns.clear();
+    for (const ArrowField& field : fields)
+      columns.emplace_back(field);
+    return writer.Open(path, fields);
+  }
+
+  size_t rows() const { return columns[0].size(); }
+
+  ssn_error_t Flush() {
+    if (rows() == 0)
+      return SSNERROR_WARNING_OK;
+    ssn_error_t rerror = writer.WriteBatch(columns);
+    for (ArrowColumn& column : columns)
+      column.Clear();
+    return rerror;
+  }
+
+  ArrowFileWriter writer;
+  std::vector<ArrowColumn> columns;
+};
+
+// PVTGeodetic_2_2_t fields; older revisions stop earlier
+struct PvtField {
+  const char* name;
+  ArrowType type;
+  size_t offset;
+  bool do_not_use;             // the all-ones / -2e10 value means null
+};
+
+#define CALCULATE_PVT_FIELD(field, type, dnu) \
+  { #field, type, offsetof(PVTGeodetic_2_2_t, field), dnu }
+
+const PvtField kPvtFields[] = {
+  CALCULATE_PVT_FIELD(TOW, kArrowUInt32, true),
+  CALCULATE_PVT_FIELD(WNc, kArrowUInt16, true),
+  CALCULATE_PVT_FIELD(Mode, kArrowUInt8, false),
+  CALCULATE_PVT_FIELD(Error, kArrowUInt8, false),
+  CALCULATE_PVT_FIELD(Lat, kArrowFloat64, true),
+  CALCULATE_PVT_FIELD(Lon, kArrowFloat64, true),
+  CALCULATE_PVT_FIELD(Alt, kArrowFloat64, true),
+  CALCULATE_PVT_FIELD(Undulation, kArrowFloat32, true),
+  CALCULATE_PVT_FIELD(Vn, kArrowFloat32, true),
+  CALCULATE_PVT_FIELD(Ve, kArrowFloat32, true),
+  CALCULATE_PVT_FIELD(Vu, kArrowFloat32, true),
+  CALCULATE_PVT_FIELD(COG, kArrowFloat32, true),
+  CALCULATE_PVT_FIELD(RxClkBias, kArrowFloat64, true),
+  CALCULATE_PVT_FIELD(RxClkDrift, kArrowFloat32, true),
+  CALCULATE_PVT_FIELD(TimeSystem, kArrowUInt8, true),
+  CALCULATE_PVT_FIELD(Datum, kArrowUInt8, false),
+  CALCULATE_PVT_FIELD(NrSV, kArrowUInt8, true),
+  CALCULATE_PVT_FIELD(WACorrInfo, kArrowUInt8, false),
+  CALCULATE_PVT_FIELD(ReferenceId, kArrowUInt16, true),
+  CALCULATE_PVT_FIELD(MeanCorrAge, kArrowUInt16, true),
+  CALCULATE_PVT_FIELD(SignalInfo, kArrowUInt32, false),
+  CALCULATE_PVT_FIELD(AlertFlag, kArrowUInt8, false),
+  CALCULATE_PVT_FIELD(NrBases, kArrowUInt8, false),
+  CALCULATE_PVT_FIELD(PPPInfo, kArrowUInt16, false),
+  CALCULATE_PVT_FIELD(Latency, kArrowUInt16, true),
+  CALCULATE_PVT_FIELD(HAccuracy, kArrowUInt16, true),
+  CALCULATE_PVT_FIELD(VAccuracy, kArrowUInt16, true),
+  CALCULATE_PVT_FIELD(Misc, kArrowUInt8, false),
+};
+
+#undef CALCULATE_PVT_FIELD
+
+template <typename T>
+void AppendField(ArrowColumn* column, const uint8_t* block, uint16_t length,
+                 const PvtField& field) {
+  T value = 0;
+  bool valid = field.offset + sizeof(T) <= length;
+  if (valid)
+    memcpy(&value, block + field.offset, sizeof(T));
+  column->Append(value, valid && !(field.do_not_use && IsDoNotUse(value)));
+}
+
+class PvtTable {
+ public:
+  ssn_error_t Open(const std::string& path) {
+    std::vector<ArrowField> fields;
+    for (const PvtField& field : kPvtFields)
+      fields.push_back(ArrowField{field.name, field.type});
+    return table_.Open(path, fields);
+  }
+
+  void Add(const uint8_t* block, uint16_t length) {
+    for (size_t i = 0; i < table_.columns.size(); ++i) {
+      const PvtField& field = kPvtFields[i];
+      ArrowColumn* column = &table_.columns[i];
+      switch (field.type) {
+        case kArrowUInt8:
+          AppendField<uint8_t>(column, block, length, field);
+          break;
+        case kArrowUInt16:
+          AppendField<uint16_t>(column, block, length, field);
+          break;
+        case kArrowUInt32:
+          AppendField<uint32_t>(column, block, length, field);
+          break;
+        case kArrowFloat32:
+          AppendField<float>(column, block, length, field);
+          break;
+        default:
+          AppendField<double>(column, block, length, field);
+          break;
+      }
+    }
+  }
+
+  Table& table() { return table_; }
+
+ private:
+  Table table_;
+};
+
+enum MeasColumn {
+  kMeasTow,
+  kMeasWnc,
+  kMeasChannel,
+  kMeasSvid,
+  kMeasSignal,
+  kMeasAntenna,
+  kMeasSubBlock,
+  kMeasFields,                 // first measurement column
+
+  kEngPseudorange = kMeasFields,
+  kEngDoppler,
+  kEngCarrierPhase,
+  kEngCn0,
+  kEngLockTime,
+  kEngObsInfo,
+
+  kRawType = kMeasFields,
+  kRawMisc,
+  kRawCodeLsb,
+  kRawDoppler,
+  kRawCarrierLsb,
+  kRawCarrierMsb,
+  kRawCn0,
+  kRawLockTime,
+  kRawObsInfo,
+  kRawOffsetsMsb,
+  kRawCodeOffsetLsb,
+  kRawDopplerOffsetLsb,
+};
+
+class MeasTable {
+ public:
+  explicit MeasTable(bool engineering) : engineering_(engineering) {}
+
+  ssn_error_t Open(const std::string& path) {
+    std::vector<ArrowField> fields = {
+      {"TOW", kArrowUInt32},
+      {"WNc", kArrowUInt16},
+      {"RxChannel", kArrowUInt8},
+      {"SVID", kArrowInt16, kSvidDictionary},
+      {"Signal", kArrowInt8, kSignalDictionary},
+      {"Antenna", kArrowUInt8},
+      {"SubBlock", kArrowUInt8},
+    };
+    if (engineering_) {
+      fields.insert(fields.end(), {
+        {"Pseudorange", kArrowFloat64},
+        {"Doppler", kArrowFloat64},
+        {"CarrierPhase", kArrowFloat64},
+        {"CN0", kArrowFloat32},
+        {"LockTime", kArrowUInt16},
+        {"ObsInfo", kArrowUInt8},
+      });
+    } else {
+      fields.insert(fields.end(), {
+        {"Type", kArrowUInt8},
+        {"Misc", kArrowUInt8},
+        {"CodeLSB", kArrowUInt32},
+        {"Doppler", kArrowInt32},
+        {"CarrierLSB", kArrowUInt16},
+        {"CarrierMSB", kArrowInt8},
+        {"CN0", kArrowUInt8},
+        {"LockTime", kArrowUInt16},
+        {"ObsInfo", kArrowUInt8},
+        {"OffsetsMSB", kArrowUInt8},
+        {"CodeOffsetLSB", kArrowUInt16},
+        {"DopplerOffsetLSB", kArrowUInt16},
+      });
+    }
+
+    ssn_error_t rerror = table_.Open(path, fields);
+    if (IsOk(rerror))
+      rerror = table_.writer.WriteDictionary(kSvidDictionary, Names(256,
+                                             MeasSvidName));
+    if (IsOk(rerror))
+      rerror = table_.writer.WriteDictionary(kSignalDictionary,
+                                             Names(kMeasSignals,
+                                                   MeasSignalName));
+    return rerror;
+  }
+
+  void Add(const uint8_t* block, uint16_t length) { batch_.Add(block, length); }
+
+  size_t rows() const { return batch_.size(); }
+
+  ssn_error_t Flush() {
+    if (engineering_)
+      batch_.Convert();
+    Fill();
+    batch_.Clear();
+    return table_.Flush();
+  }
+
+  Table& table() { return table_; }
+
+ private:
+  // the batch arrays into the columns; Type1-only raw fields are null on
+  // Type2 rows and the Type2-only ones on Type1 rows
+  void Fill() {
+    const MeasEpochBatch& b = batch_;
+    size_t n = b.size();
+    std::vector<ArrowColumn>& c = table_.columns;
+    for (ArrowColumn& column : c)
+      column.Resize(n);
+
+    Copy(b.tow, &c[kMeasTow]);
+    Copy(b.wnc, &c[kMeasWnc]);
+    Copy(b.channel, &c[kMeasChannel]);
+    int16_t* svid = c[kMeasSvid].Values<int16_t>();
+    int8_t* signal = c[kMeasSignal].Values<int8_t>();
+    for (size_t i = 0; i < n; ++i) {
+      svid[i] = b.svid[i];
+      signal[i] = static_cast<int8_t>(b.signal[i]);
+    }
+    Copy(b.antenna, &c[kMeasAntenna]);
+    Copy(b.sub_block, &c[kMeasSubBlock]);
+    uint8_t* tow_valid = c[kMeasTow].Validity();
+    uint8_t* wnc_valid = c[kMeasWnc].Validity();
+    for (size_t i = 0; i < n; ++i) {
+      tow_valid[i] = static_cast<uint8_t>(!IsDoNotUse(b.tow[i]));
+      wnc_valid[i] = static_cast<uint8_t>(!IsDoNotUse(b.wnc[i]));
+    }
+
+    if (engineering_) {
+      Copy(b.pseudorange, b.pseudorange_valid, &c[kEngPseudorange]);
+      Copy(b.doppler, b.doppler_valid, &c[kEngDoppler]);
+      Copy(b.carrier_phase, b.carrier_phase_valid, &c[kEngCarrierPhase]);
+      Copy(b.cn0, b.cn0_valid, &c[kEngCn0]);
+      Copy(b.lock_time, &c[kEngLockTime]);
+      Copy(b.obs_info, &c[kEngObsInfo]);
+      return;
+    }
+
+    Copy(b.type, &c[kRawType]);
+    Copy(b.misc, &c[kRawMisc]);
+    Copy(b.code_lsb, &c[kRawCodeLsb]);
+    Copy(b.doppler_raw, &c[kRawDoppler]);
+    Copy(b.carrier_lsb, &c[kRawCarrierLsb]);
+    Copy(b.carrier_msb, &c[kRawCarrierMsb]);
+    Copy(b.cn0_raw, &c[kRawCn0]);
+    Copy(b.lock_time, &c[kRawLockTime]);
+    Copy(b.obs_info, &c[kRawObsInfo]);
+    Copy(b.offsets_msb, &c[kRawOffsetsMsb]);
+    Copy(b.code_offset_lsb, &c[kRawCodeOffsetLsb]);
+    Copy(b.doppler_offset_lsb, &c[kRawDopplerOffsetLsb]);
+    for (size_t i = 0; i < n; ++i) {
+      uint8_t type1 = static_cast<uint8_t>(b.sub_block[i] == 1);
+      for (int column : {kRawMisc, kRawCodeLsb, kRawDoppler})
+        c[column].Validity()[i] = type1;
+      for (int column : {kRawOffsetsMsb, kRawCodeOffsetLsb,
+                         kRawDopplerOffsetLsb})
+        c[column].Validity()[i] = type1 ^ 1;
+    }
+  }
+
+  template <typename T>
+  static void Copy(const std::vector<T>& values, ArrowColumn* column) {
+    if (!values.empty())
+      memcpy(column->Values<T>(), values.data(), values.size() * sizeof(T));
+  }
+
+  template <typename T>
+  static void Copy(const std::vector<T>& values,
+                   const std::vector<uint8_t>& valid, ArrowColumn* column) {
+    Copy(values, column);
+    if (!valid.empty())
+      memcpy(column->Validity(), valid.data(), valid.size());
+  }
+
+  bool engineering_;
+  Table table_;
+  MeasEpochBatch batch_;
+};
+
+}
+
+ssn_error_t ExportColumnarFile(const std::string& path,
+                               const ColumnarOptions& options,
+                               ColumnarStats* stats, JobControl* control) {
+  MappedFile file;
+  if (!file.Open(path))
+    return GeneralError(SSNERROR_ERROR_FILEOPEN);
+  return ExportColumnar(file.data(), file.size(), options, stats, control);
+}
+
+ssn_error_t ExportColumnar(const uint8_t* data, size_t size,
+                           const ColumnarOptions& options,
+                           ColumnarStats* stats, JobControl* control) {
+  *stats = ColumnarStats();
+  bool with_pvt = !options.pvt_output.empty();
+  bool with_meas = !options.meas_output.empty();
+  if (!with_pvt && !with_meas)
+    return GeneralError(SSNERROR_ERROR_INVALIDARG);
+  size_t batch_rows = options.batch_rows > 0 ? options.batch_rows : 65536;
+
+  // writers left unfinished on an error remove their partial files
+  PvtTable pvt;
+  MeasTable meas(options.engineering);
+  ssn_error_t rerror = SSNERROR_WARNING_OK;
+  if (with_pvt)
+    rerror = pvt.Open(options.pvt_output);
+  if (IsOk(rerror) && with_meas)
+    rerror = meas.Open(options.meas_output);
+  if (!IsOk(rerror))
+    return rerror;
+
+  const uint16_t pvt_number = SBF_ID_TO_NUMBER(sbfid_PVTGeodetic_2_0);
+  const uint16_t meas_number = SBF_ID_TO_NUMBER(sbfid_MeasEpoch_2_0);
+  SbfWalker walker(data, size);
+  size_t next_report = kExportReportBytes;
+  uint16_t length;
+
+  while (const uint8_t* block = walker.Next(&length)) {
+    if (walker.position() >= next_report) {
+      next_report += kExportReportBytes;
+      if (control != nullptr) {
+        if (control->cancelled())
+          return CancelledError();
+        control->Report(0, static_cast<float>(walker.position() * 100.0 /
+                                              size));
+      }
+    }
+
+    ++stats->blocks;
+    uint16_t number = SBF_ID_TO_NUMBER(Load16(block + 4));
+    if (with_pvt && number == pvt_number) {
+      pvt.Add(block, length);
+      ++stats->pvt_rows;
+      if (pvt.table().rows() >= batch_rows)
+        rerror = pvt.table().Flush();
+    } else if (with_meas && number == meas_number) {
+      size_t before = meas.rows();
+      meas.Add(block, length);
+      stats->meas_rows += meas.rows() - before;
+      if (meas.rows() >= batch_rows)
+        rerror = meas.Flush();
+    }
+    if (!IsOk(rerror))
+      return rerror;
+  }
+  stats->crc_errors = walker.crc_errors();
+
+  if (with_pvt) {
+    rerror = pvt.table().Flush();
+    if (IsOk(rerror))
+      rerror = pvt.table().writer.Finish();
+    stats->pvt_batches = pvt.table().writer.batches();
+  }
+  if (IsOk(rerror) && with_meas) {
+    rerror = meas.Flush();
+    if (IsOk(rerror))
+      rerror = meas.table().writer.Finish();
+    stats->meas_batches = meas.table().writer.batches();
+  }
+
+  if (control != nullptr)
+    control->Report(0, 100.0f);
+  return rerror;
+}
+
+}
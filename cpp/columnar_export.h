@@ -0,0 +1,59 @@
+#ifndef CALCULATE_COLUMNAR_EXPORT_H
+#define CALCULATE_COLUMNAR_EXPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "ssnerror.h"
+
+namespace calculate {
+
+class JobControl;
+
+struct ColumnarOptions {
+  std::string pvt_output;      // Arrow file of PVTGeodetic, empty to skip
+  std::string meas_output;     // of MeasEpoch, one row per signal
+  // MeasEpoch as pseudorange (m), Doppler (Hz), carrier phase (cycles) and
+  // C/N0 (dB-Hz); otherwise the Type1 / Type2 sub-block fields unchanged
+  bool engineering = true;
+  size_t batch_rows = 65536;   // rows per record batch
+};
+
+struct ColumnarStats {
+  uint64_t blocks = 0;         // valid blocks walked
+  uint64_t crc_errors = 0;
+  uint64_t pvt_rows = 0;
+  uint64_t pvt_batches = 0;
+  uint64_t meas_rows = 0;
+  uint64_t meas_batches = 0;
+};
+
+// Columnar export of an SBF file for analytics, in one pass over a memory
+// mapping of it.
+//
+// PVTGeodetic becomes one row per block with the columns of
+// PVTGeodetic_2_2_t, in SBF units; fields a block revision lacks and
+// do-not-use values are null. MeasEpoch becomes one row per tracked signal
+// (the Type1 sub-block and each of its Type2 sub-blocks) with TOW, WNc,
+// RxChannel, SVID, Signal and Antenna, SVID and Signal dictionary-encoded
+// as "G05" / "GPSL1CA" style names, followed by the measurements. Each
+// record batch is decoded as one MeasEpochBatch, so engineering units come
+// from its SIMD kernels.
+//
+// Each table is an Arrow IPC file, see ArrowFileWriter.
+ssn_error_t ExportColumnarFile(const std::string& path,
+                               const ColumnarOptions& options,
+                               ColumnarStats* stats,
+                               JobControl* control = nullptr);
+
+// Same over bytes already in memory
+ssn_error_t ExportColumnar(const uint8_t* data, size_t size,
+                           const ColumnarOptions& options,
+                           ColumnarStats* stats,
+                           JobControl* control = nullptr);
+
+}
+
+#endif
@@ -0,0 +1,155 @@
+#include "convert_rinex.h"
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "async_job.h"
+#include "job_binding.h"
+#include "rinex_conversion.h"
+#include "sbf_stream.h"
+#include "v8_util.h"
+
+namespace calculate {
+
+using v8::Array;
+using v8::Context;
+using v8::Exception;
+using v8::FunctionCallbackInfo;
+using v8::Isolate;
+using v8::Local;
+using v8::Number;
+using v8::Object;
+using v8::String;
+using v8::Value;
+
+namespace {
+
+double Rate(uint64_t epochs, double seconds) {
+  return seconds > 0 ? epochs / seconds : 0.0;
+}
+
+class ConvertRinexJob : public AsyncJob {
+ public:
+  ConvertRinexJob(Isolate* isolate, std::vector<RinexSet> sets,
+                  const RinexConversionOptions& options, Local<Value> binding)
+      : AsyncJob(isolate, "calculate:convertRinex"), sets_(std::move(sets)),
+        options_(options), binding_(isolate, binding) {}
+
+ protected:
+  void Execute() override {
+    JobControl* control = binding_.control();
+    ssn_error_t rerror = control->cancelled()
+        ? CancelledError()
+        : RunRinexConversion(sets_, options_, &result_, control);
+    if (control->cancelled())
+      SetCancelled();
+    else if (!IsOk(rerror))
+      SetError(rerror);
+  }
+
+  void OnSettle(Isolate* isolate) override { binding_.Finish(isolate); }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    Local<Context> context = isolate->GetCurrentContext();
+    Local<Object> out = Object::New(isolate);
+    Local<Array> tasks =
+        Array::New(isolate, static_cast<int>(result_.tasks.size()));
+
+    for (size_t i = 0; i < result_.tasks.size(); ++i) {
+      const RinexTask& task = result_.tasks[i];
+      Local<Object> entry = Object::New(isolate);
+      SetNumber(isolate, entry, "set", static_cast<double>(task.set));
+      SetNumber(isolate, entry, "window", task.window);
+      SetNumber(isolate, entry, "windows", task.windows);
+      SetNumber(isolate, entry, "start", task.start);
+      SetNumber(isolate, entry, "end", task.end);
+      SetNumber(isolate, entry, "blocks", static_cast<double>(task.blocks));
+      SetNumber(isolate, entry, "epochs", static_cast<double>(task.epochs));
+      SetNumber(isolate, entry, "seconds", task.seconds);
+      SetNumber(isolate, entry, "epochsPerSecond",
+                Rate(task.epochs, task.seconds));
+      tasks->Set(context, static_cast<uint32_t>(i), entry).Check();
+    }
+
+    SetNumber(isolate, out, "workers", result_.workers);
+    SetNumber(isolate, out, "blocks", static_cast<double>(result_.blocks));
+    SetNumber(isolate, out, "epochs", static_cast<double>(result_.epochs));
+    SetNumber(isolate, out, "seconds", result_.seconds);
+    SetNumber(isolate, out, "mergeSeconds", result_.merge_seconds);
+    SetNumber(isolate, out, "epochsPerSecond",
+              Rate(result_.epochs, result_.seconds));
+    out->Set(context, Key(isolate, "tasks"), tasks).Check();
+    return out;
+  }
+
+ private:
+  std::vector<RinexSet> sets_;
+  RinexConversionOptions options_;
+  RinexConversionResult result_;
+  JobBinding binding_;
+};
+
+}
+
+void ConvertRinex(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  if (args.Length() < 1 || !args[0]->IsArray()) {
+    isolate->ThrowException(Exception::TypeError(Key(isolate,
+        "convertRinex(sets) expects an array of paths or path arrays")));
+    return;
+  }
+
+  std::vector<RinexSet> sets;
+  Local<Array> list = args[0].As<Array>();
+  for (uint32_t i = 0; i < list->Length(); ++i) {
+    Local<Value> entry = list->Get(context, i).ToLocalChecked();
+    RinexSet set;
+    if (entry->IsString()) {
+      set.files.push_back(*String::Utf8Value(isolate, entry));
+    } else if (entry->IsArray()) {
+      Local<Array> files = entry.As<Array>();
+      for (uint32_t j = 0; j < files->Length(); ++j)
+        set.files.push_back(*String::Utf8Value(
+            isolate, files->Get(context, j).ToLocalChecked()));
+    }
+    if (set.files.empty()) {
+      isolate->ThrowException(Exception::TypeError(Key(isolate,
+          "convertRinex: every set needs at least one file")));
+      return;
+    }
+    sets.push_back(std::move(set));
+  }
+
+  RinexConversionOptions options;
+  if (args.Length() > 1 && args[1]->IsObject()) {
+    Local<Object> object = args[1].As<Object>();
+    auto get = [&](const char* key) {
+      return object->Get(context, Key(isolate, key)).ToLocalChecked();
+    };
+
+    Local<Value> value = get("workers");
+    if (value->IsNumber())
+      options.workers = value->Uint32Value(context).FromJust();
+    value = get("window");
+    if (value->IsNumber()) {
+      options.window = value.As<Number>()->Value();
+      if (!std::isfinite(options.window)) {
+        isolate->ThrowException(Exception::TypeError(Key(isolate,
+            "convertRinex: window must be a finite number of seconds")));
+        return;
+      }
+    }
+    value = get("output");
+    if (value->IsString())
+      options.output = *String::Utf8Value(isolate, value);
+  }
+
+  ConvertRinexJob* job =
+      new ConvertRinexJob(isolate, std::move(sets), options, args[1]);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+}
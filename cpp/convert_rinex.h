@@ -0,0 +1,24 @@
+#ifndef CALCULATE_CONVERT_RINEX_H
+#define CALCULATE_CONVERT_RINEX_H
+
+#include <node.h>
+
+namespace calculate {
+
+// convertRinex(sets, { workers, window, output, onProgress, signal })
+//   -> Promise<{ workers, blocks, epochs, seconds, mergeSeconds,
+//                epochsPerSecond,
+//                tasks: [{ set, window, windows, start, end, blocks, epochs,
+//                          seconds, epochsPerSecond }] }>
+//
+// Converts RINEX observation / navigation files to one SBF file, see
+// RunRinexConversion(). `sets` is an array whose entries are a file path or
+// an array of paths that convert together. `window` is the time window
+// length in seconds long sets are split into, raised to at least 600 s and
+// to no more than 64 windows per set (0, the default, splits just enough to
+// keep every worker busy; -1 never splits; NaN or infinity throws).
+void ConvertRinex(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+}
+
+#endif
@@ -0,0 +1,247 @@
+#include "decode_meas_epoch.h"
+
+#include <string.h>
+
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "async_job.h"
+#include "job_binding.h"
+#include "meas_epoch.h"
+#include "sbf_stream.h"
+#include "v8_util.h"
+
+namespace calculate {
+
+using v8::Array;
+using v8::ArrayBuffer;
+using v8::BackingStore;
+using v8::Context;
+using v8::Exception;
+using v8::Float32Array;
+using v8::Float64Array;
+using v8::FunctionCallbackInfo;
+using v8::Isolate;
+using v8::Local;
+using v8::Object;
+using v8::String;
+using v8::Uint16Array;
+using v8::Uint32Array;
+using v8::Uint8Array;
+using v8::Value;
+
+namespace {
+
+void SetString(Isolate* isolate, Local<Object> target, const char* key,
+               const std::string& value) {
+  Set(isolate, target, key,
+      String::NewFromUtf8(isolate, value.c_str()).ToLocalChecked());
+}
+
+size_t Align8(size_t offset) { return (offset + 7) & ~static_cast<size_t>(7); }
+
+// where the columns of one signal start in the buffer, widest first
+struct SignalLayout {
+  int number;
+  uint32_t first;              // into the GroupBySignal order
+  uint32_t rows;
+  size_t pseudorange, doppler, carrier_phase, tow, cn0, wnc, lock_time, svid;
+};
+
+class DecodeMeasEpochJob : public AsyncJob {
+ public:
+  DecodeMeasEpochJob(Isolate* isolate, const std::string& path,
+                     MeasKernel kernel, Local<Value> binding)
+      : AsyncJob(isolate, "calculate:decodeMeasEpoch"), path_(path),
+        kernel_(kernel), binding_(isolate, binding),
+        allocator_(isolate->GetArrayBufferAllocator()) {}
+
+  ~DecodeMeasEpochJob() override {
+    if (data_ != NULL)
+      allocator_->Free(data_, length_);
+  }
+
+ protected:
+  void Execute() override {
+    JobControl* control = binding_.control();
+    ssn_error_t rerror = control->cancelled()
+        ? CancelledError()
+        : ReadMeasEpochFile(path_, &batch_, control);
+    if (IsOk(rerror) && !control->cancelled())
+      rerror = Pack();
+    if (control->cancelled())
+      SetCancelled();
+    else if (!IsOk(rerror))
+      SetError(rerror);
+  }
+
+  void OnSettle(Isolate* isolate) override { binding_.Finish(isolate); }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    Local<Context> context = isolate->GetCurrentContext();
+    std::unique_ptr<BackingStore> store = ArrayBuffer::NewBackingStore(
+        data_, length_, FreeBuffer, allocator_);
+    data_ = NULL;
+    Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, std::move(store));
+
+    Local<Array> signals = Array::New(isolate,
+                                      static_cast<int>(layouts_.size()));
+    for (size_t i = 0; i < layouts_.size(); ++i) {
+      const SignalLayout& l = layouts_[i];
+      Local<Object> signal = Object::New(isolate);
+      SetString(isolate, signal, "name", MeasSignalName(l.number));
+      SetNumber(isolate, signal, "number", l.number);
+      SetNumber(isolate, signal, "rows", l.rows);
+      Set(isolate, signal, "tow", Uint32Array::New(buffer, l.tow, l.rows));
+      Set(isolate, signal, "wnc", Uint16Array::New(buffer, l.wnc, l.rows));
+      Set(isolate, signal, "svid", Uint8Array::New(buffer, l.svid, l.rows));
+      Set(isolate, signal, "pseudorange",
+          Float64Array::New(buffer, l.pseudorange, l.rows));
+      Set(isolate, signal, "doppler",
+          Float64Array::New(buffer, l.doppler, l.rows));
+      Set(isolate, signal, "carrierPhase",
+          Float64Array::New(buffer, l.carrier_phase, l.rows));
+      Set(isolate, signal, "cn0", Float32Array::New(buffer, l.cn0, l.rows));
+      Set(isolate, signal, "lockTime",
+          Uint16Array::New(buffer, l.lock_time, l.rows));
+      signals->Set(context, static_cast<uint32_t>(i), signal).Check();
+    }
+
+    Local<Object> out = Object::New(isolate);
+    SetString(isolate, out, "kernel", MeasKernelName(used_));
+    SetNumber(isolate, out, "rows", static_cast<double>(batch_.size()));
+    SetNumber(isolate, out, "convertSeconds", convert_seconds_);
+    Set(isolate, out, "buffer", buffer);
+    Set(isolate, out, "signals", signals);
+    return out;
+  }
+
+ private:
+  // converts the batch and gathers it by signal into one allocation
+  ssn_error_t Pack() {
+    auto begin = std::chrono::steady_clock::now();
+    used_ = batch_.Convert(kernel_);
+    convert_seconds_ = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - begin).count();
+
+    std::vector<uint32_t> order, first;
+    GroupBySignal(batch_, &order, &first);
+
+    length_ = 0;
+    for (int s = 0; s < kMeasSignals; ++s) {
+      uint32_t rows = first[s + 1] - first[s];
+      if (rows == 0)
+        continue;
+      SignalLayout l;
+      l.number = s;
+      l.first = first[s];
+      l.rows = rows;
+      l.pseudorange = length_;
+      l.doppler = l.pseudorange + rows * sizeof(double);
+      l.carrier_phase = l.doppler + rows * sizeof(double);
+      l.tow = l.carrier_phase + rows * sizeof(double);
+      l.cn0 = l.tow + rows * sizeof(uint32_t);
+      l.wnc = l.cn0 + rows * sizeof(float);
+      l.lock_time = l.wnc + rows * sizeof(uint16_t);
+      l.svid = l.lock_time + rows * sizeof(uint16_t);
+      length_ = Align8(l.svid + rows);
+      layouts_.push_back(l);
+    }
+
+    data_ = allocator_->Allocate(length_);
+    if (data_ == NULL && length_ > 0)
+      return SSNERROR_CREATE(SSNERROR_SEVERITY_FAILURE, SSNERROR_MODULE_GENERAL,
+                             SSNERROR_SUBMODULE_GENERAL, SSNERROR_TYPE_GENERAL,
+                             SSNERROR_ERROR_OUTOFMEMORY);
+
+    const MeasEpochBatch& b = batch_;
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    uint8_t* base = static_cast<uint8_t*>(data_);
+    for (const SignalLayout& l : layouts_) {
+      double* range = reinterpret_cast<double*>(base + l.pseudorange);
+      double* doppler = reinterpret_cast<double*>(base + l.doppler);
+      double* phase = reinterpret_cast<double*>(base + l.carrier_phase);
+      uint32_t* tow = reinterpret_cast<uint32_t*>(base + l.tow);
+      float* cn0 = reinterpret_cast<float*>(base + l.cn0);
+      uint16_t* wnc = reinterpret_cast<uint16_t*>(base + l.wnc);
+      uint16_t* lock_time = reinterpret_cast<uint16_t*>(base + l.lock_time);
+      uint8_t* svid = base + l.svid;
+      for (uint32_t r = 0; r < l.rows; ++r) {
+        uint32_t i = order[l.first + r];
+        range[r] = b.pseudorange_valid[i] ? b.pseudorange[i] : nan;
+        doppler[r] = b.doppler_valid[i] ? b.doppler[i] : nan;
+        phase[r] = b.carrier_phase_valid[i] ? b.carrier_phase[i] : nan;
+        tow[r] = b.tow[i];
+        cn0[r] = b.cn0_valid[i] ? b.cn0[i]
+                                : std::numeric_limits<float>::quiet_NaN();
+        wnc[r] = b.wnc[i];
+        lock_time[r] = b.lock_time[i];
+        svid[r] = b.svid[i];
+      }
+    }
+    return SSNERROR_WARNING_OK;
+  }
+
+  static void FreeBuffer(void* data, size_t length, void* allocator) {
+    static_cast<ArrayBuffer::Allocator*>(allocator)->Free(data, length);
+  }
+
+  std::string path_;
+  MeasKernel kernel_;
+  MeasKernel used_ = kMeasKernelScalar;
+  JobBinding binding_;
+  ArrayBuffer::Allocator* allocator_;
+  MeasEpochBatch batch_;
+  std::vector<SignalLayout> layouts_;
+  double convert_seconds_ = 0;
+  void* data_ = NULL;
+  size_t length_ = 0;
+};
+
+bool ParseKernel(const std::string& name, MeasKernel* kernel) {
+  for (MeasKernel k : {kMeasKernelAuto, kMeasKernelScalar, kMeasKernelAvx2,
+                       kMeasKernelNeon}) {
+    if (name == MeasKernelName(k)) {
+      *kernel = k;
+      return true;
+    }
+  }
+  return false;
+}
+
+}
+
+void DecodeMeasEpoch(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  if (args.Length() < 1 || !args[0]->IsString()) {
+    isolate->ThrowException(Exception::TypeError(
+        Key(isolate, "decodeMeasEpoch(path) expects an SBF file path")));
+    return;
+  }
+
+  std::string path = *String::Utf8Value(isolate, args[0]);
+  MeasKernel kernel = kMeasKernelAuto;
+  if (args.Length() > 1 && args[1]->IsObject()) {
+    Local<Value> value = args[1].As<Object>()
+        ->Get(context, Key(isolate, "kernel")).ToLocalChecked();
+    if (!value->IsUndefined() &&
+        !(value->IsString() &&
+          ParseKernel(*String::Utf8Value(isolate, value), &kernel))) {
+      isolate->ThrowException(Exception::TypeError(Key(isolate,
+          "decodeMeasEpoch: kernel must be 'auto', 'scalar', 'avx2' or "
+          "'neon'")));
+      return;
+    }
+  }
+
+  DecodeMeasEpochJob* job = new DecodeMeasEpochJob(isolate, path, kernel,
+                                                   args[1]);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+}
@@ -0,0 +1,26 @@
+#ifndef CALCULATE_DECODE_MEAS_EPOCH_H
+#define CALCULATE_DECODE_MEAS_EPOCH_H
+
+#include <node.h>
+
+namespace calculate {
+
+// decodeMeasEpoch(path, { kernel, onProgress, signal })
+//   -> Promise<{ kernel, rows, convertSeconds, buffer,
+//                signals: [{ name, number, rows, tow, wnc, svid,
+//                            pseudorange, doppler, carrierPhase, cn0,
+//                            lockTime }] }>
+//
+// Every MeasEpoch signal of an SBF file decoded in SIMD batches (see
+// MeasEpochBatch) and grouped by signal in file order. `kernel` is 'auto'
+// (default), 'scalar', 'avx2' or 'neon'; one the CPU lacks runs as scalar
+// and the result names the kernel used. The per-signal columns are typed
+// array views into the single ArrayBuffer `buffer`: tow Uint32Array, wnc /
+// lockTime Uint16Array, svid Uint8Array, pseudorange (m) / doppler (Hz) /
+// carrierPhase (cycles) Float64Array and cn0 (dB-Hz) Float32Array, NaN
+// where the receiver flagged the value do-not-use.
+void DecodeMeasEpoch(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+}
+
+#endif
@@ -0,0 +1,363 @@
+#include "diff_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "ssnppengine.h"
+
+#include "engine_pool.h"
+#include "metrics.h"
+#include "sbf_stream.h"
+#include "temp_space.h"
+
+namespace calculate {
+
+namespace {
+
+enum Stage { kFetch, kMerge, kPVT, kWrite, kStages };
+
+// Hand-over between two stages. Push() blocks while `capacity` items wait,
+// which is what keeps a fast stage from running far ahead of a slow one.
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity)
+      : capacity_(std::max<size_t>(capacity, 1)) {}
+
+  void Push(T item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this]() { return items_.size() < capacity_; });
+    items_.push_back(std::move(item));
+    not_empty_.notify_one();
+  }
+
+  // false once the queue is closed and drained
+  bool Pop(T* item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this]() { return !items_.empty() || closed_; });
+    if (items_.empty())
+      return false;
+    *item = std::move(items_.front());
+    items_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+  }
+
+ private:
+  size_t capacity_;
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+  std::deque<T> items_;
+  bool closed_ = false;
+};
+
+// Handles of one file in flight; they travel with it from stage to stage.
+// Streams are closed as soon as no later stage needs them.
+struct DiffWork {
+  explicit DiffWork(size_t index) : index(index) {}
+
+  ~DiffWork() {
+    CloseReference();
+    CloseInput();
+    if (output_open)
+      SSNSBFStream_close(output);
+    if (sdk_open)
+      CloseSdk(sdk);
+  }
+
+  void CloseReference() {
+    if (reference_open)
+      SSNSBFStream_close(reference);
+    reference_open = false;
+  }
+
+  void CloseInput() {
+    if (input_open)
+      SSNSBFStream_close(input);
+    input_open = false;
+  }
+
+  size_t            index;
+  ssn_hsdk_t        sdk;
+  ssn_hsbfstream_t  input;
+  ssn_hsbfstream_t  reference;
+  ssn_hsbfstream_t  output;
+  bool              sdk_open = false;
+  bool              input_open = false;
+  bool              reference_open = false;
+  bool              output_open = false;
+};
+
+typedef std::unique_ptr<DiffWork> WorkPtr;
+
+ssn_error_t LoadFile(ssn_hsbfstream_t stream, const std::string& path,
+                     ssn_sbfstream_openoption_t option) {
+  // loadFile takes a non-const char*
+  std::vector<char> filename(path.begin(), path.end());
+  filename.push_back('\0');
+  StageTimer timer(kStageLoadFile);
+  ssn_error_t rerror =
+      timer.Done(SSNSBFStream_loadFile(stream, filename.data(), option));
+  uint32_t size;
+  if (IsOk(rerror) && IsOk(SSNSBFStream_getSize(stream, &size)))
+    CountBytesRead(size);
+  return rerror;
+}
+
+class Pipeline {
+ public:
+  Pipeline(std::vector<DiffTask>* tasks, const DiffPipelineOptions& options,
+           JobControl* control)
+      : tasks_(*tasks), options_(options), control_(control),
+        merge_queue_(options.queue_depth), pvt_queue_(options.queue_depth),
+        write_queue_(options.queue_depth) {}
+
+  void Run() {
+    std::thread fetch(&Pipeline::FetchStage, this);
+    std::thread merge(&Pipeline::MergeStage, this);
+    std::vector<std::thread> engines;
+    for (unsigned i = 0; i < std::max(options_.engines, 1u); ++i)
+      engines.emplace_back(&Pipeline::PVTStage, this);
+    std::thread write(&Pipeline::WriteStage, this);
+
+    fetch.join();
+    merge.join();
+    for (std::thread& engine : engines)
+      engine.join();
+    write_queue_.Close();
+    write.join();
+  }
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  static double Since(Clock::time_point begin) {
+    return std::chrono::duration<double>(Clock::now() - begin).count();
+  }
+
+  unsigned Part(size_t index, Stage stage) const {
+    return static_cast<unsigned>(index * kStages + stage);
+  }
+
+  // a stage only runs for files that got through the ones before it
+  bool Runnable(DiffTask& task) {
+    if (control_ != nullptr && control_->cancelled() && IsOk(task.error)) {
+      task.error = CancelledError();
+      task.failure = SdkFailure();
+      task.failure.error = task.error;
+      task.failure.cancelled = true;
+    }
+    return IsOk(task.error);
+  }
+
+  void Done(size_t index, Stage stage) {
+    if (control_ != nullptr)
+      control_->Report(Part(index, stage), 100.0f);
+  }
+
+  void FetchStage() {
+    for (size_t i = 0; i < tasks_.size(); ++i) {
+      DiffTask& task = tasks_[i];
+      if (Runnable(task)) {
+        BaseQuery query = options_.base;
+        query.sbf_file = task.rover;
+        query.has_position = false;
+        query.begin = query.end = 0.0;
+
+        auto begin = Clock::now();
+        BaseReference reference;
+        ErrorTrail trail;
+        task.error = BaseCache::Instance().Reference(query, &reference,
+                                                     control_,
+                                                     Part(i, kFetch));
+        task.failure = trail.Failure(task.error);
+        task.fetch_seconds = Since(begin);
+        task.reference = reference.path;
+        task.station = reference.station.name;
+        task.cached = reference.cached;
+      }
+      Done(i, kFetch);
+      merge_queue_.Push(WorkPtr(new DiffWork(i)));
+    }
+    merge_queue_.Close();
+  }
+
+  void MergeStage() {
+    WorkPtr work;
+    while (merge_queue_.Pop(&work)) {
+      DiffTask& task = tasks_[work->index];
+      if (Runnable(task)) {
+        auto begin = Clock::now();
+        ErrorTrail trail;
+        task.error = Merge(work.get(), task);
+        task.failure = trail.Failure(task.error);
+        task.merge_seconds = Since(begin);
+      }
+      Done(work->index, kMerge);
+      pvt_queue_.Push(std::move(work));
+    }
+    pvt_queue_.Close();
+  }
+
+  ssn_error_t Merge(DiffWork* work, const DiffTask& task) {
+    ssn_error_t rerror = OpenSdk(&work->sdk);
+    if (!IsOk(rerror))
+      return rerror;
+    work->sdk_open = true;
+
+    rerror = SSNSBFStream_open(work->sdk, &work->input);
+    if (!IsOk(rerror))
+      return rerror;
+    work->input_open = true;
+    rerror = SSNSBFStream_open(work->sdk, &work->reference);
+    if (!IsOk(rerror))
+      return rerror;
+    work->reference_open = true;
+
+    rerror = LoadFile(work->input, task.rover,
+                      SSNSBFSTREAM_OPENOPTION_READWRITE);
+    if (IsOk(rerror))
+      rerror = LoadFile(work->reference, task.reference,
+                        SSNSBFSTREAM_OPENOPTION_READONLY);
+    if (!IsOk(rerror))
+      return rerror;
+
+    unsigned part = Part(work->index, kMerge);
+    if (control_ != nullptr)
+      control_->AttachStream(work->input, part);
+    {
+      SpillMeter spill(kStageMerge, { work->sdk });
+      StageTimer timer(kStageMerge, "SSNSBFStream_insertReferenceStream");
+      rerror = timer.Done(SSNSBFStream_insertReferenceStream(
+          work->input, work->reference, options_.reference_id,
+          static_cast<ssn_sbfstream_rtcmversion_t>(options_.rtcm_version),
+          static_cast<ssn_sbfstream_rtcmmessage_t>(options_.messages),
+          static_cast<ssn_sbfstream_refoption_t>(options_.reference_options)));
+    }
+    if (control_ != nullptr)
+      control_->DetachStream(work->input);
+
+    // the corrections are in the rover stream now
+    work->CloseReference();
+    return rerror;
+  }
+
+  void PVTStage() {
+    WorkPtr work;
+    while (pvt_queue_.Pop(&work)) {
+      DiffTask& task = tasks_[work->index];
+      if (Runnable(task)) {
+        auto begin = Clock::now();
+        ErrorTrail trail;
+        task.error = Calculate(work.get());
+        task.failure = trail.Failure(task.error);
+        task.pvt_seconds = Since(begin);
+      }
+      Done(work->index, kPVT);
+      write_queue_.Push(std::move(work));
+    }
+  }
+
+  ssn_error_t Calculate(DiffWork* work) {
+    ssn_error_t rerror = SSNSBFStream_open(work->sdk, &work->output);
+    if (!IsOk(rerror))
+      return rerror;
+    work->output_open = true;
+
+    EngineLease engine;
+    rerror = EnginePool::Instance().Acquire(options_.profile, &engine);
+    if (!IsOk(rerror))
+      return rerror;
+    if (control_ != nullptr)
+      control_->AttachEngine(engine.engine(), Part(work->index, kPVT));
+
+    {
+      SpillMeter spill(kStageCalculatePvt, { work->sdk, engine.sdk() });
+      StageTimer timer(kStageCalculatePvt);
+      rerror = timer.Done(SSNPPEngine_calculatePVT(
+          engine.engine(), work->input,
+          static_cast<ssn_ppengine_options_t>(options_.engine_options), NULL,
+          work->output));
+    }
+
+    if (control_ != nullptr)
+      control_->DetachEngine(engine.engine());
+    if (IsOk(rerror))
+      engine.Recycle();
+    work->CloseInput();
+    return rerror;
+  }
+
+  void WriteStage() {
+    WorkPtr work;
+    while (write_queue_.Pop(&work)) {
+      DiffTask& task = tasks_[work->index];
+      if (Runnable(task)) {
+        auto begin = Clock::now();
+        std::vector<char> filename(task.output.begin(), task.output.end());
+        filename.push_back('\0');
+        if (control_ != nullptr)
+          control_->AttachStream(work->output, Part(work->index, kWrite));
+        ErrorTrail trail;
+        StageTimer timer(kStageWriteToFile);
+        task.error =
+            timer.Done(SSNSBFStream_writeToFile(work->output, filename.data()));
+        task.failure = trail.Failure(task.error);
+        if (control_ != nullptr)
+          control_->DetachStream(work->output);
+        task.write_seconds = Since(begin);
+      }
+      Done(work->index, kWrite);
+      // closes the file's handles on this thread, off the PVT stage
+      work.reset();
+    }
+  }
+
+  std::vector<DiffTask>& tasks_;
+  const DiffPipelineOptions& options_;
+  JobControl* control_;
+  BoundedQueue<WorkPtr> merge_queue_;
+  BoundedQueue<WorkPtr> pvt_queue_;
+  BoundedQueue<WorkPtr> write_queue_;
+};
+
+}
+
+ssn_error_t RunDiffPipeline(std::vector<DiffTask>* tasks,
+                            const DiffPipelineOptions& options,
+                            DiffPipelineResult* result,
+                            JobControl* control) {
+  *result = DiffPipelineResult();
+  if (control != nullptr)
+    control->SetParts(static_cast<unsigned>(tasks->size() * kStages));
+
+  auto begin = std::chrono::steady_clock::now();
+  Pipeline(tasks, options, control).Run();
+  result->seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - begin).count();
+
+  for (const DiffTask& task : *tasks) {
+    result->fetch_seconds += task.fetch_seconds;
+    result->merge_seconds += task.merge_seconds;
+    result->pvt_seconds += task.pvt_seconds;
+    result->write_seconds += task.write_seconds;
+  }
+
+  if (control != nullptr && control->cancelled())
+    return CancelledError();
+  return SSNERROR_WARNING_OK;
+}
+
+}
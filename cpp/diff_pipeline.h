@@ -0,0 +1,80 @@
+#ifndef CALCULATE_DIFF_PIPELINE_H
+#define CALCULATE_DIFF_PIPELINE_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "ssnsbfstream.h"
+
+#include "base_cache.h"
+#include "engine_pool.h"
+#include "job_control.h"
+#include "sdk_error.h"
+
+namespace calculate {
+
+struct DiffPipelineOptions {
+  // constellations, radius, manual station and blacklist of the base
+  // lookup; the site and window come from each rover file
+  BaseQuery base;
+  EngineProfilePtr profile;           // configuration of every engine
+  uint32_t engine_options = 0;        // ssn_ppengine_options_t flags
+  int32_t reference_id = 0;
+  uint32_t rtcm_version = SSNSBFSTREAM_RTCM_DEFAULT;
+  uint32_t messages = SSNSBFSTREAM_RTCMV3_MESSAGE_DEFAULT;
+  uint32_t reference_options = SSNSBFSTREAM_REFOPTION_DEFAULT;
+  unsigned engines = 1;               // concurrent calculatePVT runs
+  unsigned queue_depth = 1;           // files a stage may run ahead
+};
+
+// One rover file through the pipeline
+struct DiffTask {
+  std::string rover;
+  std::string output;                 // differential PVT result
+  std::string reference;              // reference SBF in the base cache
+  std::string station;
+  bool cached = false;                // reference data came from the cache
+  double fetch_seconds = 0.0;         // wall clock per stage
+  double merge_seconds = 0.0;
+  double pvt_seconds = 0.0;
+  double write_seconds = 0.0;
+  ssn_error_t error = SSNERROR_WARNING_OK;
+  SdkFailure failure;                 // `error` with its stage and warnings
+};
+
+struct DiffPipelineResult {
+  double seconds = 0.0;               // wall clock of the whole run
+  double fetch_seconds = 0.0;         // stage time summed over the files;
+  double merge_seconds = 0.0;         // with the stages overlapped their
+  double pvt_seconds = 0.0;           // sum exceeds `seconds`
+  double write_seconds = 0.0;
+};
+
+// Differential PVT of many rover files, with the steps of consecutive files
+// overlapped.
+//
+// Every file goes through four stages: the base data (BaseCache::Reference,
+// network bound), SSNSBFStream_insertReferenceStream after loading rover
+// and reference (disk and CPU), SSNPPEngine_calculatePVT (CPU) and
+// SSNSBFStream_writeToFile (disk). Each stage runs on its own thread, the
+// PVT stage on `engines` threads, and hands its files on through a queue
+// of `queue_depth`, so while file k is in calculatePVT the base data of
+// file k+1 downloads and merges and file k-1 is written. The bounded
+// queues keep at most a few files' streams in memory at once.
+//
+// Every file owns an SDK handle with its streams, which move from stage to
+// stage and are only used by one thread at a time; the PVT stage leases a
+// configured engine from the EnginePool for each file. A file that fails
+// keeps its error in `tasks` and does not stop the others. `control` gets
+// one progress part per file and stage, and cancels the SDK calls in
+// flight.
+ssn_error_t RunDiffPipeline(std::vector<DiffTask>* tasks,
+                            const DiffPipelineOptions& options,
+                            DiffPipelineResult* result,
+                            JobControl* control = nullptr);
+
+}
+
+#endif
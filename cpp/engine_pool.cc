@@ -0,0 +1,325 @@
+#include "engine_pool.h"
+
+#include <algorithm>
+
+#include "snmpclient.h"
+#include "snmptypes.h"
+
+#include "batch_analysis.h"
+#include "metrics.h"
+#include "sbf_stream.h"
+#include "sbf_util.h"
+
+namespace calculate {
+
+namespace {
+
+// at most 255 variable bindings fit one SNMP' message
+const size_t kMaxBindings = 255;
+
+const std::string& KeyOf(const EngineProfilePtr& profile) {
+  static const std::string kDefaults;
+  return profile ? profile->key() : kDefaults;
+}
+
+void AppendKey(const uint8_t* message, size_t size, std::string* key) {
+  key->push_back('\0');
+  key->append(reinterpret_cast<const char*>(message), size);
+}
+
+}
+
+bool EngineProfile::Compile(const EngineProfileSpec& spec,
+                            std::shared_ptr<const EngineProfile>* out,
+                            std::string* error) {
+  std::shared_ptr<EngineProfile> profile(new EngineProfile());
+  profile->commands_ = spec.commands;
+  for (const std::string& command : spec.commands) {
+    profile->key_ += command;
+    profile->key_.push_back('\n');
+  }
+
+  std::vector<uint8_t> message(SNMP_MAX_SIZE);
+  size_t used = 0;
+  size_t count = 0;
+  uint8_t request = 0;
+  auto flush = [&]() {
+    if (count == 0)
+      return;
+    profile->messages_.emplace_back(message.begin(), message.begin() + used);
+    AppendKey(message.data(), used, &profile->key_);
+    count = 0;
+  };
+
+  for (const SnmpBinding& binding : spec.bindings) {
+    if (binding.value.empty() || binding.value.size() > 255) {
+      *error = "SNMP binding values take 1 to 255 bytes";
+      return false;
+    }
+
+    size_t need = sizeof(snmpOID_t) + binding.value.size();
+    if (count == kMaxBindings || used + need > SNMP_MAX_SIZE)
+      flush();
+    if (count == 0) {
+      std::fill(message.begin(), message.end(), 0);
+      used = SNMP_initMessageHeader(snmpAuthUser, message.data());
+      used += SNMP_addPDUHeader(SNMP_SET, request++, message.data());
+    }
+
+    snmpOID_t oid = {};
+    oid.size = static_cast<uint8_t>(binding.value.size());
+    oid.appl = binding.appl;
+    oid.group = binding.group;
+    oid.command = binding.command;
+    oid.arg_tableEntry = binding.arg;
+    oid.ind_tableArg = binding.ind;
+    oid.tableInd = binding.table;
+    int32_t added = SNMP_addVarBindingSafe(&oid, binding.value.data(),
+                                           message.data(), message.size());
+    if (added <= 0) {
+      *error = "SNMP binding does not fit a message";
+      return false;
+    }
+    used += added;
+    ++count;
+    ++profile->bindings_;
+  }
+  flush();
+
+  *out = profile;
+  return true;
+}
+
+ssn_error_t EngineProfile::Apply(ssn_hppengine_t engine) const {
+  StageTimer timer(kStageConfigure);
+  ssn_error_t rerror = SSNERROR_WARNING_OK;
+
+  std::vector<char> reply(4096);
+  for (const std::string& command : commands_) {
+    size_t replySize = reply.size();
+    reply[0] = '\0';
+    rerror = SSNPPEngine_sendAsciiCommand(engine, command.c_str(),
+                                          &replySize, reply.data());
+    if (!IsOk(rerror))
+      return timer.Done(rerror);
+  }
+
+  // sendSnmpCommand takes a mutable buffer and the messages are shared
+  std::vector<uint8_t> scratch(SNMP_MAX_SIZE);
+  std::vector<uint8_t> result(SNMP_MAX_SIZE);
+  for (const std::vector<uint8_t>& message : messages_) {
+    std::copy(message.begin(), message.end(), scratch.begin());
+    rerror = SSNPPEngine_sendSnmpCommand(engine, scratch.data(),
+                                         result.data());
+    if (!IsOk(rerror))
+      return timer.Done(rerror);
+
+    snmpHeader_t header;
+    snmpPDUHeader_t pdu;
+    if (SNMP_getMessageHeader(result.data(), &header) < 0 ||
+        SNMP_getPDUHeader(result.data(), &pdu) < 0 ||
+        pdu.type != SNMP_RESP || pdu.errorStatus != SNMPERROR_NONE)
+      return timer.Done(GeneralError(SSNERROR_ERROR_INVALIDSNMPCMD));
+  }
+
+  return timer.Done(rerror);
+}
+
+size_t EngineProfile::bytes() const {
+  size_t total = 0;
+  for (const std::vector<uint8_t>& message : messages_)
+    total += message.size();
+  return total;
+}
+
+EngineLease::~EngineLease() {
+  if (open_)
+    EnginePool::Instance().Release(this, false);
+}
+
+void EngineLease::Recycle() {
+  if (open_)
+    EnginePool::Instance().Release(this, true);
+}
+
+void EngineLease::Close() {
+  SSNPPEngine_close(engine_);
+  CloseSdk(sdk_);
+  open_ = false;
+}
+
+EngineProfileRegistry& EngineProfileRegistry::Instance() {
+  static EngineProfileRegistry registry;
+  return registry;
+}
+
+void EngineProfileRegistry::Register(const std::string& name,
+                                     const EngineProfilePtr& profile) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  profiles_[name] = profile;
+}
+
+bool EngineProfileRegistry::Resolve(const std::string* name,
+                                    const std::vector<std::string>* commands,
+                                    EngineProfilePtr* profile,
+                                    std::string* error) {
+  if (name != nullptr) {
+    if (commands != nullptr) {
+      *error = "give either profile or commands";
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = profiles_.find(*name);
+    if (found == profiles_.end()) {
+      *error = "unknown engine profile '" + *name + "'";
+      return false;
+    }
+    *profile = found->second;
+    return true;
+  }
+
+  // ASCII commands alone always compile; the profile's key still lets
+  // jobs with the same commands share pooled engines
+  if (commands == nullptr || commands->empty())
+    return true;
+  EngineProfileSpec spec;
+  spec.commands = *commands;
+  return EngineProfile::Compile(spec, profile, error);
+}
+
+EnginePool& EnginePool::Instance() {
+  static EnginePool pool;
+  return pool;
+}
+
+EnginePool::EnginePool()
+    // one engine per shard plus the validation reference
+    : max_idle_(BatchAnalysis::DefaultConcurrency() + 1) {}
+
+ssn_error_t EnginePool::Acquire(const EngineProfilePtr& profile,
+                                EngineLease* lease) {
+  if (lease->open_)
+    Release(lease, false);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const std::string& key = KeyOf(profile);
+    for (auto it = idle_.begin(); it != idle_.end(); ++it) {
+      if (KeyOf(it->profile) != key)
+        continue;
+      lease->profile_ = it->profile;
+      lease->sdk_ = it->sdk;
+      lease->engine_ = it->engine;
+      lease->open_ = true;
+      lease->reused_ = true;
+      idle_.erase(it);
+      ++hits_;
+      return SSNERROR_WARNING_OK;
+    }
+    ++misses_;
+  }
+
+  ssn_hsdk_t sdk;
+  ssn_error_t rerror = OpenSdk(&sdk);
+  if (!IsOk(rerror))
+    return rerror;
+
+  ssn_hppengine_t engine;
+  {
+    StageTimer timer(kStageOpen, "SSNPPEngine_open");
+    rerror = timer.Done(SSNPPEngine_open(sdk, &engine));
+  }
+  if (!IsOk(rerror)) {
+    CloseSdk(sdk);
+    return rerror;
+  }
+
+  if (profile)
+    rerror = profile->Apply(engine);
+  if (!IsOk(rerror)) {
+    SSNPPEngine_close(engine);
+    CloseSdk(sdk);
+    return rerror;
+  }
+
+  lease->profile_ = profile;
+  lease->sdk_ = sdk;
+  lease->engine_ = engine;
+  lease->open_ = true;
+  lease->reused_ = false;
+  return rerror;
+}
+
+void EnginePool::Release(EngineLease* lease, bool recycle) {
+  if (recycle && SSNPPEngine_isEscaped(lease->engine_))
+    recycle = false;
+
+  std::vector<Idle> closing;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!recycle || max_idle_ == 0) {
+      ++discarded_;
+    } else {
+      idle_.push_front({ lease->profile_, lease->sdk_, lease->engine_ });
+      lease->profile_.reset();
+      lease->open_ = false;
+      ++recycled_;
+      EvictLocked(&closing);
+    }
+  }
+
+  if (lease->open_)
+    lease->Close();
+  lease->profile_.reset();
+  for (const Idle& idle : closing)
+    CloseIdle(idle);
+}
+
+void EnginePool::CloseIdle(const Idle& idle) {
+  SSNPPEngine_close(idle.engine);
+  CloseSdk(idle.sdk);
+}
+
+void EnginePool::EvictLocked(std::vector<Idle>* closing) {
+  while (idle_.size() > max_idle_) {
+    closing->push_back(idle_.back());
+    idle_.pop_back();
+    ++evictions_;
+  }
+}
+
+void EnginePool::SetMaxIdle(size_t max_idle) {
+  std::vector<Idle> closing;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_idle_ = max_idle;
+    EvictLocked(&closing);
+  }
+  for (const Idle& idle : closing)
+    CloseIdle(idle);
+}
+
+void EnginePool::Clear() {
+  std::list<Idle> closing;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closing.swap(idle_);
+  }
+  for (const Idle& idle : closing)
+    CloseIdle(idle);
+}
+
+EnginePool::Stats EnginePool::GetStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats;
+  stats.hits = hits_;
+  stats.misses = misses_;
+  stats.recycled = recycled_;
+  stats.discarded = discarded_;
+  stats.evictions = evictions_;
+  stats.idle = idle_.size();
+  stats.max_idle = max_idle_;
+  return stats;
+}
+
+}
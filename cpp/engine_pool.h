@@ -0,0 +1,191 @@
+#ifndef CALCULATE_ENGINE_POOL_H
+#define CALCULATE_ENGINE_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ssnppengine.h"
+
+namespace calculate {
+
+// One SNMP' set of an engine profile: the snmpOID_t fields and the payload,
+// 1 to 255 bytes in the receiver's native byte order
+struct SnmpBinding {
+  uint8_t appl = 0;
+  uint8_t group = 0;
+  uint8_t command = 0;
+  uint8_t arg = 0;                    // argument or table entry
+  uint8_t ind = 0;                    // 0 or table argument
+  uint8_t table = 0;                  // index in the table
+  std::vector<uint8_t> value;
+};
+
+struct EngineProfileSpec {
+  std::vector<std::string> commands;  // ASCII commands, sent first
+  std::vector<SnmpBinding> bindings;  // SNMP' sets, sent after them
+};
+
+// A receiver configuration compiled once for any number of engines.
+//
+// The bindings are encoded up front with SNMP_initMessageHeader /
+// SNMP_addPDUHeader / SNMP_addVarBinding into as few SET messages as fit
+// SNMP_MAX_SIZE and 255 bindings each, so Apply() is one
+// SSNPPEngine_sendSnmpCommand per message instead of one parse per
+// setting. ASCII commands are kept as they are for what has no OID at
+// hand. Profiles are immutable and shared between threads.
+class EngineProfile {
+ public:
+  // false with `error` set when a binding has no or a too long value
+  static bool Compile(const EngineProfileSpec& spec,
+                      std::shared_ptr<const EngineProfile>* out,
+                      std::string* error);
+
+  // Sends the profile to `engine`; a set the engine refused comes back as
+  // SSNERROR_ERROR_INVALIDSNMPCMD
+  ssn_error_t Apply(ssn_hppengine_t engine) const;
+
+  // identical for profiles with the same commands and bindings, which is
+  // what pooled engines are matched on
+  const std::string& key() const { return key_; }
+  size_t commands() const { return commands_.size(); }
+  size_t bindings() const { return bindings_; }
+  size_t messages() const { return messages_.size(); }
+  size_t bytes() const;
+
+ private:
+  EngineProfile() = default;
+
+  std::string key_;
+  std::vector<std::string> commands_;
+  std::vector<std::vector<uint8_t>> messages_;
+  size_t bindings_ = 0;
+};
+
+typedef std::shared_ptr<const EngineProfile> EngineProfilePtr;
+
+// Engine profiles by name, shared by every client of the process: the
+// addon's registerEngineProfile() and the daemon's registerProfile
+class EngineProfileRegistry {
+ public:
+  static EngineProfileRegistry& Instance();
+
+  // replaces any earlier profile of that name
+  void Register(const std::string& name, const EngineProfilePtr& profile);
+
+  // The engine configuration of a job: the profile registered as `name`,
+  // else `commands` compiled on the spot, else none. Null stands for an
+  // option the job left out. False with `error` set for an unknown name or
+  // both given.
+  bool Resolve(const std::string* name,
+               const std::vector<std::string>* commands,
+               EngineProfilePtr* profile, std::string* error);
+
+ private:
+  EngineProfileRegistry() = default;
+
+  std::mutex mutex_;
+  std::map<std::string, EngineProfilePtr> profiles_;
+};
+
+class EnginePool;
+
+// An engine on loan from the EnginePool, with the SDK handle it was opened
+// on. Like any handle set it is used by one thread at a time. It is closed
+// when the lease goes out of scope, unless Recycle() handed it back first.
+class EngineLease {
+ public:
+  EngineLease() = default;
+  ~EngineLease();
+
+  EngineLease(const EngineLease&) = delete;
+  void operator=(const EngineLease&) = delete;
+
+  bool open() const { return open_; }
+  ssn_hppengine_t engine() const { return engine_; }
+  ssn_hsdk_t sdk() const { return sdk_; }
+  // true when the engine came configured out of the pool
+  bool reused() const { return reused_; }
+
+  // Returns the engine to the pool for the next job with the same profile.
+  // Only for an engine whose last calculatePVT returned OK: an escaped or
+  // failed one is closed instead.
+  void Recycle();
+
+ private:
+  friend class EnginePool;
+
+  void Close();
+
+  EngineProfilePtr profile_;
+  ssn_hsdk_t sdk_;
+  ssn_hppengine_t engine_;
+  bool open_ = false;
+  bool reused_ = false;
+};
+
+// Process-wide pool of configured post-processing engines.
+//
+// Opening an engine and applying its profile costs more than a small file
+// takes to process. Acquire() hands out an idle engine configured with the
+// same profile when there is one and opens and configures a new one
+// otherwise; a recycled engine keeps its configuration, so later jobs skip
+// it entirely. At most max_idle engines wait in the pool, the least
+// recently used are closed first.
+class EnginePool {
+ public:
+  struct Stats {
+    uint64_t hits;                    // leases served configured
+    uint64_t misses;                  // engines opened and configured
+    uint64_t recycled;
+    uint64_t discarded;               // closed instead of recycled
+    uint64_t evictions;
+    uint64_t idle;
+    uint64_t max_idle;
+  };
+
+  static EnginePool& Instance();
+
+  // `profile` may be null for an engine on the SDK defaults. Safe to call
+  // from worker threads; opening and configuring run without the pool lock.
+  ssn_error_t Acquire(const EngineProfilePtr& profile, EngineLease* lease);
+
+  void SetMaxIdle(size_t max_idle);
+  void Clear();
+  Stats GetStats();
+
+ private:
+  friend class EngineLease;
+
+  struct Idle {
+    EngineProfilePtr profile;
+    ssn_hsdk_t sdk;
+    ssn_hppengine_t engine;
+  };
+
+  EnginePool();
+
+  void Release(EngineLease* lease, bool recycle);
+  static void CloseIdle(const Idle& idle);
+  // moves the idle engines over the budget into `closing`; mutex_ held
+  void EvictLocked(std::vector<Idle>* closing);
+
+  std::mutex mutex_;
+  std::list<Idle> idle_;              // most recently used first
+  size_t max_idle_;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t recycled_ = 0;
+  uint64_t discarded_ = 0;
+  uint64_t evictions_ = 0;
+};
+
+}
+
+#endif
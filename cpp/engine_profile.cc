@@ -0,0 +1,182 @@
+#include "engine_profile.h"
+
+#include <string>
+#include <vector>
+
+#include "v8_util.h"
+
+namespace calculate {
+
+using v8::Array;
+using v8::ArrayBufferView;
+using v8::Context;
+using v8::Exception;
+using v8::FunctionCallbackInfo;
+using v8::Isolate;
+using v8::Local;
+using v8::Object;
+using v8::String;
+using v8::Value;
+
+namespace {
+
+Local<String> Message(Isolate* isolate, const std::string& message) {
+  return String::NewFromUtf8(isolate, message.c_str()).ToLocalChecked();
+}
+
+Local<Value> Option(Isolate* isolate, Local<Object> options, const char* key) {
+  return options->Get(isolate->GetCurrentContext(), Key(isolate, key))
+      .ToLocalChecked();
+}
+
+uint8_t OptionByte(Isolate* isolate, Local<Object> options, const char* key) {
+  Local<Value> value = Option(isolate, options, key);
+  if (!value->IsNumber())
+    return 0;
+  return static_cast<uint8_t>(
+      value->Uint32Value(isolate->GetCurrentContext()).FromJust());
+}
+
+void ReadCommands(Isolate* isolate, Local<Value> value,
+                  std::vector<std::string>* commands) {
+  if (!value->IsArray())
+    return;
+  Local<Context> context = isolate->GetCurrentContext();
+  Local<Array> list = value.As<Array>();
+  for (uint32_t i = 0; i < list->Length(); ++i)
+    commands->push_back(*String::Utf8Value(
+        isolate, list->Get(context, i).ToLocalChecked()));
+}
+
+// false, with a TypeError thrown, for a binding that is no object
+bool ReadBindings(Isolate* isolate, Local<Value> value,
+                  std::vector<SnmpBinding>* bindings) {
+  if (!value->IsArray())
+    return true;
+  Local<Context> context = isolate->GetCurrentContext();
+  Local<Array> list = value.As<Array>();
+
+  for (uint32_t i = 0; i < list->Length(); ++i) {
+    Local<Value> entry = list->Get(context, i).ToLocalChecked();
+    if (!entry->IsObject()) {
+      isolate->ThrowException(Exception::TypeError(Key(isolate,
+          "registerEngineProfile: every binding must be an object")));
+      return false;
+    }
+
+    Local<Object> object = entry.As<Object>();
+    SnmpBinding binding;
+    binding.appl = OptionByte(isolate, object, "appl");
+    binding.group = OptionByte(isolate, object, "group");
+    binding.command = OptionByte(isolate, object, "command");
+    binding.arg = OptionByte(isolate, object, "arg");
+    binding.ind = OptionByte(isolate, object, "ind");
+    binding.table = OptionByte(isolate, object, "table");
+
+    Local<Value> bytes = Option(isolate, object, "value");
+    if (bytes->IsArrayBufferView()) {
+      Local<ArrayBufferView> view = bytes.As<ArrayBufferView>();
+      binding.value.resize(view->ByteLength());
+      view->CopyContents(binding.value.data(), binding.value.size());
+    } else if (bytes->IsArray()) {
+      Local<Array> array = bytes.As<Array>();
+      for (uint32_t k = 0; k < array->Length(); ++k)
+        binding.value.push_back(static_cast<uint8_t>(
+            array->Get(context, k).ToLocalChecked()
+                ->Uint32Value(context).FromMaybe(0)));
+    }
+    bindings->push_back(std::move(binding));
+  }
+  return true;
+}
+
+}
+
+bool ReadEngineProfile(Isolate* isolate, Local<Object> options,
+                       const char* caller, EngineProfilePtr* profile) {
+  Local<Value> name = Option(isolate, options, "profile");
+  Local<Value> commands = Option(isolate, options, "commands");
+
+  std::string key;
+  if (name->IsString())
+    key = *String::Utf8Value(isolate, name);
+  std::vector<std::string> list;
+  ReadCommands(isolate, commands, &list);
+
+  std::string error;
+  if (!EngineProfileRegistry::Instance().Resolve(
+          name->IsString() ? &key : nullptr,
+          commands->IsArray() ? &list : nullptr, profile, &error)) {
+    isolate->ThrowException(Exception::TypeError(Message(isolate,
+        std::string(caller) + ": " + error)));
+    return false;
+  }
+  return true;
+}
+
+void RegisterEngineProfile(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+
+  if (args.Length() < 2 || !args[0]->IsString() || !args[1]->IsObject()) {
+    isolate->ThrowException(Exception::TypeError(Key(isolate,
+        "registerEngineProfile: expected a name and a profile object")));
+    return;
+  }
+
+  Local<Object> object = args[1].As<Object>();
+  EngineProfileSpec spec;
+  ReadCommands(isolate, Option(isolate, object, "commands"), &spec.commands);
+  if (!ReadBindings(isolate, Option(isolate, object, "bindings"),
+                    &spec.bindings))
+    return;
+
+  EngineProfilePtr profile;
+  std::string error;
+  if (!EngineProfile::Compile(spec, &profile, &error)) {
+    isolate->ThrowException(Exception::RangeError(Message(isolate,
+        "registerEngineProfile: " + error)));
+    return;
+  }
+
+  EngineProfileRegistry::Instance().Register(
+      *String::Utf8Value(isolate, args[0]), profile);
+
+  Local<Object> out = Object::New(isolate);
+  SetNumber(isolate, out, "commands", static_cast<double>(profile->commands()));
+  SetNumber(isolate, out, "bindings", static_cast<double>(profile->bindings()));
+  SetNumber(isolate, out, "messages", static_cast<double>(profile->messages()));
+  SetNumber(isolate, out, "bytes", static_cast<double>(profile->bytes()));
+  args.GetReturnValue().Set(out);
+}
+
+void ConfigureEnginePool(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+
+  if (args.Length() > 0 && args[0]->IsObject()) {
+    Local<Value> maxIdle = Option(isolate, args[0].As<Object>(), "maxIdle");
+    if (maxIdle->IsNumber())
+      EnginePool::Instance().SetMaxIdle(static_cast<size_t>(
+          maxIdle->Uint32Value(isolate->GetCurrentContext()).FromJust()));
+  }
+}
+
+void ClearEnginePool(const FunctionCallbackInfo<Value>& args) {
+  EnginePool::Instance().Clear();
+}
+
+void GetEnginePoolStats(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  EnginePool::Stats stats = EnginePool::Instance().GetStats();
+
+  Local<Object> out = Object::New(isolate);
+  SetNumber(isolate, out, "hits", static_cast<double>(stats.hits));
+  SetNumber(isolate, out, "misses", static_cast<double>(stats.misses));
+  SetNumber(isolate, out, "recycled", static_cast<double>(stats.recycled));
+  SetNumber(isolate, out, "discarded", static_cast<double>(stats.discarded));
+  SetNumber(isolate, out, "evictions", static_cast<double>(stats.evictions));
+  SetNumber(isolate, out, "idle", static_cast<double>(stats.idle));
+  SetNumber(isolate, out, "maxIdle", static_cast<double>(stats.max_idle));
+  args.GetReturnValue().Set(out);
+}
+
+}
@@ -0,0 +1,46 @@
+#ifndef CALCULATE_ENGINE_PROFILE_H
+#define CALCULATE_ENGINE_PROFILE_H
+
+#include <node.h>
+
+#include "engine_pool.h"
+
+namespace calculate {
+
+// Engine profiles and the EnginePool. A profile is
+//
+//   { commands: ['setPVTMode, Static, , auto', ...],
+//     bindings: [{ appl, group, command, arg, ind, table, value }] }
+//
+// with the ASCII commands sent as they are and each binding an SNMP' set
+// of the OID appl.group.command.arg.ind.table to `value`, a Uint8Array (or
+// an array of bytes) of 1 to 255 bytes in the receiver's native byte order.
+
+// Reads the engine configuration of a job's options into `profile`: the
+// `profile` registered by name, else the `commands` array compiled on the
+// spot, else none. Throws a TypeError naming `caller` and returns false
+// for an unknown name, or both keys given.
+bool ReadEngineProfile(v8::Isolate* isolate, v8::Local<v8::Object> options,
+                       const char* caller, EngineProfilePtr* profile);
+
+// registerEngineProfile(name, profile)
+//   -> { commands, bindings, messages, bytes }
+//
+// Compiles `profile` once, replacing any earlier one of that name, for the
+// `profile` option of calculatePVTSharded and processDifferential.
+void RegisterEngineProfile(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+// configureEnginePool({ maxIdle }) sets how many configured engines wait
+// for the next job
+void ConfigureEnginePool(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+// clearEnginePool() closes the idle engines
+void ClearEnginePool(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+// getEnginePoolStats()
+//   -> { hits, misses, recycled, discarded, evictions, idle, maxIdle }
+void GetEnginePoolStats(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+}
+
+#endif
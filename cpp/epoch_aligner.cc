@@ -0,0 +1,214 @@
+#include "epoch_aligner.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+
+#include "sbfdef.h"
+
+#include "mapped_file.h"
+#include "sbf_scanner.h"
+#include "sbf_util.h"
+
+namespace calculate {
+
+namespace {
+
+// Most common spacing of the epoch times, then the steps of it missing in
+// between, as SSNSBFStream_getNextMissingEpoch() walks them
+void SummariseEpochs(const std::vector<uint64_t>& epochs, size_t max_missing,
+                     AlignedStream* stream) {
+  stream->epochs = epochs.size();
+  if (epochs.empty())
+    return;
+
+  stream->first_time = epochs.front() / 1000.0;
+  stream->last_time = epochs.back() / 1000.0;
+  if (epochs.size() < 2)
+    return;
+
+  std::map<uint64_t, uint64_t> spacings;
+  for (size_t i = 1; i < epochs.size(); ++i)
+    ++spacings[epochs[i] - epochs[i - 1]];
+
+  uint64_t interval = 0, best = 0;
+  for (const auto& spacing : spacings) {
+    if (spacing.second > best) {
+      best = spacing.second;
+      interval = spacing.first;
+    }
+  }
+  stream->interval = interval / 1000.0;
+
+  // spacings up to 1.5 x the interval are jitter, not a lost epoch
+  for (size_t i = 1; i < epochs.size(); ++i) {
+    if ((epochs[i] - epochs[i - 1]) * 2 <= interval * 3)
+      continue;
+    for (uint64_t time = epochs[i - 1] + interval;
+         time * 2 + interval < epochs[i] * 2; time += interval) {
+      ++stream->missing_count;
+      if (stream->missing.size() < max_missing)
+        stream->missing.push_back(time / 1000.0);
+    }
+  }
+}
+
+}
+
+struct EpochAligner::Cursor {
+  explicit Cursor(std::string path) : path(std::move(path)) {}
+
+  // Moves onto the epoch found last and looks for the one after it; false
+  // once there is none left
+  bool Advance(uint16_t epoch_number) {
+    if (!has_next)
+      return false;
+    time = next_time;
+    offset = next_offset;
+    has_next = FindEpoch(epoch_number);
+    bytes = static_cast<uint32_t>((has_next ? next_offset : end) - offset);
+    return true;
+  }
+
+  bool FindEpoch(uint16_t epoch_number) {
+    uint16_t length;
+    while (const uint8_t* block = walker->Next(&length)) {
+      size_t at = block - file.data();
+      end = at + length;
+      if (length < sizeof(TimeHeader_t))
+        continue;
+
+      TimeHeader_t header;
+      memcpy(&header, block, sizeof(header));
+      if (epoch_number != 0 &&
+          SBF_ID_TO_NUMBER(header.Header.ID) != epoch_number)
+        continue;
+      if (header.TOW == kTowDoNotUse || header.WNc == kWncDoNotUse)
+        continue;
+
+      uint64_t key = static_cast<uint64_t>(header.WNc) * 604800000ull +
+                     header.TOW;
+      if (!epochs.empty() && key <= epochs.back())
+        continue;
+      epochs.push_back(key);
+      next_time = key;
+      next_offset = at;
+      return true;
+    }
+    return false;
+  }
+
+  std::string path;
+  MappedFile file;
+  std::unique_ptr<SbfWalker> walker;
+  std::vector<uint64_t> epochs;  // ms since the GPS epoch
+
+  // current epoch
+  uint64_t time = 0;
+  size_t offset = 0;
+  uint32_t bytes = 0;
+
+  // the epoch block after it
+  bool has_next = false;
+  uint64_t next_time = 0;
+  size_t next_offset = 0;
+  size_t end = 0;                // of the last valid block walked
+};
+
+EpochAligner::EpochAligner(const AlignOptions& options) : options_(options) {}
+
+EpochAligner::~EpochAligner() = default;
+
+ssn_error_t EpochAligner::Open(const std::vector<std::string>& paths,
+                               size_t* failed) {
+  cursors_.clear();
+  heap_ = decltype(heap_)();
+  summary_.clear();
+  groups_ = common_ = 0;
+  finished_ = false;
+
+  for (size_t s = 0; s < paths.size(); ++s) {
+    std::unique_ptr<Cursor> cursor(new Cursor(paths[s]));
+    if (!cursor->file.Open(paths[s])) {
+      cursors_.clear();
+      heap_ = decltype(heap_)();
+      *failed = s;
+      return GeneralError(SSNERROR_ERROR_FILEOPEN);
+    }
+    cursor->walker.reset(
+        new SbfWalker(cursor->file.data(), cursor->file.size()));
+    cursor->has_next = cursor->FindEpoch(options_.epoch_number);
+    if (cursor->Advance(options_.epoch_number))
+      heap_.push(HeapEntry(cursor->time, s));
+    cursors_.push_back(std::move(cursor));
+  }
+
+  if (heap_.empty())
+    Finish();
+  return SSNERROR_WARNING_OK;
+}
+
+size_t EpochAligner::Next(size_t max_groups, double* times, uint32_t* present,
+                          double* offsets, uint32_t* bytes) {
+  size_t n = cursors_.size();
+  size_t count = 0;
+
+  while (count < max_groups && !heap_.empty()) {
+    uint64_t time = heap_.top().first;
+    double* group_offsets = offsets + count * n;
+    uint32_t* group_bytes = bytes + count * n;
+    std::fill(group_offsets, group_offsets + n, -1.0);
+    std::fill(group_bytes, group_bytes + n, 0u);
+
+    uint32_t streams = 0;
+    while (!heap_.empty() && heap_.top().first == time) {
+      size_t s = heap_.top().second;
+      heap_.pop();
+      Cursor* cursor = cursors_[s].get();
+      group_offsets[s] = static_cast<double>(cursor->offset);
+      group_bytes[s] = cursor->bytes;
+      ++streams;
+      if (cursor->Advance(options_.epoch_number))
+        heap_.push(HeapEntry(cursor->time, s));
+    }
+
+    times[count] = time / 1000.0;
+    present[count] = streams;
+    ++count;
+    ++groups_;
+    if (streams == n)
+      ++common_;
+  }
+
+  if (heap_.empty())
+    Finish();
+  return count;
+}
+
+float EpochAligner::progress() const {
+  uint64_t walked = 0, mapped = 0;
+  for (const std::unique_ptr<Cursor>& cursor : cursors_) {
+    walked += cursor->walker ? cursor->walker->position() : 0;
+    mapped += cursor->file.size();
+  }
+  return mapped > 0 ? static_cast<float>(walked * 100.0 / mapped) : 100.0f;
+}
+
+// the walkers stay until the aligner goes, so that progress() ends at 100
+void EpochAligner::Finish() {
+  if (finished_)
+    return;
+  finished_ = true;
+  summary_.resize(cursors_.size());
+  for (size_t s = 0; s < cursors_.size(); ++s) {
+    Cursor* cursor = cursors_[s].get();
+    AlignedStream* stream = &summary_[s];
+    stream->path = cursor->path;
+    stream->crc_errors = cursor->walker->crc_errors();
+    SummariseEpochs(cursor->epochs, options_.max_missing, stream);
+    std::vector<uint64_t>().swap(cursor->epochs);
+  }
+}
+
+}
@@ -0,0 +1,106 @@
+#ifndef CALCULATE_EPOCH_ALIGNER_H
+#define CALCULATE_EPOCH_ALIGNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ssnerror.h"
+
+namespace calculate {
+
+struct AlignOptions {
+  // block number whose time stamps define the epochs, as in ScanOptions;
+  // 0 uses every timed block
+  uint16_t epoch_number = 4027;  // MeasEpoch
+  size_t max_missing = 1000;     // missing epoch times kept per stream
+};
+
+// One stream once the aligner has run through it
+struct AlignedStream {
+  std::string path;
+  uint64_t epochs = 0;
+  double first_time = 0.0;       // GNSS seconds, 0 without epochs
+  double last_time = 0.0;
+  double interval = 0.0;         // most common epoch spacing, seconds
+  uint64_t missing_count = 0;    // epochs the interval expects but are not
+                                 // there, between first_time and last_time
+  std::vector<double> missing;   // first max_missing of them
+  uint64_t crc_errors = 0;
+};
+
+// k-way alignment of the epochs of several SBF files (rover and base,
+// antennas of one platform) in a single pass, without loading any of them
+// into the SDK.
+//
+// Every file is memory-mapped and walked in place with SbfWalker. Each
+// stream sits on its current epoch in a min-heap keyed on GNSS time; Next()
+// pops the earliest time together with every stream at that time into one
+// epoch group and moves those streams on, so N files cost one walk each
+// instead of the N - 1 passes of pairwise SSNSBFStream_merge() or
+// getNextCommonEpochSection().
+//
+// An epoch of a stream is its epoch block plus everything up to the next
+// one. Epoch blocks whose time does not increase stay part of the current
+// epoch. Missing epochs are those getNextMissingEpoch() reports: steps of
+// the most common spacing that no epoch fills.
+class EpochAligner {
+ public:
+  explicit EpochAligner(const AlignOptions& options);
+  ~EpochAligner();
+
+  EpochAligner(const EpochAligner&) = delete;
+  void operator=(const EpochAligner&) = delete;
+
+  // Maps the files (UTF-8 paths) and positions every stream on its first
+  // epoch. Returns SSNERROR_ERROR_FILEOPEN with `failed` set to the index of
+  // the first file that cannot be mapped.
+  ssn_error_t Open(const std::vector<std::string>& paths, size_t* failed);
+
+  size_t streams() const { return cursors_.size(); }
+
+  // Up to `max_groups` further epoch groups, in time order. Group g has
+  // times[g] in GNSS seconds, present[g] streams and, per stream s, the
+  // epoch's byte range of the file at offsets[g * streams() + s] and
+  // bytes[...]; offsets is -1 and bytes 0 where the stream lacks the epoch.
+  // Returns the groups written, 0 once every stream is exhausted, after
+  // which Summary() is complete.
+  size_t Next(size_t max_groups, double* times, uint32_t* present,
+              double* offsets, uint32_t* bytes);
+
+  bool done() const { return heap_.empty(); }
+
+  // bytes walked over bytes mapped, 0..100
+  float progress() const;
+
+  uint64_t groups() const { return groups_; }
+  uint64_t common() const { return common_; }  // groups with every stream
+
+  // per stream; epochs, interval and missing epochs once done()
+  const std::vector<AlignedStream>& Summary() const { return summary_; }
+
+ private:
+  struct Cursor;
+  typedef std::pair<uint64_t, size_t> HeapEntry;  // time in ms, stream
+
+  void Finish();
+
+  AlignOptions options_;
+  std::vector<std::unique_ptr<Cursor>> cursors_;
+  std::priority_queue<HeapEntry, std::vector<HeapEntry>,
+                      std::greater<HeapEntry>> heap_;
+  std::vector<AlignedStream> summary_;
+  uint64_t groups_ = 0;
+  uint64_t common_ = 0;
+  bool finished_ = false;
+};
+
+}
+
+#endif
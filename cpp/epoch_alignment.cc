@@ -0,0 +1,277 @@
+#include "epoch_alignment.h"
+
+#include <string>
+#include <vector>
+
+#include "async_job.h"
+#include "sbf_stream.h"
+#include "v8_util.h"
+
+namespace calculate {
+
+using v8::Array;
+using v8::ArrayBuffer;
+using v8::Boolean;
+using v8::Context;
+using v8::Exception;
+using v8::Float64Array;
+using v8::Function;
+using v8::FunctionCallbackInfo;
+using v8::FunctionTemplate;
+using v8::Isolate;
+using v8::Local;
+using v8::Number;
+using v8::Object;
+using v8::String;
+using v8::Uint32Array;
+using v8::Value;
+
+namespace {
+
+const uint32_t kDefaultBatchGroups = 1024;
+const uint32_t kMaxBatchGroups = 65536;
+const uint32_t kMaxStreams = 64;
+
+Local<String> Message(Isolate* isolate, const char* message) {
+  return String::NewFromUtf8(isolate, message).ToLocalChecked();
+}
+
+class AlignBatchJob : public AsyncJob {
+ public:
+  AlignBatchJob(Isolate* isolate,
+                const std::shared_ptr<EpochAlignment::State>& state)
+      : AsyncJob(isolate, "calculate:EpochAlignment.next"), state_(state) {
+    state_->busy = true;
+  }
+
+  // runs on the main thread once the promise has settled
+  ~AlignBatchJob() override { state_->busy = false; }
+
+ protected:
+  void Execute() override {
+    count_ = state_->aligner.Next(state_->max_groups, state_->times,
+                                  state_->present, state_->offsets,
+                                  state_->bytes);
+  }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    return Number::New(isolate, static_cast<double>(count_));
+  }
+
+ private:
+  std::shared_ptr<EpochAlignment::State> state_;
+  size_t count_ = 0;
+};
+
+uint32_t OptionUint32(Isolate* isolate, Local<Object> options, const char* key,
+                      uint32_t fallback) {
+  Local<Context> context = isolate->GetCurrentContext();
+  Local<Value> value = options->Get(context,
+      String::NewFromUtf8(isolate, key).ToLocalChecked()).ToLocalChecked();
+  return value->IsNumber() ? value->Uint32Value(context).FromJust() : fallback;
+}
+
+void DefineReadOnly(Isolate* isolate, Local<Object> target, const char* key,
+                    Local<Value> value) {
+  target->DefineOwnProperty(isolate->GetCurrentContext(),
+      String::NewFromUtf8(isolate, key).ToLocalChecked(), value,
+      v8::ReadOnly).Check();
+}
+
+Local<Object> StreamObject(Isolate* isolate, const AlignedStream& stream) {
+  Local<Context> context = isolate->GetCurrentContext();
+  Local<Object> obj = Object::New(isolate);
+  Set(isolate, obj, "path",
+      String::NewFromUtf8(isolate, stream.path.c_str()).ToLocalChecked());
+  Set(isolate, obj, "epochs",
+      Number::New(isolate, static_cast<double>(stream.epochs)));
+  Set(isolate, obj, "firstTime", Number::New(isolate, stream.first_time));
+  Set(isolate, obj, "lastTime", Number::New(isolate, stream.last_time));
+  Set(isolate, obj, "interval", Number::New(isolate, stream.interval));
+  Set(isolate, obj, "missingCount",
+      Number::New(isolate, static_cast<double>(stream.missing_count)));
+  Local<Array> missing = Array::New(isolate, stream.missing.size());
+  for (size_t i = 0; i < stream.missing.size(); ++i)
+    missing->Set(context, static_cast<uint32_t>(i),
+                 Number::New(isolate, stream.missing[i])).Check();
+  Set(isolate, obj, "missing", missing);
+  Set(isolate, obj, "crcErrors",
+      Number::New(isolate, static_cast<double>(stream.crc_errors)));
+  return obj;
+}
+
+}
+
+void EpochAlignment::Init(Local<Object> exports) {
+  Isolate* isolate = exports->GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(isolate, New);
+  tpl->SetClassName(
+      String::NewFromUtf8(isolate, "EpochAlignment").ToLocalChecked());
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "next", Next);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "summary", Summary);
+
+  Local<Function> constructor = tpl->GetFunction(context).ToLocalChecked();
+  exports->Set(context,
+               String::NewFromUtf8(isolate, "EpochAlignment").ToLocalChecked(),
+               constructor).Check();
+}
+
+// new EpochAlignment(paths, { epochNumber, batch, maxMissing })
+//
+//   paths        SBF files to align, 1..64
+//   epochNumber  block number defining the epochs, default 4027 (MeasEpoch);
+//                0 for every timed block
+//   batch        most epoch groups per next(), default 1024
+//   maxMissing   missing epoch times listed per stream, default 1000
+void EpochAlignment::New(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  if (!args.IsConstructCall()) {
+    isolate->ThrowException(Exception::TypeError(Message(isolate,
+        "EpochAlignment must be called with new")));
+    return;
+  }
+
+  if (args.Length() < 1 || !args[0]->IsArray()) {
+    isolate->ThrowException(Exception::TypeError(Message(isolate,
+        "EpochAlignment(paths, options) expects an array of paths")));
+    return;
+  }
+
+  Local<Array> list = args[0].As<Array>();
+  std::vector<std::string> paths;
+  for (uint32_t i = 0; i < list->Length(); ++i) {
+    Local<Value> path = list->Get(context, i).ToLocalChecked();
+    if (!path->IsString()) {
+      isolate->ThrowException(Exception::TypeError(Message(isolate,
+          "EpochAlignment: paths must be strings")));
+      return;
+    }
+    paths.push_back(*String::Utf8Value(isolate, path));
+  }
+
+  AlignOptions options;
+  uint32_t epoch_number = options.epoch_number;
+  uint32_t batch = kDefaultBatchGroups;
+  if (args.Length() > 1 && args[1]->IsObject()) {
+    Local<Object> object = args[1].As<Object>();
+    epoch_number = OptionUint32(isolate, object, "epochNumber", epoch_number);
+    batch = OptionUint32(isolate, object, "batch", batch);
+    options.max_missing = OptionUint32(
+        isolate, object, "maxMissing",
+        static_cast<uint32_t>(options.max_missing));
+  }
+
+  if (paths.empty() || paths.size() > kMaxStreams || epoch_number > 0x1fff ||
+      batch == 0 || batch > kMaxBatchGroups) {
+    isolate->ThrowException(Exception::RangeError(Message(isolate,
+        "EpochAlignment: paths must hold 1..64 files, epochNumber be "
+        "0..8191 and batch 1..65536")));
+    return;
+  }
+  options.epoch_number = static_cast<uint16_t>(epoch_number);
+
+  std::shared_ptr<State> state = std::make_shared<State>(options);
+  size_t failed = 0;
+  ssn_error_t rerror = state->aligner.Open(paths, &failed);
+  if (!IsOk(rerror)) {
+    SdkFailure failure;
+    failure.error = rerror;
+    std::string message = "EpochAlignment: cannot open " + paths[failed];
+    isolate->ThrowException(FailureError(isolate, message, failure));
+    return;
+  }
+
+  size_t n = paths.size();
+  size_t times_bytes = batch * sizeof(double);
+  size_t offsets_bytes = batch * n * sizeof(double);
+  size_t present_bytes = batch * sizeof(uint32_t);
+  size_t bytes_bytes = batch * n * sizeof(uint32_t);
+
+  Local<ArrayBuffer> buffer = ArrayBuffer::New(
+      isolate, times_bytes + offsets_bytes + present_bytes + bytes_bytes);
+  state->store = buffer->GetBackingStore();
+  uint8_t* data = static_cast<uint8_t*>(state->store->Data());
+  state->times = reinterpret_cast<double*>(data);
+  state->offsets = reinterpret_cast<double*>(data + times_bytes);
+  state->present =
+      reinterpret_cast<uint32_t*>(data + times_bytes + offsets_bytes);
+  state->bytes = reinterpret_cast<uint32_t*>(
+      data + times_bytes + offsets_bytes + present_bytes);
+  state->max_groups = batch;
+
+  EpochAlignment* alignment = new EpochAlignment();
+  alignment->state_ = state;
+  alignment->Wrap(args.This());
+
+  DefineReadOnly(isolate, args.This(), "streams",
+                 Number::New(isolate, static_cast<double>(n)));
+  DefineReadOnly(isolate, args.This(), "buffer", buffer);
+  DefineReadOnly(isolate, args.This(), "times",
+                 Float64Array::New(buffer, 0, batch));
+  DefineReadOnly(isolate, args.This(), "offsets",
+                 Float64Array::New(buffer, times_bytes, batch * n));
+  DefineReadOnly(isolate, args.This(), "present",
+                 Uint32Array::New(buffer, times_bytes + offsets_bytes, batch));
+  DefineReadOnly(isolate, args.This(), "bytes",
+                 Uint32Array::New(buffer,
+                                  times_bytes + offsets_bytes + present_bytes,
+                                  batch * n));
+  args.GetReturnValue().Set(args.This());
+}
+
+// next() -> Promise<number>, the epoch groups in the refilled views; 0 at
+// the end
+void EpochAlignment::Next(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  EpochAlignment* alignment =
+      ObjectWrap::Unwrap<EpochAlignment>(args.Holder());
+
+  if (alignment->state_->busy) {
+    isolate->ThrowException(Exception::Error(Message(isolate,
+        "EpochAlignment: next() is already pending")));
+    return;
+  }
+
+  AlignBatchJob* job = new AlignBatchJob(isolate, alignment->state_);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+// summary() -> { groups, common, done, progress, streams: [...] }; the
+// streams array is empty until done
+void EpochAlignment::Summary(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+  EpochAlignment* alignment =
+      ObjectWrap::Unwrap<EpochAlignment>(args.Holder());
+
+  if (alignment->state_->busy) {
+    isolate->ThrowException(Exception::Error(Message(isolate,
+        "EpochAlignment: cannot read the summary while next() is pending")));
+    return;
+  }
+
+  const EpochAligner& aligner = alignment->state_->aligner;
+  Local<Object> result = Object::New(isolate);
+  Set(isolate, result, "groups",
+      Number::New(isolate, static_cast<double>(aligner.groups())));
+  Set(isolate, result, "common",
+      Number::New(isolate, static_cast<double>(aligner.common())));
+  Set(isolate, result, "done", Boolean::New(isolate, aligner.done()));
+  Set(isolate, result, "progress", Number::New(isolate, aligner.progress()));
+
+  const std::vector<AlignedStream>& summary = aligner.Summary();
+  Local<Array> streams = Array::New(isolate, summary.size());
+  for (size_t s = 0; s < summary.size(); ++s)
+    streams->Set(context, static_cast<uint32_t>(s),
+                 StreamObject(isolate, summary[s])).Check();
+  Set(isolate, result, "streams", streams);
+  args.GetReturnValue().Set(result);
+}
+
+}
@@ -0,0 +1,60 @@
+#ifndef CALCULATE_EPOCH_ALIGNMENT_H
+#define CALCULATE_EPOCH_ALIGNMENT_H
+
+#include <node.h>
+#include <node_object_wrap.h>
+
+#include <memory>
+
+#include "epoch_aligner.h"
+
+namespace calculate {
+
+// JS-visible k-way epoch alignment of SBF files, see EpochAligner.
+//
+//   const al = new EpochAlignment([rover, base], { epochNumber: 4027 })
+//   for (let n = await al.next(); n > 0; n = await al.next()) {
+//     for (let g = 0; g < n; g++) {
+//       if (al.present[g] < al.streams) continue
+//       const roverAt = al.offsets[g * al.streams]      // bytes[...] long
+//     }
+//   }
+//   const { groups, common, streams } = al.summary()
+//
+// `times`, `present`, `offsets` and `bytes` are views over one ArrayBuffer
+// allocated with the object and refilled by every next(), as with
+// BlockIterator; they must not be read while a next() is pending.
+// summary() returns { groups, common, done, progress, streams }, the
+// streams { path, epochs, firstTime, lastTime, interval, missingCount,
+// missing, crcErrors } once next() has resolved 0.
+class EpochAlignment : public node::ObjectWrap {
+ public:
+  static void Init(v8::Local<v8::Object> exports);
+
+  // State shared with an in-flight batch job
+  struct State {
+    explicit State(const AlignOptions& options) : aligner(options) {}
+
+    EpochAligner aligner;
+    std::shared_ptr<v8::BackingStore> store;
+    double* times = nullptr;
+    double* offsets = nullptr;
+    uint32_t* present = nullptr;
+    uint32_t* bytes = nullptr;
+    uint32_t max_groups = 0;
+    bool busy = false;
+  };
+
+ private:
+  EpochAlignment() = default;
+
+  static void New(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Next(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Summary(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+  std::shared_ptr<State> state_;
+};
+
+}
+
+#endif
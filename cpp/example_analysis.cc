@@ -0,0 +1,103 @@
+#include "example_analysis.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "ssnsdk.h"
+#include "ssnsbfstream.h"
+#include "ssnsbfanalyze.h"
+
+#include "metrics.h"
+#include "pvt_analysis.h"
+#include "sbf_stream.h"
+#include "scratch_arena.h"
+
+namespace calculate {
+
+const char kExampleInputFile[] = "input_file.sbf";
+
+ssn_error_t AnalyzeExample(const char* path)
+{
+  ssn_hsdk_t        ssnsdkhandle;       // SSN SDK handle
+  ssn_hsbfstream_t  sbfstream;          // SBF stream handle
+  ssn_error_t       rerror;             // Assess the outcome of different functions (runtime)
+  ssn_error_t       cerror;             // Error occuring during the clean-up process
+
+  AnalysisOps                analysisOps;   // PVT error percentages only
+  PVTAnalysis                errorDistrib;  // PVT error percentages
+  size_t                     listSize;      // Size of list of tracked satellites
+  unsigned char*             buffer = NULL; // List of tracked satellites
+  std::vector<char>          inputFile(path, path + strlen(path) + 1);
+  ScratchScope               scratch;       // Owns buffer until the return
+
+  analysisOps.errors = true;
+
+  /* Create all handles */
+
+  rerror = OpenSdk(&ssnsdkhandle);
+  if (SSNERROR_GETCODE(rerror) != SSNERROR_WARNING_OK)
+    return rerror;
+
+  {
+    StageTimer timer(kStageOpen, "SSNSBFStream_open");
+    rerror = timer.Done(SSNSBFStream_open(ssnsdkhandle, &sbfstream));
+  }
+  if (SSNERROR_GETCODE(rerror) != SSNERROR_WARNING_OK)
+    goto clean_sdk;
+
+  /* The input SBF file is loaded */
+
+  {
+    StageTimer timer(kStageLoadFile);
+    rerror = timer.Done(SSNSBFStream_loadFile(sbfstream, inputFile.data(), SSNSBFSTREAM_OPENOPTION_READONLY));
+  }
+  if (SSNERROR_GETCODE(rerror) != SSNERROR_WARNING_OK)
+    goto clean_sbf;
+
+  /* Get error percentages */
+
+  rerror = AnalyzePVT(sbfstream, analysisOps, &errorDistrib);
+  if (SSNERROR_GETCODE(rerror) != SSNERROR_WARNING_OK)
+    goto clean_sbf;
+
+  /*
+   * Get list of tracked satelllites via double-call:
+   *   1) Get size
+   *   2) Get list
+   */
+
+  {
+    StageTimer timer(kStageAnalyze, "listTrackedSatellites");
+    rerror = timer.Done(SSNSBFAnalyze_listTrackedSatellites(sbfstream, 295766.0, &listSize, NULL));
+  }
+  if (SSNERROR_GETCODE(rerror) != SSNERROR_WARNING_OK)
+    goto clean_sbf;
+
+  if (listSize > 0)
+  {
+    buffer = (unsigned char*) scratch.arena().Allocate(listSize);
+    StageTimer timer(kStageAnalyze, "listTrackedSatellites");
+    rerror = timer.Done(SSNSBFAnalyze_listTrackedSatellites(sbfstream, 295766.0, &listSize, (ssn_tracked_satellites_t*) buffer));
+    if (SSNERROR_GETCODE(rerror) != SSNERROR_WARNING_OK)
+      goto clean_sbf;
+  }
+
+  /* Clean-up */
+
+clean_sbf:
+
+  cerror = SSNSBFStream_close(sbfstream);
+  if (SSNERROR_GETCODE(rerror) == SSNERROR_WARNING_OK)
+    rerror = cerror;
+
+clean_sdk:
+
+  cerror = CloseSdk(ssnsdkhandle);
+  if (SSNERROR_GETCODE(rerror) == SSNERROR_WARNING_OK)
+    rerror = cerror;
+
+  return rerror;
+}
+
+}
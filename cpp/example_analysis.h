@@ -0,0 +1,18 @@
+#ifndef CALCULATE_EXAMPLE_ANALYSIS_H
+#define CALCULATE_EXAMPLE_ANALYSIS_H
+
+#include "ssnerror.h"
+
+namespace calculate {
+
+// The file executeSync / executeAsync analyse when given none
+extern const char kExampleInputFile[];
+
+// ppsdk example: loads `path` on fresh handles, takes the PVT error
+// percentages and the satellites tracked at TOW 295766. Returns the first
+// error including those of the clean-up.
+ssn_error_t AnalyzeExample(const char* path = kExampleInputFile);
+
+}
+
+#endif
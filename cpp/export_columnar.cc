@@ -0,0 +1,140 @@
+#include "export_columnar.h"
+
+#include <filesystem>
+#include <string>
+
+#include "async_job.h"
+#include "columnar_export.h"
+#include "job_binding.h"
+#include "sbf_stream.h"
+#include "v8_util.h"
+
+namespace fs = std::filesystem;
+
+namespace calculate {
+
+using v8::Context;
+using v8::Exception;
+using v8::FunctionCallbackInfo;
+using v8::Isolate;
+using v8::Local;
+using v8::Number;
+using v8::Object;
+using v8::String;
+using v8::Value;
+
+namespace {
+
+void SetPath(Isolate* isolate, Local<Object> target, const char* key,
+             const std::string& value) {
+  if (value.empty())
+    Set(isolate, target, key, v8::Null(isolate));
+  else
+    Set(isolate, target, key,
+        String::NewFromUtf8(isolate, value.c_str()).ToLocalChecked());
+}
+
+std::string DefaultOutput(const std::string& input, const char* suffix) {
+  fs::path path = fs::u8path(input);
+  path.replace_filename(path.stem().u8string() + suffix);
+  return path.u8string();
+}
+
+// a path, false to skip, anything else for the default
+void ReadOutput(Isolate* isolate, Local<Object> options, const char* key,
+                std::string* out) {
+  Local<Value> value =
+      options->Get(isolate->GetCurrentContext(), Key(isolate, key))
+          .ToLocalChecked();
+  if (value->IsString())
+    *out = *String::Utf8Value(isolate, value);
+  else if (value->IsFalse())
+    out->clear();
+}
+
+class ExportColumnarJob : public AsyncJob {
+ public:
+  ExportColumnarJob(Isolate* isolate, const std::string& path,
+                    const ColumnarOptions& options, Local<Value> binding)
+      : AsyncJob(isolate, "calculate:exportColumnar"), path_(path),
+        options_(options), binding_(isolate, binding) {}
+
+ protected:
+  void Execute() override {
+    JobControl* control = binding_.control();
+    ssn_error_t rerror = control->cancelled()
+        ? CancelledError()
+        : ExportColumnarFile(path_, options_, &stats_, control);
+    if (control->cancelled())
+      SetCancelled();
+    else if (!IsOk(rerror))
+      SetError(rerror);
+  }
+
+  void OnSettle(Isolate* isolate) override { binding_.Finish(isolate); }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    Local<Object> out = Object::New(isolate);
+    SetPath(isolate, out, "pvt", options_.pvt_output);
+    SetPath(isolate, out, "meas", options_.meas_output);
+    SetNumber(isolate, out, "blocks", static_cast<double>(stats_.blocks));
+    SetNumber(isolate, out, "crcErrors",
+              static_cast<double>(stats_.crc_errors));
+    SetNumber(isolate, out, "pvtRows", static_cast<double>(stats_.pvt_rows));
+    SetNumber(isolate, out, "pvtBatches",
+              static_cast<double>(stats_.pvt_batches));
+    SetNumber(isolate, out, "measRows", static_cast<double>(stats_.meas_rows));
+    SetNumber(isolate, out, "measBatches",
+              static_cast<double>(stats_.meas_batches));
+    return out;
+  }
+
+ private:
+  std::string path_;
+  ColumnarOptions options_;
+  ColumnarStats stats_;
+  JobBinding binding_;
+};
+
+}
+
+void ExportColumnar(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  if (args.Length() < 1 || !args[0]->IsString()) {
+    isolate->ThrowException(Exception::TypeError(
+        Key(isolate, "exportColumnar(path) expects an SBF file path")));
+    return;
+  }
+
+  std::string path = *String::Utf8Value(isolate, args[0]);
+  ColumnarOptions options;
+  options.pvt_output = DefaultOutput(path, "_pvt.arrow");
+  options.meas_output = DefaultOutput(path, "_meas.arrow");
+
+  if (args.Length() > 1 && args[1]->IsObject()) {
+    Local<Object> object = args[1].As<Object>();
+    ReadOutput(isolate, object, "pvt", &options.pvt_output);
+    ReadOutput(isolate, object, "meas", &options.meas_output);
+    Local<Value> value =
+        object->Get(context, Key(isolate, "engineering")).ToLocalChecked();
+    if (value->IsBoolean())
+      options.engineering = value->IsTrue();
+    value = object->Get(context, Key(isolate, "batchRows")).ToLocalChecked();
+    if (value->IsNumber() && value.As<Number>()->Value() >= 1)
+      options.batch_rows = value->Uint32Value(context).FromJust();
+  }
+
+  if (options.pvt_output.empty() && options.meas_output.empty()) {
+    isolate->ThrowException(Exception::TypeError(Key(isolate,
+        "exportColumnar: pvt and meas are both disabled")));
+    return;
+  }
+
+  ExportColumnarJob* job = new ExportColumnarJob(isolate, path, options,
+                                                 args[1]);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+}
@@ -0,0 +1,22 @@
+#ifndef CALCULATE_EXPORT_COLUMNAR_H
+#define CALCULATE_EXPORT_COLUMNAR_H
+
+#include <node.h>
+
+namespace calculate {
+
+// exportColumnar(path, { pvt, meas, engineering, batchRows, onProgress,
+//                        signal })
+//   -> Promise<{ pvt, meas, blocks, crcErrors, pvtRows, pvtBatches,
+//                measRows, measBatches }>
+//
+// PVTGeodetic and MeasEpoch of an SBF file as Arrow IPC files, see
+// ExportColumnarFile(). `pvt` / `meas` are the output paths, default
+// <path>_pvt.arrow / <path>_meas.arrow next to the input, or false to skip
+// that table. `engineering` (default true) writes MeasEpoch in m / Hz /
+// cycles / dB-Hz instead of its sub-block fields.
+void ExportColumnar(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+}
+
+#endif
@@ -0,0 +1,178 @@
+#include "filter_sbf.h"
+
+#include <filesystem>
+#include <string>
+
+#include "async_job.h"
+#include "job_binding.h"
+#include "sbf_filter.h"
+#include "sbf_stream.h"
+#include "v8_util.h"
+
+namespace fs = std::filesystem;
+
+namespace calculate {
+
+using v8::Array;
+using v8::Boolean;
+using v8::Context;
+using v8::Exception;
+using v8::FunctionCallbackInfo;
+using v8::Isolate;
+using v8::Local;
+using v8::Number;
+using v8::Object;
+using v8::String;
+using v8::Value;
+
+namespace {
+
+std::string DefaultOutput(const std::string& input) {
+  fs::path path = fs::u8path(input);
+  path.replace_filename(path.stem().u8string() + "_filtered" +
+                        path.extension().u8string());
+  return path.u8string();
+}
+
+class FilterSbfJob : public AsyncJob {
+ public:
+  FilterSbfJob(Isolate* isolate, const std::string& path,
+               const FilterOptions& options, Local<Value> binding)
+      : AsyncJob(isolate, "calculate:filterSbf"), path_(path),
+        options_(options), binding_(isolate, binding) {}
+
+ protected:
+  void Execute() override {
+    JobControl* control = binding_.control();
+    ssn_error_t rerror = control->cancelled()
+        ? CancelledError()
+        : FilterSbfFile(path_, options_, &stats_, control);
+    if (control->cancelled())
+      SetCancelled();
+    else if (!IsOk(rerror))
+      SetError(rerror);
+  }
+
+  void OnSettle(Isolate* isolate) override { binding_.Finish(isolate); }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    Local<Object> out = Object::New(isolate);
+    Set(isolate, out, "output",
+        String::NewFromUtf8(isolate, options_.output.c_str())
+            .ToLocalChecked());
+    SetNumber(isolate, out, "blocksIn", static_cast<double>(stats_.blocks_in));
+    SetNumber(isolate, out, "blocksOut",
+              static_cast<double>(stats_.blocks_out));
+    SetNumber(isolate, out, "bytesIn", static_cast<double>(stats_.bytes_in));
+    SetNumber(isolate, out, "bytesOut", static_cast<double>(stats_.bytes_out));
+    SetNumber(isolate, out, "crcErrors",
+              static_cast<double>(stats_.crc_errors));
+    SetNumber(isolate, out, "rewritten", static_cast<double>(stats_.rewritten));
+    Set(isolate, out, "sdkCrop", Boolean::New(isolate, stats_.sdk_crop));
+    return out;
+  }
+
+ private:
+  std::string path_;
+  FilterOptions options_;
+  FilterStats stats_;
+  JobBinding binding_;
+};
+
+// Reads the filters of `object` into `options`; throws a TypeError and
+// returns false on a malformed one
+bool ReadFilterOptions(Isolate* isolate, Local<Object> object,
+                       FilterOptions* options) {
+  Local<Context> context = isolate->GetCurrentContext();
+  auto get = [&](const char* key) {
+    return object->Get(context, Key(isolate, key)).ToLocalChecked();
+  };
+  auto fail = [&](const char* message) {
+    isolate->ThrowException(Exception::TypeError(Key(isolate, message)));
+    return false;
+  };
+
+  Local<Value> value = get("output");
+  if (value->IsString())
+    options->output = *String::Utf8Value(isolate, value);
+  else if (!value->IsUndefined())
+    return fail("filterSbf: output must be a path");
+
+  value = get("start");
+  if (value->IsNumber())
+    options->start = value.As<Number>()->Value();
+  else if (!value->IsUndefined())
+    return fail("filterSbf: start must be a GNSS time in seconds");
+  value = get("end");
+  if (value->IsNumber())
+    options->end = value.As<Number>()->Value();
+  else if (!value->IsUndefined())
+    return fail("filterSbf: end must be a GNSS time in seconds");
+  if (!(options->start <= options->end))
+    return fail("filterSbf: start is after end");
+
+  value = get("constellations");
+  if (value->IsNumber())
+    options->constellations = value->Uint32Value(context).FromJust();
+  else if (!value->IsUndefined())
+    return fail("filterSbf: constellations must be a number");
+
+  value = get("blocks");
+  if (value->IsArray()) {
+    Local<Array> blocks = value.As<Array>();
+    for (uint32_t i = 0; i < blocks->Length(); ++i) {
+      Local<Value> id = blocks->Get(context, i).ToLocalChecked();
+      if (!id->IsNumber())
+        return fail("filterSbf: blocks must be an array of SBF IDs");
+      options->blocks.push_back(
+          static_cast<uint16_t>(id->Uint32Value(context).FromJust()));
+    }
+  } else if (!value->IsUndefined()) {
+    return fail("filterSbf: blocks must be an array of SBF IDs");
+  }
+
+  value = get("interval");
+  if (value->IsNumber() && value.As<Number>()->Value() >= 0)
+    options->interval = value->Uint32Value(context).FromJust();
+  else if (!value->IsUndefined())
+    return fail("filterSbf: interval must be a number of ms");
+
+  value = get("navigation");
+  if (value->IsString()) {
+    std::string navigation = *String::Utf8Value(isolate, value);
+    if (navigation != "window" && navigation != "applicable")
+      return fail("filterSbf: navigation must be 'window' or 'applicable'");
+    options->applicable_navigation = navigation == "applicable";
+  } else if (!value->IsUndefined()) {
+    return fail("filterSbf: navigation must be 'window' or 'applicable'");
+  }
+
+  value = get("discardInvalid");
+  if (value->IsBoolean())
+    options->discard_invalid = value->IsTrue();
+  return true;
+}
+
+}
+
+void FilterSbf(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+
+  if (args.Length() < 1 || !args[0]->IsString()) {
+    isolate->ThrowException(Exception::TypeError(
+        Key(isolate, "filterSbf(path) expects an SBF file path")));
+    return;
+  }
+
+  std::string path = *String::Utf8Value(isolate, args[0]);
+  FilterOptions options;
+  options.output = DefaultOutput(path);
+  if (args.Length() > 1 && args[1]->IsObject() &&
+      !ReadFilterOptions(isolate, args[1].As<Object>(), &options))
+    return;
+
+  FilterSbfJob* job = new FilterSbfJob(isolate, path, options, args[1]);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+}
@@ -0,0 +1,25 @@
+#ifndef CALCULATE_FILTER_SBF_H
+#define CALCULATE_FILTER_SBF_H
+
+#include <node.h>
+
+namespace calculate {
+
+// filterSbf(path, { output, start, end, constellations, blocks, interval,
+//                   navigation, discardInvalid, onProgress, signal })
+//   -> Promise<{ output, blocksIn, blocksOut, bytesIn, bytesOut, crcErrors,
+//                rewritten, sdkCrop }>
+//
+// Crop, constellation, block and decimation filters of an SBF file in one
+// pass, see FilterSbfFile(). `output` defaults to <path>_filtered.sbf next
+// to the input. start / end are GNSS seconds, constellations a bitwise-or
+// of the SSNBASEFINDER_* values as for the base finder, blocks an array of
+// SBF IDs (every revision of each passes) and interval the decimation step
+// in ms. navigation 'window' (default) crops navigation blocks by their own
+// time stamp like every other block; 'applicable' keeps the ones that apply
+// inside the window, which the SDK crops after the pass.
+void FilterSbf(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+}
+
+#endif
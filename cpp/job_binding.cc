@@ -0,0 +1,164 @@
+#include "job_binding.h"
+
+#include <uv.h>
+
+#include <atomic>
+
+#include "v8_util.h"
+
+namespace calculate {
+
+using v8::Context;
+using v8::External;
+using v8::Function;
+using v8::FunctionCallbackInfo;
+using v8::Global;
+using v8::HandleScope;
+using v8::Isolate;
+using v8::Local;
+using v8::MaybeLocal;
+using v8::Number;
+using v8::Object;
+using v8::Value;
+
+// Hands the latest progress value from the worker to onProgress through a
+// uv_async_t. Deletes itself once libuv has released the handle.
+class ProgressChannel : public node::AsyncResource {
+ public:
+  ProgressChannel(Isolate* isolate, Local<Function> callback)
+      : node::AsyncResource(isolate, Object::New(isolate),
+                            "calculate:progress"),
+        isolate_(isolate), callback_(isolate, callback),
+        context_(isolate, isolate->GetCurrentContext()) {
+    async_.data = this;
+    uv_async_init(node::GetCurrentEventLoop(isolate), &async_, OnAsync);
+  }
+
+  // any thread
+  void Post(float percent) {
+    percent_ = percent;
+    pending_ = true;
+    uv_async_send(&async_);
+  }
+
+  void Close() {
+    Deliver();
+    uv_close(reinterpret_cast<uv_handle_t*>(&async_), OnClosed);
+  }
+
+ private:
+  ~ProgressChannel() {
+    callback_.Reset();
+    context_.Reset();
+  }
+
+  static void OnAsync(uv_async_t* handle) {
+    static_cast<ProgressChannel*>(handle->data)->Deliver();
+  }
+
+  static void OnClosed(uv_handle_t* handle) {
+    delete static_cast<ProgressChannel*>(handle->data);
+  }
+
+  void Deliver() {
+    if (!pending_.exchange(false))
+      return;
+
+    HandleScope handle_scope(isolate_);
+    Context::Scope context_scope(context_.Get(isolate_));
+    Local<Value> argv[] = { Number::New(isolate_, percent_.load()) };
+    MakeCallback(callback_.Get(isolate_), 1, argv);
+  }
+
+  Isolate* isolate_;
+  uv_async_t async_;
+  Global<Function> callback_;
+  Global<Context> context_;
+  std::atomic<float> percent_{0.0f};
+  std::atomic<bool> pending_{false};
+};
+
+namespace {
+
+// calls target[method](...args) when it is a function
+void Invoke(Isolate* isolate, Local<Object> target, const char* method,
+            int argc, Local<Value> argv[]) {
+  Local<Context> context = isolate->GetCurrentContext();
+  Local<Value> fn;
+  if (target->Get(context, Key(isolate, method)).ToLocal(&fn) &&
+      fn->IsFunction()) {
+    MaybeLocal<Value> result =
+        fn.As<Function>()->Call(context, target, argc, argv);
+    (void)result;
+  }
+}
+
+}
+
+JobBinding::JobBinding(Isolate* isolate, Local<Value> options) {
+  Local<Context> context = isolate->GetCurrentContext();
+  Local<Value> on_progress = v8::Undefined(isolate);
+  Local<Value> signal = v8::Undefined(isolate);
+
+  if (options->IsObject()) {
+    Local<Object> object = options.As<Object>();
+    on_progress = object->Get(context, Key(isolate, "onProgress"))
+                      .ToLocalChecked();
+    signal = object->Get(context, Key(isolate, "signal")).ToLocalChecked();
+  }
+
+  JobControl::ProgressFn progress;
+  if (on_progress->IsFunction()) {
+    ProgressChannel* channel =
+        new ProgressChannel(isolate, on_progress.As<Function>());
+    channel_ = channel;
+    progress = [channel](float percent) { channel->Post(percent); };
+  }
+  control_.reset(new JobControl(progress));
+
+  if (signal->IsObject()) {
+    Local<Object> target = signal.As<Object>();
+    aborted_ = target->Get(context, Key(isolate, "aborted")).ToLocalChecked()
+                   ->BooleanValue(isolate);
+
+    // removed again in Finish(), so the raw pointer cannot outlive the job
+    Local<Function> listener =
+        Function::New(context, OnAbort, External::New(isolate, control_.get()))
+            .ToLocalChecked();
+    Local<Value> argv[] = { Key(isolate, "abort"), listener };
+    Invoke(isolate, target, "addEventListener", 2, argv);
+
+    signal_.Reset(isolate, target);
+    listener_.Reset(isolate, listener);
+  }
+
+  if (aborted_)
+    control_->Cancel();
+}
+
+JobBinding::~JobBinding() {
+  // Finish() normally ran already; this only covers the event loop side
+  if (channel_ != nullptr)
+    channel_->Close();
+}
+
+void JobBinding::Finish(Isolate* isolate) {
+  if (channel_ != nullptr) {
+    channel_->Close();
+    channel_ = nullptr;
+  }
+
+  if (!signal_.IsEmpty()) {
+    HandleScope handle_scope(isolate);
+    Local<Value> argv[] = { Key(isolate, "abort"), listener_.Get(isolate) };
+    Invoke(isolate, signal_.Get(isolate), "removeEventListener", 2, argv);
+    signal_.Reset();
+    listener_.Reset();
+  }
+}
+
+void JobBinding::OnAbort(const FunctionCallbackInfo<Value>& args) {
+  static_cast<JobControl*>(args.Data().As<External>()->Value())->Cancel();
+}
+
+}
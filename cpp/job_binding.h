@@ -0,0 +1,50 @@
+#ifndef CALCULATE_JOB_BINDING_H
+#define CALCULATE_JOB_BINDING_H
+
+#include <node.h>
+
+#include <memory>
+
+#include "job_control.h"
+
+namespace calculate {
+
+class ProgressChannel;
+
+// JS side of a JobControl, built from the job's `{ onProgress, signal }`
+// options.
+//
+// onProgress(percent) is called on the main thread, at most every
+// JobControl::kProgressInterval; updates in between are coalesced. An
+// AbortSignal `signal` cancels the job, after which the SDK stops at its
+// next escape check and the job rejects with "Job was cancelled".
+class JobBinding {
+ public:
+  JobBinding(v8::Isolate* isolate, v8::Local<v8::Value> options);
+  ~JobBinding();
+
+  JobBinding(const JobBinding&) = delete;
+  void operator=(const JobBinding&) = delete;
+
+  JobControl* control() { return control_.get(); }
+
+  // true when options.signal had already fired
+  bool aborted() const { return aborted_; }
+
+  // Delivers the last progress update, then detaches from the signal and
+  // the event loop. Call on the main thread once the work has stopped.
+  void Finish(v8::Isolate* isolate);
+
+ private:
+  static void OnAbort(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+  ProgressChannel* channel_ = nullptr;
+  std::unique_ptr<JobControl> control_;
+  v8::Global<v8::Object> signal_;
+  v8::Global<v8::Function> listener_;
+  bool aborted_ = false;
+};
+
+}
+
+#endif
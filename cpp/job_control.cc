@@ -0,0 +1,139 @@
+#include "job_control.h"
+
+#include <algorithm>
+
+namespace calculate {
+
+JobControl::JobControl(ProgressFn on_progress)
+    : on_progress_(std::move(on_progress)) {
+  SetParts(1);
+}
+
+void JobControl::SetParts(unsigned parts) {
+  parts_.clear();
+  for (unsigned i = 0; i < std::max(parts, 1u); ++i)
+    parts_.push_back(Part{this, i});
+  percent_.assign(parts_.size(), 0.0f);
+}
+
+void JobControl::AttachStream(ssn_hsbfstream_t sbfstream, unsigned part) {
+  SSNSBFStream_setEscapePointer(sbfstream, &escape_);
+  if (!on_progress_)
+    return;
+  SSNSBFStream_pcSetUserDataCallback(sbfstream, StreamProgress,
+                                     &parts_[part % parts_.size()]);
+  SSNSBFStream_pcSubscribe(sbfstream, SSNSBFSTREAM_PROGRESSCB_FLIST_ALL);
+}
+
+void JobControl::DetachStream(ssn_hsbfstream_t sbfstream) {
+  SSNSBFStream_setEscapePointer(sbfstream, NULL);
+  if (!on_progress_)
+    return;
+  SSNSBFStream_pcSubscribe(sbfstream, SSNSBFSTREAM_PROGRESSCB_FLIST_NONE);
+  SSNSBFStream_pcSetUserDataCallback(sbfstream, NULL, NULL);
+}
+
+void JobControl::AttachEngine(ssn_hppengine_t engine, unsigned part) {
+  SSNPPEngine_setEscapePointer(engine, &escape_);
+  if (!on_progress_)
+    return;
+  SSNPPEngine_pcSetUserDataCallback(engine, EngineProgress,
+                                    &parts_[part % parts_.size()]);
+  SSNPPEngine_pcSubscribe(engine, SSNPPENGINE_PROGRESSCB_FLIST_CALCULATEPVT);
+}
+
+void JobControl::DetachEngine(ssn_hppengine_t engine) {
+  SSNPPEngine_setEscapePointer(engine, NULL);
+  if (!on_progress_)
+    return;
+  SSNPPEngine_pcSubscribe(engine, SSNPPENGINE_PROGRESSCB_FLIST_NONE);
+  SSNPPEngine_pcSetUserDataCallback(engine, NULL, NULL);
+}
+
+void JobControl::AttachDecoder(ssn_hrnxdec_t decoder, unsigned part) {
+  SSNRNXDec_setEscapePointer(decoder, &escape_);
+  if (!on_progress_)
+    return;
+  SSNRNXDec_pcSetUserDataCallback(decoder, DecoderProgress,
+                                  &parts_[part % parts_.size()]);
+  SSNRNXDec_pcSubscribe(decoder, SSNRNXDEC_PROGRESSCB_FLIST_CREATESBF);
+}
+
+void JobControl::DetachDecoder(ssn_hrnxdec_t decoder) {
+  SSNRNXDec_setEscapePointer(decoder, NULL);
+  if (!on_progress_)
+    return;
+  SSNRNXDec_pcSubscribe(decoder, SSNRNXDEC_PROGRESSCB_FLIST_NONE);
+  SSNRNXDec_pcSetUserDataCallback(decoder, NULL, NULL);
+}
+
+void JobControl::AttachBaseFinder(ssn_hbasefinder_t basefinder,
+                                  unsigned part) {
+  SSNBaseFinder_setEscapePointer(basefinder, &escape_);
+  if (!on_progress_)
+    return;
+  SSNBaseFinder_pcSetUserDataCallback(basefinder, BaseFinderProgress,
+                                      &parts_[part % parts_.size()]);
+  SSNBaseFinder_pcSubscribe(basefinder, SSNBASEFINDER_PROGRESSCB_FLIST_ALL);
+}
+
+void JobControl::DetachBaseFinder(ssn_hbasefinder_t basefinder) {
+  SSNBaseFinder_setEscapePointer(basefinder, NULL);
+  if (!on_progress_)
+    return;
+  SSNBaseFinder_pcSubscribe(basefinder, SSNBASEFINDER_PROGRESSCB_FLIST_NONE);
+  SSNBaseFinder_pcSetUserDataCallback(basefinder, NULL, NULL);
+}
+
+void JobControl::Report(unsigned part, float percent) {
+  if (!on_progress_)
+    return;
+
+  float total = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    percent_[part % percent_.size()] = percent;
+    for (float value : percent_)
+      total += value;
+    total /= percent_.size();
+
+    auto now = std::chrono::steady_clock::now();
+    if (total < 100.0f && now - last_report_ < kProgressInterval)
+      return;
+    last_report_ = now;
+  }
+
+  on_progress_(total);
+}
+
+void JobControl::StreamProgress(ssn_sbfstream_progresscb_flist_t fitem,
+                                float percentage, void* userdata) {
+  Part* part = static_cast<Part*>(userdata);
+  part->control->Report(part->index, percentage);
+}
+
+void JobControl::EngineProgress(ssn_ppengine_progresscb_flist_t fitem,
+                                float percentage, void* userdata) {
+  Part* part = static_cast<Part*>(userdata);
+  part->control->Report(part->index, percentage);
+}
+
+void JobControl::DecoderProgress(ssn_rnxdec_progresscb_flist_t fitem,
+                                 float percentage, void* userdata) {
+  Part* part = static_cast<Part*>(userdata);
+  part->control->Report(part->index, percentage);
+}
+
+void JobControl::BaseFinderProgress(ssn_basefinder_progresscb_flist_t fitem,
+                                    float percentage, void* userdata) {
+  Part* part = static_cast<Part*>(userdata);
+  part->control->Report(part->index, percentage);
+}
+
+ssn_error_t CancelledError() {
+  return SSNERROR_CREATE(SSNERROR_SEVERITY_FAILURE, SSNERROR_MODULE_GENERAL,
+                         SSNERROR_SUBMODULE_GENERAL, SSNERROR_TYPE_GENERAL,
+                         SSNERROR_ERROR_UNEXPECTED);
+}
+
+}
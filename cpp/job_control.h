@@ -0,0 +1,86 @@
+#ifndef CALCULATE_JOB_CONTROL_H
+#define CALCULATE_JOB_CONTROL_H
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ssnbasefinder.h"
+#include "ssnppengine.h"
+#include "ssnrnxdec.h"
+#include "ssnsbfstream.h"
+
+namespace calculate {
+
+// Progress reporting and cancellation for one long-running job.
+//
+// Attach*() installs the SDK progress callback and escape pointer on a
+// handle; Detach*() must be called before the handle outlives the job.
+// A job may be split into parts (one per shard, say) whose percentages are
+// averaged. Progress is throttled to kProgressInterval before it reaches
+// the ProgressFn, which runs on whatever thread the SDK reports from.
+class JobControl {
+ public:
+  typedef std::function<void(float percent)> ProgressFn;
+
+  static constexpr std::chrono::milliseconds kProgressInterval{100};
+
+  explicit JobControl(ProgressFn on_progress = ProgressFn());
+
+  JobControl(const JobControl&) = delete;
+  void operator=(const JobControl&) = delete;
+
+  // Splits the job into `parts` averaged progress sources. Only valid before
+  // anything has been attached.
+  void SetParts(unsigned parts);
+
+  // Makes the SDK abort at its next escape check. Safe from any thread.
+  void Cancel() { escape_ = true; }
+  bool cancelled() const { return escape_; }
+
+  void AttachStream(ssn_hsbfstream_t sbfstream, unsigned part = 0);
+  void DetachStream(ssn_hsbfstream_t sbfstream);
+  void AttachEngine(ssn_hppengine_t engine, unsigned part = 0);
+  void DetachEngine(ssn_hppengine_t engine);
+  void AttachDecoder(ssn_hrnxdec_t decoder, unsigned part = 0);
+  void DetachDecoder(ssn_hrnxdec_t decoder);
+  void AttachBaseFinder(ssn_hbasefinder_t basefinder, unsigned part = 0);
+  void DetachBaseFinder(ssn_hbasefinder_t basefinder);
+
+  // Records `percent` for `part` and forwards the average when the last
+  // update is older than kProgressInterval, or the job is complete
+  void Report(unsigned part, float percent);
+
+ private:
+  struct Part {
+    JobControl* control;
+    unsigned index;
+  };
+
+  static void StreamProgress(ssn_sbfstream_progresscb_flist_t fitem,
+                             float percentage, void* userdata);
+  static void EngineProgress(ssn_ppengine_progresscb_flist_t fitem,
+                             float percentage, void* userdata);
+  static void DecoderProgress(ssn_rnxdec_progresscb_flist_t fitem,
+                              float percentage, void* userdata);
+  static void BaseFinderProgress(ssn_basefinder_progresscb_flist_t fitem,
+                                 float percentage, void* userdata);
+
+  ProgressFn on_progress_;
+  // polled by the SDK through setEscapePointer, which takes a plain bool*
+  bool escape_ = false;
+
+  std::vector<Part> parts_;
+  std::mutex mutex_;
+  std::vector<float> percent_;
+  std::chrono::steady_clock::time_point last_report_;
+};
+
+// What core code returns for work it dropped because the job was cancelled
+ssn_error_t CancelledError();
+
+}
+
+#endif
@@ -0,0 +1,232 @@
+#include "live_ingest.h"
+
+#include "sbfdef.h"
+
+#include "sbf_scanner.h"
+#include "sbf_util.h"
+
+namespace calculate {
+
+namespace {
+
+// bytes per read from the source
+const size_t kChunkBytes = 64 * 1024;
+
+// wait between reconnect attempts
+const int kReconnectPolls = 5;
+
+uint16_t Load16(const uint8_t* p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t Load32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+}
+
+LiveIngest::LiveIngest(const std::shared_ptr<SbfStream>& stream,
+                       std::unique_ptr<ByteSource> source,
+                       const LiveOptions& options, UpdateFn on_update)
+    : stream_(stream), source_(std::move(source)),
+      description_(source_->Describe()), options_(options),
+      on_update_(std::move(on_update)) {}
+
+LiveIngest::~LiveIngest() {
+  Stop();
+}
+
+void LiveIngest::Start() {
+  if (thread_.joinable())
+    return;
+  stop_ = false;
+  thread_ = std::thread(&LiveIngest::Run, this);
+}
+
+void LiveIngest::Stop() {
+  stop_ = true;
+  if (thread_.joinable())
+    thread_.join();
+}
+
+void LiveIngest::Run() {
+  std::vector<uint8_t> chunk(kChunkBytes);
+  std::vector<uint8_t> batch;
+
+  while (!stop_) {
+    SbfFramer framer;
+    std::string error;
+
+    if (!source_->Open(stop_, &error)) {
+      SetConnected(false, error);
+      Notify(true);
+      if (!options_.reconnect)
+        break;
+      Pause();
+      continue;
+    }
+
+    SetConnected(true, std::string());
+    Notify(true);
+
+    // the framer counts this connection only; the stats run over all of them
+    uint64_t crc_base;
+    uint64_t skipped_base;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      crc_base = stats_.crc_errors;
+      skipped_base = stats_.skipped_bytes;
+    }
+
+    while (!stop_) {
+      int received = source_->Read(chunk.data(), chunk.size(), &error);
+      if (received < 0)
+        break;
+      if (received == 0)
+        continue;
+
+      framer.Push(chunk.data(), static_cast<size_t>(received));
+
+      // a received chunk usually holds several blocks; they are appended
+      // with one SDK call
+      batch.clear();
+      uint16_t length;
+      while (const uint8_t* block = framer.Next(&length))
+        batch.insert(batch.end(), block, block + length);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.bytes += static_cast<uint64_t>(received);
+        stats_.crc_errors = crc_base + framer.crc_errors();
+        stats_.skipped_bytes = skipped_base + framer.skipped_bytes();
+      }
+
+      if (!batch.empty())
+        Append(batch);
+      Notify(false);
+    }
+
+    source_->Close();
+    SetConnected(false, error);
+    Notify(true);
+    if (!options_.reconnect)
+      break;
+    Pause();
+  }
+}
+
+void LiveIngest::Append(const std::vector<uint8_t>& batch) {
+  ssn_error_t rerror;
+  {
+    std::lock_guard<std::mutex> lock(stream_->mutex());
+    // appendManyBlocks takes a non-const pointer but only copies from it
+    rerror = SSNSBFStream_appendManyBlocks(
+        stream_->handle(), const_cast<uint8_t*>(batch.data()),
+        static_cast<int>(batch.size()));
+    if (IsOk(rerror))
+      stream_->CountBytes(batch.size());
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!IsOk(rerror)) {
+    stats_.error = DescribeError(rerror);
+    return;
+  }
+
+  for (size_t offset = 0; offset < batch.size();) {
+    uint16_t length = Load16(batch.data() + offset + 6);
+    Account(batch.data() + offset, length);
+    offset += length;
+  }
+}
+
+void LiveIngest::Account(const uint8_t* block, uint16_t length) {
+  uint16_t number = SBF_ID_TO_NUMBER(Load16(block + 4));
+  ++stats_.blocks;
+
+  if (length < sizeof(TimeHeader_t))
+    return;
+
+  if (number == options_.pvt_number)
+    pvt_.Add(block, length);
+
+  if (number != options_.epoch_number)
+    return;
+
+  uint32_t tow = Load32(block + 8);
+  uint16_t wnc = Load16(block + 12);
+  if (tow == kTowDoNotUse || wnc == kWncDoNotUse)
+    return;
+
+  uint64_t time = static_cast<uint64_t>(wnc) * 604800000ull + tow;
+  if (stats_.epochs == 0) {
+    first_epoch_ = time;
+  } else if (time > last_epoch_) {
+    ++spacings_[time - last_epoch_];
+  } else {
+    // blocks of one epoch share the time stamp; older ones are replays
+    return;
+  }
+  last_epoch_ = time;
+  ++stats_.epochs;
+}
+
+void LiveIngest::SetConnected(bool connected, const std::string& error) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (connected && !stats_.connected)
+    ++stats_.connects;
+  stats_.connected = connected;
+  if (!error.empty())
+    stats_.error = error;
+}
+
+void LiveIngest::Notify(bool force) {
+  if (!on_update_)
+    return;
+
+  auto now = std::chrono::steady_clock::now();
+  if (!force && now - last_notify_ < options_.update_interval)
+    return;
+  last_notify_ = now;
+  on_update_();
+}
+
+void LiveIngest::Pause() {
+  for (int i = 0; i < kReconnectPolls && !stop_; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(kByteSourcePollMs));
+}
+
+LiveStats LiveIngest::GetStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  LiveStats stats = stats_;
+
+  pvt_.Errors(&stats.errors);
+  pvt_.Modes(&stats.modes);
+
+  if (stats.epochs > 0) {
+    stats.first_time = first_epoch_ / 1000.0;
+    stats.last_time = last_epoch_ / 1000.0;
+  }
+
+  // the gaps are judged against the spacing seen most so far
+  uint64_t interval = 0, best = 0;
+  for (const auto& spacing : spacings_) {
+    if (spacing.second > best) {
+      best = spacing.second;
+      interval = spacing.first;
+    }
+  }
+  stats.interval = interval / 1000.0;
+  for (const auto& spacing : spacings_) {
+    if (spacing.first * 2 <= interval * 3)
+      continue;
+    stats.gap_count += spacing.second;
+    stats.gap_seconds += (spacing.first - interval) / 1000.0 * spacing.second;
+  }
+
+  return stats;
+}
+
+}
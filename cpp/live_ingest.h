@@ -0,0 +1,114 @@
+#ifndef CALCULATE_LIVE_INGEST_H
+#define CALCULATE_LIVE_INGEST_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ssnsbfanalyze.h"
+
+#include "byte_source.h"
+#include "pvt_stats.h"
+#include "sbf_stream.h"
+
+namespace calculate {
+
+struct LiveOptions {
+  // block number whose Mode / Error fields feed the PVT percentages
+  uint16_t pvt_number = 4007;    // PVTGeodetic
+  // block number whose time stamps define epochs for gap detection
+  uint16_t epoch_number = 4027;  // MeasEpoch
+  bool reconnect = true;
+  std::chrono::milliseconds update_interval{1000};
+};
+
+struct LiveStats {
+  bool connected = false;
+  uint64_t connects = 0;
+  uint64_t bytes = 0;
+  uint64_t blocks = 0;
+  uint64_t crc_errors = 0;            // over every connection
+  uint64_t skipped_bytes = 0;         // likewise
+  ssn_pvterror_percentages_t errors = {};
+  ssn_pvtmode_percentages_t modes = {};
+  uint64_t epochs = 0;
+  double first_time = 0.0;       // GNSS seconds
+  double last_time = 0.0;
+  double interval = 0.0;         // most common epoch spacing, seconds
+  uint64_t gap_count = 0;        // spacings over 1.5 x interval
+  double gap_seconds = 0.0;
+  std::string error;             // last connection or append error
+};
+
+// Reads SBF from a receiver on a dedicated I/O thread and appends it to a
+// stream made by SbfStream::Create().
+//
+// Bytes are framed with SbfFramer, so only complete CRC-checked blocks
+// reach SSNSBFStream_appendManyBlocks (which does no checking of its own),
+// one call per received chunk with the stream's mutex held. The PVT error
+// and mode percentages are a PvtTally over each new PVT block, instead of
+// re-running SSNSBFAnalyze_getPVT*Percentages over the whole stream on
+// every refresh.
+// Anything else (tracked satellites, ...) is a regular SDK query on the
+// stream.
+class LiveIngest {
+ public:
+  // I/O thread, after appended data, at most every update_interval, and on
+  // connection changes
+  typedef std::function<void()> UpdateFn;
+
+  LiveIngest(const std::shared_ptr<SbfStream>& stream,
+             std::unique_ptr<ByteSource> source, const LiveOptions& options,
+             UpdateFn on_update = UpdateFn());
+  ~LiveIngest();
+
+  LiveIngest(const LiveIngest&) = delete;
+  void operator=(const LiveIngest&) = delete;
+
+  void Start();
+  // Stops and joins the I/O thread, within about kByteSourcePollMs
+  void Stop();
+
+  LiveStats GetStats();
+  const std::string& source() const { return description_; }
+
+ private:
+  void Run();
+  // appends and accounts one batch of framed blocks
+  void Append(const std::vector<uint8_t>& batch);
+  void Account(const uint8_t* block, uint16_t length);
+  void SetConnected(bool connected, const std::string& error);
+  void Notify(bool force);
+  // sleeps between reconnects, waking up early on Stop()
+  void Pause();
+
+  std::shared_ptr<SbfStream> stream_;
+  std::unique_ptr<ByteSource> source_;
+  std::string description_;
+  LiveOptions options_;
+  UpdateFn on_update_;
+
+  std::thread thread_;
+  std::atomic<bool> stop_{false};
+  std::chrono::steady_clock::time_point last_notify_;
+
+  // everything below is guarded by mutex_
+  std::mutex mutex_;
+  LiveStats stats_;
+  PvtTally pvt_;
+  uint64_t first_epoch_ = 0;
+  uint64_t last_epoch_ = 0;
+  std::map<uint64_t, uint64_t> spacings_;
+};
+
+}
+
+#endif
@@ -0,0 +1,281 @@
+#include "live_receiver.h"
+
+#include <uv.h>
+
+#include <atomic>
+#include <string>
+
+#include "async_job.h"
+#include "byte_source.h"
+#include "sbf_session.h"
+#include "v8_util.h"
+
+namespace calculate {
+
+using v8::Boolean;
+using v8::Context;
+using v8::Exception;
+using v8::Function;
+using v8::FunctionCallbackInfo;
+using v8::FunctionTemplate;
+using v8::Global;
+using v8::HandleScope;
+using v8::Isolate;
+using v8::Local;
+using v8::Object;
+using v8::String;
+using v8::Undefined;
+using v8::Value;
+
+namespace {
+
+Local<Value> Option(Isolate* isolate, Local<Object> options, const char* key) {
+  return options->Get(isolate->GetCurrentContext(), Key(isolate, key))
+      .ToLocalChecked();
+}
+
+uint32_t OptionUint32(Isolate* isolate, Local<Object> options, const char* key,
+                      uint32_t fallback) {
+  Local<Value> value = Option(isolate, options, key);
+  if (!value->IsNumber())
+    return fallback;
+  return value->Uint32Value(isolate->GetCurrentContext()).FromJust();
+}
+
+Local<Object> StatsObject(Isolate* isolate, const LiveIngest& ingest,
+                          const LiveStats& stats) {
+  Local<Object> out = Object::New(isolate);
+  Set(isolate, out, "source",
+      String::NewFromUtf8(isolate, ingest.source().c_str()).ToLocalChecked());
+  Set(isolate, out, "connected", Boolean::New(isolate, stats.connected));
+  SetNumber(isolate, out, "connects", static_cast<double>(stats.connects));
+  SetNumber(isolate, out, "bytes", static_cast<double>(stats.bytes));
+  SetNumber(isolate, out, "blocks", static_cast<double>(stats.blocks));
+  SetNumber(isolate, out, "crcErrors", static_cast<double>(stats.crc_errors));
+  SetNumber(isolate, out, "skippedBytes",
+            static_cast<double>(stats.skipped_bytes));
+  Set(isolate, out, "pvtErrors", PVTErrorObject(isolate, stats.errors));
+  Set(isolate, out, "pvtModes", PVTModeObject(isolate, stats.modes));
+  SetNumber(isolate, out, "epochs", static_cast<double>(stats.epochs));
+  SetNumber(isolate, out, "firstTime", stats.first_time);
+  SetNumber(isolate, out, "lastTime", stats.last_time);
+  SetNumber(isolate, out, "interval", stats.interval);
+  SetNumber(isolate, out, "gapCount", static_cast<double>(stats.gap_count));
+  SetNumber(isolate, out, "gapSeconds", stats.gap_seconds);
+  if (!stats.error.empty())
+    Set(isolate, out, "error",
+        String::NewFromUtf8(isolate, stats.error.c_str()).ToLocalChecked());
+  return out;
+}
+
+}
+
+// Wakes the main thread from the I/O thread and calls onUpdate(stats)
+// through a uv_async_t, like ProgressChannel does for job progress. Deletes
+// itself once libuv has released the handle.
+class UpdateChannel : public node::AsyncResource {
+ public:
+  UpdateChannel(Isolate* isolate, Local<Function> callback)
+      : node::AsyncResource(isolate, Object::New(isolate), "calculate:live"),
+        isolate_(isolate), callback_(isolate, callback),
+        context_(isolate, isolate->GetCurrentContext()) {
+    async_.data = this;
+    uv_async_init(node::GetCurrentEventLoop(isolate), &async_, OnAsync);
+  }
+
+  void set_ingest(LiveIngest* ingest) { ingest_ = ingest; }
+
+  // any thread
+  void Post() {
+    pending_ = true;
+    uv_async_send(&async_);
+  }
+
+  // after the I/O thread has stopped; `flush` delivers a pending update
+  // first, which must not happen from a GC finalizer
+  void Close(bool flush) {
+    if (flush)
+      Deliver();
+    uv_close(reinterpret_cast<uv_handle_t*>(&async_), OnClosed);
+  }
+
+ private:
+  ~UpdateChannel() {
+    callback_.Reset();
+    context_.Reset();
+  }
+
+  static void OnAsync(uv_async_t* handle) {
+    static_cast<UpdateChannel*>(handle->data)->Deliver();
+  }
+
+  static void OnClosed(uv_handle_t* handle) {
+    delete static_cast<UpdateChannel*>(handle->data);
+  }
+
+  void Deliver() {
+    if (!pending_.exchange(false) || ingest_ == nullptr)
+      return;
+
+    HandleScope handle_scope(isolate_);
+    Context::Scope context_scope(context_.Get(isolate_));
+    Local<Value> argv[] = {
+      StatsObject(isolate_, *ingest_, ingest_->GetStats())
+    };
+    MakeCallback(callback_.Get(isolate_), 1, argv);
+  }
+
+  Isolate* isolate_;
+  uv_async_t async_;
+  Global<Function> callback_;
+  Global<Context> context_;
+  LiveIngest* ingest_ = nullptr;
+  std::atomic<bool> pending_{false};
+};
+
+LiveReceiver::~LiveReceiver() {
+  Shutdown(false);
+}
+
+void LiveReceiver::Init(Local<Object> exports) {
+  Isolate* isolate = exports->GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(isolate, New);
+  tpl->SetClassName(Key(isolate, "LiveReceiver"));
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "stats", Stats);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "stop", Stop);
+
+  Local<Function> constructor = tpl->GetFunction(context).ToLocalChecked();
+  exports->Set(context, Key(isolate, "LiveReceiver"), constructor).Check();
+}
+
+// new LiveReceiver(source, { pvtId, epochId, reconnect, interval, onUpdate })
+//
+//   source     { host, port } or { serial, baud } (baud defaults to 115200)
+//   pvtId      block number for the PVT percentages, default 4007
+//   epochId    block number for epochs and gaps, default 4027
+//   reconnect  retry after a failed or lost connection, default true
+//   interval   least ms between two onUpdate calls, default 1000
+void LiveReceiver::New(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  if (!args.IsConstructCall()) {
+    isolate->ThrowException(Exception::TypeError(
+        Key(isolate, "LiveReceiver must be called with new")));
+    return;
+  }
+
+  if (args.Length() < 1 || !args[0]->IsObject()) {
+    isolate->ThrowException(Exception::TypeError(Key(isolate,
+        "LiveReceiver expects { host, port } or { serial, baud }")));
+    return;
+  }
+
+  Local<Object> source = args[0].As<Object>();
+  Local<Value> host = Option(isolate, source, "host");
+  Local<Value> serial = Option(isolate, source, "serial");
+  std::unique_ptr<ByteSource> input;
+
+  if (host->IsString()) {
+    uint32_t port = OptionUint32(isolate, source, "port", 0);
+    if (port == 0 || port > 65535) {
+      isolate->ThrowException(Exception::RangeError(
+          Key(isolate, "LiveReceiver: port must be 1..65535")));
+      return;
+    }
+    String::Utf8Value name(isolate, host);
+    input = NewTcpSource(*name, static_cast<uint16_t>(port));
+  } else if (serial->IsString()) {
+    String::Utf8Value name(isolate, serial);
+    input = NewSerialSource(*name,
+                            OptionUint32(isolate, source, "baud", 115200));
+  } else {
+    isolate->ThrowException(Exception::TypeError(Key(isolate,
+        "LiveReceiver expects { host, port } or { serial, baud }")));
+    return;
+  }
+
+  LiveOptions options;
+  Local<Value> on_update = Undefined(isolate);
+  if (args.Length() > 1 && args[1]->IsObject()) {
+    Local<Object> object = args[1].As<Object>();
+    options.pvt_number = static_cast<uint16_t>(
+        OptionUint32(isolate, object, "pvtId", options.pvt_number));
+    options.epoch_number = static_cast<uint16_t>(
+        OptionUint32(isolate, object, "epochId", options.epoch_number));
+    Local<Value> reconnect = Option(isolate, object, "reconnect");
+    if (reconnect->IsBoolean())
+      options.reconnect = reconnect->BooleanValue(isolate);
+    options.update_interval = std::chrono::milliseconds(OptionUint32(
+        isolate, object, "interval",
+        static_cast<uint32_t>(options.update_interval.count())));
+    on_update = Option(isolate, object, "onUpdate");
+  }
+
+  std::shared_ptr<SbfStream> stream;
+  ErrorTrail trail;
+  ssn_error_t rerror = SbfStream::Create(input->Describe(), &stream);
+  if (!IsOk(rerror)) {
+    isolate->ThrowException(FailureError(isolate, DescribeError(rerror),
+                                         trail.Failure(rerror)));
+    return;
+  }
+
+  LiveReceiver* receiver = new LiveReceiver();
+  LiveIngest::UpdateFn update;
+  if (on_update->IsFunction()) {
+    UpdateChannel* channel =
+        new UpdateChannel(isolate, on_update.As<Function>());
+    receiver->channel_ = channel;
+    update = [channel]() { channel->Post(); };
+  }
+  receiver->ingest_.reset(
+      new LiveIngest(stream, std::move(input), options, update));
+  if (receiver->channel_ != nullptr)
+    receiver->channel_->set_ingest(receiver->ingest_.get());
+
+  receiver->Wrap(args.This());
+  args.This()->DefineOwnProperty(context, Key(isolate, "session"),
+      SbfSession::NewInstance(isolate, stream), v8::ReadOnly).Check();
+
+  receiver->ingest_->Start();
+  receiver->running_ = true;
+  receiver->Ref();
+  args.GetReturnValue().Set(args.This());
+}
+
+// stats() -> the same object onUpdate receives
+void LiveReceiver::Stats(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  LiveReceiver* receiver = ObjectWrap::Unwrap<LiveReceiver>(args.Holder());
+  args.GetReturnValue().Set(StatsObject(isolate, *receiver->ingest_,
+                                        receiver->ingest_->GetStats()));
+}
+
+// stop() closes the connection; `session` keeps the data received so far
+void LiveReceiver::Stop(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  LiveReceiver* receiver = ObjectWrap::Unwrap<LiveReceiver>(args.Holder());
+
+  if (receiver->running_) {
+    receiver->Shutdown(true);
+    receiver->running_ = false;
+    receiver->Unref();
+  }
+  args.GetReturnValue().Set(Undefined(isolate));
+}
+
+void LiveReceiver::Shutdown(bool flush) {
+  if (ingest_)
+    ingest_->Stop();
+  if (channel_ != nullptr) {
+    channel_->Close(flush);
+    channel_ = nullptr;
+  }
+}
+
+}
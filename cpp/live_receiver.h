@@ -0,0 +1,53 @@
+#ifndef CALCULATE_LIVE_RECEIVER_H
+#define CALCULATE_LIVE_RECEIVER_H
+
+#include <node.h>
+#include <node_object_wrap.h>
+
+#include <memory>
+
+#include "live_ingest.h"
+
+namespace calculate {
+
+class UpdateChannel;
+
+// JS-visible live receiver connection.
+//
+//   const receiver = new LiveReceiver({ host: '192.168.3.1', port: 28784 },
+//                                     { onUpdate: (stats) => ... })
+//   await receiver.session.listTrackedSatellites(295766.0)
+//   receiver.stats()
+//   receiver.stop()
+//
+// The source is `{ host, port }` for a TCP port of the receiver or
+// `{ serial, baud }` for a serial port. Blocks are read and appended on a
+// dedicated I/O thread (see LiveIngest); `session` is an SbfSession over the
+// growing stream, so every session query works on the data received so far.
+// onUpdate(stats) is called on the main thread at most every `interval` ms
+// and on connection changes. The receiver keeps itself and the event loop
+// alive until stop().
+class LiveReceiver : public node::ObjectWrap {
+ public:
+  static void Init(v8::Local<v8::Object> exports);
+
+ private:
+  LiveReceiver() = default;
+  ~LiveReceiver();
+
+  static void New(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Stats(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Stop(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+  // Joins the I/O thread and, with `flush`, delivers the last update;
+  // idempotent
+  void Shutdown(bool flush);
+
+  std::unique_ptr<LiveIngest> ingest_;
+  UpdateChannel* channel_ = nullptr;
+  bool running_ = false;
+};
+
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef CALCULATE_MAPPED_FILE_H
+#define CALCULATE_MAPPED_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace calculate {
+
+// Read-only memory mapping of a whole file: CreateFileMapping on Windows,
+// mmap elsewhere. An empty file maps to data() == nullptr, size() == 0.
+class MappedFile {
+ public:
+  MappedFile() = default;
+  ~MappedFile() { Close(); }
+
+  MappedFile(const MappedFile&) = delete;
+  void operator=(const MappedFile&) = delete;
+
+  // Maps `path` (UTF-8). Returns false and leaves the object closed when the
+  // file cannot be opened or mapped.
+  bool Open(const std::string& path);
+  void Close();
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool is_open() const { return open_; }
+
+ private:
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  bool open_ = false;
+#ifdef _WIN32
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#endif
+};
+
+}
+
+#endif
@@ -0,0 +1,688 @@
+#include "meas_epoch.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <array>
+#include <limits>
+
+#include "sbfdef.h"
+#include "sbfsigtypes.h"
+
+#include "job_control.h"
+#include "mapped_file.h"
+#include "sbf_scanner.h"
+#include "sbf_stream.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#define CALCULATE_MEAS_AVX2 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// MSVC compiles AVX2 intrinsics without /arch:AVX2
+#define CALCULATE_TARGET_AVX2
+#else
+#define CALCULATE_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CALCULATE_MEAS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace calculate {
+
+namespace {
+
+// bytes between two cancellation checks / progress reports
+const size_t kReadReportBytes = 16 * 1024 * 1024;
+
+const double kSpeedOfLight = 299792458.0;
+
+// SignalType_t of sbfsigtypes.h without the SIG_ prefix
+const char* const kSignalNames[SIG_LAST] = {
+  "GPSL1CA", "GPSL1P",  "GPSL2P",  "GPSL2C",  "GPSL5",   "GPSL1C",
+  "QZSL1CA", "QZSL2C",  "GLOL1CA", "GLOL1P",  "GLOL2P",  "GLOL2CA",
+  "GLOL3",   "BDSB1C",  "BDSB2a",  "IRNL5",   "GALE1A",  "GALE1BC",
+  "GALE6A",  "GALE6BC", "GALE5a",  "GALE5b",  "GALE5",   "MSS",
+  "SBSL1CA", "SBSL5",   "QZSL5",   "QZSL6",   "BDSB1I",  "BDSB2I",
+  "BDSB3",   "UNUSED",  "QZSL1C",  "QZSL1S",
+};
+
+// carrier frequency in MHz; 0 where it is not fixed by the signal number
+const double kSignalMHz[SIG_LAST] = {
+  1575.42,  1575.42, 1227.60, 1227.60, 1176.45, 1575.42,
+  1575.42,  1227.60, 0.0,     0.0,     0.0,     0.0,
+  1202.025, 1575.42, 1176.45, 1176.45, 1575.42, 1575.42,
+  1278.75,  1278.75, 1176.45, 1207.14, 1191.795, 0.0,
+  1575.42,  1176.45, 1176.45, 1278.75, 1561.098, 1207.14,
+  1268.52,  0.0,     1575.42, 1575.42,
+};
+
+// signal number from the Type field; 31 extends it through ObsInfo
+int SignalNumber(uint8_t type, uint8_t obs_info) {
+  int low = type & 0x1f;
+  return low == 31 ? 32 + ((obs_info >> 3) & 0x1f) : low;
+}
+
+// Hz, 0 when unknown. GLONASS FDMA carries its frequency number + 8 in
+// ObsInfo bits 3..7.
+double CarrierFrequency(int signal, uint8_t obs_info) {
+  int k = ((obs_info >> 3) & 0x1f) - 8;
+  switch (signal) {
+    case SIG_GLOL1CA:
+    case SIG_GLOL1P:
+      return (1602.0 + k * 0.5625) * 1e6;
+    case SIG_GLOL2P:
+    case SIG_GLOL2CA:
+      return (1246.0 + k * 0.4375) * 1e6;
+    default:
+      return signal < SIG_LAST ? kSignalMHz[signal] * 1e6 : 0.0;
+  }
+}
+
+// C/N0 is stored in 0.25 dB-Hz steps above 10 dB-Hz, except for the GPS
+// P(Y) signals
+float Cn0Bias(int signal) {
+  return signal == SIG_GPSL1P || signal == SIG_GPSL2P ? 0.0f : 10.0f;
+}
+
+// The decoding of rows [begin, end), written so that the SIMD kernels can
+// reproduce it operation for operation: code and offsets are summed as
+// exact integers in double before the one rounding multiply.
+//
+//   code      (Misc & 0x0f) << 32 | CodeLSB, mm; plus for Type2 the 3-bit
+//             signed OffsetsMSB << 16 | CodeOffsetLSB
+//   Doppler   Type1 Doppler * scale + the 5-bit signed upper OffsetsMSB
+//             << 16 | DopplerOffsetLSB, 0.0001 Hz
+//   carrier   code / wavelength + CarrierMSB << 16 | CarrierLSB, 0.001
+//             cycles
+//   C/N0      0.25 dB-Hz steps above the bias
+//
+// Do-not-use: a zero Type1 code, INT32_MIN Doppler, and the most negative
+// MSB with a zero LSB for the offsets and the carrier; C/N0 255.
+void ConvertScalar(MeasEpochBatch* b, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    int32_t offsets = b->offsets_msb[i];
+    int32_t code_msb = ((offsets & 0x07) ^ 0x04) - 0x04;
+    int32_t doppler_msb = ((offsets >> 3) ^ 0x10) - 0x10;
+    int32_t code_offset = code_msb * 65536 + b->code_offset_lsb[i];
+    int32_t doppler_offset = doppler_msb * 65536 + b->doppler_offset_lsb[i];
+    int32_t carrier = b->carrier_msb[i] * 65536 + b->carrier_lsb[i];
+    int32_t misc = b->misc[i] & 0x0f;
+
+    double mm = misc * 4294967296.0 + static_cast<double>(b->code_lsb[i]) +
+                code_offset;
+    double range = mm * 0.001;
+    b->pseudorange[i] = range;
+    uint8_t code_valid = static_cast<uint8_t>(
+        (misc | b->code_lsb[i]) != 0 &&
+        !(code_msb == -4 && b->code_offset_lsb[i] == 0));
+    b->pseudorange_valid[i] = code_valid;
+
+    b->doppler[i] = (b->doppler_raw[i] * b->doppler_scale[i] +
+                     doppler_offset) * 0.0001;
+    b->doppler_valid[i] = static_cast<uint8_t>(
+        b->doppler_raw[i] != std::numeric_limits<int32_t>::min() &&
+        !(doppler_msb == -16 && b->doppler_offset_lsb[i] == 0) &&
+        b->doppler_scale[i] > 0.0);
+
+    b->carrier_phase[i] =
+        range * b->frequency[i] * (1.0 / kSpeedOfLight) + carrier * 0.001;
+    b->carrier_phase_valid[i] = static_cast<uint8_t>(
+        code_valid && !(b->carrier_msb[i] == -128 && b->carrier_lsb[i] == 0) &&
+        b->frequency[i] > 0.0);
+
+    b->cn0[i] = static_cast<float>(b->cn0_raw[i]) * 0.25f + b->cn0_bias[i];
+    b->cn0_valid[i] = static_cast<uint8_t>(b->cn0_raw[i] != 255);
+  }
+}
+
+// 4-bit lane mask to four 0 / 1 bytes
+constexpr std::array<uint32_t, 16> MakeMaskBytes() {
+  std::array<uint32_t, 16> bytes{};
+  for (uint32_t bits = 0; bits < 16; ++bits)
+    for (uint32_t lane = 0; lane < 4; ++lane)
+      bytes[bits] |= ((bits >> lane) & 1u) << (lane * 8);
+  return bytes;
+}
+
+constexpr std::array<uint32_t, 16> kMaskBytes = MakeMaskBytes();
+
+void StoreMask(uint8_t* dest, int bits) {
+  memcpy(dest, &kMaskBytes[bits & 15], 4);
+}
+
+#if defined(CALCULATE_MEAS_AVX2)
+
+bool CpuHasAvx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+  __cpuid(info, 1);
+  // AVX and OSXSAVE, then the OS saving the YMM state
+  if ((info[2] & (1 << 28)) == 0 || (info[2] & (1 << 27)) == 0 ||
+      (_xgetbv(0) & 6) != 6)
+    return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  // libgcc / compiler-rt check the OS support as well
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+CALCULATE_TARGET_AVX2 __m128i Load4U8(const uint8_t* p) {
+  int32_t word;
+  memcpy(&word, p, 4);
+  return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(word));
+}
+
+CALCULATE_TARGET_AVX2 __m128i Load4S8(const int8_t* p) {
+  int32_t word;
+  memcpy(&word, p, 4);
+  return _mm_cvtepi8_epi32(_mm_cvtsi32_si128(word));
+}
+
+CALCULATE_TARGET_AVX2 __m128i Load4U16(const uint16_t* p) {
+  return _mm_cvtepu16_epi32(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+}
+
+CALCULATE_TARGET_AVX2 int Bits(__m128i mask) {
+  return _mm_movemask_ps(_mm_castsi128_ps(mask));
+}
+
+// Four rows per step: the integer arithmetic in 32-bit lanes, the doubles
+// in 256-bit registers. Unsigned CodeLSB goes through the sign bit, which
+// AVX2 conversions lack.
+CALCULATE_TARGET_AVX2 size_t ConvertAvx2(MeasEpochBatch* b, size_t n) {
+  const __m128i x04 = _mm_set1_epi32(0x04);
+  const __m128i x07 = _mm_set1_epi32(0x07);
+  const __m128i x0f = _mm_set1_epi32(0x0f);
+  const __m128i x10 = _mm_set1_epi32(0x10);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i int_min = _mm_set1_epi32(std::numeric_limits<int32_t>::min());
+  const __m256d two32 = _mm256_set1_pd(4294967296.0);
+  const __m256d two31 = _mm256_set1_pd(2147483648.0);
+  const __m256d milli = _mm256_set1_pd(0.001);
+  const __m256d tenth_milli = _mm256_set1_pd(0.0001);
+  const __m256d per_c = _mm256_set1_pd(1.0 / kSpeedOfLight);
+  const __m256d zero_pd = _mm256_setzero_pd();
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i offsets = Load4U8(&b->offsets_msb[i]);
+    __m128i code_msb = _mm_sub_epi32(
+        _mm_xor_si128(_mm_and_si128(offsets, x07), x04), x04);
+    __m128i doppler_msb = _mm_sub_epi32(
+        _mm_xor_si128(_mm_srli_epi32(offsets, 3), x10), x10);
+    __m128i code_offset_lsb = Load4U16(&b->code_offset_lsb[i]);
+    __m128i doppler_offset_lsb = Load4U16(&b->doppler_offset_lsb[i]);
+    __m128i code_offset =
+        _mm_add_epi32(_mm_slli_epi32(code_msb, 16), code_offset_lsb);
+    __m128i doppler_offset =
+        _mm_add_epi32(_mm_slli_epi32(doppler_msb, 16), doppler_offset_lsb);
+    __m128i carrier_msb = Load4S8(&b->carrier_msb[i]);
+    __m128i carrier_lsb = Load4U16(&b->carrier_lsb[i]);
+    __m128i carrier =
+        _mm_add_epi32(_mm_slli_epi32(carrier_msb, 16), carrier_lsb);
+    __m128i misc = _mm_and_si128(Load4U8(&b->misc[i]), x0f);
+    __m128i code_lsb =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(&b->code_lsb[i]));
+
+    // pseudorange
+    __m256d lsb = _mm256_add_pd(
+        _mm256_cvtepi32_pd(_mm_xor_si128(code_lsb, int_min)), two31);
+    __m256d mm = _mm256_add_pd(
+        _mm256_add_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(misc), two32), lsb),
+        _mm256_cvtepi32_pd(code_offset));
+    __m256d range = _mm256_mul_pd(mm, milli);
+    _mm256_storeu_pd(&b->pseudorange[i], range);
+    int code_bits =
+        ~Bits(_mm_or_si128(
+            _mm_cmpeq_epi32(_mm_or_si128(misc, code_lsb), zero),
+            _mm_and_si128(_mm_cmpeq_epi32(code_msb, _mm_set1_epi32(-4)),
+                          _mm_cmpeq_epi32(code_offset_lsb, zero)))) & 15;
+    StoreMask(&b->pseudorange_valid[i], code_bits);
+
+    // Doppler
+    __m128i doppler_raw =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(&b->doppler_raw[i]));
+    __m256d scale = _mm256_loadu_pd(&b->doppler_scale[i]);
+    __m256d doppler = _mm256_mul_pd(
+        _mm256_add_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(doppler_raw), scale),
+                      _mm256_cvtepi32_pd(doppler_offset)),
+        tenth_milli);
+    _mm256_storeu_pd(&b->doppler[i], doppler);
+    int doppler_bits =
+        ~Bits(_mm_or_si128(
+            _mm_cmpeq_epi32(doppler_raw, int_min),
+            _mm_and_si128(_mm_cmpeq_epi32(doppler_msb, _mm_set1_epi32(-16)),
+                          _mm_cmpeq_epi32(doppler_offset_lsb, zero)))) &
+        _mm256_movemask_pd(_mm256_cmp_pd(scale, zero_pd, _CMP_GT_OQ));
+    StoreMask(&b->doppler_valid[i], doppler_bits);
+
+    // carrier phase
+    __m256d frequency = _mm256_loadu_pd(&b->frequency[i]);
+    __m256d phase = _mm256_add_pd(
+        _mm256_mul_pd(_mm256_mul_pd(range, frequency), per_c),
+        _mm256_mul_pd(_mm256_cvtepi32_pd(carrier), milli));
+    _mm256_storeu_pd(&b->carrier_phase[i], phase);
+    int phase_bits =
+        code_bits &
+        ~Bits(_mm_and_si128(_mm_cmpeq_epi32(carrier_msb, _mm_set1_epi32(-128)),
+                            _mm_cmpeq_epi32(carrier_lsb, zero))) &
+        _mm256_movemask_pd(_mm256_cmp_pd(frequency, zero_pd, _CMP_GT_OQ));
+    StoreMask(&b->carrier_phase_valid[i], phase_bits);
+
+    // C/N0
+    __m128i cn0_raw = Load4U8(&b->cn0_raw[i]);
+    __m128 cn0 = _mm_add_ps(
+        _mm_mul_ps(_mm_cvtepi32_ps(cn0_raw), _mm_set1_ps(0.25f)),
+        _mm_loadu_ps(&b->cn0_bias[i]));
+    _mm_storeu_ps(&b->cn0[i], cn0);
+    StoreMask(&b->cn0_valid[i],
+              ~Bits(_mm_cmpeq_epi32(cn0_raw, _mm_set1_epi32(255))));
+  }
+  return i;
+}
+
+#endif
+
+#if defined(CALCULATE_MEAS_NEON)
+
+int32x4_t Load4U8(const uint8_t* p) {
+  uint32_t word;
+  memcpy(&word, p, 4);
+  uint8x8_t bytes = vreinterpret_u8_u32(vdup_n_u32(word));
+  return vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(vmovl_u8(bytes))));
+}
+
+int32x4_t Load4S8(const int8_t* p) {
+  uint32_t word;
+  memcpy(&word, p, 4);
+  int8x8_t bytes = vreinterpret_s8_u32(vdup_n_u32(word));
+  return vmovl_s16(vget_low_s16(vmovl_s8(bytes)));
+}
+
+int32x4_t Load4U16(const uint16_t* p) {
+  return vreinterpretq_s32_u32(vmovl_u16(vld1_u16(p)));
+}
+
+float64x2_t Low(int32x4_t v) {
+  return vcvtq_f64_s64(vmovl_s32(vget_low_s32(v)));
+}
+
+float64x2_t High(int32x4_t v) {
+  return vcvtq_f64_s64(vmovl_high_s32(v));
+}
+
+uint32x4_t Both(uint64x2_t low, uint64x2_t high) {
+  return vcombine_u32(vmovn_u64(low), vmovn_u64(high));
+}
+
+void StoreMask(uint8_t* dest, uint32x4_t mask) {
+  uint16x4_t halves = vmovn_u32(vandq_u32(mask, vdupq_n_u32(1)));
+  uint8x8_t bytes = vmovn_u16(vcombine_u16(halves, halves));
+  uint32_t word = vget_lane_u32(vreinterpret_u32_u8(bytes), 0);
+  memcpy(dest, &word, 4);
+}
+
+// Four rows per step: the integer arithmetic in 32-bit lanes, the doubles
+// as two 128-bit halves
+size_t ConvertNeon(MeasEpochBatch* b, size_t n) {
+  const int32x4_t x04 = vdupq_n_s32(0x04);
+  const int32x4_t x10 = vdupq_n_s32(0x10);
+  const int32x4_t zero = vdupq_n_s32(0);
+  const float64x2_t two32 = vdupq_n_f64(4294967296.0);
+  const float64x2_t milli = vdupq_n_f64(0.001);
+  const float64x2_t tenth_milli = vdupq_n_f64(0.0001);
+  const float64x2_t per_c = vdupq_n_f64(1.0 / kSpeedOfLight);
+  const float64x2_t zero_pd = vdupq_n_f64(0.0);
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    int32x4_t offsets = Load4U8(&b->offsets_msb[i]);
+    int32x4_t code_msb =
+        vsubq_s32(veorq_s32(vandq_s32(offsets, vdupq_n_s32(0x07)), x04), x04);
+    int32x4_t doppler_msb =
+        vsubq_s32(veorq_s32(vshrq_n_s32(offsets, 3), x10), x10);
+    int32x4_t code_offset_lsb = Load4U16(&b->code_offset_lsb[i]);
+    int32x4_t doppler_offset_lsb = Load4U16(&b->doppler_offset_lsb[i]);
+    int32x4_t code_offset =
+        vaddq_s32(vshlq_n_s32(code_msb, 16), code_offset_lsb);
+    int32x4_t doppler_offset =
+        vaddq_s32(vshlq_n_s32(doppler_msb, 16), doppler_offset_lsb);
+    int32x4_t carrier_msb = Load4S8(&b->carrier_msb[i]);
+    int32x4_t carrier_lsb = Load4U16(&b->carrier_lsb[i]);
+    int32x4_t carrier = vaddq_s32(vshlq_n_s32(carrier_msb, 16), carrier_lsb);
+    int32x4_t misc = vandq_s32(Load4U8(&b->misc[i]), vdupq_n_s32(0x0f));
+    uint32x4_t code_lsb = vld1q_u32(&b->code_lsb[i]);
+
+    // pseudorange
+    float64x2_t range[2];
+    float64x2_t lsb[2] = {vcvtq_f64_u64(vmovl_u32(vget_low_u32(code_lsb))),
+                          vcvtq_f64_u64(vmovl_high_u32(code_lsb))};
+    float64x2_t msb[2] = {Low(misc), High(misc)};
+    float64x2_t offset[2] = {Low(code_offset), High(code_offset)};
+    for (int h = 0; h < 2; ++h) {
+      float64x2_t mm =
+          vaddq_f64(vaddq_f64(vmulq_f64(msb[h], two32), lsb[h]), offset[h]);
+      range[h] = vmulq_f64(mm, milli);
+      vst1q_f64(&b->pseudorange[i + 2 * h], range[h]);
+    }
+    uint32x4_t code_valid = vmvnq_u32(vorrq_u32(
+        vceqq_u32(vorrq_u32(vreinterpretq_u32_s32(misc), code_lsb),
+                  vdupq_n_u32(0)),
+        vandq_u32(vceqq_s32(code_msb, vdupq_n_s32(-4)),
+                  vceqq_s32(code_offset_lsb, zero))));
+    StoreMask(&b->pseudorange_valid[i], code_valid);
+
+    // Doppler
+    int32x4_t doppler_raw = vld1q_s32(&b->doppler_raw[i]);
+    float64x2_t raw[2] = {Low(doppler_raw), High(doppler_raw)};
+    float64x2_t doppler_off[2] = {Low(doppler_offset), High(doppler_offset)};
+    uint64x2_t scale_known[2];
+    for (int h = 0; h < 2; ++h) {
+      float64x2_t scale = vld1q_f64(&b->doppler_scale[i + 2 * h]);
+      float64x2_t doppler = vmulq_f64(
+          vaddq_f64(vmulq_f64(raw[h], scale), doppler_off[h]), tenth_milli);
+      vst1q_f64(&b->doppler[i + 2 * h], doppler);
+      scale_known[h] = vcgtq_f64(scale, zero_pd);
+    }
+    uint32x4_t doppler_valid = vandq_u32(
+        vmvnq_u32(vorrq_u32(
+            vceqq_s32(doppler_raw,
+                      vdupq_n_s32(std::numeric_limits<int32_t>::min())),
+            vandq_u32(vceqq_s32(doppler_msb, vdupq_n_s32(-16)),
+                      vceqq_s32(doppler_offset_lsb, zero)))),
+        Both(scale_known[0], scale_known[1]));
+    StoreMask(&b->doppler_valid[i], doppler_valid);
+
+    // carrier phase
+    float64x2_t cycles[2] = {Low(carrier), High(carrier)};
+    uint64x2_t frequency_known[2];
+    for (int h = 0; h < 2; ++h) {
+      float64x2_t frequency = vld1q_f64(&b->frequency[i + 2 * h]);
+      float64x2_t phase =
+          vaddq_f64(vmulq_f64(vmulq_f64(range[h], frequency), per_c),
+                    vmulq_f64(cycles[h], milli));
+      vst1q_f64(&b->carrier_phase[i + 2 * h], phase);
+      frequency_known[h] = vcgtq_f64(frequency, zero_pd);
+    }
+    uint32x4_t phase_valid = vandq_u32(
+        vandq_u32(code_valid,
+                  vmvnq_u32(vandq_u32(
+                      vceqq_s32(carrier_msb, vdupq_n_s32(-128)),
+                      vceqq_s32(carrier_lsb, zero)))),
+        Both(frequency_known[0], frequency_known[1]));
+    StoreMask(&b->carrier_phase_valid[i], phase_valid);
+
+    // C/N0
+    int32x4_t cn0_raw = Load4U8(&b->cn0_raw[i]);
+    float32x4_t cn0 =
+        vaddq_f32(vmulq_n_f32(vcvtq_f32_s32(cn0_raw), 0.25f),
+                  vld1q_f32(&b->cn0_bias[i]));
+    vst1q_f32(&b->cn0[i], cn0);
+    StoreMask(&b->cn0_valid[i],
+              vmvnq_u32(vceqq_s32(cn0_raw, vdupq_n_s32(255))));
+  }
+  return i;
+}
+
+#endif
+
+}
+
+MeasKernel DetectMeasKernel() {
+#if defined(CALCULATE_MEAS_AVX2)
+  static const MeasKernel kernel =
+      CpuHasAvx2() ? kMeasKernelAvx2 : kMeasKernelScalar;
+  return kernel;
+#elif defined(CALCULATE_MEAS_NEON)
+  // Advanced SIMD is mandatory on AArch64
+  return kMeasKernelNeon;
+#else
+  return kMeasKernelScalar;
+#endif
+}
+
+bool MeasKernelSupported(MeasKernel kernel) {
+  return kernel == kMeasKernelAuto || kernel == kMeasKernelScalar ||
+         kernel == DetectMeasKernel();
+}
+
+const char* MeasKernelName(MeasKernel kernel) {
+  switch (kernel) {
+    case kMeasKernelScalar:
+      return "scalar";
+    case kMeasKernelAvx2:
+      return "avx2";
+    case kMeasKernelNeon:
+      return "neon";
+    default:
+      return "auto";
+  }
+}
+
+namespace {
+
+struct SvidRange {
+  int first, last;
+  char system;
+  int offset;
+};
+
+// SBF SVID ranges and the PRN / slot they start at
+const SvidRange kSvidRanges[] = {
+  {1, 37, 'G', 0},      {38, 61, 'R', 37},   {62, 62, 'R', 62},
+  {63, 68, 'R', 38},    {71, 106, 'E', 70},  {107, 119, 'L', 106},
+  {120, 140, 'S', 100}, {141, 180, 'C', 140}, {181, 190, 'J', 180},
+  {191, 197, 'I', 190}, {198, 215, 'S', 157}, {216, 222, 'I', 208},
+  {223, 245, 'C', 182},
+};
+
+const SvidRange* FindSvidRange(int svid) {
+  for (const SvidRange& range : kSvidRanges) {
+    if (svid >= range.first && svid <= range.last)
+      return &range;
+  }
+  return nullptr;
+}
+
+}
+
+char MeasSvidSystem(int svid) {
+  const SvidRange* range = FindSvidRange(svid);
+  return range != nullptr ? range->system : '\0';
+}
+
+std::string MeasSvidName(int svid) {
+  char name[8];
+  const SvidRange* range = FindSvidRange(svid);
+  if (range != nullptr)
+    snprintf(name, sizeof(name), "%c%02d", range->system,
+             svid - range->offset);
+  else
+    snprintf(name, sizeof(name), "%d", svid);
+  return name;
+}
+
+std::string MeasSignalName(int signal) {
+  if (signal >= 0 && signal < SIG_LAST)
+    return kSignalNames[signal];
+  char name[8];
+  snprintf(name, sizeof(name), "SIG%d", signal);
+  return name;
+}
+
+void MeasEpochBatch::Clear() {
+  for (auto* bytes : {&channel, &svid, &signal, &antenna, &sub_block, &type,
+                      &obs_info, &misc, &offsets_msb, &cn0_raw,
+                      &pseudorange_valid, &doppler_valid,
+                      &carrier_phase_valid, &cn0_valid})
+    bytes->clear();
+  for (auto* words : {&wnc, &lock_time, &code_offset_lsb,
+                      &doppler_offset_lsb, &carrier_lsb})
+    words->clear();
+  for (auto* doubles : {&frequency, &doppler_scale, &pseudorange, &doppler,
+                        &carrier_phase})
+    doubles->clear();
+  tow.clear();
+  code_lsb.clear();
+  doppler_raw.clear();
+  carrier_msb.clear();
+  cn0_bias.clear();
+  cn0.clear();
+}
+
+void MeasEpochBatch::Add(const uint8_t* block, uint16_t length) {
+  if (length < offsetof(MeasEpoch_2_0_t, Data))
+    return;
+  const uint8_t* p = block + offsetof(MeasEpoch_2_0_t, Data);
+  const uint8_t* end = block + length;
+  uint32_t block_tow;
+  uint16_t block_wnc;
+  memcpy(&block_tow, block + offsetof(MeasEpoch_2_0_t, TOW), 4);
+  memcpy(&block_wnc, block + offsetof(MeasEpoch_2_0_t, WNc), 2);
+  unsigned n = block[offsetof(MeasEpoch_2_0_t, N)];
+  size_t sb1 = block[offsetof(MeasEpoch_2_0_t, SB1Size)];
+  size_t sb2 = block[offsetof(MeasEpoch_2_0_t, SB2Size)];
+  if (sb1 < sizeof(MeasEpochChannelType1_2_0_t))
+    return;
+
+  auto add_row = [&](const MeasEpochChannelType1_2_0_t& type1, uint8_t sub,
+                     uint8_t row_type, uint16_t row_lock_time,
+                     uint8_t row_obs_info, int8_t row_carrier_msb,
+                     uint16_t row_carrier_lsb, uint8_t row_cn0) {
+    tow.push_back(block_tow);
+    wnc.push_back(block_wnc);
+    channel.push_back(type1.RXChannel);
+    svid.push_back(type1.SVID);
+    int number = SignalNumber(row_type, row_obs_info);
+    signal.push_back(static_cast<uint8_t>(number));
+    antenna.push_back(static_cast<uint8_t>(row_type >> 5));
+    sub_block.push_back(sub);
+    type.push_back(row_type);
+    lock_time.push_back(row_lock_time);
+    obs_info.push_back(row_obs_info);
+    misc.push_back(type1.Misc);
+    code_lsb.push_back(type1.CodeLSB);
+    doppler_raw.push_back(type1.Doppler);
+    carrier_msb.push_back(row_carrier_msb);
+    carrier_lsb.push_back(row_carrier_lsb);
+    cn0_raw.push_back(row_cn0);
+    frequency.push_back(CarrierFrequency(number, row_obs_info));
+    cn0_bias.push_back(Cn0Bias(number));
+  };
+
+  for (unsigned i = 0; i < n && sb1 <= static_cast<size_t>(end - p); ++i) {
+    MeasEpochChannelType1_2_0_t type1;
+    memcpy(&type1, p, sizeof(type1));
+    p += sb1;
+    add_row(type1, 1, type1.Type, type1.LockTime, type1.ObsInfo,
+            type1.CarrierMSB, type1.CarrierLSB, type1.CN0);
+    offsets_msb.push_back(0);
+    code_offset_lsb.push_back(0);
+    doppler_offset_lsb.push_back(0);
+    doppler_scale.push_back(1.0);
+
+    if (type1.N_Type2 == 0)
+      continue;
+    if (sb2 < sizeof(MeasEpochChannelType2_2_0_t))
+      return;
+    double master = frequency.back();
+    for (unsigned j = 0; j < type1.N_Type2; ++j) {
+      if (sb2 > static_cast<size_t>(end - p))
+        return;
+      MeasEpochChannelType2_2_0_t type2;
+      memcpy(&type2, p, sizeof(type2));
+      p += sb2;
+      add_row(type1, 2, type2.Type, type2.LockTime, type2.ObsInfo,
+              type2.CarrierMSB, type2.CarrierLSB, type2.CN0);
+      offsets_msb.push_back(type2.OffsetsMSB);
+      code_offset_lsb.push_back(type2.CodeOffsetLSB);
+      doppler_offset_lsb.push_back(type2.DopplerOffsetLSB);
+      double own = frequency.back();
+      doppler_scale.push_back(master > 0.0 && own > 0.0 ? own / master : 0.0);
+    }
+  }
+}
+
+MeasKernel MeasEpochBatch::Convert(MeasKernel kernel) {
+  if (kernel == kMeasKernelAuto || !MeasKernelSupported(kernel))
+    kernel = kernel == kMeasKernelAuto ? DetectMeasKernel()
+                                       : kMeasKernelScalar;
+
+  size_t n = size();
+  for (auto* doubles : {&pseudorange, &doppler, &carrier_phase})
+    doubles->resize(n);
+  cn0.resize(n);
+  for (auto* valid : {&pseudorange_valid, &doppler_valid,
+                      &carrier_phase_valid, &cn0_valid})
+    valid->resize(n);
+
+  size_t done = 0;
+#if defined(CALCULATE_MEAS_AVX2)
+  if (kernel == kMeasKernelAvx2)
+    done = ConvertAvx2(this, n);
+#elif defined(CALCULATE_MEAS_NEON)
+  if (kernel == kMeasKernelNeon)
+    done = ConvertNeon(this, n);
+#endif
+  ConvertScalar(this, done, n);
+  return kernel;
+}
+
+ssn_error_t ReadMeasEpochFile(const std::string& path, MeasEpochBatch* batch,
+                              JobControl* control) {
+  MappedFile file;
+  if (!file.Open(path))
+    return SSNERROR_CREATE(SSNERROR_SEVERITY_FAILURE, SSNERROR_MODULE_GENERAL,
+                           SSNERROR_SUBMODULE_GENERAL, SSNERROR_TYPE_GENERAL,
+                           SSNERROR_ERROR_FILEOPEN);
+
+  const uint16_t meas_number = SBF_ID_TO_NUMBER(sbfid_MeasEpoch_2_0);
+  SbfWalker walker(file.data(), file.size());
+  size_t next_report = kReadReportBytes;
+  uint16_t length;
+  while (const uint8_t* block = walker.Next(&length)) {
+    if (walker.position() >= next_report) {
+      next_report += kReadReportBytes;
+      if (control != nullptr) {
+        if (control->cancelled())
+          return CancelledError();
+        control->Report(0, static_cast<float>(walker.position() * 100.0 /
+                                              file.size()));
+      }
+    }
+    uint16_t id;
+    memcpy(&id, block + 4, sizeof(id));
+    if (SBF_ID_TO_NUMBER(id) == meas_number)
+      batch->Add(block, length);
+  }
+
+  if (control != nullptr)
+    control->Report(0, 100.0f);
+  return SSNERROR_WARNING_OK;
+}
+
+void GroupBySignal(const MeasEpochBatch& batch, std::vector<uint32_t>* order,
+                   std::vector<uint32_t>* begin) {
+  begin->assign(kMeasSignals + 1, 0);
+  for (uint8_t signal : batch.signal)
+    ++(*begin)[(signal & (kMeasSignals - 1)) + 1];
+  for (int s = 0; s < kMeasSignals; ++s)
+    (*begin)[s + 1] += (*begin)[s];
+
+  std::vector<uint32_t> next(begin->begin(), begin->end() - 1);
+  order->resize(batch.size());
+  for (size_t i = 0; i < batch.size(); ++i)
+    (*order)[next[batch.signal[i] & (kMeasSignals - 1)]++] =
+        static_cast<uint32_t>(i);
+}
+
+}
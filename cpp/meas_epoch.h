@@ -0,0 +1,111 @@
+#ifndef CALCULATE_MEAS_EPOCH_H
+#define CALCULATE_MEAS_EPOCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "ssnerror.h"
+
+namespace calculate {
+
+class JobControl;
+
+// MeasEpoch signal numbers are 0..63 (Type & 0x1f, 31 extended by ObsInfo)
+const int kMeasSignals = 64;
+
+enum MeasKernel {
+  kMeasKernelAuto,             // DetectMeasKernel()
+  kMeasKernelScalar,
+  kMeasKernelAvx2,
+  kMeasKernelNeon,
+};
+
+// Fastest kernel of this CPU: AVX2 when cpuid and the OS report it, NEON on
+// 64-bit ARM, scalar otherwise. Detected once.
+MeasKernel DetectMeasKernel();
+bool MeasKernelSupported(MeasKernel kernel);
+const char* MeasKernelName(MeasKernel kernel);
+
+// "G05", "R12", "E24", ... for an SBF SVID; the number for unassigned ones
+std::string MeasSvidName(int svid);
+// its RINEX system letter, 'G', 'R', 'E', 'C', 'J', 'I', 'S' or 'L', or 0
+char MeasSvidSystem(int svid);
+// SignalType_t name without the SIG_ prefix ("GPSL1CA"), "SIG<n>" beyond
+std::string MeasSignalName(int signal);
+
+// Signals of a batch of MeasEpoch blocks in structure-of-arrays form, one
+// row per Type1 sub-block and per Type2 sub-block after it, in file order.
+//
+// Add() is the only per-record step: it copies the packed, variably sized
+// sub-blocks into the raw arrays, repeating a Type1's code and Doppler on
+// its Type2 rows so that every row decodes on its own. Convert() then runs
+// the MSB / sign-extension arithmetic and the fixed-point to double
+// conversion over whole arrays, in AVX2 or NEON when the CPU has it; every
+// kernel gives the scalar one's results.
+struct MeasEpochBatch {
+  size_t size() const { return tow.size(); }
+  void Clear();
+
+  // Appends the signals of one MeasEpoch_2_0 / 2_1 block; sub-block sizes
+  // that run past the block end it early
+  void Add(const uint8_t* block, uint16_t length);
+
+  // Fills the unit arrays for all rows; returns the kernel used, scalar in
+  // place of one the CPU lacks
+  MeasKernel Convert(MeasKernel kernel = kMeasKernelAuto);
+
+  // per row, as stored
+  std::vector<uint32_t> tow;
+  std::vector<uint16_t> wnc;
+  std::vector<uint8_t> channel;
+  std::vector<uint8_t> svid;
+  std::vector<uint8_t> signal;
+  std::vector<uint8_t> antenna;
+  std::vector<uint8_t> sub_block;        // 1 or 2
+  std::vector<uint8_t> type;
+  std::vector<uint16_t> lock_time;       // s
+  std::vector<uint8_t> obs_info;
+
+  // fixed-point fields; Type1 rows have zero offsets
+  std::vector<uint8_t> misc;             // Type1's, CodeMSB in bits 0..3
+  std::vector<uint32_t> code_lsb;        // Type1's, mm
+  std::vector<int32_t> doppler_raw;      // Type1's, 0.0001 Hz
+  std::vector<uint8_t> offsets_msb;
+  std::vector<uint16_t> code_offset_lsb;
+  std::vector<uint16_t> doppler_offset_lsb;
+  std::vector<int8_t> carrier_msb;
+  std::vector<uint16_t> carrier_lsb;
+  std::vector<uint8_t> cn0_raw;          // 0.25 dB-Hz
+
+  std::vector<double> frequency;         // carrier, Hz; 0 when unknown
+  std::vector<double> doppler_scale;     // frequency / Type1's, 0 if unknown
+  std::vector<float> cn0_bias;           // dB-Hz
+
+  // Convert() output; the valid arrays hold 0 / 1
+  std::vector<double> pseudorange;       // m
+  std::vector<double> doppler;           // Hz
+  std::vector<double> carrier_phase;     // cycles
+  std::vector<float> cn0;                // dB-Hz
+  std::vector<uint8_t> pseudorange_valid;
+  std::vector<uint8_t> doppler_valid;
+  std::vector<uint8_t> carrier_phase_valid;
+  std::vector<uint8_t> cn0_valid;
+};
+
+// Adds every MeasEpoch block of an SBF file to `batch`, walking a memory
+// mapping of it; no conversion
+ssn_error_t ReadMeasEpochFile(const std::string& path, MeasEpochBatch* batch,
+                              JobControl* control = nullptr);
+
+// Stable counting sort of the rows by signal: the rows of signal s are
+// order[begin[s]] .. order[begin[s + 1] - 1], in file order. `begin` gets
+// kMeasSignals + 1 entries.
+void GroupBySignal(const MeasEpochBatch& batch, std::vector<uint32_t>* order,
+                   std::vector<uint32_t>* begin);
+
+}
+
+#endif
@@ -0,0 +1,347 @@
+#include "metrics.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "sbf_util.h"
+#include "sdk_error.h"
+
+namespace calculate {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* const kStageNames[kStageCount] = {
+  "open",
+  "loadFile",
+  "analyze",
+  "merge",
+  "configure",
+  "calculatePVT",
+  "writeToFile"
+};
+
+// written by the owning thread only, read by any
+class Counter {
+ public:
+  void Add(uint64_t n) {
+    value_.store(value_.load(std::memory_order_relaxed) + n,
+                 std::memory_order_relaxed);
+  }
+  void Max(uint64_t n) {
+    if (n > value_.load(std::memory_order_relaxed))
+      value_.store(n, std::memory_order_relaxed);
+  }
+  uint64_t Get() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64_t> value_{0};
+};
+
+struct TraceEvent {
+  const char* name;
+  int stage;
+  unsigned code;            // SSNERROR_GETCODE of the result
+  unsigned tid;
+  uint64_t start_ns;
+  uint64_t wall_ns;
+  uint64_t cpu_ns;
+};
+
+struct Slot {
+  unsigned tid;
+  Counter calls[kStageCount];
+  Counter errors[kStageCount];
+  Counter warnings[kStageCount];
+  Counter wall_ns[kStageCount];
+  Counter cpu_ns[kStageCount];
+  Counter max_wall_ns[kStageCount];
+  Counter spill_bytes[kStageCount];
+  Counter max_spill_bytes[kStageCount];
+  Counter blocks;
+  Counter bytes_read;
+  // uncontended but for WriteTraceFile()
+  std::mutex trace_mutex;
+  std::vector<TraceEvent> trace;
+};
+
+void AddSlot(const Slot& slot, MetricsSnapshot* out) {
+  for (int stage = 0; stage < kStageCount; ++stage) {
+    StageMetrics& s = out->stages[stage];
+    s.calls += slot.calls[stage].Get();
+    s.errors += slot.errors[stage].Get();
+    s.warnings += slot.warnings[stage].Get();
+    s.wall_ns += slot.wall_ns[stage].Get();
+    s.cpu_ns += slot.cpu_ns[stage].Get();
+    s.max_wall_ns = std::max(s.max_wall_ns, slot.max_wall_ns[stage].Get());
+    s.spill_bytes += slot.spill_bytes[stage].Get();
+    s.max_spill_bytes =
+        std::max(s.max_spill_bytes, slot.max_spill_bytes[stage].Get());
+  }
+  out->blocks += slot.blocks.Get();
+  out->bytes_read += slot.bytes_read.Get();
+}
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<Slot*> slots;
+  MetricsSnapshot retired;             // of the threads that have exited
+  std::vector<TraceEvent> retired_trace;
+  unsigned threads = 0;
+};
+
+// never destroyed, so threads exiting after static destruction still
+// find it
+Registry& GetRegistry() {
+  static Registry* registry = new Registry();
+  return *registry;
+}
+
+class SlotOwner {
+ public:
+  SlotOwner() {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    slot_.tid = ++registry.threads;
+    registry.slots.push_back(&slot_);
+  }
+
+  ~SlotOwner() {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    AddSlot(slot_, &registry.retired);
+    registry.retired_trace.insert(registry.retired_trace.end(),
+                                  slot_.trace.begin(), slot_.trace.end());
+    registry.slots.erase(
+        std::find(registry.slots.begin(), registry.slots.end(), &slot_));
+  }
+
+  Slot& slot() { return slot_; }
+
+ private:
+  Slot slot_;
+};
+
+Slot& ThreadSlot() {
+  thread_local SlotOwner owner;
+  return owner.slot();
+}
+
+std::atomic<bool> g_tracing{false};
+std::atomic<size_t> g_trace_events{0};
+std::atomic<uint64_t> g_stream_bytes{0};
+std::atomic<uint64_t> g_peak_stream_bytes{0};
+
+typedef std::chrono::steady_clock Clock;
+
+// trace time stamps count from the first clock read
+uint64_t WallNanos() {
+  static const Clock::time_point origin = Clock::now();
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          Clock::now() - origin).count());
+}
+
+uint64_t ThreadCpuNanos() {
+#ifdef _WIN32
+  FILETIME creation, exit, kernel, user;
+  if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+    return 0;
+  auto ticks = [](const FILETIME& time) {
+    return (static_cast<uint64_t>(time.dwHighDateTime) << 32) |
+           time.dwLowDateTime;
+  };
+  return (ticks(kernel) + ticks(user)) * 100;
+#else
+  timespec now;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0)
+    return 0;
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000u +
+         static_cast<uint64_t>(now.tv_nsec);
+#endif
+}
+
+bool WriteEvents(std::ostream& out, const std::vector<TraceEvent>& events) {
+  char line[512];
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+  std::vector<unsigned> tids;
+  for (const TraceEvent& event : events)
+    tids.push_back(event.tid);
+  std::sort(tids.begin(), tids.end());
+  tids.erase(std::unique(tids.begin(), tids.end()), tids.end());
+  bool first = true;
+  for (unsigned tid : tids) {
+    snprintf(line, sizeof(line),
+             "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+             "\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+             first ? "" : ",\n", tid, tid);
+    out << line;
+    first = false;
+  }
+
+  // ts / dur in microseconds
+  for (const TraceEvent& event : events) {
+    const char* stage = kStageNames[event.stage];
+    snprintf(line, sizeof(line),
+             "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+             "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+             "\"args\":{\"cpuMs\":%.3f,\"code\":%u}}",
+             first ? "" : ",\n", event.name != nullptr ? event.name : stage,
+             stage, event.tid, event.start_ns / 1e3, event.wall_ns / 1e3,
+             event.cpu_ns / 1e6, event.code);
+    out << line;
+    first = false;
+  }
+
+  out << "\n]}\n";
+  return out.good();
+}
+
+}
+
+const char* MetricStageName(int stage) {
+  return stage >= 0 && stage < kStageCount ? kStageNames[stage] : nullptr;
+}
+
+MetricsSnapshot SnapshotMetrics() {
+  Registry& registry = GetRegistry();
+  MetricsSnapshot out;
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    out = registry.retired;
+    for (const Slot* slot : registry.slots)
+      AddSlot(*slot, &out);
+    out.threads = registry.threads;
+  }
+  out.stream_bytes = g_stream_bytes.load(std::memory_order_relaxed);
+  out.peak_stream_bytes = g_peak_stream_bytes.load(std::memory_order_relaxed);
+  out.tracing = g_tracing.load(std::memory_order_relaxed);
+  out.trace_events = g_trace_events.load(std::memory_order_relaxed);
+  return out;
+}
+
+void CountBlocks(uint64_t blocks, uint64_t bytes) {
+  Slot& slot = ThreadSlot();
+  slot.blocks.Add(blocks);
+  slot.bytes_read.Add(bytes);
+}
+
+void CountBytesRead(uint64_t bytes) {
+  ThreadSlot().bytes_read.Add(bytes);
+}
+
+void CountStreamBytes(int64_t delta) {
+  uint64_t now = g_stream_bytes.fetch_add(static_cast<uint64_t>(delta),
+                                          std::memory_order_relaxed) +
+                 static_cast<uint64_t>(delta);
+  if (delta <= 0)
+    return;
+  uint64_t peak = g_peak_stream_bytes.load(std::memory_order_relaxed);
+  while (now > peak &&
+         !g_peak_stream_bytes.compare_exchange_weak(
+             peak, now, std::memory_order_relaxed)) {
+  }
+}
+
+void CountSpill(MetricStage stage, uint64_t bytes) {
+  Slot& slot = ThreadSlot();
+  slot.spill_bytes[stage].Add(bytes);
+  slot.max_spill_bytes[stage].Max(bytes);
+}
+
+StageTimer::StageTimer(MetricStage stage, const char* name)
+    : stage_(stage), name_(name), wall_start_(WallNanos()),
+      cpu_start_(ThreadCpuNanos()) {}
+
+StageTimer::~StageTimer() {
+  uint64_t wall = WallNanos() - wall_start_;
+  uint64_t cpu_end = ThreadCpuNanos();
+  uint64_t cpu = cpu_end > cpu_start_ ? cpu_end - cpu_start_ : 0;
+
+  unsigned code = static_cast<unsigned>(SSNERROR_GETCODE(error_));
+  Slot& slot = ThreadSlot();
+  slot.calls[stage_].Add(1);
+  if (code != SSNERROR_WARNING_OK) {
+    slot.errors[stage_].Add(1);
+    if (SSNERROR_ISWARNING(error_))
+      slot.warnings[stage_].Add(1);
+  }
+  slot.wall_ns[stage_].Add(wall);
+  slot.cpu_ns[stage_].Add(cpu);
+  slot.max_wall_ns[stage_].Max(wall);
+
+  if (!g_tracing.load(std::memory_order_relaxed))
+    return;
+  if (g_trace_events.fetch_add(1, std::memory_order_relaxed) >=
+      kMaxTraceEvents) {
+    g_trace_events.fetch_sub(1, std::memory_order_relaxed);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(slot.trace_mutex);
+  slot.trace.push_back(TraceEvent{name_, stage_, code, slot.tid,
+                                  wall_start_, wall, cpu});
+}
+
+ssn_error_t StageTimer::Done(ssn_error_t error) {
+  error_ = error;
+  if (ErrorTrail* trail = ErrorTrail::Current())
+    trail->Record(error, kStageNames[stage_], name_);
+  return error;
+}
+
+void EnableTracing(bool enabled) {
+  g_tracing.store(enabled, std::memory_order_relaxed);
+}
+
+ssn_error_t WriteTraceFile(const std::string& path, size_t* events) {
+  Registry& registry = GetRegistry();
+  std::vector<TraceEvent> trace;
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    trace.swap(registry.retired_trace);
+    for (Slot* slot : registry.slots) {
+      std::lock_guard<std::mutex> slot_lock(slot->trace_mutex);
+      trace.insert(trace.end(), slot->trace.begin(), slot->trace.end());
+      std::vector<TraceEvent>().swap(slot->trace);
+    }
+  }
+  g_trace_events.fetch_sub(trace.size(), std::memory_order_relaxed);
+  std::sort(trace.begin(), trace.end(),
+            [](const TraceEvent& a, const TraceEvent& b) {
+              return a.start_ns < b.start_ns;
+            });
+  *events = trace.size();
+
+  std::string temp = path + ".tmp";
+  bool written;
+  {
+    std::ofstream out(fs::u8path(temp), std::ios::binary | std::ios::trunc);
+    written = out.is_open() && WriteEvents(out, trace);
+  }
+
+  std::error_code ec;
+  if (written)
+    fs::rename(fs::u8path(temp), fs::u8path(path), ec);
+  if (!written || ec) {
+    fs::remove(fs::u8path(temp), ec);
+    return GeneralError(SSNERROR_ERROR_FILEOPEN);
+  }
+  return SSNERROR_WARNING_OK;
+}
+
+}
@@ -0,0 +1,110 @@
+#ifndef CALCULATE_METRICS_H
+#define CALCULATE_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "ssnerror.h"
+
+namespace calculate {
+
+// PPSDK calls timed by StageTimer, in the order of MetricStageName()
+enum MetricStage {
+  kStageOpen,               // SSNSDK_open, SSNSBFStream_open
+  kStageLoadFile,           // SSNSBFStream_loadFile
+  kStageAnalyze,            // SSNSBFAnalyze_*
+  kStageMerge,              // SSNSBFStream_insertReferenceStream,
+                            // SSNSBFStream_appendStreamBlocks
+  kStageConfigure,          // SSNPPEngine_send*Command of an engine profile
+  kStageCalculatePvt,       // SSNPPEngine_calculatePVT
+  kStageWriteToFile,        // SSNSBFStream_writeToFile
+  kStageCount
+};
+
+// "open", "loadFile", "analyze", "merge", "configure", "calculatePVT",
+// "writeToFile"
+const char* MetricStageName(int stage);
+
+struct StageMetrics {
+  uint64_t calls = 0;
+  uint64_t errors = 0;      // calls that did not return SSNERROR_WARNING_OK
+  uint64_t warnings = 0;    // of those, the ones with a warning code
+  uint64_t wall_ns = 0;
+  uint64_t cpu_ns = 0;      // of the calling thread
+  uint64_t max_wall_ns = 0;
+  uint64_t spill_bytes = 0;   // peak temp-file bytes, summed over the calls
+  uint64_t max_spill_bytes = 0;
+};
+
+struct MetricsSnapshot {
+  StageMetrics stages[kStageCount];
+  uint64_t blocks = 0;               // walked in place or framed live
+  uint64_t bytes_read = 0;           // loaded by the SDK or walked in place
+  uint64_t stream_bytes = 0;         // held by open SDK streams
+  uint64_t peak_stream_bytes = 0;
+  uint64_t threads = 0;              // that have recorded anything
+  bool tracing = false;
+  uint64_t trace_events = 0;         // buffered for WriteTraceFile()
+};
+
+// Always-on counters of the addon since it was loaded.
+//
+// Every thread records into its own slot: one writer per counter, so an
+// update is a relaxed load and store with no lock or read-modify-write.
+// Slots are registered under a lock on a thread's first record and folded
+// into the totals when the thread exits; SnapshotMetrics() sums them.
+// Counters only grow, so callers diff two snapshots for an interval.
+MetricsSnapshot SnapshotMetrics();
+
+// blocks and bytes that went through an in-place walk or a live framer
+void CountBlocks(uint64_t blocks, uint64_t bytes);
+// bytes the SDK read from a file, without a block count (that would take
+// another SSNSBFStream_getNumberOfBlocks pass)
+void CountBytesRead(uint64_t bytes);
+// bytes now held by (positive) or released from (negative) SDK streams
+void CountStreamBytes(int64_t delta);
+// peak bytes one call of `stage` kept in PPSDK temp files, see SpillMeter
+void CountSpill(MetricStage stage, uint64_t bytes);
+
+// Times one PPSDK call on the calling thread, wall clock and thread CPU:
+//
+//   StageTimer timer(kStageLoadFile);
+//   rerror = timer.Done(SSNSBFStream_loadFile(...));
+//
+// Done() hands the result to the thread's ErrorTrail; the call is recorded
+// when the timer goes out of scope, as an error when Done() saw one. While
+// tracing is on it also becomes a trace event, named `name` (a string
+// literal) or else after the stage.
+class StageTimer {
+ public:
+  explicit StageTimer(MetricStage stage, const char* name = nullptr);
+  ~StageTimer();
+
+  StageTimer(const StageTimer&) = delete;
+  void operator=(const StageTimer&) = delete;
+
+  ssn_error_t Done(ssn_error_t error);
+
+ private:
+  MetricStage stage_;
+  const char* name_;
+  ssn_error_t error_ = SSNERROR_WARNING_OK;
+  uint64_t wall_start_;
+  uint64_t cpu_start_;
+};
+
+// Chrome trace events of the StageTimer calls, off by default. The buffer
+// keeps at most kMaxTraceEvents; later calls are still counted, not traced.
+const size_t kMaxTraceEvents = 1 << 18;
+void EnableTracing(bool enabled);
+
+// Writes the buffered events as Chrome trace JSON (chrome://tracing,
+// DevTools Performance panel) and empties the buffer. The file is written
+// beside `path` and renamed into place.
+ssn_error_t WriteTraceFile(const std::string& path, size_t* events);
+
+}
+
+#endif
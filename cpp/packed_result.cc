@@ -0,0 +1,130 @@
+#include "packed_result.h"
+
+#include <string.h>
+
+namespace calculate {
+
+// the layout documented in packed_result.h, checked against the SDK structs
+static_assert(sizeof(PackedHeader) == 16, "PackedHeader layout");
+static_assert(sizeof(PackedSection) == 16, "PackedSection layout");
+static_assert(sizeof(PackedEpoch) == 16, "PackedEpoch layout");
+static_assert(sizeof(PackedTrackedSatellite) == 12, "PackedTrackedSatellite layout");
+static_assert(sizeof(ssn_pvterror_percentages_t) == 52, "ssn_pvterror_percentages_t layout");
+static_assert(sizeof(ssn_pvtmode_percentages_t) == 48, "ssn_pvtmode_percentages_t layout");
+static_assert(sizeof(ssn_pvt_satusage_t) == 8, "ssn_pvt_satusage_t layout");
+
+namespace {
+
+size_t Align8(size_t value) {
+  return (value + 7) & ~static_cast<size_t>(7);
+}
+
+// Walks the sections of `input` in layout order. `visit` gets the section
+// type, record count and record size; the payload writer is picked by type.
+template <typename Visit>
+void ForEachSection(const PackedInput& input, Visit visit) {
+  if (input.errors != nullptr)
+    visit(kPackedPVTError, 1, sizeof(ssn_pvterror_percentages_t));
+  if (input.modes != nullptr)
+    visit(kPackedPVTMode, 1, sizeof(ssn_pvtmode_percentages_t));
+  if (input.tracked != nullptr) {
+    visit(kPackedTrackedEpochs, input.tracked->epochs.size(),
+          sizeof(PackedEpoch));
+    visit(kPackedTrackedSatellites, input.tracked->svid.size(),
+          sizeof(PackedTrackedSatellite));
+  }
+  if (input.used != nullptr) {
+    visit(kPackedUsedEpochs, input.used->epochs.size(), sizeof(PackedEpoch));
+    visit(kPackedUsedSatellites, input.used->satellites.size(),
+          sizeof(ssn_pvt_satusage_t));
+  }
+}
+
+void WriteEpochs(const std::vector<double>& epochs,
+                 const std::vector<uint32_t>& offsets, uint8_t* dest) {
+  PackedEpoch* out = reinterpret_cast<PackedEpoch*>(dest);
+  for (size_t i = 0; i < epochs.size(); ++i) {
+    out[i].gnsstime = epochs[i];
+    out[i].first = offsets[i];
+    out[i].count = offsets[i + 1] - offsets[i];
+  }
+}
+
+void WriteTracked(const TrackedTimeline& tracked, uint8_t* dest) {
+  PackedTrackedSatellite* out =
+      reinterpret_cast<PackedTrackedSatellite*>(dest);
+  for (size_t i = 0; i < tracked.svid.size(); ++i) {
+    out[i].svid = tracked.svid[i];
+    out[i].freqnr = tracked.freqnr[i];
+    out[i].signals_lo = static_cast<uint32_t>(tracked.signals[i]);
+    out[i].signals_hi = static_cast<uint32_t>(tracked.signals[i] >> 32);
+  }
+}
+
+}
+
+size_t PackedByteLength(const PackedInput& input) {
+  size_t sections = 0;
+  size_t payload = 0;
+
+  ForEachSection(input, [&](uint32_t, size_t count, size_t record_size) {
+    ++sections;
+    payload += Align8(count * record_size);
+  });
+
+  return Align8(sizeof(PackedHeader) + sections * sizeof(PackedSection)) +
+         payload;
+}
+
+void WritePacked(const PackedInput& input, void* dest) {
+  uint8_t* base = static_cast<uint8_t*>(dest);
+  PackedHeader* header = reinterpret_cast<PackedHeader*>(base);
+  PackedSection* table = reinterpret_cast<PackedSection*>(base + sizeof(PackedHeader));
+  uint16_t sections = 0;
+
+  ForEachSection(input, [&](uint32_t, size_t, size_t) { ++sections; });
+
+  size_t offset = Align8(sizeof(PackedHeader) + sections * sizeof(PackedSection));
+  uint16_t index = 0;
+
+  ForEachSection(input, [&](uint32_t type, size_t count, size_t record_size) {
+    PackedSection& section = table[index++];
+    uint8_t* payload = base + offset;
+
+    section.type = type;
+    section.offset = static_cast<uint32_t>(offset);
+    section.count = static_cast<uint32_t>(count);
+    section.record_size = static_cast<uint32_t>(record_size);
+
+    switch (type) {
+      case kPackedPVTError:
+        memcpy(payload, input.errors, record_size);
+        break;
+      case kPackedPVTMode:
+        memcpy(payload, input.modes, record_size);
+        break;
+      case kPackedTrackedEpochs:
+        WriteEpochs(input.tracked->epochs, input.tracked->offsets, payload);
+        break;
+      case kPackedTrackedSatellites:
+        WriteTracked(*input.tracked, payload);
+        break;
+      case kPackedUsedEpochs:
+        WriteEpochs(input.used->epochs, input.used->offsets, payload);
+        break;
+      case kPackedUsedSatellites:
+        if (count > 0)
+          memcpy(payload, input.used->satellites.data(), count * record_size);
+        break;
+    }
+
+    offset += Align8(count * record_size);
+  });
+
+  header->magic = kPackedMagic;
+  header->version = kPackedVersion;
+  header->section_count = sections;
+  header->byte_length = static_cast<uint32_t>(offset);
+}
+
+}
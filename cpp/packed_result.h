@@ -0,0 +1,105 @@
+#ifndef CALCULATE_PACKED_RESULT_H
+#define CALCULATE_PACKED_RESULT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ssnsbfanalyze.h"
+
+#include "tracked_timeline.h"
+
+namespace calculate {
+
+/*
+ * Packed analysis result layout (version 1), little endian
+ *
+ *   offset 0   PackedHeader
+ *   offset 16  PackedSection[section_count]
+ *   ...        section payloads, each starting on an 8-byte boundary
+ *
+ * Record layouts follow the #pragma pack(4) structs of ssnsbfanalyze.h, so
+ * the PVT sections are byte copies of the SDK structs:
+ *
+ *   PVT_ERROR           1 x ssn_pvterror_percentages_t   (11 float, 2 uint32)
+ *   PVT_MODE            1 x ssn_pvtmode_percentages_t    (11 float, 1 uint32)
+ *   TRACKED_EPOCHS      n x PackedEpoch
+ *   TRACKED_SATELLITES  n x PackedTrackedSatellite
+ *   USED_EPOCHS         n x PackedEpoch
+ *   USED_SATELLITES     n x ssn_pvt_satusage_t           (uint8, uint8, pad,
+ *                                                         uint32 signaltype)
+ *
+ * Every record size is a multiple of 4, so a section maps onto Float32Array /
+ * Uint32Array views with a stride of record_size / 4. The renderer side
+ * reader lives in src/renderer/src/packedResult.js.
+ */
+
+const uint32_t kPackedMagic = 0x52464253;  // "SBFR"
+const uint16_t kPackedVersion = 1;
+
+enum PackedSectionType {
+  kPackedPVTError = 1,
+  kPackedPVTMode = 2,
+  kPackedTrackedEpochs = 3,
+  kPackedTrackedSatellites = 4,
+  kPackedUsedEpochs = 5,
+  kPackedUsedSatellites = 6
+};
+
+#pragma pack(push, 4)
+
+typedef struct
+{
+  uint32_t  magic;          // kPackedMagic
+  uint16_t  version;        // kPackedVersion
+  uint16_t  section_count;  // entries in the section table
+  uint32_t  byte_length;    // total size of the buffer
+  uint32_t  reserved;
+} PackedHeader;
+
+typedef struct
+{
+  uint32_t  type;           // PackedSectionType
+  uint32_t  offset;         // payload offset from the start of the buffer
+  uint32_t  count;          // number of records
+  uint32_t  record_size;    // bytes per record
+} PackedSection;
+
+// one epoch of a satellite list, rows [first, first + count)
+typedef struct
+{
+  double    gnsstime;
+  uint32_t  first;
+  uint32_t  count;
+} PackedEpoch;
+
+// ssn_tracked_satellites_t with the bool[SIG_LAST] array packed into a
+// 64-bit mask; bit n set means SignalType_t n is tracked
+typedef struct
+{
+  uint8_t   svid;
+  uint8_t   freqnr;
+  uint16_t  reserved;
+  uint32_t  signals_lo;     // SignalType_t 0..31
+  uint32_t  signals_hi;     // SignalType_t 32..SIG_LAST-1
+} PackedTrackedSatellite;
+
+#pragma pack(pop)
+
+// Everything a packed result can hold; null members are left out
+struct PackedInput {
+  const ssn_pvterror_percentages_t* errors = nullptr;
+  const ssn_pvtmode_percentages_t*  modes = nullptr;
+  const TrackedTimeline*            tracked = nullptr;
+  const UsedTimeline*               used = nullptr;
+};
+
+// Bytes needed to pack `input`
+size_t PackedByteLength(const PackedInput& input);
+
+// Writes `input` into `dest`, which must hold PackedByteLength() bytes and be
+// zero-initialised (padding is not written)
+void WritePacked(const PackedInput& input, void* dest);
+
+}
+
+#endif
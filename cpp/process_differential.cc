@@ -0,0 +1,195 @@
+#include "process_differential.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "async_job.h"
+#include "base_finder.h"
+#include "diff_pipeline.h"
+#include "engine_profile.h"
+#include "job_binding.h"
+#include "sbf_stream.h"
+#include "v8_util.h"
+
+namespace fs = std::filesystem;
+
+namespace calculate {
+
+using v8::Array;
+using v8::Boolean;
+using v8::Context;
+using v8::Exception;
+using v8::FunctionCallbackInfo;
+using v8::Isolate;
+using v8::Local;
+using v8::Object;
+using v8::String;
+using v8::Value;
+
+namespace {
+
+void SetString(Isolate* isolate, Local<Object> target, const char* key,
+               const std::string& value) {
+  Set(isolate, target, key,
+      String::NewFromUtf8(isolate, value.c_str()).ToLocalChecked());
+}
+
+std::string DefaultOutput(const std::string& rover) {
+  fs::path path = fs::u8path(rover);
+  path.replace_filename(path.stem().u8string() + "_diff.sbf");
+  return path.u8string();
+}
+
+class ProcessDifferentialJob : public AsyncJob {
+ public:
+  ProcessDifferentialJob(Isolate* isolate, std::vector<DiffTask> tasks,
+                         const DiffPipelineOptions& options,
+                         Local<Value> binding)
+      : AsyncJob(isolate, "calculate:processDifferential"),
+        tasks_(std::move(tasks)), options_(options),
+        binding_(isolate, binding) {}
+
+ protected:
+  void Execute() override {
+    JobControl* control = binding_.control();
+    ssn_error_t rerror = control->cancelled()
+        ? CancelledError()
+        : RunDiffPipeline(&tasks_, options_, &result_, control);
+    if (control->cancelled())
+      SetCancelled();
+    else if (!IsOk(rerror))
+      SetError(rerror);
+  }
+
+  void OnSettle(Isolate* isolate) override { binding_.Finish(isolate); }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    Local<Context> context = isolate->GetCurrentContext();
+    Local<Array> tasks = Array::New(isolate, static_cast<int>(tasks_.size()));
+
+    for (size_t i = 0; i < tasks_.size(); ++i) {
+      const DiffTask& task = tasks_[i];
+      Local<Object> entry = Object::New(isolate);
+      SetString(isolate, entry, "rover", task.rover);
+      SetString(isolate, entry, "output", task.output);
+      SetString(isolate, entry, "reference", task.reference);
+      SetString(isolate, entry, "station", task.station);
+      Set(isolate, entry, "cached", Boolean::New(isolate, task.cached));
+      SetNumber(isolate, entry, "fetchSeconds", task.fetch_seconds);
+      SetNumber(isolate, entry, "mergeSeconds", task.merge_seconds);
+      SetNumber(isolate, entry, "pvtSeconds", task.pvt_seconds);
+      SetNumber(isolate, entry, "writeSeconds", task.write_seconds);
+      if (!IsOk(task.error)) {
+        SetString(isolate, entry, "error", DescribeError(task.error));
+        Local<Object> failure = Object::New(isolate);
+        SetFailureFields(isolate, failure, task.failure);
+        Set(isolate, entry, "failure", failure);
+      }
+      tasks->Set(context, static_cast<uint32_t>(i), entry).Check();
+    }
+
+    Local<Object> out = Object::New(isolate);
+    SetNumber(isolate, out, "seconds", result_.seconds);
+    SetNumber(isolate, out, "fetchSeconds", result_.fetch_seconds);
+    SetNumber(isolate, out, "mergeSeconds", result_.merge_seconds);
+    SetNumber(isolate, out, "pvtSeconds", result_.pvt_seconds);
+    SetNumber(isolate, out, "writeSeconds", result_.write_seconds);
+    Set(isolate, out, "tasks", tasks);
+    return out;
+  }
+
+ private:
+  std::vector<DiffTask> tasks_;
+  DiffPipelineOptions options_;
+  DiffPipelineResult result_;
+  JobBinding binding_;
+};
+
+}
+
+void ProcessDifferential(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  if (args.Length() < 1 || !args[0]->IsArray()) {
+    isolate->ThrowException(Exception::TypeError(Key(isolate,
+        "processDifferential(rovers) expects an array of rover files")));
+    return;
+  }
+
+  std::vector<DiffTask> tasks;
+  Local<Array> list = args[0].As<Array>();
+  for (uint32_t i = 0; i < list->Length(); ++i) {
+    Local<Value> entry = list->Get(context, i).ToLocalChecked();
+    DiffTask task;
+    if (entry->IsString()) {
+      task.rover = *String::Utf8Value(isolate, entry);
+    } else if (entry->IsObject()) {
+      Local<Object> object = entry.As<Object>();
+      Local<Value> rover =
+          object->Get(context, Key(isolate, "rover")).ToLocalChecked();
+      Local<Value> output =
+          object->Get(context, Key(isolate, "output")).ToLocalChecked();
+      if (rover->IsString())
+        task.rover = *String::Utf8Value(isolate, rover);
+      if (output->IsString())
+        task.output = *String::Utf8Value(isolate, output);
+    }
+    if (task.rover.empty()) {
+      isolate->ThrowException(Exception::TypeError(Key(isolate,
+          "processDifferential: every entry needs a rover file")));
+      return;
+    }
+    if (task.output.empty())
+      task.output = DefaultOutput(task.rover);
+    tasks.push_back(std::move(task));
+  }
+
+  DiffPipelineOptions options;
+  if (args.Length() > 1 && args[1]->IsObject()) {
+    Local<Object> object = args[1].As<Object>();
+    auto get = [&](const char* key) {
+      return object->Get(context, Key(isolate, key)).ToLocalChecked();
+    };
+
+    Local<Value> value = get("base");
+    if (value->IsObject() &&
+        !ReadBaseQuery(isolate, value, &options.base, false))
+      return;
+    if (!ReadEngineProfile(isolate, object, "processDifferential",
+                           &options.profile))
+      return;
+    value = get("engineOptions");
+    if (value->IsNumber())
+      options.engine_options = value->Uint32Value(context).FromJust();
+    value = get("referenceId");
+    if (value->IsNumber())
+      options.reference_id = value->Int32Value(context).FromJust();
+    value = get("rtcmVersion");
+    if (value->IsNumber()) {
+      bool v2 = value->Uint32Value(context).FromJust() == 2;
+      options.rtcm_version = v2 ? SSNSBFSTREAM_RTCM_2 : SSNSBFSTREAM_RTCM_3;
+      if (v2)
+        options.messages = SSNSBFSTREAM_RTCMV2_MESSAGE_DEFAULT;
+    }
+    value = get("messages");
+    if (value->IsNumber())
+      options.messages = value->Uint32Value(context).FromJust();
+    value = get("referenceOptions");
+    if (value->IsNumber())
+      options.reference_options = value->Uint32Value(context).FromJust();
+    value = get("engines");
+    if (value->IsNumber())
+      options.engines = value->Uint32Value(context).FromJust();
+    value = get("queueDepth");
+    if (value->IsNumber())
+      options.queue_depth = value->Uint32Value(context).FromJust();
+  }
+
+  ProcessDifferentialJob* job =
+      new ProcessDifferentialJob(isolate, std::move(tasks), options, args[1]);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+}
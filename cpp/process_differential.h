@@ -0,0 +1,31 @@
+#ifndef CALCULATE_PROCESS_DIFFERENTIAL_H
+#define CALCULATE_PROCESS_DIFFERENTIAL_H
+
+#include <node.h>
+
+namespace calculate {
+
+// processDifferential(rovers, { base, profile, commands, engineOptions,
+//                               referenceId, rtcmVersion, messages,
+//                               referenceOptions, engines, queueDepth,
+//                               onProgress, signal })
+//   -> Promise<{ seconds, fetchSeconds, mergeSeconds, pvtSeconds,
+//                writeSeconds,
+//                tasks: [{ rover, output, reference, station, cached,
+//                          fetchSeconds, mergeSeconds, pvtSeconds,
+//                          writeSeconds, error, failure }] }>
+//
+// Differential PVT of many rover files, see RunDiffPipeline(). `rovers`
+// holds file paths or { rover, output } objects; the output defaults to
+// <rover>_diff.sbf next to the rover. `base` takes the constellations,
+// radius, station and blacklist of a base station query, `profile` or
+// `commands` the engine configuration (see engine_profile.h). rtcmVersion
+// is 2 or 3 (default: the SDK's); messages and referenceOptions take the
+// ssn_sbfstream_rtcmmessage_t / refoption_t bits. A file that fails
+// carries `error` and `failure` and does not reject the promise; cancelling
+// does.
+void ProcessDifferential(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+}
+
+#endif
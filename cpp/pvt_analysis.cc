@@ -0,0 +1,34 @@
+#include "pvt_analysis.h"
+
+#include "job_control.h"
+#include "metrics.h"
+#include "sbf_stream.h"
+
+namespace calculate {
+
+ssn_error_t AnalyzePVT(ssn_hsbfstream_t sbfstream, const AnalysisOps& ops,
+                       PVTAnalysis* out, JobControl* control) {
+  ssn_error_t rerror = SSNERROR_WARNING_OK;
+  if (control != nullptr)
+    control->AttachStream(sbfstream);
+
+  if (ops.errors) {
+    StageTimer timer(kStageAnalyze, "getPVTErrorPercentages");
+    rerror = timer.Done(SSNSBFAnalyze_getPVTErrorPercentages(
+        sbfstream, ops.sbfid, &out->errors));
+    out->has_errors = IsOk(rerror);
+  }
+
+  if (IsOk(rerror) && ops.modes) {
+    StageTimer timer(kStageAnalyze, "getPVTModePercentages");
+    rerror = timer.Done(SSNSBFAnalyze_getPVTModePercentages(
+        sbfstream, ops.sbfid, &out->modes));
+    out->has_modes = IsOk(rerror);
+  }
+
+  if (control != nullptr)
+    control->DetachStream(sbfstream);
+  return rerror;
+}
+
+}
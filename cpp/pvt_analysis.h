@@ -0,0 +1,73 @@
+#ifndef CALCULATE_PVT_ANALYSIS_H
+#define CALCULATE_PVT_ANALYSIS_H
+
+#include "ssnsbfanalyze.h"
+#include "ssnsbfstream.h"
+
+namespace calculate {
+
+class JobControl;
+
+// The PVT percentage queries of an analysis job
+struct AnalysisOps {
+  SBFID_t sbfid = sbfid_ALL;
+  bool errors = false;
+  bool modes = false;
+};
+
+// What AnalyzePVT() got; has_* tells which of the results are set
+struct PVTAnalysis {
+  bool has_errors = false;
+  bool has_modes = false;
+  ssn_pvterror_percentages_t errors;
+  ssn_pvtmode_percentages_t modes;
+};
+
+// The analyze stage of analyze(), analyzeMany, analyzePacked and the
+// daemon: getPVTErrorPercentages then getPVTModePercentages as `ops` asks,
+// each timed under kStageAnalyze. Stops at and returns the first failing
+// call. `control`, when given, is attached to the stream meanwhile so a
+// cancel reaches the SDK. The caller holds the stream's mutex when the
+// stream is shared.
+ssn_error_t AnalyzePVT(ssn_hsbfstream_t sbfstream, const AnalysisOps& ops,
+                       PVTAnalysis* out, JobControl* control = nullptr);
+
+// Calls fn(key, value) for every field of `r` under the key of the result
+// objects of the addon and the daemon: ne, nem, ..., checktotal, checkerror
+template <typename Fn>
+void ForEachPVTError(const ssn_pvterror_percentages_t& r, Fn fn) {
+  fn("ne", r.ne);
+  fn("nem", r.nem);
+  fn("neea", r.neea);
+  fn("dtl", r.dtl);
+  fn("ssrtl", r.ssrtl);
+  fn("nc", r.nc);
+  fn("nemaor", r.nemaor);
+  fn("popdtel", r.popdtel);
+  fn("nedca", r.nedca);
+  fn("bscu", r.bscu);
+  fn("total", r.total);
+  fn("checktotal", r.checktotal);
+  fn("checkerror", r.checkerror);
+}
+
+// Likewise for the modes: npa, sp, ..., checktotal
+template <typename Fn>
+void ForEachPVTMode(const ssn_pvtmode_percentages_t& r, Fn fn) {
+  fn("npa", r.npa);
+  fn("sp", r.sp);
+  fn("dp", r.dp);
+  fn("fl", r.fl);
+  fn("rfia", r.rfia);
+  fn("rfla", r.rfla);
+  fn("sap", r.sap);
+  fn("mrfia", r.mrfia);
+  fn("mrfla", r.mrfla);
+  fn("pppfia", r.pppfia);
+  fn("pppfla", r.pppfla);
+  fn("checktotal", r.checktotal);
+}
+
+}
+
+#endif
@@ -0,0 +1,145 @@
+#include "pvt_stats.h"
+
+#include <vector>
+
+#include "job_control.h"
+#include "sbf_stream.h"
+#include "sbf_util.h"
+
+namespace calculate {
+
+namespace {
+
+// Mode / Error of PVTCartesian and PVTGeodetic, right after TOW / WNc;
+// sizeof(TimeHeader_t) includes padding under pack(4)
+const size_t kPvtModeOffset = 14;
+const size_t kPvtErrorOffset = 15;
+
+// blocks between two cancellation checks
+const uint64_t kCancelCheckBlocks = 4096;
+
+// SBF Error / Mode codes in ssn_pvt*_percentages_t member order
+float ssn_pvterror_percentages_t::* const kErrorFields[] = {
+  &ssn_pvterror_percentages_t::ne,
+  &ssn_pvterror_percentages_t::nem,
+  &ssn_pvterror_percentages_t::neea,
+  &ssn_pvterror_percentages_t::dtl,
+  &ssn_pvterror_percentages_t::ssrtl,
+  &ssn_pvterror_percentages_t::nc,
+  &ssn_pvterror_percentages_t::nemaor,
+  &ssn_pvterror_percentages_t::popdtel,
+  &ssn_pvterror_percentages_t::nedca,
+  &ssn_pvterror_percentages_t::bscu
+};
+
+float ssn_pvtmode_percentages_t::* const kModeFields[] = {
+  &ssn_pvtmode_percentages_t::npa,
+  &ssn_pvtmode_percentages_t::sp,
+  &ssn_pvtmode_percentages_t::dp,
+  &ssn_pvtmode_percentages_t::fl,
+  &ssn_pvtmode_percentages_t::rfia,
+  &ssn_pvtmode_percentages_t::rfla,
+  &ssn_pvtmode_percentages_t::sap,
+  &ssn_pvtmode_percentages_t::mrfia,
+  &ssn_pvtmode_percentages_t::mrfla,
+  &ssn_pvtmode_percentages_t::pppfia,
+  &ssn_pvtmode_percentages_t::pppfla
+};
+
+}
+
+void PvtTally::Add(const uint8_t* block, uint16_t length) {
+  if (length <= kPvtErrorOffset)
+    return;
+
+  uint8_t mode = block[kPvtModeOffset] & 0x0f;
+  uint8_t error = block[kPvtErrorOffset];
+  ++blocks_;
+  if (error != 0)
+    ++erroneous_;
+  if (error < 10)
+    ++error_counts_[error];
+  if (mode < 11)
+    ++mode_counts_[mode];
+}
+
+void PvtTally::Errors(ssn_pvterror_percentages_t* errors) const {
+  *errors = ssn_pvterror_percentages_t();
+  if (blocks_ > 0) {
+    float scale = 100.0f / static_cast<float>(blocks_);
+    for (size_t i = 0; i < 10; ++i)
+      errors->*kErrorFields[i] = error_counts_[i] * scale;
+    errors->total = erroneous_ * scale;
+  }
+  errors->checktotal = static_cast<uint32_t>(blocks_);
+  errors->checkerror = static_cast<uint32_t>(erroneous_);
+}
+
+void PvtTally::Modes(ssn_pvtmode_percentages_t* modes) const {
+  *modes = ssn_pvtmode_percentages_t();
+  if (blocks_ > 0) {
+    float scale = 100.0f / static_cast<float>(blocks_);
+    for (size_t i = 0; i < 11; ++i)
+      modes->*kModeFields[i] = mode_counts_[i] * scale;
+  }
+  modes->checktotal = static_cast<uint32_t>(blocks_);
+}
+
+ssn_error_t IncrementalPvtStats::Update(ssn_hsbfstream_t sbfstream,
+                                        uint64_t* added, JobControl* control) {
+  std::vector<uint8_t> buffer(MAX_SBFSIZE);
+  VoidBlock_t* block = reinterpret_cast<VoidBlock_t*>(buffer.data());
+  ssn_error_t rerror;
+
+  *added = 0;
+
+  rerror = SSNSBFStream_positionSave(sbfstream);
+  if (!IsOk(rerror))
+    return rerror;
+
+  // a stream that got shorter was replaced; count it again from the start
+  uint32_t size = 0;
+  rerror = SSNSBFStream_getSize(sbfstream, &size);
+  if (IsOk(rerror) && size < position_) {
+    tally_ = PvtTally();
+    started_ = false;
+    position_ = 0;
+  }
+
+  if (IsOk(rerror))
+    rerror = started_ ? SSNSBFStream_setPosition(sbfstream, position_)
+                      : SSNSBFStream_rewind(sbfstream);
+  bool positioned = IsOk(rerror);
+
+  while (IsOk(rerror)) {
+    if (control != nullptr && *added % kCancelCheckBlocks == 0 &&
+        control->cancelled()) {
+      rerror = CancelledError();
+      break;
+    }
+
+    rerror = SSNSBFStream_getNextBlockByID(sbfstream, sbfid_, block);
+    if (IsEndOfStream(rerror)) {
+      rerror = SSNERROR_WARNING_OK;
+      break;
+    }
+    if (!IsOk(rerror))
+      break;
+
+    tally_.Add(buffer.data(), block->Length);
+    ++*added;
+  }
+
+  // remember how far the tally got, also when it was cut short, so the
+  // next call neither skips nor counts a block twice
+  uint32_t position = 0;
+  if (positioned && IsOk(SSNSBFStream_getPosition(sbfstream, &position))) {
+    position_ = position;
+    started_ = true;
+  }
+
+  ssn_error_t oerror = SSNSBFStream_positionRestore(sbfstream);
+  return IsOk(rerror) ? oerror : rerror;
+}
+
+}
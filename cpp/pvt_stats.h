@@ -0,0 +1,61 @@
+#ifndef CALCULATE_PVT_STATS_H
+#define CALCULATE_PVT_STATS_H
+
+#include <stdint.h>
+
+#include "sbfdef.h"
+#include "ssnsbfanalyze.h"
+#include "ssnsbfstream.h"
+
+namespace calculate {
+
+class JobControl;
+
+// Running Mode / Error counts over PVTCartesian / PVTGeodetic blocks, turned
+// into the same percentages SSNSBFAnalyze_getPVT*Percentages returns
+class PvtTally {
+ public:
+  // Counts one raw PVT block (BlockHeader_t onwards)
+  void Add(const uint8_t* block, uint16_t length);
+
+  void Errors(ssn_pvterror_percentages_t* errors) const;
+  void Modes(ssn_pvtmode_percentages_t* modes) const;
+
+  uint64_t blocks() const { return blocks_; }
+
+ private:
+  uint64_t error_counts_[10] = {};
+  uint64_t mode_counts_[11] = {};
+  uint64_t blocks_ = 0;
+  uint64_t erroneous_ = 0;
+};
+
+// PVT percentages of a stream that only grows, updated from the blocks
+// appended since the previous Update().
+//
+// SSNSBFAnalyze_getPVT*Percentages rescan the whole stream on every call,
+// so refreshing them while a stream grows costs O(n^2) over a session.
+// This keeps the tally and the stream position it reached instead; the
+// caller must hold the stream's mutex, and the stream's own position is
+// restored afterwards.
+class IncrementalPvtStats {
+ public:
+  explicit IncrementalPvtStats(SBFID_t sbfid) : sbfid_(sbfid) {}
+
+  // Tallies the blocks past the last position; `added` receives their count
+  ssn_error_t Update(ssn_hsbfstream_t sbfstream, uint64_t* added,
+                     JobControl* control = nullptr);
+
+  const PvtTally& tally() const { return tally_; }
+  SBFID_t sbfid() const { return sbfid_; }
+
+ private:
+  SBFID_t  sbfid_;
+  uint32_t position_ = 0;
+  bool     started_ = false;
+  PvtTally tally_;
+};
+
+}
+
+#endif
@@ -0,0 +1,331 @@
+#include "replay_scheduler.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <timeapi.h>
+#endif
+
+#include "sbfdef.h"
+
+#include "block_index.h"
+#include "sbf_util.h"
+
+namespace calculate {
+
+namespace {
+
+// GNSS ms of a block, negative when it has no valid time
+double BlockTime(const uint8_t* block, uint16_t length) {
+  if (length < sizeof(TimeHeader_t))
+    return -1.0;
+  TimeHeader_t header;
+  memcpy(&header, block, sizeof(header));
+  if (header.TOW == kTowDoNotUse || header.WNc == kWncDoNotUse)
+    return -1.0;
+  return header.WNc * 604800000.0 + header.TOW;
+}
+
+double ClampSpeed(double speed) {
+  return std::min(std::max(speed, kMinReplaySpeed), kMaxReplaySpeed);
+}
+
+}
+
+ReplayScheduler::ReplayScheduler(const std::shared_ptr<SbfStream>& stream,
+                                 const ReplayOptions& options,
+                                 FrameFn on_frame)
+    : stream_(stream), options_(options), on_frame_(std::move(on_frame)),
+      hold_(MAX_SBFSIZE) {
+  playing_ = !options.paused;
+  speed_ = ClampSpeed(options.speed);
+}
+
+ReplayScheduler::~ReplayScheduler() {
+  Stop();
+}
+
+void ReplayScheduler::Start() {
+  if (thread_.joinable())
+    return;
+  stop_ = false;
+  thread_ = std::thread(&ReplayScheduler::Run, this);
+}
+
+void ReplayScheduler::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  if (thread_.joinable())
+    thread_.join();
+}
+
+void ReplayScheduler::Play() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (playing_)
+      return;
+    Reanchor(Clock::now());
+    playing_ = true;
+  }
+  wake_.notify_all();
+}
+
+void ReplayScheduler::Pause() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Reanchor(Clock::now());
+  playing_ = false;
+}
+
+void ReplayScheduler::SetSpeed(double speed) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Reanchor(Clock::now());
+  speed_ = ClampSpeed(speed);
+}
+
+void ReplayScheduler::Seek(double gnsstime) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    seek_pending_ = true;
+    seek_time_ = gnsstime;
+  }
+  wake_.notify_all();
+}
+
+bool ReplayScheduler::TakeFrame(ReplayFrame* frame) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  frame->blocks.clear();
+  frame->offsets.clear();
+  if (pending_.offsets.empty())
+    return false;
+  frame->blocks.swap(pending_.blocks);
+  frame->offsets.swap(pending_.offsets);
+  return true;
+}
+
+ReplayStats ReplayScheduler::GetStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ReplayStats stats = stats_;
+  stats.playing = playing_;
+  stats.speed = speed_;
+  if (anchored_)
+    stats.time = ClockAt(Clock::now()) / 1000.0;
+  return stats;
+}
+
+double ReplayScheduler::ClockAt(Clock::time_point now) const {
+  if (!playing_)
+    return anchor_ms_;
+  return anchor_ms_ +
+         std::chrono::duration<double, std::milli>(now - anchor_wall_)
+             .count() * speed_;
+}
+
+void ReplayScheduler::Reanchor(Clock::time_point now) {
+  anchor_ms_ = ClockAt(now);
+  anchor_wall_ = now;
+}
+
+void ReplayScheduler::Run() {
+#ifdef _WIN32
+  // the default 15.6 ms tick would let frames slip by half a budget
+  timeBeginPeriod(1);
+#endif
+
+  ReplayFrame frame;
+  Clock::time_point deadline = Clock::now();
+  while (!stop_) {
+    bool seek = false;
+    double seek_time = 0.0;
+    double due = 0.0;
+    bool anchor = false;
+    bool room = false;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      auto ready = [this]() {
+        return stop_ || seek_pending_ || (playing_ && !stats_.finished);
+      };
+      if (!ready()) {
+        wake_.wait(lock, ready);
+        // frames missed while paused are not late
+        deadline = Clock::now();
+      }
+      if (stop_)
+        break;
+      if (seek_pending_) {
+        seek = true;
+        seek_time = seek_time_;
+        seek_pending_ = false;
+        // blocks read before the seek must not reach the next TakeFrame
+        pending_.blocks.clear();
+        pending_.offsets.clear();
+      } else {
+        anchor = anchored_;
+        due = ClockAt(Clock::now());
+        room = pending_.blocks.size() < options_.max_pending_bytes;
+      }
+    }
+
+    if (seek) {
+      bool found = false;
+      ssn_error_t rerror = SeekStream(seek_time, &found);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.seeks;
+        stats_.finished = IsOk(rerror) && !found;
+        if (!IsOk(rerror))
+          stats_.error = DescribeError(rerror);
+        anchored_ = true;
+        anchor_ms_ = seek_time * 1000.0;
+        anchor_wall_ = Clock::now();
+      }
+      deadline = Clock::now();
+      Notify();
+      continue;
+    }
+
+    frame.blocks.clear();
+    frame.offsets.clear();
+    double oldest = due;
+    bool end = false;
+    ssn_error_t rerror = SSNERROR_WARNING_OK;
+    bool was_anchored = anchor;
+    if (room)
+      rerror = Fill(&due, &anchor, &frame, &oldest, &end);
+
+    Clock::time_point now = Clock::now();
+    bool changed = !frame.offsets.empty() || end || !IsOk(rerror);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!was_anchored && anchor && !anchored_) {
+        // the clock starts at the first timed block
+        anchored_ = true;
+        anchor_ms_ = due;
+        anchor_wall_ = now;
+      }
+      if (!frame.offsets.empty()) {
+        size_t base = pending_.blocks.size();
+        pending_.blocks.insert(pending_.blocks.end(), frame.blocks.begin(),
+                               frame.blocks.end());
+        if (pending_.offsets.empty())
+          pending_.offsets.push_back(0);
+        for (size_t i = 1; i < frame.offsets.size(); ++i)
+          pending_.offsets.push_back(
+              static_cast<uint32_t>(base + frame.offsets[i]));
+        stats_.blocks += frame.offsets.size() - 1;
+        stats_.bytes += frame.blocks.size();
+        ++stats_.frames;
+        stats_.lag_ms = oldest < due ? (due - oldest) / speed_ : 0.0;
+        pvt_.Errors(&stats_.errors);
+        pvt_.Modes(&stats_.modes);
+      }
+      if (now > deadline + options_.frame)
+        ++stats_.late_frames;
+      if (!IsOk(rerror))
+        stats_.error = DescribeError(rerror);
+      // the clock stops where the data ends or cannot be read, until the
+      // next seek
+      if (end || !IsOk(rerror)) {
+        Reanchor(now);
+        playing_ = false;
+      }
+      if (end)
+        stats_.finished = true;
+    }
+    if (changed)
+      Notify();
+
+    deadline += options_.frame;
+    if (deadline < now)
+      deadline = now;
+    std::unique_lock<std::mutex> lock(mutex_);
+    wake_.wait_until(lock, deadline,
+                     [this]() { return stop_ || seek_pending_; });
+  }
+
+#ifdef _WIN32
+  timeEndPeriod(1);
+#endif
+}
+
+ssn_error_t ReplayScheduler::Fill(double* due, bool* anchor,
+                                  ReplayFrame* frame, double* oldest,
+                                  bool* end) {
+  std::lock_guard<std::mutex> lock(stream_->mutex());
+  ssn_hsbfstream_t sbfstream = stream_->handle();
+
+  // the handle is shared, so pick up where the replay left off
+  ssn_error_t rerror = started_
+      ? SSNSBFStream_setPosition(sbfstream, position_)
+      : SSNSBFStream_rewind(sbfstream);
+  if (!IsOk(rerror))
+    return rerror;
+  started_ = true;
+
+  VoidBlock_t* block = reinterpret_cast<VoidBlock_t*>(hold_.data());
+  while (frame->blocks.size() < options_.max_pending_bytes) {
+    if (!holding_) {
+      rerror = options_.sbfid == sbfid_ALL
+          ? SSNSBFStream_getNextBlock(sbfstream, block)
+          : SSNSBFStream_getNextBlockByID(sbfstream, options_.sbfid, block);
+      if (IsEndOfStream(rerror)) {
+        *end = true;
+        rerror = SSNERROR_WARNING_OK;
+        break;
+      }
+      if (!IsOk(rerror))
+        break;
+      holding_ = true;
+    }
+
+    const uint8_t* bytes = hold_.data();
+    double time = BlockTime(bytes, block->Length);
+    if (time >= 0.0) {
+      if (!*anchor) {
+        *anchor = true;
+        *due = time;
+      }
+      if (time > *due)
+        break;
+      *oldest = std::min(*oldest, time);
+    }
+
+    if (frame->offsets.empty())
+      frame->offsets.push_back(0);
+    frame->blocks.insert(frame->blocks.end(), bytes, bytes + block->Length);
+    frame->offsets.push_back(static_cast<uint32_t>(frame->blocks.size()));
+    if (SBF_ID_TO_NUMBER(block->ID) == options_.pvt_number)
+      pvt_.Add(bytes, block->Length);
+    holding_ = false;
+  }
+
+  if (IsOk(rerror) && !*end)
+    rerror = SSNSBFStream_getPosition(sbfstream, &position_);
+  return rerror;
+}
+
+ssn_error_t ReplayScheduler::SeekStream(double gnsstime, bool* found) {
+  std::lock_guard<std::mutex> lock(stream_->mutex());
+  uint32_t position = 0;
+  ssn_error_t rerror = FindBlockPosition(
+      stream_->handle(), stream_->index().get(), gnsstime, options_.sbfid,
+      &position, found);
+  if (IsOk(rerror) && *found) {
+    position_ = position;
+    started_ = true;
+    holding_ = false;
+  }
+  return rerror;
+}
+
+void ReplayScheduler::Notify() {
+  if (on_frame_)
+    on_frame_();
+}
+
+}
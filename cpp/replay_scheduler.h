@@ -0,0 +1,153 @@
+#ifndef CALCULATE_REPLAY_SCHEDULER_H
+#define CALCULATE_REPLAY_SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ssnsbfanalyze.h"
+
+#include "pvt_stats.h"
+#include "sbf_stream.h"
+
+namespace calculate {
+
+const double kMinReplaySpeed = 0.1;
+const double kMaxReplaySpeed = 100.0;
+
+struct ReplayOptions {
+  double speed = 1.0;                  // GNSS seconds per wall second
+  std::chrono::milliseconds frame{33}; // frame budget
+  SBFID_t sbfid = sbfid_ALL;           // blocks replayed
+  uint16_t pvt_number = 4007;          // PVTGeodetic, for the percentages
+  // frame bytes not yet taken by the consumer before the replay holds off
+  size_t max_pending_bytes = 4 << 20;
+  bool paused = false;                 // start paused
+};
+
+struct ReplayStats {
+  bool playing = false;
+  bool finished = false;               // the end of the stream was reached
+  double speed = 1.0;
+  double time = 0.0;                   // replay clock, GNSS seconds; 0 until
+                                       // the first timed block
+  uint64_t blocks = 0;                 // replayed since the start
+  uint64_t bytes = 0;
+  uint64_t frames = 0;                 // with at least one block
+  uint64_t late_frames = 0;            // that overran the frame budget
+  double lag_ms = 0.0;                 // wall time the last frame's oldest
+                                       // block was overdue
+  uint64_t seeks = 0;
+  ssn_pvterror_percentages_t errors = {};  // of the PVT blocks replayed
+  ssn_pvtmode_percentages_t modes = {};
+  std::string error;                   // last SDK error
+};
+
+// Blocks replayed since the consumer last took a frame
+struct ReplayFrame {
+  std::vector<uint8_t> blocks;         // back to back, block i at
+  std::vector<uint32_t> offsets;       // [offsets[i], offsets[i + 1])
+};
+
+// Replays a loaded stream at a controlled speed on a dedicated thread, the
+// non-blocking counterpart of SSNSBFStream_waitOnNextBlock().
+//
+// The scheduler wakes once per frame budget on a steady-clock deadline
+// (with a 1 ms system timer on Windows) and moves a replay clock, GNSS
+// time anchored at its last seek, play or speed change, on by the wall
+// time elapsed times the speed. The blocks whose time stamp the clock has
+// passed are read into the frame under the stream's mutex, which is never
+// held across a wait; the first block not yet due is kept for the next
+// frame. Blocks without a valid time go out with the ones before them.
+//
+// Pausing freezes the clock, changing the speed re-anchors it where it is,
+// and seeking moves the stream position through the session's block index
+// (a linear SDK scan without one) and the clock to the time sought, so
+// none of them replays from the start. A consumer that falls behind holds
+// the replay off after max_pending_bytes instead of growing the frame; the
+// clock keeps running and the lag shows in the stats.
+class ReplayScheduler {
+ public:
+  // replay thread, whenever a frame or a state change is ready to take
+  typedef std::function<void()> FrameFn;
+
+  ReplayScheduler(const std::shared_ptr<SbfStream>& stream,
+                  const ReplayOptions& options, FrameFn on_frame = FrameFn());
+  ~ReplayScheduler();
+
+  ReplayScheduler(const ReplayScheduler&) = delete;
+  void operator=(const ReplayScheduler&) = delete;
+
+  void Start();
+  // Stops and joins the replay thread, within one frame budget
+  void Stop();
+
+  void Play();
+  void Pause();
+  // clamped to kMinReplaySpeed..kMaxReplaySpeed
+  void SetSpeed(double speed);
+  // continues from the first replayed block at or after `gnsstime`
+  void Seek(double gnsstime);
+
+  // Moves the blocks replayed since the last call into `frame`; false when
+  // there are none
+  bool TakeFrame(ReplayFrame* frame);
+
+  ReplayStats GetStats();
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  void Run();
+  // replay clock in GNSS ms at `now`; mutex_ held
+  double ClockAt(Clock::time_point now) const;
+  void Reanchor(Clock::time_point now);
+  // Reads the blocks due by the clock `due` (GNSS ms) into `frame`, or
+  // with `*anchor` unset from the first timed block on, which then sets
+  // `*due`. `oldest` gets the earliest time stamp read, `end` whether the
+  // stream ran out.
+  ssn_error_t Fill(double* due, bool* anchor, ReplayFrame* frame,
+                   double* oldest, bool* end);
+  ssn_error_t SeekStream(double gnsstime, bool* found);
+  void Notify();
+
+  std::shared_ptr<SbfStream> stream_;
+  ReplayOptions options_;
+  FrameFn on_frame_;
+
+  std::thread thread_;
+  std::atomic<bool> stop_{false};
+
+  // replay thread only
+  std::vector<uint8_t> hold_;          // first block not yet due
+  bool holding_ = false;
+  uint32_t position_ = 0;              // stream position after hold_
+  bool started_ = false;
+  PvtTally pvt_;
+
+  // everything below is guarded by mutex_
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool playing_ = true;
+  double speed_ = 1.0;
+  bool anchored_ = false;              // the clock has a time
+  double anchor_ms_ = 0.0;             // replay clock at anchor_wall_
+  Clock::time_point anchor_wall_;
+  bool seek_pending_ = false;
+  double seek_time_ = 0.0;
+  ReplayFrame pending_;
+  ReplayStats stats_;
+};
+
+}
+
+#endif
@@ -0,0 +1,372 @@
+#include "rinex_conversion.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "sbfdef.h"
+#include "ssnrnxdec.h"
+#include "ssnsbfstream.h"
+
+#include "batch_analysis.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "sbf_stream.h"
+#include "scratch_arena.h"
+
+namespace calculate {
+
+namespace {
+
+// windows shorter than this cost more in per-decoder overhead than they save
+const double kMinWindowSeconds = 600.0;
+
+// and every window re-reads its whole set, so no set splits further
+const size_t kMaxPieces = 64;
+
+// tail of a RINEX 3 file searched for the last epoch line
+const size_t kTailBytes = 1024 * 1024;
+
+// days from 1970-01-01 to a proleptic Gregorian date
+int64_t DaysFromCivil(int64_t y, int64_t m, int64_t d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  int64_t yoe = y - era * 400;
+  int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+// calendar GPS time to WNc * 604800 + TOW
+double GnssSeconds(int year, int month, int day, int hour, int minute,
+                   double second) {
+  int64_t days = DaysFromCivil(year, month, day) - DaysFromCivil(1980, 1, 6);
+  return days * 86400.0 + hour * 3600.0 + minute * 60.0 + second;
+}
+
+// "  2023     1     5     0     0    0.0000000     GPS" and
+// "> 2023 01 05 00 00  0.0000000  0 32" both parse after the first column
+bool ParseTime(const std::string& text, double* gnsstime) {
+  int year, month, day, hour, minute;
+  double second;
+  if (sscanf(text.c_str(), "%d %d %d %d %d %lf", &year, &month, &day, &hour,
+             &minute, &second) != 6 || year < 1980)
+    return false;
+  *gnsstime = GnssSeconds(year, month, day, hour, minute, second);
+  return true;
+}
+
+// seconds to add to a time in `system` to get GPS time; false when the
+// system is not a fixed offset from GPS (GLONASS, UTC)
+bool TimeSystemOffset(const std::string& system, double* offset) {
+  if (system.empty() || system == "GPS" || system == "GAL" ||
+      system == "QZS" || system == "IRN") {
+    *offset = 0.0;
+    return true;
+  }
+  if (system == "BDT") {
+    *offset = 14.0;
+    return true;
+  }
+  return false;
+}
+
+std::string Trim(const std::string& text) {
+  size_t begin = text.find_first_not_of(' ');
+  size_t end = text.find_last_not_of(" \r");
+  return begin == std::string::npos ? std::string()
+                                    : text.substr(begin, end - begin + 1);
+}
+
+// Span of one observation file; false for other file types or when the
+// header has no usable times
+bool ReadObservationSpan(const std::string& path, double* first,
+                         double* last) {
+  MappedFile file;
+  if (!file.Open(path) || file.data() == nullptr)
+    return false;
+
+  const char* data = reinterpret_cast<const char*>(file.data());
+  size_t size = file.size();
+  double version = 0.0, offset = 0.0;
+  bool observation = false, has_first = false, has_last = false;
+  bool aligned = true;
+
+  for (size_t pos = 0; pos < size;) {
+    const char* end = static_cast<const char*>(
+        memchr(data + pos, '\n', size - pos));
+    size_t length = (end != nullptr ? end - data : size) - pos;
+    std::string line(data + pos, length);
+    pos += length + 1;
+
+    std::string label = line.size() > 60 ? Trim(line.substr(60)) : "";
+    if (label == "RINEX VERSION / TYPE") {
+      version = atof(line.substr(0, 9).c_str());
+      observation = line.size() > 20 && line[20] == 'O';
+      if (!observation)
+        return false;
+    } else if (label == "TIME OF FIRST OBS" || label == "TIME OF LAST OBS") {
+      double time;
+      if (!ParseTime(line.substr(0, 43), &time))
+        continue;
+      aligned = aligned &&
+                TimeSystemOffset(Trim(line.substr(48, 3)), &offset);
+      if (label == "TIME OF FIRST OBS") {
+        *first = time;
+        has_first = true;
+      } else {
+        *last = time;
+        has_last = true;
+      }
+    } else if (label == "END OF HEADER") {
+      break;
+    }
+  }
+
+  if (!observation || !has_first || !aligned)
+    return false;
+
+  // TIME OF LAST OBS is optional; RINEX 3 epoch lines start with '>'
+  if (!has_last && version >= 3.0) {
+    size_t from = size > kTailBytes ? size - kTailBytes : 0;
+    for (size_t pos = size; pos > from; --pos) {
+      if (data[pos - 1] != '>' || (pos > 1 && data[pos - 2] != '\n'))
+        continue;
+      const char* end = static_cast<const char*>(
+          memchr(data + pos, '\n', size - pos));
+      std::string line(data + pos, (end != nullptr ? end - data : size) - pos);
+      has_last = ParseTime(line, last);
+      break;
+    }
+  }
+  if (!has_last)
+    return false;
+
+  *first += offset;
+  *last += offset;
+  return *last >= *first;
+}
+
+// Per-worker SDK handles plus every task's output stream. The streams were
+// created on the workers' SDK handles, so they are closed first.
+struct ConversionWorkspace {
+  std::vector<ssn_hsdk_t> sdks;
+  std::vector<ssn_hsbfstream_t> outputs;
+  std::vector<uint8_t> output_open;   // not vector<bool>: set concurrently
+
+  ~ConversionWorkspace() {
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      if (output_open[i])
+        SSNSBFStream_close(outputs[i]);
+    }
+    for (ssn_hsdk_t sdk : sdks)
+      CloseSdk(sdk);
+  }
+};
+
+ssn_error_t Convert(ssn_hsdk_t sdk, const RinexSet& set, RinexTask* task,
+                    unsigned part, JobControl* control,
+                    ssn_hsbfstream_t* output, uint8_t* output_open) {
+  ssn_hrnxdec_t decoder;
+  ssn_error_t rerror = SSNRNXDec_open(sdk, &decoder);
+  if (!IsOk(rerror))
+    return rerror;
+  if (control != nullptr)
+    control->AttachDecoder(decoder, part);
+
+  for (const std::string& path : set.files) {
+    // the SDK takes a mutable name
+    ScratchScope scratch;
+    char* filename = scratch.arena().AllocateArray<char>(path.size() + 1);
+    memcpy(filename, path.c_str(), path.size() + 1);
+    rerror = SSNRNXDec_addRinexFile(decoder, filename);
+    if (!IsOk(rerror))
+      break;
+  }
+
+  if (IsOk(rerror)) {
+    // open-ended at both ends, so no navigation data is cropped away;
+    // interior ends stop short of the next window's first epoch
+    double start = task->window == 0 ? F64_NOTVALID : task->start;
+    double end = task->window + 1 == task->windows ? F64_NOTVALID
+                                                   : task->end - 1e-3;
+    auto begin = std::chrono::steady_clock::now();
+    rerror = task->windows > 1
+        ? SSNRNXDec_createSBFCropped(decoder, start, end, output)
+        : SSNRNXDec_createSBF(decoder, output);
+    task->seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - begin).count();
+    *output_open = IsOk(rerror) ? 1 : 0;
+  }
+
+  if (control != nullptr)
+    control->DetachDecoder(decoder);
+  SSNRNXDec_close(decoder);
+  if (!IsOk(rerror))
+    return rerror;
+
+  int blocks = 0, epochs = 0, revised = 0;
+  rerror = SSNSBFStream_getNumberOfBlocks(*output, sbfid_ALL, true, &blocks);
+  if (IsOk(rerror))
+    rerror = SSNSBFStream_getNumberOfBlocks(*output, sbfid_MeasEpoch_2_0, true,
+                                            &epochs);
+  if (IsOk(rerror))
+    rerror = SSNSBFStream_getNumberOfBlocks(*output, sbfid_MeasEpoch_2_1, true,
+                                            &revised);
+  task->blocks = static_cast<uint64_t>(blocks);
+  task->epochs = static_cast<uint64_t>(epochs) + static_cast<uint64_t>(revised);
+
+  if (control != nullptr)
+    control->Report(part, 100.0f);
+  return rerror;
+}
+
+}
+
+RinexSpan ReadRinexSpan(const RinexSet& set) {
+  RinexSpan span;
+  for (const std::string& path : set.files) {
+    double first, last;
+    if (!ReadObservationSpan(path, &first, &last))
+      continue;
+    span.first = span.known ? std::min(span.first, first) : first;
+    span.last = span.known ? std::max(span.last, last) : last;
+    span.known = true;
+  }
+  return span;
+}
+
+ssn_error_t RunRinexConversion(const std::vector<RinexSet>& sets,
+                               const RinexConversionOptions& options,
+                               RinexConversionResult* result,
+                               JobControl* control) {
+  ssn_error_t rerror = SSNERROR_WARNING_OK;
+  unsigned workers = options.workers > 0 ? options.workers
+                                         : BatchAnalysis::DefaultConcurrency();
+
+  result->spans.clear();
+  for (const RinexSet& set : sets)
+    result->spans.push_back(ReadRinexSpan(set));
+
+  // merge order: by first observation, sets without a known span last
+  std::vector<size_t> order(sets.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  auto key = [&](size_t i) {
+    return result->spans[i].known ? result->spans[i].first : HUGE_VAL;
+  };
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t a, size_t b) { return key(a) < key(b); });
+
+  size_t auto_pieces = sets.empty() ? 1 : (workers + sets.size() - 1) /
+                                              sets.size();
+  result->tasks.clear();
+  for (size_t index : order) {
+    const RinexSpan& span = result->spans[index];
+    double length = span.last - span.first + 1.0;
+    size_t pieces = 1;
+    if (span.known && options.window > 0) {
+      double window = std::max({options.window, kMinWindowSeconds,
+                                length / kMaxPieces});
+      pieces = static_cast<size_t>(ceil(length / window));
+    } else if (span.known && options.window == 0) {
+      pieces = std::min(auto_pieces, static_cast<size_t>(
+                                         floor(length / kMinWindowSeconds)));
+    }
+    pieces = std::min(std::max<size_t>(pieces, 1), kMaxPieces);
+
+    for (size_t k = 0; k < pieces; ++k) {
+      RinexTask task;
+      task.set = index;
+      task.window = static_cast<unsigned>(k);
+      task.windows = static_cast<unsigned>(pieces);
+      if (span.known) {
+        task.start = span.first + length * k / pieces;
+        task.end = span.first + length * (k + 1) / pieces;
+      }
+      result->tasks.push_back(task);
+    }
+  }
+
+  std::vector<RinexTask>& tasks = result->tasks;
+  workers = static_cast<unsigned>(
+      std::max<size_t>(std::min<size_t>(workers, tasks.size()), 1));
+  result->workers = workers;
+  if (tasks.empty())
+    return rerror;
+  if (control != nullptr)
+    control->SetParts(static_cast<unsigned>(tasks.size()));
+
+  ConversionWorkspace workspace;
+  workspace.outputs.resize(tasks.size());
+  workspace.output_open.assign(tasks.size(), false);
+  for (unsigned i = 0; i < workers; ++i) {
+    ssn_hsdk_t sdk;
+    rerror = OpenSdk(&sdk);
+    if (!IsOk(rerror))
+      return rerror;
+    workspace.sdks.push_back(sdk);
+  }
+
+  std::atomic<size_t> next{0};
+  auto begin = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  threads.reserve(workers);
+
+  for (unsigned i = 0; i < workers; ++i) {
+    threads.emplace_back([&, i]() {
+      for (;;) {
+        size_t k = next++;
+        if (k >= tasks.size() || (control != nullptr && control->cancelled()))
+          break;
+        tasks[k].error = Convert(workspace.sdks[i], sets[tasks[k].set],
+                                 &tasks[k], static_cast<unsigned>(k), control,
+                                 &workspace.outputs[k],
+                                 &workspace.output_open[k]);
+      }
+    });
+  }
+
+  for (std::thread& thread : threads)
+    thread.join();
+  result->seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - begin).count();
+
+  if (control != nullptr && control->cancelled())
+    return CancelledError();
+
+  for (const RinexTask& task : tasks) {
+    if (!IsOk(task.error))
+      return task.error;
+    result->blocks += task.blocks;
+    result->epochs += task.epochs;
+  }
+
+  begin = std::chrono::steady_clock::now();
+  ssn_hsbfstream_t merged = workspace.outputs[0];
+  for (size_t k = 1; k < tasks.size(); ++k) {
+    rerror = SSNSBFStream_appendStreamBlocks(merged, workspace.outputs[k],
+                                             sbfid_ALL);
+    if (!IsOk(rerror))
+      return rerror;
+  }
+
+  if (!options.output.empty()) {
+    std::vector<char> filename(options.output.begin(), options.output.end());
+    filename.push_back('\0');
+    StageTimer timer(kStageWriteToFile);
+    rerror = timer.Done(SSNSBFStream_writeToFile(merged, filename.data()));
+  }
+  result->merge_seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - begin).count();
+
+  return rerror;
+}
+
+}
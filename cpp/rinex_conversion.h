@@ -0,0 +1,86 @@
+#ifndef CALCULATE_RINEX_CONVERSION_H
+#define CALCULATE_RINEX_CONVERSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "ssnerror.h"
+
+#include "job_control.h"
+
+namespace calculate {
+
+// Observation and navigation files that convert together, e.g. one
+// receiver's obs file plus the matching nav files
+struct RinexSet {
+  std::vector<std::string> files;
+};
+
+struct RinexConversionOptions {
+  unsigned workers = 0;        // decoder pool size, 0: one per hardware thread
+  // split sets into windows of this many seconds, at least 600 and at most
+  // 64 windows per set; 0 splits just enough to keep every worker busy,
+  // negative never splits
+  double window = 0.0;
+  std::string output;          // merged SBF file, empty to skip
+};
+
+// Observation span of a RINEX set from the obs file headers (and the last
+// epoch line of RINEX 3 files). `known` stays false when no obs file has a
+// usable TIME OF FIRST / LAST OBS in a GPS-aligned time system; such sets
+// are converted whole.
+struct RinexSpan {
+  bool known = false;
+  double first = 0.0;          // GNSS seconds
+  double last = 0.0;
+};
+
+// One unit of work: a set, or one time window of it
+struct RinexTask {
+  size_t set = 0;
+  unsigned window = 0;         // index among `windows` of the set
+  unsigned windows = 1;
+  double start = 0.0;          // GNSS seconds, [start, end) of the window;
+  double end = 0.0;            // the set's span when unsplit
+  uint64_t blocks = 0;
+  uint64_t epochs = 0;         // MeasEpoch blocks produced
+  double seconds = 0.0;        // wall clock of createSBF(Cropped)
+  ssn_error_t error = SSNERROR_WARNING_OK;
+};
+
+struct RinexConversionResult {
+  std::vector<RinexSpan> spans;   // per set
+  std::vector<RinexTask> tasks;   // in output order
+  unsigned workers = 0;
+  uint64_t blocks = 0;
+  uint64_t epochs = 0;
+  double seconds = 0.0;           // wall clock of the conversion, no merge
+  double merge_seconds = 0.0;     // appending and writing the output
+};
+
+// TIME OF FIRST / LAST OBS of the observation files in `set`
+RinexSpan ReadRinexSpan(const RinexSet& set);
+
+// Converts RINEX sets to one SBF stream on a pool of SSNRNXDec handles.
+//
+// Every worker owns an SDK handle and opens a fresh decoder per task, so no
+// handle is shared between threads. Long sets are split into time windows
+// converted with SSNRNXDec_createSBFCropped; the first and last window stay
+// open-ended, so navigation data outside the observation span is kept. Each
+// window still reads all of its set's files; what runs in parallel is the
+// decoding and SBF generation. Sets are merged in the order of their first
+// observation, windows in time order, with SSNSBFStream_appendStreamBlocks.
+//
+// `control` gets one progress part per task, and cancels the decoders in
+// flight.
+ssn_error_t RunRinexConversion(const std::vector<RinexSet>& sets,
+                               const RinexConversionOptions& options,
+                               RinexConversionResult* result,
+                               JobControl* control = nullptr);
+
+}
+
+#endif
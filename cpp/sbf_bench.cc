@@ -0,0 +1,339 @@
+// sbf_bench: times the stages of the SBF load / analyze pipeline for one
+// file and prints the result as JSON on stdout.
+//
+//   sbf_bench <file.sbf> [--iterations N] [--warmup N] [--no-pvt]
+//             [--command "<ascii command>"]...
+//
+// Every iteration runs the full pipeline on fresh handles, so the SDK open
+// and the file parse are measured cold each time. Peak RSS is the process
+// peak, which is why run-bench.js starts one process per corpus file.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "ssnsdk.h"
+#include "ssnerror.h"
+#include "ssnsbfstream.h"
+#include "ssnsbfanalyze.h"
+#include "ssnppengine.h"
+
+#include "sbf_stream.h"
+
+namespace calculate {
+
+namespace {
+
+enum Stage {
+  kSdkOpen,
+  kLoadFile,
+  kNumberOfBlocks,
+  kPVTErrorPercentages,
+  kTrackedSatellites,
+  kCalculatePVT,
+  kStageCount
+};
+
+const char* const kStageNames[kStageCount] = {
+  "sdkOpen",
+  "loadFile",
+  "getNumberOfBlocks",
+  "getPVTErrorPercentages",
+  "listTrackedSatellites",
+  "calculatePVT"
+};
+
+struct Options {
+  std::string path;
+  int iterations = 10;
+  int warmup = 1;
+  bool pvt = true;
+  std::vector<std::string> commands;
+};
+
+struct Run {
+  double seconds[kStageCount] = {};
+  int blocks = 0;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double Since(Clock::time_point begin) {
+  return std::chrono::duration<double>(Clock::now() - begin).count();
+}
+
+uint64_t PeakRssBytes() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+  return counters.PeakWorkingSetSize;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// Nearest-rank percentile of the sorted samples
+double Percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty())
+    return 0.0;
+  size_t rank = static_cast<size_t>(ceil(p / 100.0 * sorted.size()));
+  return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+// Handles of one pipeline run, closed in reverse order of opening
+struct Pipeline {
+  ssn_hsdk_t       sdk;
+  ssn_hsbfstream_t input;
+  ssn_hsbfstream_t output;
+  ssn_hppengine_t  engine;
+  bool sdk_open = false;
+  bool input_open = false;
+  bool output_open = false;
+  bool engine_open = false;
+
+  ~Pipeline() {
+    if (engine_open)
+      SSNPPEngine_close(engine);
+    if (output_open)
+      SSNSBFStream_close(output);
+    if (input_open)
+      SSNSBFStream_close(input);
+    if (sdk_open)
+      CloseSdk(sdk);
+  }
+};
+
+ssn_error_t RunOnce(const Options& options, Run* run) {
+  Pipeline pipeline;
+  ssn_error_t rerror;
+  Clock::time_point begin;
+
+  begin = Clock::now();
+  rerror = OpenSdk(&pipeline.sdk);
+  run->seconds[kSdkOpen] = Since(begin);
+  if (!IsOk(rerror))
+    return rerror;
+  pipeline.sdk_open = true;
+
+  rerror = SSNSBFStream_open(pipeline.sdk, &pipeline.input);
+  if (!IsOk(rerror))
+    return rerror;
+  pipeline.input_open = true;
+
+  // loadFile takes a non-const char*
+  std::vector<char> filename(options.path.begin(), options.path.end());
+  filename.push_back('\0');
+
+  begin = Clock::now();
+  rerror = SSNSBFStream_loadFile(pipeline.input, filename.data(),
+                                 SSNSBFSTREAM_OPENOPTION_READONLY);
+  run->seconds[kLoadFile] = Since(begin);
+  if (!IsOk(rerror))
+    return rerror;
+
+  begin = Clock::now();
+  rerror = SSNSBFStream_getNumberOfBlocks(pipeline.input, sbfid_ALL, true,
+                                          &run->blocks);
+  run->seconds[kNumberOfBlocks] = Since(begin);
+  if (!IsOk(rerror))
+    return rerror;
+
+  ssn_pvterror_percentages_t errors;
+  begin = Clock::now();
+  rerror = SSNSBFAnalyze_getPVTErrorPercentages(pipeline.input, sbfid_ALL,
+                                                &errors);
+  run->seconds[kPVTErrorPercentages] = Since(begin);
+  if (!IsOk(rerror))
+    return rerror;
+
+  // the tracked list is taken in the middle of the measurement interval,
+  // double-call included, as the renderer would do it
+  double low = 0.0, high = 0.0;
+  rerror = SSNSBFStream_getStreamMeasurementsInterval(pipeline.input, &low,
+                                                      &high);
+  if (!IsOk(rerror))
+    return rerror;
+
+  double gnsstime = (low + high) / 2.0;
+  size_t listSize = 0;
+  std::vector<ssn_tracked_satellites_t> satellites;
+  begin = Clock::now();
+  rerror = SSNSBFAnalyze_listTrackedSatellites(pipeline.input, gnsstime,
+                                               &listSize, NULL);
+  if (IsOk(rerror) && listSize > 0) {
+    satellites.resize(listSize / sizeof(ssn_tracked_satellites_t) + 1);
+    rerror = SSNSBFAnalyze_listTrackedSatellites(pipeline.input, gnsstime,
+                                                 &listSize, satellites.data());
+  }
+  run->seconds[kTrackedSatellites] = Since(begin);
+  if (!IsOk(rerror))
+    return rerror;
+
+  if (!options.pvt)
+    return rerror;
+
+  rerror = SSNSBFStream_open(pipeline.sdk, &pipeline.output);
+  if (!IsOk(rerror))
+    return rerror;
+  pipeline.output_open = true;
+
+  rerror = SSNPPEngine_open(pipeline.sdk, &pipeline.engine);
+  if (!IsOk(rerror))
+    return rerror;
+  pipeline.engine_open = true;
+
+  std::vector<char> reply(4096);
+  for (const std::string& command : options.commands) {
+    size_t replySize = reply.size();
+    reply[0] = '\0';
+    rerror = SSNPPEngine_sendAsciiCommand(pipeline.engine, command.c_str(),
+                                          &replySize, reply.data());
+    if (!IsOk(rerror))
+      return rerror;
+  }
+
+  begin = Clock::now();
+  rerror = SSNPPEngine_calculatePVT(
+      pipeline.engine, pipeline.input,
+      static_cast<ssn_ppengine_options_t>(0), NULL, pipeline.output);
+  run->seconds[kCalculatePVT] = Since(begin);
+  return rerror;
+}
+
+// Escapes `value` for use inside a JSON string
+std::string JsonString(const std::string& value) {
+  std::string out = "\"";
+  for (char c : value) {
+    switch (c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char escaped[8];
+          snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          out += escaped;
+        } else {
+          out += c;
+        }
+    }
+  }
+  return out + "\"";
+}
+
+void PrintReport(const Options& options, const std::vector<Run>& runs) {
+  int blocks = runs.empty() ? 0 : runs.front().blocks;
+
+  printf("{\n");
+  printf("  \"file\": %s,\n", JsonString(options.path).c_str());
+  printf("  \"iterations\": %zu,\n", runs.size());
+  printf("  \"blocks\": %d,\n", blocks);
+  printf("  \"peakRssBytes\": %llu,\n",
+         static_cast<unsigned long long>(PeakRssBytes()));
+  printf("  \"stages\": {");
+
+  const char* separator = "\n";
+  for (int stage = 0; stage < kStageCount; ++stage) {
+    if (stage == kCalculatePVT && !options.pvt)
+      continue;
+
+    std::vector<double> samples;
+    double total = 0.0;
+    for (const Run& run : runs) {
+      samples.push_back(run.seconds[stage] * 1000.0);
+      total += run.seconds[stage] * 1000.0;
+    }
+    std::sort(samples.begin(), samples.end());
+
+    double p50 = Percentile(samples, 50.0);
+    printf("%s    \"%s\": { \"p50Ms\": %.3f, \"p99Ms\": %.3f, \"minMs\": %.3f, "
+           "\"maxMs\": %.3f, \"meanMs\": %.3f",
+           separator, kStageNames[stage], p50, Percentile(samples, 99.0),
+           samples.front(), samples.back(), total / samples.size());
+    // throughput only means something for the stages that walk every block
+    if (stage != kSdkOpen && stage != kTrackedSatellites && p50 > 0.0)
+      printf(", \"blocksPerSecond\": %.0f", blocks / (p50 / 1000.0));
+    printf(" }");
+    separator = ",\n";
+  }
+
+  printf("\n  }\n}\n");
+}
+
+bool ParseArgs(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    bool has_value = i + 1 < argc;
+
+    if (strcmp(arg, "--iterations") == 0 && has_value) {
+      options->iterations = atoi(argv[++i]);
+    } else if (strcmp(arg, "--warmup") == 0 && has_value) {
+      options->warmup = atoi(argv[++i]);
+    } else if (strcmp(arg, "--command") == 0 && has_value) {
+      options->commands.push_back(argv[++i]);
+    } else if (strcmp(arg, "--no-pvt") == 0) {
+      options->pvt = false;
+    } else if (arg[0] != '-' && options->path.empty()) {
+      options->path = arg;
+    } else {
+      return false;
+    }
+  }
+  return !options->path.empty() && options->iterations > 0 &&
+         options->warmup >= 0;
+}
+
+}
+
+}
+
+int main(int argc, char** argv) {
+  using namespace calculate;
+
+  Options options;
+  if (!ParseArgs(argc, argv, &options)) {
+    fprintf(stderr,
+            "usage: sbf_bench <file.sbf> [--iterations N] [--warmup N] "
+            "[--no-pvt] [--command \"<ascii command>\"]...\n");
+    return EXIT_FAILURE;
+  }
+
+  std::vector<Run> runs;
+  for (int i = 0; i < options.warmup + options.iterations; ++i) {
+    Run run;
+    ssn_error_t rerror = RunOnce(options, &run);
+    if (!IsOk(rerror)) {
+      fprintf(stderr, "Error: %s\n", DescribeError(rerror).c_str());
+      return EXIT_FAILURE;
+    }
+    if (i >= options.warmup)
+      runs.push_back(run);
+  }
+
+  PrintReport(options, runs);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,1528 @@
+// sbf_daemon: serves the native pipeline to local clients without Node or
+// Electron, one process for any number of users.
+//
+//   sbf_daemon [--socket <path>] [--port N] [--token-file <path>]
+//              [--workers N] [--cache-bytes N] [--max-idle N]
+//              [--temp-dir <dir>] [--temp-bytes N]
+//
+// Clients connect to a Unix domain socket, <system temp>/sbf_daemon.sock by
+// default, or with --port (always on Windows) to 127.0.0.1:N, and send one
+// JSON request per line:
+//
+//   {"id": 1, "op": "analyze", "path": "a.sbf", "errors": true}
+//
+// Every start writes a new random token to a file only its user can read,
+// <socket>.token or <system temp>/sbf_daemon-<port>.token by default, and
+// the first request of a connection must carry it as "token". Anything
+// else on the machine can reach a loopback port, a web page in a browser
+// included, and would otherwise read and write files as the daemon's user.
+// A connection is closed without a reply on a wrong token and on the first
+// line that is no JSON object, such as an HTTP request line.
+//
+// and get one reply line per request with the same id,
+//
+//   {"id": 1, "ok": true, "result": { ... }}
+//   {"id": 1, "ok": false, "error": { "message", "kind", "retryable", ... }}
+//
+// preceded by {"id": 1, "progress": 42.5} lines when the request asked for
+// "progress": true. Replies come in the order the jobs finish.
+//
+//   example     { path }                        AnalyzeExample(), executeSync
+//   analyze     { path, sbfid, errors, modes }  PVT percentages
+//   scan        { path, epochNumber, maxGaps }  ScanSbfFile()
+//   pvtSharded  { path, shards, warmup, options, output, validate,
+//                 profile | commands }          RunShardedPVT()
+//   registerProfile  { name, commands, bindings }
+//   cancel      { target }                      a job of this connection
+//   stats       {}                              metrics and every pool
+//
+// Requests and results use the keys of the addon's functions, and the jobs
+// run the same calculate_core code (AnalyzePVT(), ScanSbfFile(),
+// RunShardedPVT(), EngineProfileRegistry). Jobs of every connection share
+// one queue drained by --workers threads, and the process-wide StreamCache,
+// EnginePool, TempSpace and metrics of the addon, so a file one client
+// loaded is served to the next from memory. A client that hangs up cancels
+// its jobs.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "ssnsdk.h"
+#include "ssnerror.h"
+#include "ssnsbfstream.h"
+#include "ssnsbfanalyze.h"
+
+#include "batch_analysis.h"
+#include "engine_pool.h"
+#include "example_analysis.h"
+#include "job_control.h"
+#include "metrics.h"
+#include "pvt_analysis.h"
+#include "sbf_scanner.h"
+#include "sbf_stream.h"
+#include "scratch_arena.h"
+#include "sdk_error.h"
+#include "sharded_pvt.h"
+#include "stream_cache.h"
+#include "temp_space.h"
+
+namespace calculate {
+
+namespace {
+
+#ifdef _WIN32
+typedef SOCKET Socket;
+const Socket kNoSocket = INVALID_SOCKET;
+
+void CloseSocket(Socket socket) { closesocket(socket); }
+#else
+typedef int Socket;
+const Socket kNoSocket = -1;
+
+void CloseSocket(Socket socket) { close(socket); }
+#endif
+
+// without a Unix domain socket to fall back on
+const int kDefaultPort = 47420;
+// longer request lines are a client bug, not a job
+const size_t kMaxLine = 1 << 20;
+const int kMaxDepth = 32;
+// a pvtSharded request asking for more is not worth a workspace each
+const double kMaxShards = 1024;
+
+struct Options {
+  std::string socket_path;            // empty for the default
+  int port = 0;                       // loopback TCP instead when set
+  std::string token_path;             // empty for the default
+  unsigned workers = 0;               // 0: one per hardware thread
+  uint64_t cache_bytes = 0;           // 0 keeps the StreamCache budget
+  int max_idle = -1;                  // < 0 keeps the EnginePool default
+  TempSpaceSettings temp;
+};
+
+std::atomic<bool> stopping{false};
+
+// Request numbers the workers cast to integers, up to what the type they
+// go to holds
+struct IntegerOption {
+  const char* op;
+  const char* key;
+  double max;
+};
+
+const IntegerOption kIntegerOptions[] = {
+  { "analyze", "sbfid", 65535 },
+  { "scan", "epochNumber", 65535 },
+  { "scan", "maxGaps", 4294967295.0 },
+  { "pvtSharded", "shards", kMaxShards },
+  { "pvtSharded", "options", 4294967295.0 },
+};
+
+// ------------------------------------------------------------------------
+// JSON
+
+// A parsed request value; numbers are doubles like in JavaScript
+struct Json {
+  enum Type { kNull, kBool, kNumber, kString, kArray, kObject };
+
+  Type type = kNull;
+  bool boolean = false;
+  double number = 0;
+  std::string string;
+  std::vector<Json> items;
+  std::vector<std::pair<std::string, Json>> members;
+
+  // member `key` of an object, null when absent
+  const Json* Get(const char* key) const {
+    for (const auto& member : members)
+      if (member.first == key)
+        return &member.second;
+    return nullptr;
+  }
+
+  bool IsString(const char* key) const {
+    const Json* value = Get(key);
+    return value != nullptr && value->type == kString;
+  }
+
+  bool IsNumber(const char* key) const {
+    const Json* value = Get(key);
+    return value != nullptr && value->type == kNumber;
+  }
+
+  std::string String(const char* key) const {
+    return IsString(key) ? Get(key)->string : std::string();
+  }
+
+  double Number(const char* key, double fallback) const {
+    return IsNumber(key) ? Get(key)->number : fallback;
+  }
+
+  // false for a number that is no integer in [low, high], true for
+  // anything else Number() falls back on
+  bool IntegerIn(const char* key, double low, double high) const {
+    if (!IsNumber(key))
+      return true;
+    double value = Get(key)->number;
+    return value >= low && value <= high && value == floor(value);
+  }
+
+  // like BooleanValue() in the addon, for the flags of a request
+  bool Flag(const char* key) const {
+    const Json* value = Get(key);
+    if (value == nullptr)
+      return false;
+    switch (value->type) {
+      case kBool: return value->boolean;
+      case kNumber: return value->number != 0;
+      case kString: return !value->string.empty();
+      case kArray: case kObject: return true;
+      default: return false;
+    }
+  }
+};
+
+// Recursive descent over one request line, RFC 8259 without extensions
+class JsonParser {
+ public:
+  explicit JsonParser(const std::string& text)
+      : p_(text.data()), end_(text.data() + text.size()) {}
+
+  bool Parse(Json* out) {
+    if (!Value(out, 0))
+      return false;
+    Space();
+    return p_ == end_;
+  }
+
+ private:
+  void Space() {
+    while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\r' ||
+                         *p_ == '\n'))
+      ++p_;
+  }
+
+  bool Literal(const char* word) {
+    size_t length = strlen(word);
+    if (static_cast<size_t>(end_ - p_) < length ||
+        memcmp(p_, word, length) != 0)
+      return false;
+    p_ += length;
+    return true;
+  }
+
+  static void AppendUtf8(uint32_t code, std::string* out) {
+    if (code < 0x80) {
+      out->push_back(static_cast<char>(code));
+    } else if (code < 0x800) {
+      out->push_back(static_cast<char>(0xC0 | (code >> 6)));
+      out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+      out->push_back(static_cast<char>(0xE0 | (code >> 12)));
+      out->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else {
+      out->push_back(static_cast<char>(0xF0 | (code >> 18)));
+      out->push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+  }
+
+  bool Hex4(uint32_t* code) {
+    if (end_ - p_ < 4)
+      return false;
+    *code = 0;
+    for (int i = 0; i < 4; ++i) {
+      char c = *p_++;
+      *code <<= 4;
+      if (c >= '0' && c <= '9')
+        *code |= c - '0';
+      else if (c >= 'a' && c <= 'f')
+        *code |= c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F')
+        *code |= c - 'A' + 10;
+      else
+        return false;
+    }
+    return true;
+  }
+
+  bool String(std::string* out) {
+    ++p_;                             // opening quote
+    while (p_ < end_) {
+      char c = *p_++;
+      if (c == '"')
+        return true;
+      if (static_cast<unsigned char>(c) < 0x20)
+        return false;
+      if (c != '\\') {
+        out->push_back(c);
+        continue;
+      }
+      if (p_ == end_)
+        return false;
+      switch (*p_++) {
+        case '"': out->push_back('"'); break;
+        case '\\': out->push_back('\\'); break;
+        case '/': out->push_back('/'); break;
+        case 'b': out->push_back('\b'); break;
+        case 'f': out->push_back('\f'); break;
+        case 'n': out->push_back('\n'); break;
+        case 'r': out->push_back('\r'); break;
+        case 't': out->push_back('\t'); break;
+        case 'u': {
+          uint32_t code;
+          if (!Hex4(&code))
+            return false;
+          // a surrogate pair spells one code point above the BMP
+          if (code >= 0xD800 && code < 0xDC00) {
+            uint32_t low;
+            if (!Literal("\\u") || !Hex4(&low) || low < 0xDC00 ||
+                low >= 0xE000)
+              return false;
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+          } else if (code >= 0xDC00 && code < 0xE000) {
+            return false;
+          }
+          AppendUtf8(code, out);
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+    return false;
+  }
+
+  bool Number(double* out) {
+    const char* begin = p_;
+    if (p_ < end_ && *p_ == '-')
+      ++p_;
+    if (p_ == end_ || *p_ < '0' || *p_ > '9')
+      return false;
+    while (p_ < end_ && ((*p_ >= '0' && *p_ <= '9') || *p_ == '.' ||
+                         *p_ == 'e' || *p_ == 'E' || *p_ == '+' ||
+                         *p_ == '-'))
+      ++p_;
+    std::string text(begin, p_);
+    char* parsed = nullptr;
+    *out = strtod(text.c_str(), &parsed);
+    return parsed == text.c_str() + text.size();
+  }
+
+  bool Value(Json* out, int depth) {
+    Space();
+    if (p_ == end_ || depth > kMaxDepth)
+      return false;
+
+    switch (*p_) {
+      case '{': {
+        out->type = Json::kObject;
+        ++p_;
+        Space();
+        if (p_ < end_ && *p_ == '}') {
+          ++p_;
+          return true;
+        }
+        while (true) {
+          Space();
+          std::string key;
+          if (p_ == end_ || *p_ != '"' || !String(&key))
+            return false;
+          Space();
+          if (p_ == end_ || *p_++ != ':')
+            return false;
+          out->members.emplace_back(std::move(key), Json());
+          if (!Value(&out->members.back().second, depth + 1))
+            return false;
+          Space();
+          if (p_ == end_)
+            return false;
+          char c = *p_++;
+          if (c == '}')
+            return true;
+          if (c != ',')
+            return false;
+        }
+      }
+      case '[': {
+        out->type = Json::kArray;
+        ++p_;
+        Space();
+        if (p_ < end_ && *p_ == ']') {
+          ++p_;
+          return true;
+        }
+        while (true) {
+          out->items.emplace_back();
+          if (!Value(&out->items.back(), depth + 1))
+            return false;
+          Space();
+          if (p_ == end_)
+            return false;
+          char c = *p_++;
+          if (c == ']')
+            return true;
+          if (c != ',')
+            return false;
+        }
+      }
+      case '"':
+        out->type = Json::kString;
+        return String(&out->string);
+      case 't':
+        out->type = Json::kBool;
+        out->boolean = true;
+        return Literal("true");
+      case 'f':
+        out->type = Json::kBool;
+        return Literal("false");
+      case 'n':
+        return Literal("null");
+      default:
+        out->type = Json::kNumber;
+        return Number(&out->number);
+    }
+  }
+
+  const char* p_;
+  const char* end_;
+};
+
+// Escapes `value` for use inside a JSON string
+std::string JsonString(const std::string& value) {
+  std::string out = "\"";
+  for (char c : value) {
+    switch (c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char escaped[8];
+          snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          out += escaped;
+        } else {
+          out += c;
+        }
+    }
+  }
+  return out + "\"";
+}
+
+// Shortest of %.15g / %.17g that reads back the same; null for what JSON
+// has no number for
+std::string JsonNumber(double value) {
+  if (!(value == value) || value - value != 0)
+    return "null";
+  char text[32];
+  snprintf(text, sizeof(text), "%.15g", value);
+  if (strtod(text, nullptr) != value)
+    snprintf(text, sizeof(text), "%.17g", value);
+  return text;
+}
+
+// Builds one reply line. Keys are given inside objects and left null
+// inside arrays.
+class JsonWriter {
+ public:
+  JsonWriter() : out_("{") { first_.push_back(true); }
+
+  void Number(const char* key, double value) {
+    Next(key);
+    out_ += JsonNumber(value);
+  }
+
+  void Bool(const char* key, bool value) {
+    Next(key);
+    out_ += value ? "true" : "false";
+  }
+
+  void String(const char* key, const std::string& value) {
+    Next(key);
+    out_ += JsonString(value);
+  }
+
+  // `json` is already serialised, the id of a request say
+  void Raw(const char* key, const std::string& json) {
+    Next(key);
+    out_ += json;
+  }
+
+  void BeginObject(const char* key = nullptr) { Open(key, '{', '}'); }
+  void BeginArray(const char* key = nullptr) { Open(key, '[', ']'); }
+
+  void End() {
+    out_ += closers_.back();
+    closers_.pop_back();
+    first_.pop_back();
+  }
+
+  // the line without its newline; nothing may be added afterwards
+  std::string Finish() {
+    while (!closers_.empty())
+      End();
+    return out_ + "}";
+  }
+
+ private:
+  void Next(const char* key) {
+    if (!first_.back())
+      out_ += ",";
+    first_.back() = false;
+    if (key != nullptr)
+      out_ += JsonString(key) + ":";
+  }
+
+  void Open(const char* key, char open, char close) {
+    Next(key);
+    out_ += open;
+    closers_.push_back(close);
+    first_.push_back(true);
+  }
+
+  std::string out_;
+  std::vector<char> closers_;
+  std::vector<bool> first_;
+};
+
+// ------------------------------------------------------------------------
+// Results, with the keys of the addon's objects
+
+void WritePVTAnalysis(JsonWriter* out, const PVTAnalysis& analysis) {
+  auto number = [out](const char* key, double value) {
+    out->Number(key, value);
+  };
+  if (analysis.has_errors) {
+    out->BeginObject("errors");
+    ForEachPVTError(analysis.errors, number);
+    out->End();
+  }
+  if (analysis.has_modes) {
+    out->BeginObject("modes");
+    ForEachPVTMode(analysis.modes, number);
+    out->End();
+  }
+}
+
+void WriteScan(JsonWriter* out, const ScanStats& stats) {
+  out->Number("bytes", static_cast<double>(stats.bytes));
+  out->Number("blocks", static_cast<double>(stats.blocks));
+  out->Number("crcErrors", static_cast<double>(stats.crc_errors));
+  out->Number("skippedBytes", static_cast<double>(stats.skipped_bytes));
+  out->Bool("truncated", stats.truncated);
+  out->BeginArray("blockTypes");
+  for (const ScanBlockType& type : stats.block_types) {
+    out->BeginObject();
+    out->Number("number", type.number);
+    out->Number("count", static_cast<double>(type.count));
+    out->Number("bytes", static_cast<double>(type.bytes));
+    out->End();
+  }
+  out->End();
+  out->Number("epochs", static_cast<double>(stats.epochs));
+  out->Number("firstTime", stats.first_time);
+  out->Number("lastTime", stats.last_time);
+  out->Number("interval", stats.interval);
+  out->Number("gapCount", static_cast<double>(stats.gap_count));
+  out->Number("gapSeconds", stats.gap_seconds);
+  out->BeginArray("gaps");
+  for (const ScanGap& gap : stats.gaps) {
+    out->BeginObject();
+    out->Number("start", gap.start);
+    out->Number("end", gap.end);
+    out->End();
+  }
+  out->End();
+}
+
+void WriteShardedPVT(JsonWriter* out, const ShardedPVTResult& result) {
+  out->Number("seconds", result.seconds);
+  out->BeginArray("shards");
+  for (const PVTShard& shard : result.shards) {
+    out->BeginObject();
+    out->Number("start", shard.start);
+    out->Number("end", shard.end);
+    out->Number("seconds", shard.seconds);
+    out->End();
+  }
+  out->End();
+
+  if (result.validated) {
+    const PVTValidation& v = result.validation;
+    out->BeginObject("validation");
+    out->Number("shardedEpochs", v.sharded_epochs);
+    out->Number("referenceEpochs", v.reference_epochs);
+    out->Number("matched", v.matched);
+    out->Number("missing", v.missing);
+    out->Number("extra", v.extra);
+    out->Number("modeMismatches", v.mode_mismatches);
+    out->Number("maxError", v.max_error);
+    out->Number("rmsError", v.rms_error);
+    out->Number("referenceSeconds", v.reference_seconds);
+    out->Number("speedup", result.seconds > 0
+                               ? v.reference_seconds / result.seconds : 0.0);
+    out->End();
+  }
+}
+
+// the fields SetFailureFields() puts on a rejected promise
+void WriteFailure(JsonWriter* out, const SdkFailure& failure) {
+  out->BeginObject("error");
+  out->String("message", DescribeError(failure.error));
+  out->Number("code", SSNERROR_GETCODE(failure.error));
+  out->Number("error", static_cast<uint32_t>(failure.error));
+  out->String("severity", SSNERROR_GETSTATUS(failure.error)
+                              ? "warning" : "failure");
+  const char* module = SSNError_getModule(failure.error);
+  if (module != NULL && *module != '\0')
+    out->String("module", module);
+  if (failure.stage != nullptr)
+    out->String("stage", failure.stage);
+  if (failure.call != nullptr)
+    out->String("call", failure.call);
+  out->String("kind", ErrorKindName(failure.kind()));
+  out->Bool("retryable", failure.retryable());
+  out->BeginArray("warnings");
+  for (const SdkWarning& warning : failure.warnings) {
+    out->BeginObject();
+    out->Number("code", SSNERROR_GETCODE(warning.error));
+    out->String("message", SSNError_getMessage(warning.error));
+    out->Number("count", static_cast<double>(warning.count));
+    out->End();
+  }
+  out->End();
+  out->End();
+}
+
+// ------------------------------------------------------------------------
+// Engine profiles, in the process-wide EngineProfileRegistry of the addon
+
+void ReadCommands(const Json* value, std::vector<std::string>* commands) {
+  if (value == nullptr || value->type != Json::kArray)
+    return;
+  for (const Json& item : value->items)
+    if (item.type == Json::kString)
+      commands->push_back(item.string);
+}
+
+// false with `error` set for a binding that is no object
+bool ReadBindings(const Json* value, std::vector<SnmpBinding>* bindings,
+                  std::string* error) {
+  if (value == nullptr || value->type != Json::kArray)
+    return true;
+  for (const Json& item : value->items) {
+    if (item.type != Json::kObject) {
+      *error = "every binding must be an object";
+      return false;
+    }
+    const Json* bytes = item.Get("value");
+    bool in_range = true;
+    for (const char* key : { "appl", "group", "command", "arg", "ind",
+                             "table" })
+      in_range = in_range && item.IntegerIn(key, 0, 255);
+    if (bytes != nullptr && bytes->type == Json::kArray)
+      for (const Json& b : bytes->items)
+        in_range = in_range && (b.type != Json::kNumber ||
+                                (b.number >= 0 && b.number <= 255 &&
+                                 b.number == floor(b.number)));
+    if (!in_range) {
+      *error = "binding fields and value bytes must be integers from 0 to "
+               "255";
+      return false;
+    }
+    auto byte = [&](const char* key) {
+      return static_cast<uint8_t>(item.Number(key, 0));
+    };
+    SnmpBinding binding;
+    binding.appl = byte("appl");
+    binding.group = byte("group");
+    binding.command = byte("command");
+    binding.arg = byte("arg");
+    binding.ind = byte("ind");
+    binding.table = byte("table");
+    if (bytes != nullptr && bytes->type == Json::kArray)
+      for (const Json& b : bytes->items)
+        binding.value.push_back(static_cast<uint8_t>(
+            b.type == Json::kNumber ? b.number : 0));
+    bindings->push_back(std::move(binding));
+  }
+  return true;
+}
+
+// The engine configuration of a request: `profile` by name, else
+// `commands` compiled on the spot, else none
+bool ReadProfile(const Json& request, EngineProfilePtr* profile,
+                 std::string* error) {
+  std::string name = request.String("profile");
+  std::vector<std::string> commands;
+  ReadCommands(request.Get("commands"), &commands);
+  return EngineProfileRegistry::Instance().Resolve(
+      request.IsString("profile") ? &name : nullptr,
+      request.Get("commands") != nullptr ? &commands : nullptr, profile,
+      error);
+}
+
+// ------------------------------------------------------------------------
+// Connections and jobs
+
+// in time independent of where the two differ
+bool SameToken(const std::string& a, const std::string& b) {
+  if (a.size() != b.size())
+    return false;
+  unsigned char diff = 0;
+  for (size_t i = 0; i < a.size(); ++i)
+    diff |= static_cast<unsigned char>(a[i] ^ b[i]);
+  return diff == 0;
+}
+
+class Connection;
+
+// One request between its line and its reply
+struct Job {
+  std::shared_ptr<Connection> connection;
+  std::string id;                     // serialised, echoed in every line
+  std::string op;
+  Json request;
+  EngineProfilePtr profile;           // of a pvtSharded job
+  std::unique_ptr<JobControl> control;
+};
+
+class Connection {
+ public:
+  explicit Connection(Socket socket) : socket_(socket) {}
+
+  ~Connection() { CloseSocket(socket_); }
+
+  Connection(const Connection&) = delete;
+  void operator=(const Connection&) = delete;
+
+  // Next request line without its newline; false once the client hung up
+  // or sent a line over kMaxLine
+  bool ReadLine(std::string* line) {
+    while (true) {
+      size_t newline = buffer_.find('\n');
+      if (newline != std::string::npos) {
+        line->assign(buffer_, 0, newline);
+        buffer_.erase(0, newline + 1);
+        if (!line->empty() && line->back() == '\r')
+          line->pop_back();
+        return true;
+      }
+      if (buffer_.size() > kMaxLine)
+        return false;
+
+      char chunk[4096];
+      int received = recv(socket_, chunk, sizeof(chunk), 0);
+      if (received <= 0)
+        return false;
+      buffer_.append(chunk, received);
+    }
+  }
+
+  // Whole lines only, from any thread; a client that left is ignored
+  void Send(const std::string& line) {
+    std::string data = line + "\n";
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    size_t sent = 0;
+    while (sent < data.size()) {
+      int n = send(socket_, data.data() + sent,
+                   static_cast<int>(data.size() - sent), 0);
+      if (n <= 0)
+        return;
+      sent += n;
+    }
+  }
+
+  // true once a request carried the daemon's token; reader thread only
+  bool authenticated() const { return authenticated_; }
+  void Authenticate() { authenticated_ = true; }
+
+  // wakes the reader blocked in recv()
+  void Shutdown() {
+#ifdef _WIN32
+    shutdown(socket_, SD_BOTH);
+#else
+    shutdown(socket_, SHUT_RDWR);
+#endif
+  }
+
+  // Jobs in flight by id, for cancel and hang-ups
+  bool Add(const std::shared_ptr<Job>& job) {
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    return jobs_.emplace(job->id, job).second;
+  }
+
+  void Remove(const std::string& id) {
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    jobs_.erase(id);
+  }
+
+  bool Cancel(const std::string& id) {
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    auto found = jobs_.find(id);
+    if (found == jobs_.end())
+      return false;
+    found->second->control->Cancel();
+    return true;
+  }
+
+  void CancelAll() {
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    for (auto& entry : jobs_)
+      entry.second->control->Cancel();
+  }
+
+ private:
+  Socket socket_;
+  std::string buffer_;                // reader thread only
+  bool authenticated_ = false;        // likewise
+  std::mutex write_mutex_;
+  std::mutex jobs_mutex_;
+  std::map<std::string, std::shared_ptr<Job>> jobs_;
+};
+
+// Accepts connections, reads their requests and runs the jobs.
+//
+// Every connection has a reader thread; what touches a file or an engine
+// goes to the queue and the fixed set of workers, so concurrency is the
+// worker count however many clients there are. Handles stay with the
+// process-wide pools in between jobs.
+class Daemon {
+ public:
+  Daemon(unsigned workers, std::string token) : token_(std::move(token)) {
+    for (unsigned i = 0; i < workers; ++i)
+      workers_.emplace_back(&Daemon::Work, this);
+  }
+
+  // Cancels what is queued or running and waits for the readers and workers
+  ~Daemon() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stop_ = true;
+      for (const std::weak_ptr<Connection>& weak : connections_) {
+        std::shared_ptr<Connection> connection = weak.lock();
+        if (connection) {
+          connection->CancelAll();
+          connection->Shutdown();
+        }
+      }
+      ready_.notify_all();
+      readers_done_.wait(lock, [this]() { return readers_ == 0; });
+    }
+    for (std::thread& worker : workers_)
+      worker.join();
+  }
+
+  Daemon(const Daemon&) = delete;
+  void operator=(const Daemon&) = delete;
+
+  void Accept(Socket socket) {
+    std::shared_ptr<Connection> connection =
+        std::make_shared<Connection>(socket);
+    std::lock_guard<std::mutex> lock(mutex_);
+    connections_.erase(
+        std::remove_if(connections_.begin(), connections_.end(),
+                       [](const std::weak_ptr<Connection>& weak) {
+                         return weak.expired();
+                       }),
+        connections_.end());
+    connections_.push_back(connection);
+    ++readers_;
+    ++accepted_;
+    std::thread(&Daemon::Read, this, connection).detach();
+  }
+
+ private:
+  void Read(std::shared_ptr<Connection> connection) {
+    std::string line;
+    while (!stopping && connection->ReadLine(&line)) {
+      if (line.find_first_not_of(" \t") != std::string::npos &&
+          !Dispatch(connection, line))
+        break;
+    }
+    connection->CancelAll();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--readers_ == 0)
+      readers_done_.notify_all();
+  }
+
+  static void Reject(Connection* connection, const std::string& id,
+                     const std::string& message) {
+    JsonWriter reply;
+    reply.Raw("id", id);
+    reply.Bool("ok", false);
+    reply.BeginObject("error");
+    reply.String("message", message);
+    reply.String("kind", ErrorKindName(kErrorArgument));
+    reply.Bool("retryable", false);
+    reply.End();
+    connection->Send(reply.Finish());
+  }
+
+  // Parses and checks one request line; queues what needs a worker. False
+  // to drop the connection unanswered: a line that is no JSON object is
+  // no client of ours, and neither is one without the token.
+  bool Dispatch(const std::shared_ptr<Connection>& connection,
+                const std::string& line) {
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->connection = connection;
+    job->id = "null";
+
+    if (!JsonParser(line).Parse(&job->request) ||
+        job->request.type != Json::kObject)
+      return false;
+    if (!connection->authenticated()) {
+      if (!job->request.IsString("token") ||
+          !SameToken(job->request.String("token"), token_))
+        return false;
+      connection->Authenticate();
+    }
+
+    const Json* id = job->request.Get("id");
+    if (id != nullptr && id->type == Json::kNumber)
+      job->id = JsonNumber(id->number);
+    else if (id != nullptr && id->type == Json::kString)
+      job->id = JsonString(id->string);
+    else if (id != nullptr && id->type != Json::kNull) {
+      Reject(connection.get(), job->id, "id must be a number or a string");
+      return true;
+    }
+
+    job->op = job->request.String("op");
+    std::string error;
+    if (job->op == "stats") {
+      Stats(job.get());
+      return true;
+    }
+    if (job->op == "cancel") {
+      CancelJob(job.get());
+      return true;
+    }
+    if (job->op == "registerProfile") {
+      RegisterProfile(job.get());
+      return true;
+    }
+    if (job->op != "example" && job->op != "analyze" && job->op != "scan" &&
+        job->op != "pvtSharded") {
+      Reject(connection.get(), job->id, "unknown op '" + job->op + "'");
+      return true;
+    }
+    if (job->op != "example" && !job->request.IsString("path")) {
+      Reject(connection.get(), job->id, job->op + ": path must be a string");
+      return true;
+    }
+    for (const IntegerOption& option : kIntegerOptions) {
+      if (job->op == option.op &&
+          !job->request.IntegerIn(option.key, 0, option.max)) {
+        Reject(connection.get(), job->id,
+               job->op + ": " + option.key + " must be an integer from 0 to " +
+                   JsonNumber(option.max));
+        return true;
+      }
+    }
+    if (job->op == "pvtSharded") {
+      if (!(job->request.Number("warmup", 0) >= 0)) {
+        Reject(connection.get(), job->id,
+               "pvtSharded: warmup must not be negative");
+        return true;
+      }
+      if (!ReadProfile(job->request, &job->profile, &error)) {
+        Reject(connection.get(), job->id, "pvtSharded: " + error);
+        return true;
+      }
+    }
+
+    // progress goes out on the worker thread the SDK reports from
+    if (job->request.Flag("progress")) {
+      Job* raw = job.get();
+      job->control.reset(new JobControl([raw](float percent) {
+        JsonWriter line;
+        line.Raw("id", raw->id);
+        line.Number("progress", percent);
+        raw->connection->Send(line.Finish());
+      }));
+    } else {
+      job->control.reset(new JobControl());
+    }
+
+    if (!connection->Add(job)) {
+      Reject(connection.get(), job->id, "a job with this id is running");
+      return true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // still answered, as cancelled, by the workers draining the queue
+    if (stop_)
+      job->control->Cancel();
+    queue_.push_back(job);
+    ready_.notify_one();
+    return true;
+  }
+
+  void Work() {
+    while (true) {
+      std::shared_ptr<Job> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+        if (queue_.empty())
+          return;
+        job = queue_.front();
+        queue_.pop_front();
+        ++running_;
+      }
+
+      Run(job.get());
+      job->connection->Remove(job->id);
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      --running_;
+      ++served_;
+    }
+  }
+
+  // Runs one job on the calling worker and sends its reply
+  void Run(Job* job) {
+    const Json& request = job->request;
+    JobControl* control = job->control.get();
+    ErrorTrail trail;
+    JsonWriter result;
+    ssn_error_t rerror = SSNERROR_WARNING_OK;
+
+    if (control->cancelled()) {
+      rerror = CancelledError();
+    } else if (job->op == "example") {
+      std::string path = request.String("path");
+      rerror = AnalyzeExample(path.empty() ? kExampleInputFile : path.c_str());
+      result.Number("status", IsOk(rerror) ? EXIT_SUCCESS : EXIT_FAILURE);
+    } else if (job->op == "scan") {
+      ScanOptions options;
+      options.epoch_number = static_cast<uint16_t>(
+          request.Number("epochNumber", options.epoch_number));
+      options.max_gaps = static_cast<size_t>(
+          request.Number("maxGaps", static_cast<double>(options.max_gaps)));
+      ScanStats stats;
+      rerror = ScanSbfFile(request.String("path"), options, &stats, control);
+      if (IsOk(rerror))
+        WriteScan(&result, stats);
+    } else {
+      std::shared_ptr<SbfStream> stream;
+      rerror = StreamCache::Instance().Acquire(request.String("path"), &stream,
+                                               control);
+      if (IsOk(rerror)) {
+        std::lock_guard<std::mutex> lock(stream->mutex());
+        rerror = job->op == "analyze"
+            ? Analyze(request, stream->handle(), control, &result)
+            : ShardedPVT(request, job->profile, stream->handle(), control,
+                         &result);
+      }
+    }
+
+    JsonWriter reply;
+    reply.Raw("id", job->id);
+    if (control->cancelled() || !IsOk(rerror)) {
+      SdkFailure failure = trail.Failure(
+          control->cancelled() ? CancelledError() : rerror);
+      failure.cancelled = control->cancelled();
+      reply.Bool("ok", false);
+      WriteFailure(&reply, failure);
+    } else {
+      reply.Bool("ok", true);
+      reply.Raw("result", result.Finish());
+    }
+    job->connection->Send(reply.Finish());
+  }
+
+  static ssn_error_t Analyze(const Json& request, ssn_hsbfstream_t sbfstream,
+                             JobControl* control, JsonWriter* result) {
+    AnalysisOps ops;
+    ops.sbfid = static_cast<SBFID_t>(
+        request.Number("sbfid", static_cast<double>(sbfid_ALL)));
+    ops.errors = request.Flag("errors");
+    ops.modes = request.Flag("modes");
+    if (!ops.errors && !ops.modes)
+      ops.errors = ops.modes = true;
+
+    PVTAnalysis analysis;
+    ssn_error_t rerror = AnalyzePVT(sbfstream, ops, &analysis, control);
+    if (IsOk(rerror))
+      WritePVTAnalysis(result, analysis);
+    return rerror;
+  }
+
+  static ssn_error_t ShardedPVT(const Json& request,
+                                const EngineProfilePtr& profile,
+                                ssn_hsbfstream_t sbfstream,
+                                JobControl* control, JsonWriter* result) {
+    ShardedPVTOptions options;
+    options.profile = profile;
+    options.shards = static_cast<unsigned>(request.Number("shards", 0));
+    options.warmup = request.Number("warmup", options.warmup);
+    options.engine_options =
+        static_cast<uint32_t>(request.Number("options", 0));
+    options.output = request.String("output");
+    options.validate = request.Flag("validate");
+
+    ShardedPVTResult sharded;
+    ssn_error_t rerror = RunShardedPVT(sbfstream, options, &sharded, control);
+    if (IsOk(rerror))
+      WriteShardedPVT(result, sharded);
+    return rerror;
+  }
+
+  void RegisterProfile(Job* job) {
+    const Json& request = job->request;
+    Connection* connection = job->connection.get();
+    if (!request.IsString("name")) {
+      Reject(connection, job->id, "registerProfile: name must be a string");
+      return;
+    }
+
+    EngineProfileSpec spec;
+    std::string error;
+    ReadCommands(request.Get("commands"), &spec.commands);
+    EngineProfilePtr profile;
+    if (!ReadBindings(request.Get("bindings"), &spec.bindings, &error) ||
+        !EngineProfile::Compile(spec, &profile, &error)) {
+      Reject(connection, job->id, "registerProfile: " + error);
+      return;
+    }
+    EngineProfileRegistry::Instance().Register(request.String("name"),
+                                               profile);
+
+    JsonWriter reply;
+    reply.Raw("id", job->id);
+    reply.Bool("ok", true);
+    reply.BeginObject("result");
+    reply.Number("commands", static_cast<double>(profile->commands()));
+    reply.Number("bindings", static_cast<double>(profile->bindings()));
+    reply.Number("messages", static_cast<double>(profile->messages()));
+    reply.Number("bytes", static_cast<double>(profile->bytes()));
+    reply.End();
+    connection->Send(reply.Finish());
+  }
+
+  void CancelJob(Job* job) {
+    const Json* target = job->request.Get("target");
+    std::string id;
+    if (target != nullptr && target->type == Json::kNumber)
+      id = JsonNumber(target->number);
+    else if (target != nullptr && target->type == Json::kString)
+      id = JsonString(target->string);
+
+    JsonWriter reply;
+    reply.Raw("id", job->id);
+    reply.Bool("ok", true);
+    reply.BeginObject("result");
+    reply.Bool("cancelled", !id.empty() && job->connection->Cancel(id));
+    reply.End();
+    job->connection->Send(reply.Finish());
+  }
+
+  // getMetrics(), get*Stats() of the addon and the daemon's own counters
+  void Stats(Job* job) {
+    JsonWriter reply;
+    reply.Raw("id", job->id);
+    reply.Bool("ok", true);
+    reply.BeginObject("result");
+
+    MetricsSnapshot metrics = SnapshotMetrics();
+    reply.BeginObject("metrics");
+    reply.BeginObject("stages");
+    for (int stage = 0; stage < kStageCount; ++stage) {
+      const StageMetrics& s = metrics.stages[stage];
+      reply.BeginObject(MetricStageName(stage));
+      reply.Number("calls", static_cast<double>(s.calls));
+      reply.Number("errors", static_cast<double>(s.errors));
+      reply.Number("warnings", static_cast<double>(s.warnings));
+      reply.Number("wallMs", s.wall_ns / 1e6);
+      reply.Number("cpuMs", s.cpu_ns / 1e6);
+      reply.Number("maxWallMs", s.max_wall_ns / 1e6);
+      reply.Number("spillBytes", static_cast<double>(s.spill_bytes));
+      reply.Number("maxSpillBytes", static_cast<double>(s.max_spill_bytes));
+      reply.End();
+    }
+    reply.End();
+    reply.Number("blocks", static_cast<double>(metrics.blocks));
+    reply.Number("bytesRead", static_cast<double>(metrics.bytes_read));
+    reply.Number("streamBytes", static_cast<double>(metrics.stream_bytes));
+    reply.Number("peakStreamBytes",
+                 static_cast<double>(metrics.peak_stream_bytes));
+    reply.Number("threads", static_cast<double>(metrics.threads));
+    reply.End();
+
+    StreamCache::Stats cache = StreamCache::Instance().GetStats();
+    reply.BeginObject("streamCache");
+    reply.Number("hits", static_cast<double>(cache.hits));
+    reply.Number("misses", static_cast<double>(cache.misses));
+    reply.Number("evictions", static_cast<double>(cache.evictions));
+    reply.Number("entries", static_cast<double>(cache.entries));
+    reply.Number("bytes", static_cast<double>(cache.bytes));
+    reply.Number("maxBytes", static_cast<double>(cache.max_bytes));
+    reply.End();
+
+    EnginePool::Stats pool = EnginePool::Instance().GetStats();
+    reply.BeginObject("enginePool");
+    reply.Number("hits", static_cast<double>(pool.hits));
+    reply.Number("misses", static_cast<double>(pool.misses));
+    reply.Number("recycled", static_cast<double>(pool.recycled));
+    reply.Number("discarded", static_cast<double>(pool.discarded));
+    reply.Number("evictions", static_cast<double>(pool.evictions));
+    reply.Number("idle", static_cast<double>(pool.idle));
+    reply.Number("maxIdle", static_cast<double>(pool.max_idle));
+    reply.End();
+
+    TempSpace::Stats temp = TempSpace::Instance().GetStats();
+    reply.BeginObject("tempSpace");
+    reply.String("directory", temp.directory);
+    reply.Number("bytes", static_cast<double>(temp.bytes));
+    reply.Number("peakBytes", static_cast<double>(temp.peak_bytes));
+    reply.Number("maxBytes", static_cast<double>(temp.max_bytes));
+    reply.Number("handles", static_cast<double>(temp.handles));
+    reply.Number("fallbacks", static_cast<double>(temp.fallbacks));
+    reply.Number("waits", static_cast<double>(temp.waits));
+    reply.Number("swept", static_cast<double>(temp.swept));
+    reply.End();
+
+    ScratchArena::Stats scratch = ScratchArena::GetStats();
+    reply.BeginObject("scratch");
+    reply.Number("freshBytes", static_cast<double>(scratch.fresh_bytes));
+    reply.Number("reusedBytes", static_cast<double>(scratch.reused_bytes));
+    reply.Number("resets", static_cast<double>(scratch.resets));
+    reply.Number("retainedBytes", static_cast<double>(scratch.retained_bytes));
+    reply.Number("arenas", static_cast<double>(scratch.arenas));
+    reply.End();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      reply.BeginObject("daemon");
+      reply.Number("workers", static_cast<double>(workers_.size()));
+      reply.Number("connections", static_cast<double>(readers_));
+      reply.Number("accepted", static_cast<double>(accepted_));
+      reply.Number("queued", static_cast<double>(queue_.size()));
+      reply.Number("running", static_cast<double>(running_));
+      reply.Number("served", static_cast<double>(served_));
+      reply.End();
+    }
+
+    reply.End();
+    job->connection->Send(reply.Finish());
+  }
+
+  const std::string token_;
+  std::mutex mutex_;
+  std::condition_variable ready_;          // workers
+  std::condition_variable readers_done_;
+  std::deque<std::shared_ptr<Job>> queue_;
+  std::vector<std::weak_ptr<Connection>> connections_;
+  std::vector<std::thread> workers_;
+  bool stop_ = false;
+  unsigned readers_ = 0;
+  uint64_t accepted_ = 0;
+  uint64_t running_ = 0;
+  uint64_t served_ = 0;
+};
+
+// ------------------------------------------------------------------------
+// Listening
+
+Socket ListenTcp(int port, std::string* error) {
+  Socket listener = socket(AF_INET, SOCK_STREAM, 0);
+  if (listener == kNoSocket) {
+    *error = "socket() failed";
+    return kNoSocket;
+  }
+
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(static_cast<uint16_t>(port));
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listener, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(listener, SOMAXCONN) != 0) {
+    *error = "cannot listen on 127.0.0.1:" + std::to_string(port);
+    CloseSocket(listener);
+    return kNoSocket;
+  }
+  return listener;
+}
+
+#ifndef _WIN32
+std::string DefaultSocketPath() {
+  std::error_code ec;
+  std::filesystem::path temp = std::filesystem::temp_directory_path(ec);
+  if (ec)
+    temp = ".";
+  return (temp / "sbf_daemon.sock").u8string();
+}
+
+// A socket file nobody answers on is left over from a daemon that died and
+// is replaced; one that answers belongs to a running daemon
+Socket ListenUnix(const std::string& path, std::string* error) {
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    *error = "socket path too long: " + path;
+    return kNoSocket;
+  }
+  memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  Socket probe = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (probe != kNoSocket) {
+    bool running = connect(probe, reinterpret_cast<sockaddr*>(&address),
+                           sizeof(address)) == 0;
+    CloseSocket(probe);
+    if (running) {
+      *error = "another daemon is serving " + path;
+      return kNoSocket;
+    }
+  }
+  unlink(path.c_str());
+
+  Socket listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener == kNoSocket) {
+    *error = "socket() failed";
+    return kNoSocket;
+  }
+  if (bind(listener, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(listener, SOMAXCONN) != 0) {
+    *error = "cannot listen on " + path;
+    CloseSocket(listener);
+    return kNoSocket;
+  }
+  return listener;
+}
+#endif
+
+// 128 bits of the OS random source, as hex
+std::string NewToken() {
+  std::random_device random;
+  std::string token;
+  for (int i = 0; i < 4; ++i) {
+    char hex[9];
+    snprintf(hex, sizeof(hex), "%08x", static_cast<unsigned>(random()));
+    token += hex;
+  }
+  return token;
+}
+
+std::string DefaultTokenPath(const std::string& socket_path, int port) {
+  if (port == 0)
+    return socket_path + ".token";
+  std::error_code ec;
+  std::filesystem::path temp = std::filesystem::temp_directory_path(ec);
+  if (ec)
+    temp = ".";
+  return (temp / ("sbf_daemon-" + std::to_string(port) + ".token"))
+      .u8string();
+}
+
+// A fresh file readable by this user only. On POSIX whatever was at `path`
+// is replaced rather than opened, so a planted symlink is not followed; on
+// Windows the default lies in the user's own temp directory, which other
+// users cannot read.
+bool WriteTokenFile(const std::string& path, const std::string& token,
+                    std::string* error) {
+#ifdef _WIN32
+  FILE* file = fopen(path.c_str(), "wb");
+#else
+  unlink(path.c_str());
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+  FILE* file = fd >= 0 ? fdopen(fd, "wb") : nullptr;
+  if (file == nullptr && fd >= 0)
+    close(fd);
+#endif
+  bool written = file != nullptr &&
+                 fputs((token + "\n").c_str(), file) >= 0;
+  if (file != nullptr && fclose(file) != 0)
+    written = false;
+  if (!written)
+    *error = "cannot write the token to " + path;
+  return written;
+}
+
+void OnSignal(int) { stopping = true; }
+
+// Accepts until SIGINT / SIGTERM; select() with a timeout so the flag is
+// seen without a connection coming in
+void Serve(Socket listener, Daemon* daemon) {
+  while (!stopping) {
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(listener, &readable);
+    timeval timeout = { 0, 200000 };
+    int ready = select(static_cast<int>(listener) + 1, &readable, nullptr,
+                       nullptr, &timeout);
+    if (ready <= 0)
+      continue;
+    Socket client = accept(listener, nullptr, nullptr);
+    if (client != kNoSocket)
+      daemon->Accept(client);
+  }
+}
+
+bool ParseArgs(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    bool has_value = i + 1 < argc;
+
+    if (strcmp(arg, "--socket") == 0 && has_value) {
+      options->socket_path = argv[++i];
+    } else if (strcmp(arg, "--port") == 0 && has_value) {
+      options->port = atoi(argv[++i]);
+      if (options->port <= 0 || options->port > 65535)
+        return false;
+    } else if (strcmp(arg, "--token-file") == 0 && has_value) {
+      options->token_path = argv[++i];
+    } else if (strcmp(arg, "--workers") == 0 && has_value) {
+      options->workers = static_cast<unsigned>(atoi(argv[++i]));
+    } else if (strcmp(arg, "--cache-bytes") == 0 && has_value) {
+      options->cache_bytes = strtoull(argv[++i], nullptr, 10);
+    } else if (strcmp(arg, "--max-idle") == 0 && has_value) {
+      options->max_idle = atoi(argv[++i]);
+    } else if (strcmp(arg, "--temp-dir") == 0 && has_value) {
+      options->temp.directory = argv[++i];
+    } else if (strcmp(arg, "--temp-bytes") == 0 && has_value) {
+      options->temp.max_bytes = strtoull(argv[++i], nullptr, 10);
+    } else {
+      return false;
+    }
+  }
+  return options->socket_path.empty() || options->port == 0;
+}
+
+}
+
+}
+
+int main(int argc, char** argv) {
+  using namespace calculate;
+
+  Options options;
+  if (!ParseArgs(argc, argv, &options)) {
+    fprintf(stderr,
+            "usage: sbf_daemon [--socket <path> | --port N] "
+            "[--token-file <path>] [--workers N] [--cache-bytes N] "
+            "[--max-idle N] [--temp-dir <dir>] [--temp-bytes N]\n");
+    return EXIT_FAILURE;
+  }
+
+  if (options.cache_bytes > 0)
+    StreamCache::Instance().SetMaxBytes(options.cache_bytes);
+  if (options.max_idle >= 0)
+    EnginePool::Instance().SetMaxIdle(static_cast<size_t>(options.max_idle));
+  TempSpace::Instance().Configure(options.temp);
+  unsigned workers = options.workers > 0
+      ? options.workers : BatchAnalysis::DefaultConcurrency();
+
+  std::string error;
+  std::string endpoint;
+  std::string token_path = options.token_path;
+  Socket listener;
+#ifdef _WIN32
+  WSADATA wsa;
+  if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+    fprintf(stderr, "Error: WSAStartup failed\n");
+    return EXIT_FAILURE;
+  }
+  signal(SIGINT, OnSignal);
+  int port = options.port > 0 ? options.port : kDefaultPort;
+  listener = ListenTcp(port, &error);
+  endpoint = "127.0.0.1:" + std::to_string(port);
+  if (token_path.empty())
+    token_path = DefaultTokenPath(std::string(), port);
+#else
+  // replies to a client that hung up must not end the process
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, OnSignal);
+  signal(SIGTERM, OnSignal);
+  std::string path = options.socket_path.empty() ? DefaultSocketPath()
+                                                 : options.socket_path;
+  if (options.port > 0) {
+    listener = ListenTcp(options.port, &error);
+    endpoint = "127.0.0.1:" + std::to_string(options.port);
+  } else {
+    listener = ListenUnix(path, &error);
+    endpoint = path;
+  }
+  if (token_path.empty())
+    token_path = DefaultTokenPath(path, options.port);
+#endif
+  if (listener == kNoSocket) {
+    fprintf(stderr, "Error: %s\n", error.c_str());
+    return EXIT_FAILURE;
+  }
+
+  // written once the endpoint is ours, so a daemon already serving it
+  // keeps its token
+  std::string token = NewToken();
+  if (!WriteTokenFile(token_path, token, &error)) {
+    fprintf(stderr, "Error: %s\n", error.c_str());
+    CloseSocket(listener);
+    return EXIT_FAILURE;
+  }
+
+  printf("{\"listening\": %s, \"tokenFile\": %s, \"workers\": %u}\n",
+         JsonString(endpoint).c_str(), JsonString(token_path).c_str(),
+         workers);
+  fflush(stdout);
+
+  {
+    Daemon daemon(workers, token);
+    Serve(listener, &daemon);
+    CloseSocket(listener);
+  }
+
+  remove(token_path.c_str());
+#ifdef _WIN32
+  WSACleanup();
+#else
+  if (options.port == 0)
+    unlink(path.c_str());
+#endif
+
+  // close the pooled handles while TempSpace can still remove their
+  // directories
+  EnginePool::Instance().Clear();
+  StreamCache::Instance().Clear();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,457 @@
+#include "sbf_filter.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+#include "sbfdef.h"
+#include "basefinderconstellations.h"
+
+#include "job_control.h"
+#include "mapped_file.h"
+#include "meas_epoch.h"
+#include "metrics.h"
+#include "sbf_scanner.h"
+#include "sbf_stream.h"
+#include "sbf_util.h"
+#include "scratch_arena.h"
+
+namespace fs = std::filesystem;
+
+namespace calculate {
+
+namespace {
+
+// progress and cancellation are checked every this many input bytes
+const size_t kFilterReportBytes = 16 * 1024 * 1024;
+// kept bytes handed to the sink at once at most
+const size_t kFilterRunBytes = 64 * 1024 * 1024;
+const uint16_t kBlockNumbers = 0x2000;
+
+uint16_t Load16(const uint8_t* p) {
+  uint16_t v;
+  memcpy(&v, p, 2);
+  return v;
+}
+
+uint32_t Load32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+void Store16(uint8_t* p, uint16_t v) { memcpy(p, &v, 2); }
+
+struct NavigationBlock {
+  uint16_t number;
+  uint32_t constellation;
+};
+
+// navigation page and decoded navigation blocks, by the constellation they
+// belong to
+const NavigationBlock kNavigationBlocks[] = {
+  {sbfnr_GPSRaw_1, SSNBASEFINDER_GPS},
+  {sbfnr_CNAVRaw_1, SSNBASEFINDER_GPS},
+  {sbfnr_GPSRawCA_1, SSNBASEFINDER_GPS},
+  {sbfnr_GPSRawL2C_1, SSNBASEFINDER_GPS},
+  {sbfnr_GPSRawL5_1, SSNBASEFINDER_GPS},
+  {sbfnr_GPSRawL1C_1, SSNBASEFINDER_GPS},
+  {sbfnr_GPSNav_1, SSNBASEFINDER_GPS},
+  {sbfnr_GPSAlm_1, SSNBASEFINDER_GPS},
+  {sbfnr_GPSIon_1, SSNBASEFINDER_GPS},
+  {sbfnr_GPSUtc_1, SSNBASEFINDER_GPS},
+  {sbfnr_GPSCNav_1, SSNBASEFINDER_GPS},
+  {sbfnr_GLORawCA_1, SSNBASEFINDER_GLONASS},
+  {sbfnr_GLONav_1, SSNBASEFINDER_GLONASS},
+  {sbfnr_GLOAlm_1, SSNBASEFINDER_GLONASS},
+  {sbfnr_GLOTime_1, SSNBASEFINDER_GLONASS},
+  {sbfnr_GALRawFNAV_1, SSNBASEFINDER_GALILEO},
+  {sbfnr_GALRawINAV_1, SSNBASEFINDER_GALILEO},
+  {sbfnr_GALRawCNAV_1, SSNBASEFINDER_GALILEO},
+  {sbfnr_GALRawGNAV_1, SSNBASEFINDER_GALILEO},
+  {sbfnr_GALRawGNAVe_1, SSNBASEFINDER_GALILEO},
+  {sbfnr_GALNav_1, SSNBASEFINDER_GALILEO},
+  {sbfnr_GALAlm_1, SSNBASEFINDER_GALILEO},
+  {sbfnr_GALIon_1, SSNBASEFINDER_GALILEO},
+  {sbfnr_GALUtc_1, SSNBASEFINDER_GALILEO},
+  {sbfnr_GALGstGps_1, SSNBASEFINDER_GALILEO},
+  {sbfnr_GALSARRLM_1, SSNBASEFINDER_GALILEO},
+  {sbfnr_BDSRaw_1, SSNBASEFINDER_BEIDOU},
+  {sbfnr_BDSRawB1C_1, SSNBASEFINDER_BEIDOU},
+  {sbfnr_BDSRawB2a_1, SSNBASEFINDER_BEIDOU},
+  {sbfnr_BDSNav_1, SSNBASEFINDER_BEIDOU},
+  {sbfnr_BDSAlm_1, SSNBASEFINDER_BEIDOU},
+  {sbfnr_BDSIon_1, SSNBASEFINDER_BEIDOU},
+  {sbfnr_BDSUtc_1, SSNBASEFINDER_BEIDOU},
+  {sbfnr_QZSRawL1CA_1, SSNBASEFINDER_QZSS},
+  {sbfnr_QZSRawL2C_1, SSNBASEFINDER_QZSS},
+  {sbfnr_QZSRawL5_1, SSNBASEFINDER_QZSS},
+  {sbfnr_QZSRawL6_1, SSNBASEFINDER_QZSS},
+  {sbfnr_QZSRawL1C_1, SSNBASEFINDER_QZSS},
+  {sbfnr_QZSRawL1S_1, SSNBASEFINDER_QZSS},
+  {sbfnr_QZSNav_1, SSNBASEFINDER_QZSS},
+  {sbfnr_QZSAlm_1, SSNBASEFINDER_QZSS},
+  {sbfnr_NAVICRaw_1, SSNBASEFINDER_IRNSS},
+  {sbfnr_GEORaw_1, SSNBASEFINDER_SBAS},
+  {sbfnr_GEORawL1_1, SSNBASEFINDER_SBAS},
+  {sbfnr_GEORawL5_1, SSNBASEFINDER_SBAS},
+  {sbfnr_GEOMT00_1, SSNBASEFINDER_SBAS},
+  {sbfnr_GEOPRNMask_1, SSNBASEFINDER_SBAS},
+  {sbfnr_GEOFastCorr_1, SSNBASEFINDER_SBAS},
+  {sbfnr_GEOIntegrity_1, SSNBASEFINDER_SBAS},
+  {sbfnr_GEOFastCorrDegr_1, SSNBASEFINDER_SBAS},
+  {sbfnr_GEONav_1, SSNBASEFINDER_SBAS},
+  {sbfnr_GEODegrFactors_1, SSNBASEFINDER_SBAS},
+  {sbfnr_GEONetworkTime_1, SSNBASEFINDER_SBAS},
+  {sbfnr_GEOAlm_1, SSNBASEFINDER_SBAS},
+  {sbfnr_GEOIGPMask_1, SSNBASEFINDER_SBAS},
+  {sbfnr_GEOLongTermCorr_1, SSNBASEFINDER_SBAS},
+  {sbfnr_GEOIonoDelay_1, SSNBASEFINDER_SBAS},
+  {sbfnr_GEOServiceLevel_1, SSNBASEFINDER_SBAS},
+  {sbfnr_GEOClockEphCovMatrix_1, SSNBASEFINDER_SBAS},
+  {sbfnr_SBASL5Nav_1, SSNBASEFINDER_SBAS},
+  {sbfnr_SBASL5Alm_1, SSNBASEFINDER_SBAS},
+};
+
+// setup and message blocks, written once or on demand rather than per epoch
+const uint16_t kUntimedBlocks[] = {
+  sbfnr_ReceiverSetup_1, sbfnr_RxComponents_1, sbfnr_RxMessage_1,
+  sbfnr_Commands_1, sbfnr_Comment_1, sbfnr_BBSamples_1, sbfnr_ASCIIIn_1,
+  sbfnr_EncapsulatedOutput_1, sbfnr_RawDataIn_1,
+};
+
+// per block number: the constellation of a navigation block, or kUntimed
+// for blocks decimation leaves alone
+const uint32_t kUntimed = 0x80000000u;
+
+std::vector<uint32_t> BlockClasses() {
+  std::vector<uint32_t> classes(kBlockNumbers, 0);
+  for (const NavigationBlock& nav : kNavigationBlocks)
+    classes[nav.number] = nav.constellation | kUntimed;
+  for (uint16_t number : kUntimedBlocks)
+    classes[number] = kUntimed;
+  return classes;
+}
+
+uint32_t SvidConstellation(int svid) {
+  switch (MeasSvidSystem(svid)) {
+    case 'G':
+      return SSNBASEFINDER_GPS;
+    case 'R':
+      return SSNBASEFINDER_GLONASS;
+    case 'E':
+      return SSNBASEFINDER_GALILEO;
+    case 'C':
+      return SSNBASEFINDER_BEIDOU;
+    case 'S':
+      return SSNBASEFINDER_SBAS;
+    case 'J':
+      return SSNBASEFINDER_QZSS;
+    case 'I':
+      return SSNBASEFINDER_IRNSS;
+    default:
+      return 0;
+  }
+}
+
+// Copies a MeasEpoch block to `out` without the channels (Type1 sub-block
+// and its Type2 ones) of satellites outside `mask` and returns its new
+// Length; 0 when every channel stays or the block does not parse, so that
+// it is written unchanged
+uint16_t DropChannels(const uint8_t* block, uint16_t length, uint32_t mask,
+                      uint8_t* out) {
+  const size_t data = offsetof(MeasEpoch_2_0_t, Data);
+  if (length < data)
+    return 0;
+  unsigned n = block[offsetof(MeasEpoch_2_0_t, N)];
+  size_t sb1 = block[offsetof(MeasEpoch_2_0_t, SB1Size)];
+  size_t sb2 = block[offsetof(MeasEpoch_2_0_t, SB2Size)];
+  if (sb1 < sizeof(MeasEpochChannelType1_2_0_t))
+    return 0;
+
+  memcpy(out, block, data);
+  size_t in = data, written = data;
+  unsigned kept = 0;
+  for (unsigned i = 0; i < n; ++i) {
+    if (sb1 > length - in)
+      return 0;
+    const uint8_t* type1 = block + in;
+    size_t size =
+        sb1 + type1[offsetof(MeasEpochChannelType1_2_0_t, N_Type2)] * sb2;
+    if (size > length - in)
+      return 0;
+    int svid = type1[offsetof(MeasEpochChannelType1_2_0_t, SVID)];
+    if (SvidConstellation(svid) & mask) {
+      memcpy(out + written, type1, size);
+      written += size;
+      ++kept;
+    }
+    in += size;
+  }
+  if (kept == n)
+    return 0;
+
+  // pad to the 4-byte multiple SBF Length requires
+  while (written % 4 != 0)
+    out[written++] = 0;
+  out[offsetof(MeasEpoch_2_0_t, N)] = static_cast<uint8_t>(kept);
+  Store16(out + 6, static_cast<uint16_t>(written));
+  Store16(out + 2, SbfCrc16(out + 4, written - 4));
+  return static_cast<uint16_t>(written);
+}
+
+// where the kept blocks go
+class FilterSink {
+ public:
+  virtual ~FilterSink() = default;
+  virtual ssn_error_t Write(const uint8_t* data, size_t size) = 0;
+};
+
+// the output file, through a temporary beside it
+class FileSink : public FilterSink {
+ public:
+  ~FileSink() override {
+    if (!out_.is_open())
+      return;
+    out_.close();
+    std::error_code ec;
+    fs::remove(fs::u8path(temp_), ec);
+  }
+
+  ssn_error_t Open(const std::string& path) {
+    path_ = path;
+    temp_ = path + ".tmp";
+    out_.open(fs::u8path(temp_), std::ios::binary | std::ios::trunc);
+    if (!out_.is_open())
+      return GeneralError(SSNERROR_ERROR_FILEOPEN);
+    return SSNERROR_WARNING_OK;
+  }
+
+  ssn_error_t Write(const uint8_t* data, size_t size) override {
+    out_.write(reinterpret_cast<const char*>(data), size);
+    if (out_.fail())
+      return GeneralError(SSNERROR_ERROR_FILEWRITE);
+    return SSNERROR_WARNING_OK;
+  }
+
+  ssn_error_t Finish() {
+    out_.close();
+    std::error_code ec;
+    if (!out_.fail())
+      fs::rename(fs::u8path(temp_), fs::u8path(path_), ec);
+    if (out_.fail() || ec) {
+      fs::remove(fs::u8path(temp_), ec);
+      return GeneralError(SSNERROR_ERROR_FILEWRITE);
+    }
+    return SSNERROR_WARNING_OK;
+  }
+
+ private:
+  std::string path_;
+  std::string temp_;
+  std::ofstream out_;
+};
+
+// an in-memory SDK stream, for what only the SDK can do
+class StreamSink : public FilterSink {
+ public:
+  ssn_error_t Open() { return SbfStream::Create("filterSbf", &stream_); }
+
+  ssn_error_t Write(const uint8_t* data, size_t size) override {
+    // appendManyBlocks takes a non-const pointer but only copies from it
+    return SSNSBFStream_appendManyBlocks(
+        stream_->handle(), const_cast<uint8_t*>(data),
+        static_cast<int>(size));
+  }
+
+  const std::shared_ptr<SbfStream>& stream() const { return stream_; }
+
+ private:
+  std::shared_ptr<SbfStream> stream_;
+};
+
+// Crops the stream with navigation applicability and writes it out. Like
+// the file sink it writes beside `path` and renames.
+ssn_error_t CropAndWrite(ssn_hsbfstream_t stream, const FilterOptions& options) {
+  ssn_sbfstream_cropoption_t crop = options.discard_invalid
+      ? static_cast<ssn_sbfstream_cropoption_t>(
+            SSNSBFSTREAM_CROPOPTION_DEFAULT |
+            SSNSBFSTREAM_CROPOPTION_DISCARDINVALID)
+      : SSNSBFSTREAM_CROPOPTION_DEFAULT;
+  ssn_error_t rerror = SSNSBFStream_cropGNSS(
+      stream, std::isfinite(options.start) ? options.start : F64_NOTVALID,
+      std::isfinite(options.end) ? options.end : F64_NOTVALID, crop);
+  if (!IsOk(rerror))
+    return rerror;
+
+  std::string temp = options.output + ".tmp";
+  std::vector<char> filename(temp.begin(), temp.end());
+  filename.push_back('\0');
+  {
+    StageTimer timer(kStageWriteToFile);
+    rerror = timer.Done(SSNSBFStream_writeToFile(stream, filename.data()));
+  }
+  std::error_code ec;
+  if (IsOk(rerror)) {
+    fs::rename(fs::u8path(temp), fs::u8path(options.output), ec);
+    if (ec)
+      rerror = GeneralError(SSNERROR_ERROR_FILEWRITE);
+  }
+  if (!IsOk(rerror))
+    fs::remove(fs::u8path(temp), ec);
+  return rerror;
+}
+
+}
+
+ssn_error_t FilterSbfFile(const std::string& path,
+                          const FilterOptions& options, FilterStats* stats,
+                          JobControl* control) {
+  *stats = FilterStats();
+  std::error_code ec;
+  if (options.output.empty() || !(options.start <= options.end) ||
+      fs::equivalent(fs::u8path(path), fs::u8path(options.output), ec))
+    return GeneralError(SSNERROR_ERROR_INVALIDARG);
+
+  MappedFile file;
+  if (!file.Open(path))
+    return GeneralError(SSNERROR_ERROR_FILEOPEN);
+
+  bool window = std::isfinite(options.start) || std::isfinite(options.end);
+  stats->sdk_crop = window && options.applicable_navigation;
+  bool crop_here = window && !stats->sdk_crop;
+
+  FileSink file_sink;
+  StreamSink stream_sink;
+  FilterSink* sink;
+  ssn_error_t rerror;
+  if (stats->sdk_crop) {
+    rerror = stream_sink.Open();
+    sink = &stream_sink;
+  } else {
+    rerror = file_sink.Open(options.output);
+    sink = &file_sink;
+  }
+  if (!IsOk(rerror))
+    return rerror;
+
+  static const std::vector<uint32_t> kClasses = BlockClasses();
+  std::vector<uint8_t> wanted;
+  if (!options.blocks.empty()) {
+    wanted.assign(kBlockNumbers, 0);
+    for (uint16_t number : options.blocks)
+      wanted[SBF_ID_TO_NUMBER(number)] = 1;
+  }
+  const uint32_t mask = options.constellations;
+  const uint16_t meas_number = SBF_ID_TO_NUMBER(sbfid_MeasEpoch_2_0);
+
+  ScratchScope scratch;
+  uint8_t* rewritten = scratch.arena().AllocateArray<uint8_t>(MAX_SBFSIZE);
+
+  // kept blocks that follow each other in the mapping go out in one write
+  const uint8_t* run = nullptr;
+  size_t run_size = 0;
+  auto flush = [&]() -> ssn_error_t {
+    if (run_size == 0)
+      return SSNERROR_WARNING_OK;
+    ssn_error_t werror = sink->Write(run, run_size);
+    run_size = 0;
+    return werror;
+  };
+  auto keep = [&](const uint8_t* block, uint16_t length) -> ssn_error_t {
+    ++stats->blocks_out;
+    stats->bytes_out += length;
+    if (run_size > 0 && run + run_size == block &&
+        run_size + length <= kFilterRunBytes) {
+      run_size += length;
+      return SSNERROR_WARNING_OK;
+    }
+    ssn_error_t werror = flush();
+    run = block;
+    run_size = length;
+    return werror;
+  };
+
+  SbfWalker walker(file.data(), file.size());
+  size_t next_report = kFilterReportBytes;
+  uint16_t length;
+  while (const uint8_t* block = walker.Next(&length)) {
+    if (walker.position() >= next_report) {
+      next_report += kFilterReportBytes;
+      if (control != nullptr) {
+        if (control->cancelled())
+          return CancelledError();
+        control->Report(0, static_cast<float>(walker.position() * 100.0 /
+                                              file.size()));
+      }
+    }
+
+    ++stats->blocks_in;
+    stats->bytes_in += length;
+    uint16_t number = SBF_ID_TO_NUMBER(Load16(block + 4));
+    if (!wanted.empty() && !wanted[number])
+      continue;
+
+    bool timed = false;
+    uint32_t tow = 0;
+    if (length >= sizeof(TimeHeader_t)) {
+      tow = Load32(block + 8);
+      uint16_t wnc = Load16(block + 12);
+      timed = tow != U32_NOTVALID && wnc != U16_NOTVALID;
+      if (crop_here && timed) {
+        double gnsstime = wnc * 604800.0 + tow * 0.001;
+        if (gnsstime < options.start || gnsstime > options.end)
+          continue;
+      }
+    }
+    if (crop_here && !timed && options.discard_invalid)
+      continue;
+
+    uint32_t cls = kClasses[number];
+    uint32_t constellation = cls & ~kUntimed;
+    if (mask != 0 && constellation != 0 && !(constellation & mask))
+      continue;
+    if (options.interval > 0 && timed && !(cls & kUntimed) &&
+        tow % options.interval != 0)
+      continue;
+
+    if (mask != 0 && number == meas_number) {
+      uint16_t size = DropChannels(block, length, mask, rewritten);
+      if (size > 0) {
+        ++stats->rewritten;
+        ++stats->blocks_out;
+        stats->bytes_out += size;
+        rerror = flush();
+        if (IsOk(rerror))
+          rerror = sink->Write(rewritten, size);
+        if (!IsOk(rerror))
+          return rerror;
+        continue;
+      }
+    }
+
+    rerror = keep(block, length);
+    if (!IsOk(rerror))
+      return rerror;
+  }
+  stats->crc_errors = walker.crc_errors();
+
+  rerror = flush();
+  if (!IsOk(rerror))
+    return rerror;
+  if (control != nullptr && control->cancelled())
+    return CancelledError();
+
+  if (!stats->sdk_crop)
+    return file_sink.Finish();
+
+  return CropAndWrite(stream_sink.stream()->handle(), options);
+}
+
+}
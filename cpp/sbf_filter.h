@@ -0,0 +1,69 @@
+#ifndef CALCULATE_SBF_FILTER_H
+#define CALCULATE_SBF_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "ssnerror.h"
+
+namespace calculate {
+
+class JobControl;
+
+struct FilterOptions {
+  std::string output;          // SBF file written
+  // crop window, GNSS seconds, both ends included
+  double start = -std::numeric_limits<double>::infinity();
+  double end = std::numeric_limits<double>::infinity();
+  // SSNBASEFINDER_* bits of the constellations kept, 0 for all
+  uint32_t constellations = 0;
+  // block numbers kept (SBF_ID_TO_NUMBER, any revision), empty for all
+  std::vector<uint16_t> blocks;
+  // keeps the epochs whose TOW is a multiple of it, ms; 0 for all
+  uint32_t interval = 0;
+  // with a crop window: also keep the navigation blocks from outside it
+  // that apply inside it, as SSNSBFStream_cropGNSS does by default
+  bool applicable_navigation = false;
+  // with a crop window: drop blocks without a valid time stamp
+  bool discard_invalid = false;
+};
+
+struct FilterStats {
+  uint64_t blocks_in = 0;      // valid blocks walked
+  uint64_t blocks_out = 0;     // before the crop when sdk_crop
+  uint64_t bytes_in = 0;
+  uint64_t bytes_out = 0;
+  uint64_t crc_errors = 0;
+  uint64_t rewritten = 0;      // MeasEpoch blocks that lost channels
+  bool sdk_crop = false;       // the window went through the SDK
+};
+
+// SSNSBFStream_cropGNSS, filterID, sample and writeToFile of an SBF file
+// fused into one pass over a memory mapping of it.
+//
+// Every block walked is tested against all filters at once and the ones
+// kept are written as they come, runs of consecutive kept blocks straight
+// from the mapping. The constellation mask drops the navigation page and
+// decoded navigation blocks of the other constellations and rewrites
+// MeasEpoch without their channels (N, Length and CRC updated); other
+// blocks are not tied to one constellation and pass. Decimation leaves the
+// navigation blocks alone, since they are timed by transmission rather
+// than by epoch, and so do blocks without a valid time stamp.
+//
+// Only navigation applicability needs the SDK: with applicable_navigation
+// and a crop window the other filters still run in the one pass, into an
+// in-memory stream that SSNSBFStream_cropGNSS then crops and writes out.
+//
+// The output is written beside `options.output` and renamed into place,
+// so readers never see a partial file; it must not be the input.
+ssn_error_t FilterSbfFile(const std::string& path,
+                          const FilterOptions& options, FilterStats* stats,
+                          JobControl* control = nullptr);
+
+}
+
+#endif
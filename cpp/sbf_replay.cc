@@ -0,0 +1,312 @@
+#include "sbf_replay.h"
+
+#include <string.h>
+#include <uv.h>
+
+#include <atomic>
+
+#include "sbf_session.h"
+#include "v8_util.h"
+
+namespace calculate {
+
+using v8::ArrayBuffer;
+using v8::Boolean;
+using v8::Context;
+using v8::Exception;
+using v8::Function;
+using v8::FunctionCallbackInfo;
+using v8::FunctionTemplate;
+using v8::Global;
+using v8::HandleScope;
+using v8::Isolate;
+using v8::Local;
+using v8::Number;
+using v8::Object;
+using v8::String;
+using v8::Uint32Array;
+using v8::Uint8Array;
+using v8::Undefined;
+using v8::Value;
+
+namespace {
+
+Local<Value> Option(Isolate* isolate, Local<Object> options, const char* key) {
+  return options->Get(isolate->GetCurrentContext(), Key(isolate, key))
+      .ToLocalChecked();
+}
+
+uint32_t OptionUint32(Isolate* isolate, Local<Object> options, const char* key,
+                      uint32_t fallback) {
+  Local<Value> value = Option(isolate, options, key);
+  if (!value->IsNumber())
+    return fallback;
+  return value->Uint32Value(isolate->GetCurrentContext()).FromJust();
+}
+
+Local<Object> StatsObject(Isolate* isolate, const ReplayStats& stats) {
+  Local<Object> out = Object::New(isolate);
+  Set(isolate, out, "playing", Boolean::New(isolate, stats.playing));
+  Set(isolate, out, "finished", Boolean::New(isolate, stats.finished));
+  SetNumber(isolate, out, "speed", stats.speed);
+  SetNumber(isolate, out, "time", stats.time);
+  SetNumber(isolate, out, "blocks", static_cast<double>(stats.blocks));
+  SetNumber(isolate, out, "bytes", static_cast<double>(stats.bytes));
+  SetNumber(isolate, out, "frames", static_cast<double>(stats.frames));
+  SetNumber(isolate, out, "lateFrames",
+            static_cast<double>(stats.late_frames));
+  SetNumber(isolate, out, "lagMs", stats.lag_ms);
+  SetNumber(isolate, out, "seeks", static_cast<double>(stats.seeks));
+  Set(isolate, out, "pvtErrors", PVTErrorObject(isolate, stats.errors));
+  Set(isolate, out, "pvtModes", PVTModeObject(isolate, stats.modes));
+  if (!stats.error.empty())
+    Set(isolate, out, "error",
+        String::NewFromUtf8(isolate, stats.error.c_str()).ToLocalChecked());
+  return out;
+}
+
+}
+
+// Wakes the main thread from the replay thread and calls onFrame(frame)
+// through a uv_async_t, like UpdateChannel does for live receivers. Deletes
+// itself once libuv has released the handle.
+class FrameChannel : public node::AsyncResource {
+ public:
+  FrameChannel(Isolate* isolate, Local<Function> callback)
+      : node::AsyncResource(isolate, Object::New(isolate), "calculate:replay"),
+        isolate_(isolate), callback_(isolate, callback),
+        context_(isolate, isolate->GetCurrentContext()) {
+    async_.data = this;
+    uv_async_init(node::GetCurrentEventLoop(isolate), &async_, OnAsync);
+  }
+
+  void set_scheduler(ReplayScheduler* scheduler) { scheduler_ = scheduler; }
+
+  // any thread
+  void Post() {
+    pending_ = true;
+    uv_async_send(&async_);
+  }
+
+  // after the replay thread has stopped; `flush` delivers a pending frame
+  // first, which must not happen from a GC finalizer
+  void Close(bool flush) {
+    if (flush)
+      Deliver();
+    uv_close(reinterpret_cast<uv_handle_t*>(&async_), OnClosed);
+  }
+
+ private:
+  ~FrameChannel() {
+    callback_.Reset();
+    context_.Reset();
+  }
+
+  static void OnAsync(uv_async_t* handle) {
+    static_cast<FrameChannel*>(handle->data)->Deliver();
+  }
+
+  static void OnClosed(uv_handle_t* handle) {
+    delete static_cast<FrameChannel*>(handle->data);
+  }
+
+  void Deliver() {
+    if (!pending_.exchange(false) || scheduler_ == nullptr)
+      return;
+
+    HandleScope handle_scope(isolate_);
+    Context::Scope context_scope(context_.Get(isolate_));
+
+    // the frame buffers are swapped back and forth, so they keep their
+    // capacity between frames
+    scheduler_->TakeFrame(&frame_);
+    size_t count = frame_.offsets.empty() ? 0 : frame_.offsets.size() - 1;
+    size_t offsets_bytes = (count + 1) * sizeof(uint32_t);
+    Local<ArrayBuffer> buffer =
+        ArrayBuffer::New(isolate_, offsets_bytes + frame_.blocks.size());
+    uint8_t* data = static_cast<uint8_t*>(buffer->GetBackingStore()->Data());
+    if (count > 0) {
+      memcpy(data, frame_.offsets.data(), offsets_bytes);
+      memcpy(data + offsets_bytes, frame_.blocks.data(),
+             frame_.blocks.size());
+    } else {
+      memset(data, 0, offsets_bytes);
+    }
+
+    Local<Object> frame = Object::New(isolate_);
+    Set(isolate_, frame, "offsets", Uint32Array::New(buffer, 0, count + 1));
+    Set(isolate_, frame, "blocks",
+        Uint8Array::New(buffer, offsets_bytes, frame_.blocks.size()));
+    Set(isolate_, frame, "stats",
+        StatsObject(isolate_, scheduler_->GetStats()));
+
+    Local<Value> argv[] = { frame };
+    MakeCallback(callback_.Get(isolate_), 1, argv);
+  }
+
+  Isolate* isolate_;
+  uv_async_t async_;
+  Global<Function> callback_;
+  Global<Context> context_;
+  ReplayScheduler* scheduler_ = nullptr;
+  ReplayFrame frame_;
+  std::atomic<bool> pending_{false};
+};
+
+SbfReplay::~SbfReplay() {
+  Shutdown(false);
+}
+
+void SbfReplay::Init(Local<Object> exports) {
+  Isolate* isolate = exports->GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(isolate, New);
+  tpl->SetClassName(Key(isolate, "SbfReplay"));
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "play", Play);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "pause", Pause);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "seek", Seek);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "setSpeed", SetSpeed);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "stats", Stats);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "stop", Stop);
+
+  Local<Function> constructor = tpl->GetFunction(context).ToLocalChecked();
+  exports->Set(context, Key(isolate, "SbfReplay"), constructor).Check();
+}
+
+// new SbfReplay(session, { speed, frameMs, sbfid, pvtId, paused, onFrame })
+//
+//   speed    GNSS seconds per wall second, 0.1..100, default 1
+//   frameMs  frame budget, 5..1000 ms, default 33
+//   sbfid    block type to replay, every block when omitted
+//   pvtId    block number for the PVT percentages, default 4007
+//   paused   start paused, default false
+void SbfReplay::New(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+
+  if (!args.IsConstructCall()) {
+    isolate->ThrowException(Exception::TypeError(
+        Key(isolate, "SbfReplay must be called with new")));
+    return;
+  }
+
+  std::shared_ptr<SbfStream> stream = SbfSession::StreamFrom(isolate, args[0]);
+  if (!stream)
+    return;
+
+  ReplayOptions options;
+  Local<Value> on_frame = Undefined(isolate);
+  if (args.Length() > 1 && args[1]->IsObject()) {
+    Local<Object> object = args[1].As<Object>();
+    Local<Value> speed = Option(isolate, object, "speed");
+    if (speed->IsNumber())
+      options.speed = speed.As<Number>()->Value();
+    options.frame = std::chrono::milliseconds(OptionUint32(
+        isolate, object, "frameMs",
+        static_cast<uint32_t>(options.frame.count())));
+    options.sbfid = static_cast<SBFID_t>(
+        OptionUint32(isolate, object, "sbfid", sbfid_ALL));
+    options.pvt_number = static_cast<uint16_t>(
+        OptionUint32(isolate, object, "pvtId", options.pvt_number));
+    Local<Value> paused = Option(isolate, object, "paused");
+    if (paused->IsBoolean())
+      options.paused = paused->BooleanValue(isolate);
+    on_frame = Option(isolate, object, "onFrame");
+  }
+
+  if (!(options.speed >= kMinReplaySpeed && options.speed <= kMaxReplaySpeed) ||
+      options.frame.count() < 5 || options.frame.count() > 1000) {
+    isolate->ThrowException(Exception::RangeError(Key(isolate,
+        "SbfReplay: speed must be 0.1..100 and frameMs 5..1000")));
+    return;
+  }
+
+  SbfReplay* replay = new SbfReplay();
+  ReplayScheduler::FrameFn frame;
+  if (on_frame->IsFunction()) {
+    FrameChannel* channel = new FrameChannel(isolate, on_frame.As<Function>());
+    replay->channel_ = channel;
+    frame = [channel]() { channel->Post(); };
+  }
+  replay->scheduler_.reset(new ReplayScheduler(stream, options, frame));
+  if (replay->channel_ != nullptr)
+    replay->channel_->set_scheduler(replay->scheduler_.get());
+
+  replay->Wrap(args.This());
+  replay->scheduler_->Start();
+  replay->running_ = true;
+  replay->Ref();
+  args.GetReturnValue().Set(args.This());
+}
+
+void SbfReplay::Play(const FunctionCallbackInfo<Value>& args) {
+  SbfReplay* replay = ObjectWrap::Unwrap<SbfReplay>(args.Holder());
+  replay->scheduler_->Play();
+}
+
+void SbfReplay::Pause(const FunctionCallbackInfo<Value>& args) {
+  SbfReplay* replay = ObjectWrap::Unwrap<SbfReplay>(args.Holder());
+  replay->scheduler_->Pause();
+}
+
+// seek(gnsstime) continues from the first block at or after gnsstime,
+// O(log n) once session.buildIndex() has run; playing or paused as before
+void SbfReplay::Seek(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  SbfReplay* replay = ObjectWrap::Unwrap<SbfReplay>(args.Holder());
+
+  if (args.Length() < 1 || !args[0]->IsNumber()) {
+    isolate->ThrowException(Exception::TypeError(
+        Key(isolate, "SbfReplay: seek(gnsstime) expects a number")));
+    return;
+  }
+  replay->scheduler_->Seek(args[0].As<Number>()->Value());
+}
+
+// setSpeed(speed) keeps the replay where it is, 0.1..100
+void SbfReplay::SetSpeed(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  SbfReplay* replay = ObjectWrap::Unwrap<SbfReplay>(args.Holder());
+
+  if (args.Length() < 1 || !args[0]->IsNumber()) {
+    isolate->ThrowException(Exception::TypeError(
+        Key(isolate, "SbfReplay: setSpeed(speed) expects a number")));
+    return;
+  }
+  replay->scheduler_->SetSpeed(args[0].As<Number>()->Value());
+}
+
+// stats() -> { playing, finished, speed, time, blocks, bytes, frames,
+//              lateFrames, lagMs, seeks, pvtErrors, pvtModes, error }
+void SbfReplay::Stats(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  SbfReplay* replay = ObjectWrap::Unwrap<SbfReplay>(args.Holder());
+  args.GetReturnValue().Set(
+      StatsObject(isolate, replay->scheduler_->GetStats()));
+}
+
+// stop() ends the replay; the session stays open
+void SbfReplay::Stop(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  SbfReplay* replay = ObjectWrap::Unwrap<SbfReplay>(args.Holder());
+
+  if (replay->running_) {
+    replay->Shutdown(true);
+    replay->running_ = false;
+    replay->Unref();
+  }
+  args.GetReturnValue().Set(Undefined(isolate));
+}
+
+void SbfReplay::Shutdown(bool flush) {
+  if (scheduler_)
+    scheduler_->Stop();
+  if (channel_ != nullptr) {
+    channel_->Close(flush);
+    channel_ = nullptr;
+  }
+}
+
+}
@@ -0,0 +1,57 @@
+#ifndef CALCULATE_SBF_REPLAY_H
+#define CALCULATE_SBF_REPLAY_H
+
+#include <node.h>
+#include <node_object_wrap.h>
+
+#include <memory>
+
+#include "replay_scheduler.h"
+
+namespace calculate {
+
+class FrameChannel;
+
+// JS-visible replay of a loaded session, see ReplayScheduler.
+//
+//   const replay = new SbfReplay(session, { speed: 10, onFrame: (frame) => {
+//     const { blocks, offsets, stats } = frame
+//   }})
+//   replay.pause(); replay.seek(gnsstime); replay.setSpeed(50); replay.play()
+//   replay.stop()
+//
+// onFrame(frame) is called on the main thread with the blocks replayed
+// since the previous call: `blocks` a Uint8Array of SBF blocks back to
+// back, block i at [offsets[i], offsets[i + 1]) of the Uint32Array
+// `offsets`, and `stats` as stats() returns them. Frames the main thread
+// had no time for are coalesced into the next one. At the end of the
+// stream the replay pauses; seek() and play() start it again. The replay
+// keeps itself and the event loop alive until stop().
+class SbfReplay : public node::ObjectWrap {
+ public:
+  static void Init(v8::Local<v8::Object> exports);
+
+ private:
+  SbfReplay() = default;
+  ~SbfReplay();
+
+  static void New(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Play(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Pause(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Seek(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void SetSpeed(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Stats(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Stop(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+  // Joins the replay thread and, with `flush`, delivers the last frame;
+  // idempotent
+  void Shutdown(bool flush);
+
+  std::unique_ptr<ReplayScheduler> scheduler_;
+  FrameChannel* channel_ = nullptr;
+  bool running_ = false;
+};
+
+}
+
+#endif
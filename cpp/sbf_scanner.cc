@@ -0,0 +1,316 @@
+#include "sbf_scanner.h"
+
+#include <string.h>
+
+#include <array>
+#include <map>
+
+#include "sbfdef.h"
+
+#include "job_control.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "sbf_util.h"
+
+namespace calculate {
+
+namespace {
+
+typedef std::array<std::array<uint16_t, 256>, 8> CrcTables;
+
+// tables[0] is the classic byte-at-a-time table; tables[k][b] is the CRC of
+// byte b followed by k zero bytes, which lets eight bytes be folded at once
+constexpr CrcTables MakeCrcTables() {
+  CrcTables tables{};
+  for (int b = 0; b < 256; ++b) {
+    uint16_t crc = static_cast<uint16_t>(b << 8);
+    for (int bit = 0; bit < 8; ++bit)
+      crc = static_cast<uint16_t>((crc & 0x8000) ? (crc << 1) ^ 0x1021
+                                                 : crc << 1);
+    tables[0][b] = crc;
+  }
+  for (int k = 1; k < 8; ++k) {
+    for (int b = 0; b < 256; ++b) {
+      uint16_t prev = tables[k - 1][b];
+      tables[k][b] = static_cast<uint16_t>((prev << 8) ^ tables[0][prev >> 8]);
+    }
+  }
+  return tables;
+}
+
+constexpr CrcTables kCrcTables = MakeCrcTables();
+
+const uint8_t kSync1 = 0x24;  // '$'
+const uint8_t kSync2 = 0x40;  // '@'
+
+// bytes between two cancellation checks / progress reports
+const size_t kScanReportBytes = 16 * 1024 * 1024;
+
+uint16_t Load16(const uint8_t* p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t Load32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// Most common spacing of the epoch times, then the gaps beyond 1.5 x that
+void SummariseEpochs(const std::vector<uint64_t>& epochs,
+                     const ScanOptions& options, ScanStats* stats) {
+  stats->epochs = epochs.size();
+  if (epochs.empty())
+    return;
+
+  stats->first_time = epochs.front() / 1000.0;
+  stats->last_time = epochs.back() / 1000.0;
+  if (epochs.size() < 2)
+    return;
+
+  std::map<uint64_t, uint64_t> spacings;
+  for (size_t i = 1; i < epochs.size(); ++i)
+    ++spacings[epochs[i] - epochs[i - 1]];
+
+  uint64_t interval = 0, best = 0;
+  for (const auto& spacing : spacings) {
+    if (spacing.second > best) {
+      best = spacing.second;
+      interval = spacing.first;
+    }
+  }
+  stats->interval = interval / 1000.0;
+
+  for (size_t i = 1; i < epochs.size(); ++i) {
+    uint64_t spacing = epochs[i] - epochs[i - 1];
+    if (spacing * 2 <= interval * 3)
+      continue;
+    ++stats->gap_count;
+    stats->gap_seconds += (spacing - interval) / 1000.0;
+    if (stats->gaps.size() < options.max_gaps)
+      stats->gaps.push_back(
+          ScanGap{epochs[i - 1] / 1000.0, epochs[i] / 1000.0});
+  }
+}
+
+}
+
+uint16_t SbfCrc16(const uint8_t* data, size_t length, uint16_t crc) {
+  const CrcTables& t = kCrcTables;
+
+  while (length >= 8) {
+    crc ^= static_cast<uint16_t>((data[0] << 8) | data[1]);
+    crc = t[7][crc >> 8] ^ t[6][crc & 0xff] ^ t[5][data[2]] ^
+          t[4][data[3]] ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^
+          t[0][data[7]];
+    data += 8;
+    length -= 8;
+  }
+
+  while (length-- > 0)
+    crc = static_cast<uint16_t>((crc << 8) ^ t[0][(crc >> 8) ^ *data++]);
+
+  return crc;
+}
+
+ssn_error_t ScanSbfFile(const std::string& path, const ScanOptions& options,
+                        ScanStats* stats, JobControl* control) {
+  MappedFile file;
+  if (!file.Open(path))
+    return SSNERROR_CREATE(SSNERROR_SEVERITY_FAILURE, SSNERROR_MODULE_GENERAL,
+                           SSNERROR_SUBMODULE_GENERAL, SSNERROR_TYPE_GENERAL,
+                           SSNERROR_ERROR_FILEOPEN);
+  return ScanSbf(file.data(), file.size(), options, stats, control);
+}
+
+ssn_error_t ScanSbf(const uint8_t* data, size_t size,
+                    const ScanOptions& options, ScanStats* stats,
+                    JobControl* control) {
+  // counts per block number, SBF_ID_TO_NUMBER keeps 13 bits
+  std::vector<uint64_t> counts(0x2000), bytes(0x2000);
+  std::vector<uint64_t> epochs;
+  size_t pos = 0, next_report = kScanReportBytes;
+  size_t valid_bytes = 0;
+  // syncs whose Length runs past the end: false ones inside garbage when a
+  // valid block follows, a cut-off last block when none does
+  uint64_t overruns = 0;
+
+  *stats = ScanStats();
+  stats->bytes = size;
+
+  while (pos + sizeof(BlockHeader_t) <= size) {
+    if (pos >= next_report) {
+      next_report += kScanReportBytes;
+      if (control != nullptr) {
+        if (control->cancelled())
+          return CancelledError();
+        control->Report(0, static_cast<float>(pos * 100.0 / size));
+      }
+    }
+
+    // skip to the next sync
+    if (data[pos] != kSync1 || data[pos + 1] != kSync2) {
+      const void* sync = memchr(data + pos + 1, kSync1, size - pos - 1);
+      pos = sync != nullptr ? static_cast<const uint8_t*>(sync) - data : size;
+      continue;
+    }
+
+    const uint8_t* block = data + pos;
+    uint16_t crc = Load16(block + 2);
+    uint16_t id = Load16(block + 4);
+    uint16_t length = Load16(block + 6);
+
+    if (length < sizeof(BlockHeader_t) || length % 4 != 0) {
+      ++stats->crc_errors;
+      ++pos;
+      continue;
+    }
+    if (pos + length > size) {
+      ++overruns;
+      ++pos;
+      continue;
+    }
+    // the CRC covers everything after the CRC field itself
+    if (SbfCrc16(block + 4, length - 4) != crc) {
+      ++stats->crc_errors;
+      ++pos;
+      continue;
+    }
+
+    uint16_t number = SBF_ID_TO_NUMBER(id);
+    stats->crc_errors += overruns;
+    overruns = 0;
+    ++stats->blocks;
+    ++counts[number];
+    bytes[number] += length;
+    valid_bytes += length;
+    pos += length;
+
+    if (length < sizeof(TimeHeader_t))
+      continue;
+
+    uint32_t tow = Load32(block + 8);
+    uint16_t wnc = Load16(block + 12);
+    if (tow == kTowDoNotUse || wnc == kWncDoNotUse)
+      continue;
+
+    uint64_t time = static_cast<uint64_t>(wnc) * 604800000ull + tow;
+
+    // one epoch per distinct time; blocks of an epoch share the time stamp
+    if ((options.epoch_number == 0 || number == options.epoch_number) &&
+        (epochs.empty() || time > epochs.back()))
+      epochs.push_back(time);
+  }
+
+  stats->truncated = overruns > 0;
+  stats->skipped_bytes = size - valid_bytes;
+  CountBlocks(stats->blocks, pos < size ? pos : size);
+
+  for (uint16_t number = 0; number < counts.size(); ++number) {
+    if (counts[number] > 0)
+      stats->block_types.push_back(
+          ScanBlockType{number, counts[number], bytes[number]});
+  }
+
+  SummariseEpochs(epochs, options, stats);
+
+  if (control != nullptr)
+    control->Report(0, 100.0f);
+  return SSNERROR_WARNING_OK;
+}
+
+SbfWalker::~SbfWalker() {
+  CountBlocks(blocks_, pos_);
+}
+
+const uint8_t* SbfWalker::Next(uint16_t* length) {
+  while (pos_ + sizeof(BlockHeader_t) <= size_) {
+    if (data_[pos_] != kSync1 || data_[pos_ + 1] != kSync2) {
+      const void* sync = memchr(data_ + pos_ + 1, kSync1, size_ - pos_ - 1);
+      pos_ = sync != nullptr ? static_cast<const uint8_t*>(sync) - data_
+                             : size_;
+      continue;
+    }
+
+    const uint8_t* block = data_ + pos_;
+    uint16_t size = Load16(block + 6);
+    if (size < sizeof(BlockHeader_t) || size % 4 != 0) {
+      ++crc_errors_;
+      ++pos_;
+      continue;
+    }
+    if (size > size_ - pos_) {
+      ++overruns_;
+      ++pos_;
+      continue;
+    }
+    if (SbfCrc16(block + 4, size - 4) != Load16(block + 2)) {
+      ++crc_errors_;
+      ++pos_;
+      continue;
+    }
+
+    crc_errors_ += overruns_;
+    overruns_ = 0;
+    pos_ += size;
+    ++blocks_;
+    *length = size;
+    return block;
+  }
+  pos_ = size_;
+  return nullptr;
+}
+
+void SbfFramer::Push(const uint8_t* data, size_t size) {
+  if (start_ > 0) {
+    buffer_.erase(buffer_.begin(), buffer_.begin() + start_);
+    start_ = 0;
+  }
+  buffer_.insert(buffer_.end(), data, data + size);
+}
+
+const uint8_t* SbfFramer::Next(uint16_t* length) {
+  for (;;) {
+    size_t available = buffer_.size() - start_;
+    const uint8_t* block = buffer_.data() + start_;
+
+    if (available < 2)
+      return nullptr;
+
+    if (block[0] != kSync1 || block[1] != kSync2) {
+      const void* sync = memchr(block + 1, kSync1, available - 1);
+      size_t skip = sync != nullptr
+          ? static_cast<size_t>(static_cast<const uint8_t*>(sync) - block)
+          : available;
+      skipped_bytes_ += skip;
+      start_ += skip;
+      continue;
+    }
+
+    if (available < sizeof(BlockHeader_t))
+      return nullptr;
+
+    uint16_t size = Load16(block + 6);
+    if (size < sizeof(BlockHeader_t) || size % 4 != 0) {
+      ++crc_errors_;
+      ++skipped_bytes_;
+      ++start_;
+      continue;
+    }
+    if (available < size)
+      return nullptr;
+    if (SbfCrc16(block + 4, size - 4) != Load16(block + 2)) {
+      ++crc_errors_;
+      ++skipped_bytes_;
+      ++start_;
+      continue;
+    }
+
+    start_ += size;
+    CountBlocks(1, size);
+    *length = size;
+    return block;
+  }
+}
+
+}
@@ -0,0 +1,125 @@
+#ifndef CALCULATE_SBF_SCANNER_H
+#define CALCULATE_SBF_SCANNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "ssnerror.h"
+
+namespace calculate {
+
+class JobControl;
+
+// CRC-16-CCITT (polynomial 0x1021, initial value 0) as used by SBF, over
+// `length` bytes. Slicing-by-8 over constexpr tables.
+uint16_t SbfCrc16(const uint8_t* data, size_t length, uint16_t crc = 0);
+
+struct ScanOptions {
+  // block number whose time stamps define the epochs for gap detection;
+  // 0 uses every timed block
+  uint16_t epoch_number = 4027;  // MeasEpoch
+  size_t max_gaps = 1000;
+};
+
+struct ScanBlockType {
+  uint16_t number;               // SBF_ID_TO_NUMBER of the block ID
+  uint64_t count;
+  uint64_t bytes;
+};
+
+struct ScanGap {
+  double start;                  // GNSS time of the last epoch before the gap
+  double end;                    // and of the first one after it
+};
+
+struct ScanStats {
+  uint64_t bytes = 0;
+  uint64_t blocks = 0;
+  uint64_t crc_errors = 0;       // sync found but CRC or length invalid
+  uint64_t skipped_bytes = 0;    // bytes outside valid blocks
+  bool truncated = false;        // a sync after the last valid block has a
+                                 // Length past the end of file
+  std::vector<ScanBlockType> block_types;  // by block number
+
+  // epochs are the distinct, increasing time stamps of the epoch blocks;
+  // navigation blocks carry transmit times and would skew the span
+  uint64_t epochs = 0;
+  double first_time = 0.0;       // GNSS seconds, 0 without epochs
+  double last_time = 0.0;
+  double interval = 0.0;         // most common epoch spacing, seconds
+  uint64_t gap_count = 0;        // spacings over 1.5 x interval
+  double gap_seconds = 0.0;      // time lost in gaps beyond the interval
+  std::vector<ScanGap> gaps;     // first max_gaps of them
+};
+
+// Quick-look statistics of an SBF file without SSNSBFStream_loadFile.
+//
+// The file is memory-mapped and the blocks are walked in place: sync
+// "$@", then the BlockHeader_t / TimeHeader_t fields of sbfdef.h. A block
+// counts when its Length is a multiple of 4 within the file and its CRC
+// matches; otherwise the scanner resynchronises on the next sync.
+// Nothing is decoded beyond the header, so anything semantic (PVT, tracked
+// satellites) still goes through the SDK.
+ssn_error_t ScanSbfFile(const std::string& path, const ScanOptions& options,
+                        ScanStats* stats, JobControl* control = nullptr);
+
+// Same over bytes already in memory
+ssn_error_t ScanSbf(const uint8_t* data, size_t size,
+                    const ScanOptions& options, ScanStats* stats,
+                    JobControl* control = nullptr);
+
+// In-place walk over the valid blocks of bytes in memory, with the framing
+// and resynchronisation rules of ScanSbf(). Blocks point into `data`. The
+// blocks and bytes walked go to SnapshotMetrics() once it is destroyed.
+class SbfWalker {
+ public:
+  SbfWalker(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+  ~SbfWalker();
+
+  SbfWalker(const SbfWalker&) = delete;
+  void operator=(const SbfWalker&) = delete;
+
+  // Next valid block and its Length, or null at the end of the data
+  const uint8_t* Next(uint16_t* length);
+
+  size_t position() const { return pos_; }
+  uint64_t crc_errors() const { return crc_errors_; }
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_ = 0;
+  uint64_t blocks_ = 0;
+  uint64_t crc_errors_ = 0;
+  // syncs since the last valid block whose Length ran past the end
+  uint64_t overruns_ = 0;
+};
+
+// Incremental SBF framing for byte streams (sockets, serial ports).
+//
+// Received bytes go in through Push(); Next() hands out complete blocks
+// whose Length and CRC check out, with the same resynchronisation rules as
+// ScanSbf(). A block pointer stays valid until the next Push().
+class SbfFramer {
+ public:
+  void Push(const uint8_t* data, size_t size);
+
+  // Next complete block and its Length, or null when more bytes are needed
+  const uint8_t* Next(uint16_t* length);
+
+  uint64_t crc_errors() const { return crc_errors_; }
+  uint64_t skipped_bytes() const { return skipped_bytes_; }
+
+ private:
+  std::vector<uint8_t> buffer_;
+  size_t start_ = 0;
+  uint64_t crc_errors_ = 0;
+  uint64_t skipped_bytes_ = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,792 @@
+#include "sbf_session.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "ssnsbfanalyze.h"
+
+#include "block_index.h"
+#include "job_binding.h"
+#include "metrics.h"
+#include "pvt_analysis.h"
+#include "pvt_stats.h"
+#include "scratch_arena.h"
+#include "series_pyramid.h"
+#include "stream_cache.h"
+#include "v8_util.h"
+
+namespace calculate {
+
+using v8::Array;
+using v8::ArrayBuffer;
+using v8::Boolean;
+using v8::Context;
+using v8::Eternal;
+using v8::Exception;
+using v8::Float64Array;
+using v8::Function;
+using v8::FunctionCallbackInfo;
+using v8::FunctionTemplate;
+using v8::Global;
+using v8::Isolate;
+using v8::Local;
+using v8::Null;
+using v8::Number;
+using v8::Object;
+using v8::String;
+using v8::Uint32Array;
+using v8::Undefined;
+using v8::Value;
+
+Eternal<FunctionTemplate> SbfSession::constructor_;
+
+namespace {
+
+void ThrowTypeError(Isolate* isolate, const char* message) {
+  isolate->ThrowException(Exception::TypeError(
+      String::NewFromUtf8(isolate, message).ToLocalChecked()));
+}
+
+// optional SBF ID argument, defaults to every block like analyze() does
+SBFID_t SbfIdArg(const FunctionCallbackInfo<Value>& args, int index) {
+  if (args.Length() > index && args[index]->IsNumber())
+    return static_cast<SBFID_t>(
+        args[index]->Uint32Value(args.GetIsolate()->GetCurrentContext())
+            .FromJust());
+  return sbfid_ALL;
+}
+
+// Loads the file off the main thread (or takes it from the stream cache) and
+// hands the stream to the session
+class LoadJob : public AsyncJob {
+ public:
+  LoadJob(Isolate* isolate, Local<Object> session, const std::string& path,
+          Local<Value> options)
+      : AsyncJob(isolate, "calculate:SbfSession.load"),
+        session_(isolate, session), path_(path), binding_(isolate, options) {}
+
+ protected:
+  void Execute() override {
+    JobControl* control = binding_.control();
+    ssn_error_t rerror = control->cancelled()
+        ? CancelledError()
+        : StreamCache::Instance().Acquire(path_, &stream_, control);
+    if (control->cancelled())
+      SetCancelled();
+    else if (!IsOk(rerror))
+      SetError(rerror);
+  }
+
+  void OnSettle(Isolate* isolate) override { binding_.Finish(isolate); }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    Local<Object> handle = session_.Get(isolate);
+    node::ObjectWrap::Unwrap<SbfSession>(handle)->set_stream(stream_);
+    return handle;
+  }
+
+ private:
+  Global<Object> session_;
+  std::string path_;
+  std::shared_ptr<SbfStream> stream_;
+  JobBinding binding_;
+};
+
+// Maps or (re)builds the sidecar block index and attaches it to the stream,
+// so every session sharing the cached stream seeks through it
+class IndexJob : public StreamJob {
+ public:
+  IndexJob(Isolate* isolate, const std::shared_ptr<SbfStream>& stream,
+           Local<Value> options)
+      : StreamJob(isolate, "calculate:SbfSession.buildIndex", stream),
+        binding_(isolate, options) {}
+
+ protected:
+  void Execute() override {
+    StreamJob::Execute();
+    if (binding_.control()->cancelled())
+      SetCancelled();
+  }
+
+  ssn_error_t Query(ssn_hsbfstream_t sbfstream) override {
+    if (binding_.control()->cancelled())
+      return CancelledError();
+
+    std::shared_ptr<BlockIndex> index = std::make_shared<BlockIndex>();
+    ssn_error_t rerror = index->Load(stream_->path(), sbfstream,
+                                     binding_.control());
+    if (!IsOk(rerror))
+      return rerror;
+
+    stream_->set_index(index);
+    index_ = index;
+    return rerror;
+  }
+
+  void OnSettle(Isolate* isolate) override { binding_.Finish(isolate); }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    static const char* const kOrigins[] = {"reused", "extended", "built"};
+    Local<Context> context = isolate->GetCurrentContext();
+    Local<Object> out = Object::New(isolate);
+
+    SetNumber(isolate, out, "entries", static_cast<double>(index_->size()));
+    out->Set(context, String::NewFromUtf8(isolate, "origin").ToLocalChecked(),
+             String::NewFromUtf8(isolate, kOrigins[index_->origin()])
+                 .ToLocalChecked()).Check();
+    out->Set(context,
+             String::NewFromUtf8(isolate, "persisted").ToLocalChecked(),
+             Boolean::New(isolate, index_->persisted())).Check();
+    out->Set(context, String::NewFromUtf8(isolate, "path").ToLocalChecked(),
+             String::NewFromUtf8(isolate, index_->path().c_str())
+                 .ToLocalChecked()).Check();
+    return out;
+  }
+
+ private:
+  JobBinding binding_;
+  std::shared_ptr<BlockIndex> index_;
+};
+
+// Maps or builds the sidecar LOD pyramid and attaches it to the stream.
+// Once attached it is immutable, so getSeries() reads it on the main thread.
+class SeriesJob : public StreamJob {
+ public:
+  SeriesJob(Isolate* isolate, const std::shared_ptr<SbfStream>& stream,
+            Local<Value> options)
+      : StreamJob(isolate, "calculate:SbfSession.buildSeries", stream),
+        binding_(isolate, options) {}
+
+ protected:
+  void Execute() override {
+    StreamJob::Execute();
+    if (binding_.control()->cancelled())
+      SetCancelled();
+  }
+
+  ssn_error_t Query(ssn_hsbfstream_t sbfstream) override {
+    if (binding_.control()->cancelled())
+      return CancelledError();
+
+    std::shared_ptr<SeriesPyramid> series = std::make_shared<SeriesPyramid>();
+    ssn_error_t rerror = series->Load(stream_->path(), sbfstream,
+                                      binding_.control());
+    if (!IsOk(rerror))
+      return rerror;
+
+    stream_->set_series(series);
+    series_ = series;
+    return rerror;
+  }
+
+  void OnSettle(Isolate* isolate) override { binding_.Finish(isolate); }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    static const char* const kOrigins[] = {"reused", "built"};
+    Local<Context> context = isolate->GetCurrentContext();
+    Local<Object> out = Object::New(isolate);
+
+    SetNumber(isolate, out, "epochs", static_cast<double>(series_->epochs()));
+    SetNumber(isolate, out, "levels", series_->levels());
+    out->Set(context, String::NewFromUtf8(isolate, "origin").ToLocalChecked(),
+             String::NewFromUtf8(isolate, kOrigins[series_->origin()])
+                 .ToLocalChecked()).Check();
+    out->Set(context,
+             String::NewFromUtf8(isolate, "persisted").ToLocalChecked(),
+             Boolean::New(isolate, series_->persisted())).Check();
+    out->Set(context, String::NewFromUtf8(isolate, "path").ToLocalChecked(),
+             String::NewFromUtf8(isolate, series_->path().c_str())
+                 .ToLocalChecked()).Check();
+    return out;
+  }
+
+ private:
+  JobBinding binding_;
+  std::shared_ptr<SeriesPyramid> series_;
+};
+
+// Reads the first block at or after a GNSS time, through the block index
+// when one has been built
+class FindBlockJob : public StreamJob {
+ public:
+  FindBlockJob(Isolate* isolate, const std::shared_ptr<SbfStream>& stream,
+               double gnsstime, SBFID_t sbfid)
+      : StreamJob(isolate, "calculate:SbfSession.findBlock", stream),
+        gnsstime_(gnsstime), sbfid_(sbfid) {}
+
+ protected:
+  ssn_error_t Query(ssn_hsbfstream_t sbfstream) override {
+    ssn_error_t rerror;
+
+    rerror = FindBlockPosition(sbfstream, stream_->index().get(), gnsstime_,
+                               sbfid_, &offset_, &found_);
+    if (!IsOk(rerror) || !found_)
+      return rerror;
+
+    block_.resize(MAX_SBFSIZE);
+    rerror = SSNSBFStream_setPosition(sbfstream, offset_);
+    if (IsOk(rerror))
+      rerror = SSNSBFStream_getNextBlock(
+          sbfstream, reinterpret_cast<VoidBlock_t*>(block_.data()));
+    if (IsOk(rerror))
+      block_.resize(reinterpret_cast<VoidBlock_t*>(block_.data())->Length);
+    return rerror;
+  }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    if (!found_)
+      return Null(isolate);
+
+    Local<Context> context = isolate->GetCurrentContext();
+    const TimeHeader_t* header =
+        reinterpret_cast<const TimeHeader_t*>(block_.data());
+    Local<Object> out = Object::New(isolate);
+    Local<ArrayBuffer> data = ArrayBuffer::New(isolate, block_.size());
+    memcpy(data->GetBackingStore()->Data(), block_.data(), block_.size());
+
+    SetNumber(isolate, out, "id", header->Header.ID);
+    SetNumber(isolate, out, "offset", offset_);
+    if (block_.size() >= sizeof(TimeHeader_t)) {
+      SetNumber(isolate, out, "tow", header->TOW);
+      SetNumber(isolate, out, "wnc", header->WNc);
+    }
+    out->Set(context, String::NewFromUtf8(isolate, "data").ToLocalChecked(),
+             data).Check();
+    return out;
+  }
+
+ private:
+  double gnsstime_;
+  SBFID_t sbfid_;
+  uint32_t offset_ = 0;
+  bool found_ = false;
+  std::vector<uint8_t> block_;
+};
+
+class PVTErrorJob : public StreamJob {
+ public:
+  PVTErrorJob(Isolate* isolate, const std::shared_ptr<SbfStream>& stream,
+              SBFID_t sbfid)
+      : StreamJob(isolate, "calculate:SbfSession.getPVTErrorPercentages",
+                  stream),
+        sbfid_(sbfid) {}
+
+ protected:
+  ssn_error_t Query(ssn_hsbfstream_t sbfstream) override {
+    StageTimer timer(kStageAnalyze, "getPVTErrorPercentages");
+    return timer.Done(
+        SSNSBFAnalyze_getPVTErrorPercentages(sbfstream, sbfid_, &result_));
+  }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    return PVTErrorObject(isolate, result_);
+  }
+
+ private:
+  SBFID_t sbfid_;
+  ssn_pvterror_percentages_t result_;
+};
+
+class PVTModeJob : public StreamJob {
+ public:
+  PVTModeJob(Isolate* isolate, const std::shared_ptr<SbfStream>& stream,
+             SBFID_t sbfid)
+      : StreamJob(isolate, "calculate:SbfSession.getPVTModePercentages",
+                  stream),
+        sbfid_(sbfid) {}
+
+ protected:
+  ssn_error_t Query(ssn_hsbfstream_t sbfstream) override {
+    StageTimer timer(kStageAnalyze, "getPVTModePercentages");
+    return timer.Done(
+        SSNSBFAnalyze_getPVTModePercentages(sbfstream, sbfid_, &result_));
+  }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    return PVTModeObject(isolate, result_);
+  }
+
+ private:
+  SBFID_t sbfid_;
+  ssn_pvtmode_percentages_t result_;
+};
+
+// Brings the stream's running PVT tally up to date with the blocks that
+// arrived since the previous call
+class PVTStatsJob : public StreamJob {
+ public:
+  PVTStatsJob(Isolate* isolate, const std::shared_ptr<SbfStream>& stream,
+              SBFID_t sbfid)
+      : StreamJob(isolate, "calculate:SbfSession.getPVTStats", stream),
+        sbfid_(sbfid) {}
+
+ protected:
+  ssn_error_t Query(ssn_hsbfstream_t sbfstream) override {
+    IncrementalPvtStats* stats = stream_->pvt_stats(sbfid_);
+    ssn_error_t rerror = stats->Update(sbfstream, &added_);
+    stats->tally().Errors(&errors_);
+    stats->tally().Modes(&modes_);
+    blocks_ = stats->tally().blocks();
+    return rerror;
+  }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    Local<Context> context = isolate->GetCurrentContext();
+    Local<Object> out = Object::New(isolate);
+    out->Set(context, String::NewFromUtf8(isolate, "errors").ToLocalChecked(),
+             PVTErrorObject(isolate, errors_)).Check();
+    out->Set(context, String::NewFromUtf8(isolate, "modes").ToLocalChecked(),
+             PVTModeObject(isolate, modes_)).Check();
+    SetNumber(isolate, out, "blocks", static_cast<double>(blocks_));
+    SetNumber(isolate, out, "added", static_cast<double>(added_));
+    return out;
+  }
+
+ private:
+  SBFID_t sbfid_;
+  uint64_t added_ = 0;
+  uint64_t blocks_ = 0;
+  ssn_pvterror_percentages_t errors_;
+  ssn_pvtmode_percentages_t modes_;
+};
+
+class TrackedSatellitesJob : public StreamJob {
+ public:
+  TrackedSatellitesJob(Isolate* isolate,
+                       const std::shared_ptr<SbfStream>& stream,
+                       double gnsstime)
+      : StreamJob(isolate, "calculate:SbfSession.listTrackedSatellites",
+                  stream),
+        gnsstime_(gnsstime) {}
+
+ protected:
+  ssn_error_t Query(ssn_hsbfstream_t sbfstream) override {
+    ssn_error_t rerror;
+    size_t listSize = 0;
+
+    /*
+     * Double-call:
+     *   1) Get size in bytes
+     *   2) Get list, size then holds the number of elements
+     */
+
+    StageTimer timer(kStageAnalyze, "listTrackedSatellites");
+    rerror = timer.Done(SSNSBFAnalyze_listTrackedSatellites(
+        sbfstream, gnsstime_, &listSize, NULL));
+    if (!IsOk(rerror) || listSize == 0)
+      return rerror;
+
+    // the SDK fills scratch memory; OnOK() gets an exact copy
+    ScratchScope scratch;
+    size_t capacity = listSize / sizeof(ssn_tracked_satellites_t) + 1;
+    ssn_tracked_satellites_t* list =
+        scratch.arena().AllocateArray<ssn_tracked_satellites_t>(capacity);
+    rerror = timer.Done(SSNSBFAnalyze_listTrackedSatellites(
+        sbfstream, gnsstime_, &listSize, list));
+    if (IsOk(rerror))
+      satellites_.assign(list, list + std::min(listSize, capacity));
+    return rerror;
+  }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    Local<Context> context = isolate->GetCurrentContext();
+    Local<Array> out = Array::New(isolate, static_cast<int>(satellites_.size()));
+
+    for (size_t i = 0; i < satellites_.size(); ++i) {
+      const ssn_tracked_satellites_t& sat = satellites_[i];
+      Local<Object> entry = Object::New(isolate);
+      Local<Array> signals = Array::New(isolate);
+      uint32_t count = 0;
+
+      for (int sig = 0; sig < SIG_LAST; ++sig) {
+        if (sat.signaltype[sig])
+          signals->Set(context, count++, Number::New(isolate, sig)).Check();
+      }
+
+      SetNumber(isolate, entry, "svid", sat.svid);
+      SetNumber(isolate, entry, "freqnr", sat.freqnr);
+      entry->Set(context,
+                 String::NewFromUtf8(isolate, "signals").ToLocalChecked(),
+                 signals).Check();
+      out->Set(context, static_cast<uint32_t>(i), entry).Check();
+    }
+
+    return out;
+  }
+
+ private:
+  double gnsstime_;
+  std::vector<ssn_tracked_satellites_t> satellites_;
+};
+
+class SatelliteUsedJob : public StreamJob {
+ public:
+  SatelliteUsedJob(Isolate* isolate, const std::shared_ptr<SbfStream>& stream,
+                   double gnsstime, ssn_pvt_satusage_t satusage)
+      : StreamJob(isolate, "calculate:SbfSession.isSatelliteUsed", stream),
+        gnsstime_(gnsstime), satusage_(satusage), isused_(false) {}
+
+ protected:
+  ssn_error_t Query(ssn_hsbfstream_t sbfstream) override {
+    StageTimer timer(kStageAnalyze, "isSatelliteUsed");
+    return timer.Done(SSNSBFAnalyze_isSatelliteUsed(sbfstream, gnsstime_,
+                                                    satusage_, &isused_));
+  }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    return Boolean::New(isolate, isused_);
+  }
+
+ private:
+  double gnsstime_;
+  ssn_pvt_satusage_t satusage_;
+  bool isused_;
+};
+
+}
+
+Local<Object> PVTErrorObject(Isolate* isolate,
+                             const ssn_pvterror_percentages_t& result) {
+  Local<Object> out = Object::New(isolate);
+  ForEachPVTError(result, [&](const char* key, double value) {
+    SetNumber(isolate, out, key, value);
+  });
+  return out;
+}
+
+Local<Object> PVTModeObject(Isolate* isolate,
+                            const ssn_pvtmode_percentages_t& result) {
+  Local<Object> out = Object::New(isolate);
+  ForEachPVTMode(result, [&](const char* key, double value) {
+    SetNumber(isolate, out, key, value);
+  });
+  return out;
+}
+
+void StreamJob::Execute() {
+  std::lock_guard<std::mutex> lock(stream_->mutex());
+  ssn_error_t rerror = Query(stream_->handle());
+  if (!IsOk(rerror))
+    SetError(rerror);
+}
+
+void SbfSession::Init(Local<Object> exports) {
+  Isolate* isolate = exports->GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(isolate, New);
+  tpl->SetClassName(String::NewFromUtf8(isolate, "SbfSession").ToLocalChecked());
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "load", Load);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "close", Close);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "isLoaded", IsLoaded);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "getPVTErrorPercentages",
+                            GetPVTErrorPercentages);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "getPVTModePercentages",
+                            GetPVTModePercentages);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "listTrackedSatellites",
+                            ListTrackedSatellites);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "getPVTStats", GetPVTStats);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "isSatelliteUsed", IsSatelliteUsed);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "buildIndex", BuildIndex);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "findBlock", FindBlock);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "buildSeries", BuildSeries);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "getSeries", GetSeries);
+
+  constructor_.Set(isolate, tpl);
+
+  Local<Function> constructor = tpl->GetFunction(context).ToLocalChecked();
+  exports->Set(context,
+               String::NewFromUtf8(isolate, "SbfSession").ToLocalChecked(),
+               constructor).Check();
+}
+
+std::shared_ptr<SbfStream> SbfSession::StreamFrom(Isolate* isolate,
+                                                  Local<Value> value) {
+  if (!value->IsObject() || !constructor_.Get(isolate)->HasInstance(value)) {
+    ThrowTypeError(isolate, "Expected an SbfSession");
+    return nullptr;
+  }
+
+  SbfSession* session = ObjectWrap::Unwrap<SbfSession>(value.As<Object>());
+  if (!session->stream_)
+    ThrowTypeError(isolate, "SbfSession has no file loaded");
+  return session->stream_;
+}
+
+Local<Object> SbfSession::NewInstance(Isolate* isolate,
+                                      const std::shared_ptr<SbfStream>& stream) {
+  Local<Context> context = isolate->GetCurrentContext();
+  Local<Object> handle = constructor_.Get(isolate)->GetFunction(context)
+                             .ToLocalChecked()->NewInstance(context)
+                             .ToLocalChecked();
+  ObjectWrap::Unwrap<SbfSession>(handle)->set_stream(stream);
+  return handle;
+}
+
+void SbfSession::New(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+
+  if (!args.IsConstructCall()) {
+    ThrowTypeError(isolate, "SbfSession must be called with new");
+    return;
+  }
+
+  SbfSession* session = new SbfSession();
+  session->Wrap(args.This());
+  args.GetReturnValue().Set(args.This());
+}
+
+// load(path, { onProgress, signal }), see JobBinding for the options
+void SbfSession::Load(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+
+  if (args.Length() < 1 || !args[0]->IsString()) {
+    ThrowTypeError(isolate, "load(path) expects a file path");
+    return;
+  }
+
+  String::Utf8Value path(isolate, args[0]);
+  LoadJob* job = new LoadJob(isolate, args.Holder(), *path, args[1]);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+// Drops the session's reference; handles close once in-flight queries finish
+void SbfSession::Close(const FunctionCallbackInfo<Value>& args) {
+  SbfSession* session = ObjectWrap::Unwrap<SbfSession>(args.Holder());
+  session->stream_.reset();
+  args.GetReturnValue().Set(Undefined(args.GetIsolate()));
+}
+
+void SbfSession::IsLoaded(const FunctionCallbackInfo<Value>& args) {
+  SbfSession* session = ObjectWrap::Unwrap<SbfSession>(args.Holder());
+  args.GetReturnValue().Set(
+      Boolean::New(args.GetIsolate(), session->stream_ != nullptr));
+}
+
+void SbfSession::GetPVTErrorPercentages(
+    const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  std::shared_ptr<SbfStream> stream = StreamFrom(isolate, args.Holder());
+  if (!stream)
+    return;
+
+  PVTErrorJob* job = new PVTErrorJob(isolate, stream, SbfIdArg(args, 0));
+  args.GetReturnValue().Set(job->Queue());
+}
+
+void SbfSession::GetPVTModePercentages(
+    const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  std::shared_ptr<SbfStream> stream = StreamFrom(isolate, args.Holder());
+  if (!stream)
+    return;
+
+  PVTModeJob* job = new PVTModeJob(isolate, stream, SbfIdArg(args, 0));
+  args.GetReturnValue().Set(job->Queue());
+}
+
+// getPVTStats(sbfid = PVTGeodetic) -> { errors, modes, blocks, added }
+//
+// errors / modes match getPVTErrorPercentages() / getPVTModePercentages(),
+// but only the blocks appended since the previous call are read; `added`
+// is how many that were.
+void SbfSession::GetPVTStats(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  std::shared_ptr<SbfStream> stream = StreamFrom(isolate, args.Holder());
+  if (!stream)
+    return;
+
+  SBFID_t sbfid = SbfIdArg(args, 0);
+  if (sbfid == sbfid_ALL)
+    sbfid = sbfid_PVTGeodetic_2_0;
+
+  PVTStatsJob* job = new PVTStatsJob(isolate, stream, sbfid);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+void SbfSession::ListTrackedSatellites(
+    const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  std::shared_ptr<SbfStream> stream = StreamFrom(isolate, args.Holder());
+  if (!stream)
+    return;
+
+  if (args.Length() < 1 || !args[0]->IsNumber()) {
+    ThrowTypeError(isolate, "listTrackedSatellites(gnsstime) expects a number");
+    return;
+  }
+
+  double gnsstime = args[0].As<Number>()->Value();
+  TrackedSatellitesJob* job = new TrackedSatellitesJob(isolate, stream, gnsstime);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+// isSatelliteUsed(gnsstime, { svid, freqnr, signaltype })
+void SbfSession::IsSatelliteUsed(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+  std::shared_ptr<SbfStream> stream = StreamFrom(isolate, args.Holder());
+  if (!stream)
+    return;
+
+  if (args.Length() < 2 || !args[0]->IsNumber() || !args[1]->IsObject()) {
+    ThrowTypeError(isolate,
+                   "isSatelliteUsed(gnsstime, satellite) expects a number "
+                   "and { svid, freqnr, signaltype }");
+    return;
+  }
+
+  Local<Object> sat = args[1].As<Object>();
+  auto field = [&](const char* key) -> uint32_t {
+    Local<Value> value =
+        sat->Get(context, String::NewFromUtf8(isolate, key).ToLocalChecked())
+            .ToLocalChecked();
+    return value->IsNumber() ? value->Uint32Value(context).FromJust() : 0;
+  };
+
+  ssn_pvt_satusage_t satusage;
+  satusage.svid = static_cast<uint8_t>(field("svid"));
+  satusage.freqnr = static_cast<uint8_t>(field("freqnr"));
+  satusage.signaltype = static_cast<SignalType_t>(field("signaltype"));
+
+  double gnsstime = args[0].As<Number>()->Value();
+  SatelliteUsedJob* job = new SatelliteUsedJob(isolate, stream, gnsstime, satusage);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+// buildIndex({ onProgress, signal }) -> { entries, origin, persisted, path }
+//
+// origin is "reused" when the sidecar matched the file, "extended" when the
+// file only grew and "built" otherwise
+void SbfSession::BuildIndex(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  std::shared_ptr<SbfStream> stream = StreamFrom(isolate, args.Holder());
+  if (!stream)
+    return;
+
+  if (stream->live()) {
+    ThrowTypeError(isolate, "buildIndex() needs a session loaded from a file");
+    return;
+  }
+
+  IndexJob* job = new IndexJob(isolate, stream, args[0]);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+// findBlock(gnsstime, sbfid) -> { id, tow, wnc, offset, data } or null
+void SbfSession::FindBlock(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  std::shared_ptr<SbfStream> stream = StreamFrom(isolate, args.Holder());
+  if (!stream)
+    return;
+
+  if (args.Length() < 1 || !args[0]->IsNumber()) {
+    ThrowTypeError(isolate, "findBlock(gnsstime) expects a number");
+    return;
+  }
+
+  double gnsstime = args[0].As<Number>()->Value();
+  FindBlockJob* job = new FindBlockJob(isolate, stream, gnsstime,
+                                       SbfIdArg(args, 1));
+  args.GetReturnValue().Set(job->Queue());
+}
+
+// buildSeries({ onProgress, signal }) -> { epochs, levels, origin, persisted,
+//                                         path }
+//
+// origin is "reused" when the sidecar matched the file and "built" otherwise
+void SbfSession::BuildSeries(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  std::shared_ptr<SbfStream> stream = StreamFrom(isolate, args.Holder());
+  if (!stream)
+    return;
+
+  if (stream->live()) {
+    ThrowTypeError(isolate, "buildSeries() needs a session loaded from a file");
+    return;
+  }
+
+  SeriesJob* job = new SeriesJob(isolate, stream, args[0]);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+// getSeries(field, start, end, pixelWidth)
+//   -> { level, bucketSeconds, time, min, max, mean, count, epochs }
+//
+// Synchronous: the buckets are copied straight out of the pyramid, whatever
+// the length of the file. start / end are GNSS times in seconds like
+// findBlock(); time / min / max / mean are Float64Arrays and count / epochs
+// Uint32Arrays, one entry per bucket holding an epoch.
+void SbfSession::GetSeries(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+  std::shared_ptr<SbfStream> stream = StreamFrom(isolate, args.Holder());
+  if (!stream)
+    return;
+
+  if (args.Length() < 4 || !args[0]->IsString() || !args[1]->IsNumber() ||
+      !args[2]->IsNumber() || !args[3]->IsNumber()) {
+    ThrowTypeError(isolate,
+                   "getSeries(field, start, end, pixelWidth) expects a field "
+                   "name and three numbers");
+    return;
+  }
+
+  int field = SeriesFieldFromName(*String::Utf8Value(isolate, args[0]));
+  if (field < 0) {
+    ThrowTypeError(isolate, "getSeries(): unknown field");
+    return;
+  }
+
+  std::shared_ptr<const SeriesPyramid> series = stream->series();
+  if (!series) {
+    isolate->ThrowException(Exception::Error(
+        String::NewFromUtf8(isolate, "getSeries() needs buildSeries() first")
+            .ToLocalChecked()));
+    return;
+  }
+
+  double start = args[1].As<Number>()->Value();
+  double end = args[2].As<Number>()->Value();
+  double pixels = args[3].As<Number>()->Value();
+  if (!std::isfinite(pixels)) {
+    ThrowTypeError(isolate, "getSeries(): pixelWidth must be finite");
+    return;
+  }
+  SeriesSlice slice;
+  series->Query(field, start, end,
+                static_cast<unsigned>(std::min(std::max(pixels, 1.0), 1e6)),
+                &slice);
+
+  Local<Object> out = Object::New(isolate);
+  auto copy = [&](const char* key, const void* data, size_t size, bool wide) {
+    Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, slice.rows * size);
+    if (slice.rows > 0)
+      memcpy(buffer->GetBackingStore()->Data(), data, slice.rows * size);
+    Local<Value> view;
+    if (wide)
+      view = Float64Array::New(buffer, 0, slice.rows);
+    else
+      view = Uint32Array::New(buffer, 0, slice.rows);
+    out->Set(context, String::NewFromUtf8(isolate, key).ToLocalChecked(),
+             view).Check();
+  };
+
+  SetNumber(isolate, out, "level", slice.level);
+  SetNumber(isolate, out, "bucketSeconds", slice.bucket_seconds);
+  copy("time", slice.time, sizeof(double), true);
+  copy("min", slice.min, sizeof(double), true);
+  copy("max", slice.max, sizeof(double), true);
+  copy("mean", slice.mean, sizeof(double), true);
+  copy("count", slice.count, sizeof(uint32_t), false);
+  copy("epochs", slice.epochs, sizeof(uint32_t), false);
+  args.GetReturnValue().Set(out);
+}
+
+}
@@ -0,0 +1,102 @@
+#ifndef CALCULATE_SBF_SESSION_H
+#define CALCULATE_SBF_SESSION_H
+
+#include <node.h>
+#include <node_object_wrap.h>
+
+#include <memory>
+
+#include "ssnsbfanalyze.h"
+
+#include "async_job.h"
+#include "sbf_stream.h"
+
+namespace calculate {
+
+// { ne, nem, ..., checktotal, checkerror } as returned by
+// getPVTErrorPercentages()
+v8::Local<v8::Object> PVTErrorObject(v8::Isolate* isolate,
+                                     const ssn_pvterror_percentages_t& result);
+
+// { npa, sp, ..., checktotal } as returned by getPVTModePercentages()
+v8::Local<v8::Object> PVTModeObject(v8::Isolate* isolate,
+                                    const ssn_pvtmode_percentages_t& result);
+
+// AsyncJob that runs Query() against a loaded stream with its mutex held.
+// A failing SDK call rejects the promise with the SDK message.
+class StreamJob : public AsyncJob {
+ public:
+  StreamJob(v8::Isolate* isolate, const char* name,
+            const std::shared_ptr<SbfStream>& stream)
+      : AsyncJob(isolate, name), stream_(stream) {}
+
+ protected:
+  void Execute() override;
+  virtual ssn_error_t Query(ssn_hsbfstream_t sbfstream) = 0;
+
+  std::shared_ptr<SbfStream> stream_;
+};
+
+// JS-visible wrapper around a loaded SbfStream.
+//
+//   const session = new SbfSession()
+//   await session.load('input_file.sbf', { onProgress, signal })
+//   await session.getPVTErrorPercentages()
+//   await session.getPVTStats(4007)
+//   await session.listTrackedSatellites(295766.0)
+//   await session.buildIndex()
+//   await session.findBlock(295766.0, 4007)
+//   await session.buildSeries()
+//   session.getSeries('height', start, end, 1000)
+//   session.close()
+//
+// Every query but getSeries() runs on the libuv thread pool against the
+// already parsed stream; the promise rejects with the SDK message when a call
+// fails.
+class SbfSession : public node::ObjectWrap {
+ public:
+  static void Init(v8::Local<v8::Object> exports);
+
+  // Unwraps `value` into the stream it currently holds. Throws a TypeError
+  // and returns null when it is not an SbfSession or nothing is loaded.
+  static std::shared_ptr<SbfStream> StreamFrom(v8::Isolate* isolate,
+                                               v8::Local<v8::Value> value);
+
+  // A new SbfSession already holding `stream`, e.g. the stream behind a
+  // LiveReceiver
+  static v8::Local<v8::Object> NewInstance(
+      v8::Isolate* isolate, const std::shared_ptr<SbfStream>& stream);
+
+  const std::shared_ptr<SbfStream>& stream() const { return stream_; }
+  void set_stream(const std::shared_ptr<SbfStream>& stream) {
+    stream_ = stream;
+  }
+
+ private:
+  SbfSession() = default;
+
+  static void New(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Load(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Close(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void IsLoaded(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void GetPVTErrorPercentages(
+      const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void GetPVTModePercentages(
+      const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void GetPVTStats(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void ListTrackedSatellites(
+      const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void IsSatelliteUsed(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void BuildIndex(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void FindBlock(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void BuildSeries(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void GetSeries(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+  static v8::Eternal<v8::FunctionTemplate> constructor_;
+
+  std::shared_ptr<SbfStream> stream_;
+};
+
+}
+
+#endif
@@ -0,0 +1,190 @@
+#include "sbf_stream.h"
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "job_control.h"
+#include "metrics.h"
+#include "pvt_stats.h"
+#include "temp_space.h"
+
+namespace calculate {
+
+namespace {
+
+std::mutex& SdkLifecycleMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+}
+
+ssn_error_t OpenSdk(ssn_hsdk_t* sdk) {
+  std::lock_guard<std::mutex> lock(SdkLifecycleMutex());
+  // licence and dongle checks happen here
+  StageTimer timer(kStageOpen, "SSNSDK_open");
+  ssn_error_t rerror = timer.Done(SSNSDK_open(sdk));
+  if (IsOk(rerror))
+    TempSpace::Instance().Attach(*sdk);
+  return rerror;
+}
+
+ssn_error_t CloseSdk(ssn_hsdk_t sdk) {
+  std::lock_guard<std::mutex> lock(SdkLifecycleMutex());
+  ssn_error_t rerror = SSNSDK_close(sdk);
+  // also what a failed or cancelled call left behind
+  TempSpace::Instance().Detach(sdk);
+  return rerror;
+}
+
+ssn_error_t SbfStream::Open(const std::string& path,
+                            std::shared_ptr<SbfStream>* out,
+                            JobControl* control) {
+  std::shared_ptr<SbfStream> stream(new SbfStream());
+  ssn_error_t rerror;
+
+  rerror = OpenSdk(&stream->ssnsdkhandle_);
+  if (!IsOk(rerror))
+    return rerror;
+  stream->sdk_open_ = true;
+
+  rerror = stream->Load(path, control);
+  if (!IsOk(rerror))
+    return rerror;
+
+  *out = stream;
+  return rerror;
+}
+
+ssn_error_t SbfStream::Open(ssn_hsdk_t sdk, const std::string& path,
+                            std::shared_ptr<SbfStream>* out,
+                            JobControl* control) {
+  std::shared_ptr<SbfStream> stream(new SbfStream());
+  ssn_error_t rerror;
+
+  stream->ssnsdkhandle_ = sdk;
+
+  rerror = stream->Load(path, control);
+  if (!IsOk(rerror))
+    return rerror;
+
+  *out = stream;
+  return rerror;
+}
+
+ssn_error_t SbfStream::Create(const std::string& name,
+                              std::shared_ptr<SbfStream>* out) {
+  std::shared_ptr<SbfStream> stream(new SbfStream());
+  ssn_error_t rerror;
+
+  rerror = OpenSdk(&stream->ssnsdkhandle_);
+  if (!IsOk(rerror))
+    return rerror;
+  stream->sdk_open_ = true;
+
+  {
+    StageTimer timer(kStageOpen, "SSNSBFStream_open");
+    rerror = timer.Done(
+        SSNSBFStream_open(stream->ssnsdkhandle_, &stream->sbfstream_));
+  }
+  if (!IsOk(rerror))
+    return rerror;
+  stream->stream_open_ = true;
+  stream->path_ = name;
+  stream->live_ = true;
+
+  *out = stream;
+  return rerror;
+}
+
+ssn_error_t SbfStream::Load(const std::string& path, JobControl* control) {
+  ssn_error_t rerror;
+
+  path_ = path;
+
+  {
+    StageTimer timer(kStageOpen, "SSNSBFStream_open");
+    rerror = timer.Done(SSNSBFStream_open(ssnsdkhandle_, &sbfstream_));
+  }
+  if (!IsOk(rerror))
+    return rerror;
+  stream_open_ = true;
+
+  // loadFile takes a non-const char*
+  std::vector<char> filename(path.begin(), path.end());
+  filename.push_back('\0');
+
+  if (control != nullptr)
+    control->AttachStream(sbfstream_);
+  {
+    StageTimer timer(kStageLoadFile);
+    rerror = timer.Done(SSNSBFStream_loadFile(
+        sbfstream_, filename.data(), SSNSBFSTREAM_OPENOPTION_READONLY));
+  }
+  // the stream outlives the job, so the callbacks must not stay behind
+  if (control != nullptr) {
+    control->DetachStream(sbfstream_);
+    // never hand out (or cache) a partially loaded stream
+    if (control->cancelled())
+      return CancelledError();
+  }
+
+  uint32_t size;
+  if (IsOk(rerror) && IsOk(SSNSBFStream_getSize(sbfstream_, &size))) {
+    CountBytesRead(size);
+    CountBytes(size);
+  }
+  return rerror;
+}
+
+void SbfStream::CountBytes(uint64_t bytes) {
+  bytes_ += bytes;
+  CountStreamBytes(static_cast<int64_t>(bytes));
+}
+
+SbfStream::~SbfStream() {
+  ssn_error_t cerror;
+
+  CountStreamBytes(-static_cast<int64_t>(bytes_));
+
+  if (stream_open_) {
+    cerror = SSNSBFStream_close(sbfstream_);
+    if (!IsOk(cerror))
+      fprintf(stderr, "Error: %s\n", SSNError_getMessage(cerror));
+  }
+
+  if (sdk_open_) {
+    cerror = CloseSdk(ssnsdkhandle_);
+    if (!IsOk(cerror))
+      fprintf(stderr, "Error: %s\n", SSNError_getMessage(cerror));
+  }
+}
+
+IncrementalPvtStats* SbfStream::pvt_stats(SBFID_t sbfid) {
+  std::unique_ptr<IncrementalPvtStats>& stats = pvt_stats_[sbfid];
+  if (!stats)
+    stats.reset(new IncrementalPvtStats(sbfid));
+  return stats.get();
+}
+
+std::shared_ptr<const SeriesPyramid> SbfStream::series() const {
+  std::lock_guard<std::mutex> lock(series_mutex_);
+  return series_;
+}
+
+void SbfStream::set_series(
+    const std::shared_ptr<const SeriesPyramid>& series) {
+  std::lock_guard<std::mutex> lock(series_mutex_);
+  series_ = series;
+}
+
+std::string DescribeError(ssn_error_t error) {
+  std::string message = SSNError_getMessage(error);
+  const char* module = SSNError_getModule(error);
+  if (module != NULL && *module != '\0')
+    message += std::string(" (") + module + ")";
+  return message;
+}
+
+}
@@ -0,0 +1,120 @@
+#ifndef CALCULATE_SBF_STREAM_H
+#define CALCULATE_SBF_STREAM_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "ssnsdk.h"
+#include "ssnerror.h"
+#include "ssnsbfstream.h"
+
+namespace calculate {
+
+class BlockIndex;
+class IncrementalPvtStats;
+class JobControl;
+class SeriesPyramid;
+
+// PPSDK threading rules, as enforced by this addon:
+//
+//  * an SDK or stream handle is used by one thread at a time; shared streams
+//    are guarded by SbfStream::mutex(), worker-owned ones never leave their
+//    thread
+//  * SSNSDK_open / SSNSDK_close touch process-wide SDK state (licence and
+//    info files) and are serialised through OpenSdk() / CloseSdk()
+//  * distinct handle sets may run queries in parallel on different threads
+
+// Opens / closes an SDK handle under the process-wide SDK lifecycle lock,
+// with a temp directory of its own (see TempSpace)
+ssn_error_t OpenSdk(ssn_hsdk_t* sdk);
+ssn_error_t CloseSdk(ssn_hsdk_t sdk);
+
+// An SDK handle plus an SBF stream with a file already loaded into it.
+//
+// The handles are opened once and kept until the object is destroyed, so
+// repeated queries against the same file skip SSNSDK_open and the full
+// SSNSBFStream_loadFile parse. PPSDK stream handles are not safe for
+// concurrent use; callers must hold mutex() while using handle().
+class SbfStream {
+ public:
+  ~SbfStream();
+
+  SbfStream(const SbfStream&) = delete;
+  void operator=(const SbfStream&) = delete;
+
+  // Opens the SDK and loads `path` read-only. On failure `out` is left empty
+  // and the SDK error is returned. `control`, when given, receives the load
+  // progress and can abort it.
+  static ssn_error_t Open(const std::string& path,
+                          std::shared_ptr<SbfStream>* out,
+                          JobControl* control = nullptr);
+
+  // Same, but opens the stream on an SDK handle the caller owns and keeps
+  // open for at least as long as the stream
+  static ssn_error_t Open(ssn_hsdk_t sdk, const std::string& path,
+                          std::shared_ptr<SbfStream>* out,
+                          JobControl* control = nullptr);
+
+  // Opens the SDK and an empty in-memory stream, which the caller fills
+  // with SSNSBFStream_appendManyBlocks (live ingest). `name` only shows up
+  // in path().
+  static ssn_error_t Create(const std::string& name,
+                            std::shared_ptr<SbfStream>* out);
+
+  ssn_hsbfstream_t handle() const { return sbfstream_; }
+  ssn_hsdk_t sdk() const { return ssnsdkhandle_; }
+  const std::string& path() const { return path_; }
+  // true for streams made by Create(), which have no file behind them
+  bool live() const { return live_; }
+  std::mutex& mutex() { return mutex_; }
+
+  // Block index once SbfSession.buildIndex() has run; guarded by mutex()
+  // like handle()
+  const std::shared_ptr<BlockIndex>& index() const { return index_; }
+  void set_index(const std::shared_ptr<BlockIndex>& index) { index_ = index; }
+
+  // LOD pyramid once SbfSession.buildSeries() has run. Guarded by its own
+  // lock rather than mutex(), so getSeries() never waits behind a query.
+  std::shared_ptr<const SeriesPyramid> series() const;
+  void set_series(const std::shared_ptr<const SeriesPyramid>& series);
+
+  // Adds `bytes` appended to the stream to the SDK stream memory of
+  // SnapshotMetrics(); loaded files count themselves. Guarded by mutex().
+  void CountBytes(uint64_t bytes);
+
+  // Running PVT percentages over the blocks with `sbfid`, made on first
+  // use; guarded by mutex() like handle()
+  IncrementalPvtStats* pvt_stats(SBFID_t sbfid);
+
+ private:
+  SbfStream() = default;
+
+  ssn_error_t Load(const std::string& path, JobControl* control);
+
+  ssn_hsdk_t        ssnsdkhandle_;       // SSN SDK handle
+  ssn_hsbfstream_t  sbfstream_;          // SBF stream handle
+  bool              sdk_open_ = false;
+  bool              stream_open_ = false;
+  bool              live_ = false;
+  std::string       path_;
+  uint64_t          bytes_ = 0;          // counted by CountBytes()
+  std::mutex        mutex_;
+  std::shared_ptr<BlockIndex> index_;
+  mutable std::mutex series_mutex_;
+  std::shared_ptr<const SeriesPyramid> series_;
+  std::map<SBFID_t, std::unique_ptr<IncrementalPvtStats>> pvt_stats_;
+};
+
+// true when `error` is SSNERROR_WARNING_OK
+inline bool IsOk(ssn_error_t error) {
+  return SSNERROR_GETCODE(error) == SSNERROR_WARNING_OK;
+}
+
+// "<message> (<module>)" for an SDK error, used for promise rejections
+std::string DescribeError(ssn_error_t error);
+
+}
+
+#endif
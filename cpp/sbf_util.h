@@ -0,0 +1,31 @@
+#ifndef CALCULATE_SBF_UTIL_H
+#define CALCULATE_SBF_UTIL_H
+
+#include <stdint.h>
+
+#include "ssnerror.h"
+
+namespace calculate {
+
+// Do-not-use values of the SBF block header time fields
+const uint32_t kTowDoNotUse = 4294967295u;
+const uint16_t kWncDoNotUse = 65535;
+
+// A failure in the general module with `code`, for errors of our own
+inline ssn_error_t GeneralError(int code) {
+  return SSNERROR_CREATE(SSNERROR_SEVERITY_FAILURE, SSNERROR_MODULE_GENERAL,
+                         SSNERROR_SUBMODULE_GENERAL, SSNERROR_TYPE_GENERAL,
+                         code);
+}
+
+// true for the codes the SDK ends a block walk with
+inline bool IsEndOfStream(ssn_error_t error) {
+  int code = SSNERROR_GETCODE(error);
+  return code == SSNERROR_WARNING_ENDOFSTREAM ||
+         code == SSNERROR_WARNING_ENDOFFILE ||
+         code == SSNERROR_ERROR_BLOCKNOTFOUND;
+}
+
+}
+
+#endif
@@ -0,0 +1,127 @@
+#include "scan_file.h"
+
+#include <string>
+
+#include "sbfdef.h"
+
+#include "async_job.h"
+#include "job_binding.h"
+#include "sbf_scanner.h"
+#include "sbf_stream.h"
+#include "v8_util.h"
+
+namespace calculate {
+
+using v8::Array;
+using v8::Boolean;
+using v8::Context;
+using v8::Exception;
+using v8::FunctionCallbackInfo;
+using v8::Isolate;
+using v8::Local;
+using v8::Object;
+using v8::String;
+using v8::Value;
+
+namespace {
+
+class ScanJob : public AsyncJob {
+ public:
+  ScanJob(Isolate* isolate, const std::string& path,
+          const ScanOptions& options, Local<Value> binding)
+      : AsyncJob(isolate, "calculate:scanFile"), path_(path),
+        options_(options), binding_(isolate, binding) {}
+
+ protected:
+  void Execute() override {
+    JobControl* control = binding_.control();
+    ssn_error_t rerror = control->cancelled()
+        ? CancelledError()
+        : ScanSbfFile(path_, options_, &stats_, control);
+    if (control->cancelled())
+      SetCancelled();
+    else if (!IsOk(rerror))
+      SetError(rerror);
+  }
+
+  void OnSettle(Isolate* isolate) override { binding_.Finish(isolate); }
+
+  Local<Value> OnOK(Isolate* isolate) override {
+    Local<Context> context = isolate->GetCurrentContext();
+    Local<Object> out = Object::New(isolate);
+    Local<Array> types =
+        Array::New(isolate, static_cast<int>(stats_.block_types.size()));
+    Local<Array> gaps = Array::New(isolate, static_cast<int>(stats_.gaps.size()));
+
+    for (size_t i = 0; i < stats_.block_types.size(); ++i) {
+      const ScanBlockType& type = stats_.block_types[i];
+      Local<Object> entry = Object::New(isolate);
+      SetNumber(isolate, entry, "number", type.number);
+      SetNumber(isolate, entry, "count", static_cast<double>(type.count));
+      SetNumber(isolate, entry, "bytes", static_cast<double>(type.bytes));
+      types->Set(context, static_cast<uint32_t>(i), entry).Check();
+    }
+
+    for (size_t i = 0; i < stats_.gaps.size(); ++i) {
+      Local<Object> entry = Object::New(isolate);
+      SetNumber(isolate, entry, "start", stats_.gaps[i].start);
+      SetNumber(isolate, entry, "end", stats_.gaps[i].end);
+      gaps->Set(context, static_cast<uint32_t>(i), entry).Check();
+    }
+
+    SetNumber(isolate, out, "bytes", static_cast<double>(stats_.bytes));
+    SetNumber(isolate, out, "blocks", static_cast<double>(stats_.blocks));
+    SetNumber(isolate, out, "crcErrors", static_cast<double>(stats_.crc_errors));
+    SetNumber(isolate, out, "skippedBytes",
+              static_cast<double>(stats_.skipped_bytes));
+    out->Set(context, Key(isolate, "truncated"),
+             Boolean::New(isolate, stats_.truncated)).Check();
+    out->Set(context, Key(isolate, "blockTypes"), types).Check();
+    SetNumber(isolate, out, "epochs", static_cast<double>(stats_.epochs));
+    SetNumber(isolate, out, "firstTime", stats_.first_time);
+    SetNumber(isolate, out, "lastTime", stats_.last_time);
+    SetNumber(isolate, out, "interval", stats_.interval);
+    SetNumber(isolate, out, "gapCount", static_cast<double>(stats_.gap_count));
+    SetNumber(isolate, out, "gapSeconds", stats_.gap_seconds);
+    out->Set(context, Key(isolate, "gaps"), gaps).Check();
+    return out;
+  }
+
+ private:
+  std::string path_;
+  ScanOptions options_;
+  ScanStats stats_;
+  JobBinding binding_;
+};
+
+}
+
+void ScanFile(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  if (args.Length() < 1 || !args[0]->IsString()) {
+    isolate->ThrowException(Exception::TypeError(
+        Key(isolate, "scanFile(path) expects a file path")));
+    return;
+  }
+
+  ScanOptions options;
+  if (args.Length() > 1 && args[1]->IsObject()) {
+    Local<Object> object = args[1].As<Object>();
+    Local<Value> value = object->Get(context, Key(isolate, "epochId"))
+                             .ToLocalChecked();
+    if (value->IsNumber())
+      options.epoch_number = static_cast<uint16_t>(
+          SBF_ID_TO_NUMBER(value->Uint32Value(context).FromJust()));
+    value = object->Get(context, Key(isolate, "maxGaps")).ToLocalChecked();
+    if (value->IsNumber())
+      options.max_gaps = value->Uint32Value(context).FromJust();
+  }
+
+  String::Utf8Value path(isolate, args[0]);
+  ScanJob* job = new ScanJob(isolate, *path, options, args[1]);
+  args.GetReturnValue().Set(job->Queue());
+}
+
+}
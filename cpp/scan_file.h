@@ -0,0 +1,23 @@
+#ifndef CALCULATE_SCAN_FILE_H
+#define CALCULATE_SCAN_FILE_H
+
+#include <node.h>
+
+namespace calculate {
+
+// scanFile(path, { epochId, maxGaps, onProgress, signal })
+//   -> Promise<{ bytes, blocks, crcErrors, skippedBytes, truncated,
+//                blockTypes: [{ number, count, bytes }],
+//                epochs, firstTime, lastTime, interval,
+//                gapCount, gapSeconds, gaps: [{ start, end }] }>
+//
+// Quick-look statistics straight from a memory mapping of the file, see
+// ScanSbfFile(). No SDK stream is loaded, so this is much cheaper than
+// SbfSession.load() and available for files that are still being written.
+// `epochId` is the block number whose time stamps define epochs (default
+// 4027, MeasEpoch; 0 for every timed block).
+void ScanFile(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+}
+
+#endif
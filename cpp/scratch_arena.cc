@@ -0,0 +1,124 @@
+#include "scratch_arena.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace calculate {
+
+namespace {
+
+const size_t kMinChunkBytes = 64 * 1024;
+// an arena left holding more than this after a job gives it back
+const size_t kMaxRetainedBytes = 16 * 1024 * 1024;
+
+std::atomic<uint64_t> g_fresh_bytes{0};
+std::atomic<uint64_t> g_reused_bytes{0};
+std::atomic<uint64_t> g_resets{0};
+std::atomic<uint64_t> g_retained_bytes{0};
+std::atomic<uint64_t> g_arenas{0};
+
+}
+
+ScratchArena& ScratchArena::ForThread() {
+  thread_local ScratchArena arena;
+  return arena;
+}
+
+ScratchArena::Stats ScratchArena::GetStats() {
+  Stats stats;
+  stats.fresh_bytes = g_fresh_bytes.load(std::memory_order_relaxed);
+  stats.reused_bytes = g_reused_bytes.load(std::memory_order_relaxed);
+  stats.resets = g_resets.load(std::memory_order_relaxed);
+  stats.retained_bytes = g_retained_bytes.load(std::memory_order_relaxed);
+  stats.arenas = g_arenas.load(std::memory_order_relaxed);
+  return stats;
+}
+
+ScratchArena::~ScratchArena() {
+  for (const Chunk& chunk : chunks_)
+    g_retained_bytes.fetch_sub(chunk.size, std::memory_order_relaxed);
+  if (counted_)
+    g_arenas.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void* ScratchArena::Allocate(size_t bytes, size_t align) {
+  for (;;) {
+    if (current_ < chunks_.size()) {
+      Chunk& chunk = chunks_[current_];
+      uintptr_t base = reinterpret_cast<uintptr_t>(chunk.data.get());
+      size_t offset = static_cast<size_t>(
+          ((base + used_ + align - 1) & ~static_cast<uintptr_t>(align - 1)) -
+          base);
+      if (offset <= chunk.size && bytes <= chunk.size - offset) {
+        size_t end = offset + bytes;
+        if (chunk.high > offset)
+          g_reused_bytes.fetch_add(std::min(end, chunk.high) - offset,
+                                   std::memory_order_relaxed);
+        chunk.high = std::max(chunk.high, end);
+        used_ = end;
+        return chunk.data.get() + offset;
+      }
+      // later chunks are left over from a rewind and may still fit
+      if (current_ + 1 < chunks_.size()) {
+        ++current_;
+        used_ = 0;
+        continue;
+      }
+    }
+    AddChunk(bytes + align);
+    current_ = chunks_.size() - 1;
+    used_ = 0;
+  }
+}
+
+void ScratchArena::AddChunk(size_t bytes) {
+  size_t size = std::max(kMinChunkBytes, bytes);
+  if (!chunks_.empty())
+    size = std::max(size, chunks_.back().size * 2);
+  chunks_.push_back(Chunk{std::unique_ptr<uint8_t[]>(new uint8_t[size]),
+                          size, 0});
+  g_fresh_bytes.fetch_add(size, std::memory_order_relaxed);
+  g_retained_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (!counted_) {
+    counted_ = true;
+    g_arenas.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void ScratchArena::Rewind(const Mark& mark) {
+  current_ = mark.chunk;
+  used_ = mark.used;
+}
+
+void ScratchArena::Reset() {
+  current_ = 0;
+  used_ = 0;
+  g_resets.fetch_add(1, std::memory_order_relaxed);
+
+  size_t total = 0;
+  for (const Chunk& chunk : chunks_)
+    total += chunk.size;
+  if (total <= kMaxRetainedBytes && chunks_.size() <= 1)
+    return;
+
+  g_retained_bytes.fetch_sub(total, std::memory_order_relaxed);
+  chunks_.clear();
+  // one chunk as large as the job needed, allocated now so the next job
+  // starts warm
+  if (total <= kMaxRetainedBytes)
+    AddChunk(total);
+}
+
+ScratchScope::ScratchScope()
+    : arena_(ScratchArena::ForThread()), mark_(arena_.mark()) {
+  ++arena_.depth_;
+}
+
+ScratchScope::~ScratchScope() {
+  if (--arena_.depth_ == 0)
+    arena_.Reset();
+  else
+    arena_.Rewind(mark_);
+}
+
+}
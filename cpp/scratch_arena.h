@@ -0,0 +1,99 @@
+#ifndef CALCULATE_SCRATCH_ARENA_H
+#define CALCULATE_SCRATCH_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace calculate {
+
+// Monotonic allocator for the transient buffers of a job, one per thread.
+//
+// Allocate() bumps a pointer through chunks that are kept from job to job,
+// so the buffers handed to the SDK double-call APIs stop going through the
+// heap once a worker has warmed up. Nothing is freed individually: a
+// ScratchScope hands everything allocated inside it back when it ends, and
+// the outermost one (AsyncJob wraps every Execute() in one) resets the
+// arena, merging its chunks so that the next job fits in one.
+//
+// Memory is not initialised and must not outlive its scope; results that
+// reach OnOK() on the main thread belong in their own containers.
+class ScratchArena {
+ public:
+  // summed over the arenas of all threads
+  struct Stats {
+    uint64_t fresh_bytes;      // chunk memory taken from the heap
+    uint64_t reused_bytes;     // handed out again after a scope ended
+    uint64_t resets;           // outermost scopes ended
+    uint64_t retained_bytes;   // chunk memory currently held
+    uint64_t arenas;           // threads holding an arena
+  };
+
+  // arena of the calling thread, created on first use
+  static ScratchArena& ForThread();
+  static Stats GetStats();
+
+  ScratchArena() = default;
+  ~ScratchArena();
+
+  ScratchArena(const ScratchArena&) = delete;
+  void operator=(const ScratchArena&) = delete;
+
+  // Never null; aborts like operator new when the heap is exhausted
+  void* Allocate(size_t bytes, size_t align = alignof(std::max_align_t));
+
+  template <typename T>
+  T* AllocateArray(size_t count) {
+    return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+  }
+
+ private:
+  friend class ScratchScope;
+
+  struct Chunk {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size;
+    size_t high;               // most ever handed out, for reused_bytes
+  };
+
+  struct Mark {
+    size_t chunk;
+    size_t used;
+  };
+
+  Mark mark() const { return Mark{current_, used_}; }
+  void Rewind(const Mark& mark);
+  // back to empty; merges or trims the chunks
+  void Reset();
+  void AddChunk(size_t bytes);
+
+  std::vector<Chunk> chunks_;
+  size_t current_ = 0;         // chunk being filled
+  size_t used_ = 0;            // bytes of it handed out
+  unsigned depth_ = 0;         // open scopes
+  bool counted_ = false;       // included in Stats::arenas
+};
+
+// Everything allocated from the thread's arena while the scope is open is
+// released when it ends. Scopes nest.
+class ScratchScope {
+ public:
+  ScratchScope();
+  ~ScratchScope();
+
+  ScratchScope(const ScratchScope&) = delete;
+  void operator=(const ScratchScope&) = delete;
+
+  ScratchArena& arena() { return arena_; }
+
+ private:
+  ScratchArena& arena_;
+  ScratchArena::Mark mark_;
+};
+
+}
+
+#endif
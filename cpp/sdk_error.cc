@@ -0,0 +1,194 @@
+#include "sdk_error.h"
+
+namespace calculate {
+
+namespace {
+
+thread_local ErrorTrail* t_current = nullptr;
+
+}
+
+const char* ErrorKindName(ErrorKind kind) {
+  switch (kind) {
+    case kErrorNone: return "none";
+    case kErrorLicense: return "license";
+    case kErrorResource: return "resource";
+    case kErrorIo: return "io";
+    case kErrorInput: return "input";
+    case kErrorArgument: return "argument";
+    case kErrorCancelled: return "cancelled";
+    case kErrorInternal: return "internal";
+  }
+  return "internal";
+}
+
+ErrorKind ClassifyError(ssn_error_t error) {
+  switch (SSNERROR_GETCODE(error)) {
+    case SSNERROR_WARNING_OK:
+      return kErrorNone;
+
+    case SSNERROR_ERROR_INVALIDLICENSE:
+    case SSNERROR_ERROR_LICENSENOTFOUND:
+    case SSNERROR_ERROR_LICENSENODONGLE:
+    case SSNERROR_ERROR_INITLICENSE:
+    case SSNERROR_ERROR_DEMOENDED:
+    case SSNERROR_ERROR_NOINFOFILEPATH:
+    case SSNERROR_ERROR_INFOFILEPATHTOOLARGE:
+    case SSNERROR_ERROR_NOPERMSFILE:
+    case SSNERROR_ERROR_BADSERIALNR:
+    case SSNERROR_ERROR_WRONGHWPLATFORM:
+    case SSNERROR_ERROR_NOPPSDKDONGLE:
+    case SSNERROR_ERROR_NOGEOTAGZDONGLE:
+    case SSNERROR_ERROR_NOBASEFINDERPERM:
+      return kErrorLicense;
+
+    case SSNERROR_ERROR_OUTOFMEMORY:
+    case SSNERROR_ERROR_BUSY:
+    case SSNERROR_ERROR_READONLY:
+    case SSNERROR_ERROR_ONEINSTANCE:
+      return kErrorResource;
+
+    case SSNERROR_ERROR_INVALIDNAME:
+    case SSNERROR_ERROR_FILEOPEN:
+    case SSNERROR_ERROR_FILECLOSE:
+    case SSNERROR_ERROR_FILEREAD:
+    case SSNERROR_ERROR_FILEWRITE:
+    case SSNERROR_ERROR_FILESEEK:
+    case SSNERROR_ERROR_FILEREMOVE:
+    case SSNERROR_ERROR_FILERO:
+    case SSNERROR_ERROR_DIRISSUE:
+    case SSNERROR_ERROR_UNCOMPRESSING_GZ:
+    case SSNERROR_ERROR_UNCOMPRESSING_Z:
+      return kErrorIo;
+
+    case SSNERROR_WARNING_ENDOFSTREAM:
+    case SSNERROR_WARNING_ENDOFFILE:
+    case SSNERROR_WARNING_INVALIDSBFBLOCK:
+    case SSNERROR_WARNING_NODGPS:
+    case SSNERROR_WARNING_TIMEOUTOFRANGE:
+    case SSNERROR_WARNING_STREAMEMPTY:
+    case SSNERROR_ERROR_INVALIDRINEXFILE:
+    case SSNERROR_ERROR_IRNXHEADER:
+    case SSNERROR_ERROR_IRNXEPOCHFLAG:
+    case SSNERROR_ERROR_INVALIDSBFFILE:
+    case SSNERROR_ERROR_INVALIDTIMESTAMP:
+    case SSNERROR_ERROR_INVALIDSBFBLOCK:
+    case SSNERROR_ERROR_FNNOTENOUGH:
+    case SSNERROR_ERROR_NOPVT:
+    case SSNERROR_ERROR_NO_GPSCORR:
+    case SSNERROR_ERROR_NOPOSDATA:
+    case SSNERROR_ERROR_BLOCKNOTFOUND:
+    case SSNERROR_ERROR_PPEC_PVTFAILED:
+    case SSNERROR_ERROR_PPEC_NAVMSGFAILED:
+    case SSNERROR_ERROR_PPEC_MEASFAILED:
+    case SSNERROR_ERROR_PPEC_PVAFAILED:
+    case SSNERROR_ERROR_PPEC_EXTMEASMSGFAILED:
+    case SSNERROR_ERROR_PVTFAILED:
+    case SSNERROR_ERROR_RTCMENCODINGFAILED:
+    case SSNERROR_ERROR_CONSTELLATIONRINEX:
+    case SSNERROR_ERROR_BASEFINDERDBMISSING:
+    case SSNERROR_ERROR_BASEFINDERDBFORMAT:
+    case SSNERROR_ERROR_BASEFINDER_NO_RINEX:
+      return kErrorInput;
+
+    case SSNERROR_WARNING_FALSE:
+    case SSNERROR_WARNING_ALREADYPRESENT:
+    case SSNERROR_WARNING_ENDOFLIST:
+    case SSNERROR_ERROR_INVALIDARG:
+    case SSNERROR_ERROR_NULLPOINTER:
+    case SSNERROR_ERROR_OUTOFRANGE:
+    case SSNERROR_ERROR_BUFTOOSMALL:
+    case SSNERROR_ERROR_EMPTYSTRING:
+    case SSNERROR_ERROR_NOTPRESENT:
+    case SSNERROR_ERROR_INVALIDHANDLE:
+    case SSNERROR_ERROR_WRONGSTATE:
+    case SSNERROR_ERROR_INVALIDASCIICMD:
+    case SSNERROR_ERROR_INVALIDSNMPCMD:
+    case SSNERROR_ERROR_INVALIDRATE:
+    case SSNERROR_ERROR_INVALIDSBFID:
+    case SSNERROR_ERROR_NOFLEXRATE:
+    case SSNERROR_ERROR_ASN1:
+    case SSNERROR_ERROR_SNMP:
+    case SSNERROR_ERROR_STREAMNOTEMPTY:
+    case SSNERROR_ERROR_APPENDBLOCKFAILED:
+    case SSNERROR_ERROR_ELC_INVALIDSETTINGS:
+    case SSNERROR_ERROR_BASEFINDER_NO_POS:
+    case SSNERROR_ERROR_BASEFINDER_NO_TIME:
+    case SSNERROR_ERROR_BASEFINDER_NO_RADIUS:
+      return kErrorArgument;
+
+    default:
+      return kErrorInternal;
+  }
+}
+
+bool IsRetryable(ssn_error_t error) {
+  switch (SSNERROR_GETCODE(error)) {
+    // the dongle or the licence files may come back
+    case SSNERROR_ERROR_LICENSENOTFOUND:
+    case SSNERROR_ERROR_LICENSENODONGLE:
+    case SSNERROR_ERROR_INITLICENSE:
+    // someone else lets go
+    case SSNERROR_ERROR_OUTOFMEMORY:
+    case SSNERROR_ERROR_BUSY:
+    case SSNERROR_ERROR_READONLY:
+    case SSNERROR_ERROR_ONEINSTANCE:
+    // locked files, network shares, full disks
+    case SSNERROR_ERROR_FILEOPEN:
+    case SSNERROR_ERROR_FILECLOSE:
+    case SSNERROR_ERROR_FILEREAD:
+    case SSNERROR_ERROR_FILEWRITE:
+    case SSNERROR_ERROR_FILESEEK:
+    case SSNERROR_ERROR_FILEREMOVE:
+    case SSNERROR_ERROR_DIRISSUE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+ErrorTrail::ErrorTrail() : previous_(t_current) {
+  t_current = this;
+}
+
+ErrorTrail::~ErrorTrail() {
+  t_current = previous_;
+}
+
+ErrorTrail* ErrorTrail::Current() {
+  return t_current;
+}
+
+void ErrorTrail::Record(ssn_error_t error, const char* stage,
+                        const char* call) {
+  if (SSNERROR_GETCODE(error) == SSNERROR_WARNING_OK)
+    return;
+
+  // callers treat anything but OK as failed, warnings included
+  last_.error = error;
+  last_.stage = stage;
+  last_.call = call;
+
+  if (!SSNERROR_ISWARNING(error))
+    return;
+  for (SdkWarning& warning : warnings_) {
+    if (SSNERROR_GETCODE(warning.error) == SSNERROR_GETCODE(error)) {
+      ++warning.count;
+      return;
+    }
+  }
+  warnings_.push_back(SdkWarning{error, 1});
+}
+
+SdkFailure ErrorTrail::Failure(ssn_error_t error) const {
+  SdkFailure failure;
+  failure.error = error;
+  if (error == last_.error) {
+    failure.stage = last_.stage;
+    failure.call = last_.call;
+  }
+  failure.warnings = warnings_;
+  return failure;
+}
+
+}
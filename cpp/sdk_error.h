@@ -0,0 +1,89 @@
+#ifndef CALCULATE_SDK_ERROR_H
+#define CALCULATE_SDK_ERROR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "ssnerror.h"
+
+namespace calculate {
+
+// What a failed call tells a caller deciding whether to try again
+enum ErrorKind {
+  kErrorNone,
+  kErrorLicense,            // licence, dongle or permission files
+  kErrorResource,           // busy, in use or out of memory
+  kErrorIo,                 // reading or writing files
+  kErrorInput,              // the data: invalid SBF / RINEX, nothing to solve
+  kErrorArgument,           // the request: arguments, handles, commands
+  kErrorCancelled,
+  kErrorInternal            // anything else
+};
+
+// "none", "license", "resource", "io", "input", "argument", "cancelled",
+// "internal"
+const char* ErrorKindName(ErrorKind kind);
+
+// By SSNERROR_GETCODE(); warnings classify like the errors they stand for
+ErrorKind ClassifyError(ssn_error_t error);
+
+// True when the same call may succeed later without any change to its
+// input: a dongle plugged back in, a file no longer locked, memory freed.
+// Never for the data or the arguments, which fail the same way every time.
+bool IsRetryable(ssn_error_t error);
+
+struct SdkWarning {
+  ssn_error_t error;        // as first returned
+  uint64_t count;
+};
+
+// A failed call in context, for the structured errors of the JS API
+struct SdkFailure {
+  ssn_error_t error = SSNERROR_WARNING_OK;
+  const char* stage = nullptr;         // MetricStageName(), null when the
+                                       // error did not come from a timed call
+  const char* call = nullptr;          // SDK function, when the timer named it
+  bool cancelled = false;
+  std::vector<SdkWarning> warnings;    // by code, of the job's timed calls
+
+  ErrorKind kind() const {
+    return cancelled ? kErrorCancelled : ClassifyError(error);
+  }
+  bool retryable() const { return !cancelled && IsRetryable(error); }
+};
+
+// Collects what the StageTimer calls of one job return on the calling
+// thread, so the job can report the stage that failed and the warnings the
+// SDK raised along the way. AsyncJob opens one around every Execute().
+// Trails nest; only the innermost one records.
+class ErrorTrail {
+ public:
+  ErrorTrail();
+  ~ErrorTrail();
+
+  ErrorTrail(const ErrorTrail&) = delete;
+  void operator=(const ErrorTrail&) = delete;
+
+  // innermost open trail of the calling thread, or null
+  static ErrorTrail* Current();
+
+  // Result of a timed call; OK results are not recorded
+  void Record(ssn_error_t error, const char* stage, const char* call);
+
+  // `error` with the stage and call that returned it when one of the timed
+  // calls did, and the warnings so far
+  SdkFailure Failure(ssn_error_t error) const;
+
+  const std::vector<SdkWarning>& warnings() const { return warnings_; }
+
+ private:
+  ErrorTrail* previous_;
+  SdkFailure last_;                    // last failed call
+  std::vector<SdkWarning> warnings_;
+};
+
+}
+
+#endif
@@ -0,0 +1,539 @@
+#include "series_pyramid.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <system_error>
+
+#include "sbfdef.h"
+
+#include "block_dispatch.h"
+#include "job_control.h"
+#include "sbf_stream.h"
+#include "sbf_util.h"
+#include "scratch_arena.h"
+
+namespace calculate {
+
+namespace fs = std::filesystem;
+
+static_assert(sizeof(SeriesHeader) == 64, "SeriesHeader layout");
+static_assert(sizeof(SeriesLevel) == 16, "SeriesLevel layout");
+
+namespace {
+
+const char* const kFieldNames[kSeriesFields] = {
+  "lat", "lon", "height", "vn", "ve", "vu", "clockBias", "nrSv",
+  "hAccuracy", "vAccuracy", "pdop", "tdop", "hdop", "vdop", "hpl", "vpl",
+};
+
+// blocks between two cancellation checks / progress reports
+const uint32_t kScanReportBlocks = 4096;
+
+// one bucket left long before this on any real file
+const unsigned kMaxLevels = 48;
+
+// level 0 buckets span at least 2^10 ms, about a second: a 10 Hz file
+// then costs a tenth of one bucket per epoch, not a full one
+const uint32_t kMinBaseShift = 10;
+
+const double kRadToDeg = 180.0 / 3.14159265358979323846;
+
+// one PVTGeodetic / DOP epoch, NaN for what its blocks lack
+struct Epoch {
+  uint64_t key;             // ms since the GPS epoch
+  double value[kSeriesFields];
+};
+
+// buckets of one level while building, field values interleaved
+struct Level {
+  uint32_t shift = 0;
+  std::vector<uint32_t> bucket;
+  std::vector<uint32_t> epochs;
+  std::vector<double> time_sum;     // ms from origin
+  std::vector<double> min, max, sum;
+  std::vector<uint32_t> count;
+
+  size_t size() const { return bucket.size(); }
+
+  void Open(uint32_t b) {
+    bucket.push_back(b);
+    epochs.push_back(0);
+    time_sum.push_back(0.0);
+    min.insert(min.end(), kSeriesFields,
+               std::numeric_limits<double>::infinity());
+    max.insert(max.end(), kSeriesFields,
+               -std::numeric_limits<double>::infinity());
+    sum.insert(sum.end(), kSeriesFields, 0.0);
+    count.insert(count.end(), kSeriesFields, 0);
+  }
+};
+
+size_t Align8(size_t offset) { return (offset + 7) & ~static_cast<size_t>(7); }
+
+size_t LevelBytes(size_t n) {
+  return 2 * Align8(n * sizeof(uint32_t)) + n * sizeof(double) +
+         kSeriesFields * (3 * n * sizeof(double) +
+                          Align8(n * sizeof(uint32_t)));
+}
+
+// where the arrays of a level start
+struct LevelView {
+  const uint32_t* bucket;
+  const uint32_t* epochs;
+  const double* time;
+  const uint8_t* fields;
+  size_t n;
+
+  LevelView(const uint8_t* data, const SeriesLevel& level)
+      : n(level.bucket_count) {
+    const uint8_t* p = data + level.offset;
+    bucket = reinterpret_cast<const uint32_t*>(p);
+    p += Align8(n * sizeof(uint32_t));
+    epochs = reinterpret_cast<const uint32_t*>(p);
+    p += Align8(n * sizeof(uint32_t));
+    time = reinterpret_cast<const double*>(p);
+    fields = p + n * sizeof(double);
+  }
+
+  size_t FieldBytes() const {
+    return 3 * n * sizeof(double) + Align8(n * sizeof(uint32_t));
+  }
+  const double* min(int field) const {
+    return reinterpret_cast<const double*>(fields + field * FieldBytes());
+  }
+  const double* max(int field) const { return min(field) + n; }
+  const double* mean(int field) const { return min(field) + 2 * n; }
+  const uint32_t* count(int field) const {
+    return reinterpret_cast<const uint32_t*>(min(field) + 3 * n);
+  }
+};
+
+int64_t LastWriteTime(const std::string& path) {
+  std::error_code ec;
+  fs::file_time_type mtime = fs::last_write_time(fs::u8path(path), ec);
+  return ec ? 0 : static_cast<int64_t>(mtime.time_since_epoch().count());
+}
+
+// PVTGeodetic and DOP blocks to epochs, through a BlockDispatcher
+class EpochReader {
+ public:
+  explicit EpochReader(std::vector<Epoch>* epochs) : epochs_(epochs) {}
+
+  void On(const BlockView<PVTGeodetic_2_2_t>& pvt) {
+    if (!pvt.Has(&PVTGeodetic_2_2_t::RxClkBias))
+      return;
+    Epoch* epoch = Start(pvt->TOW, pvt->WNc);
+    if (epoch == nullptr)
+      return;
+    double* v = epoch->value;
+    if (pvt->Lat != F64_NOTVALID)
+      v[kSeriesLat] = pvt->Lat * kRadToDeg;
+    if (pvt->Lon != F64_NOTVALID)
+      v[kSeriesLon] = pvt->Lon * kRadToDeg;
+    if (pvt->Alt != F64_NOTVALID)
+      v[kSeriesHeight] = pvt->Alt;
+    if (pvt->Vn != F32_NOTVALID)
+      v[kSeriesVn] = pvt->Vn;
+    if (pvt->Ve != F32_NOTVALID)
+      v[kSeriesVe] = pvt->Ve;
+    if (pvt->Vu != F32_NOTVALID)
+      v[kSeriesVu] = pvt->Vu;
+    if (pvt->RxClkBias != F64_NOTVALID)
+      v[kSeriesClockBias] = pvt->RxClkBias;
+    if (pvt.Has(&PVTGeodetic_2_2_t::NrSV) && pvt->NrSV != 255)
+      v[kSeriesNrSv] = pvt->NrSV;
+    if (pvt.Has(&PVTGeodetic_2_2_t::HAccuracy) && pvt->HAccuracy != 65535)
+      v[kSeriesHAccuracy] = pvt->HAccuracy * 0.01;
+    if (pvt.Has(&PVTGeodetic_2_2_t::VAccuracy) && pvt->VAccuracy != 65535)
+      v[kSeriesVAccuracy] = pvt->VAccuracy * 0.01;
+  }
+
+  void On(const BlockView<DOP_2_0_t>& dop) {
+    if (!dop.Has(&DOP_2_0_t::VPL))
+      return;
+    Epoch* epoch = Start(dop->TOW, dop->WNc);
+    if (epoch == nullptr)
+      return;
+    double* v = epoch->value;
+    // 0 is do-not-use for the DOPs
+    const uint16_t dops[] = {dop->PDOP, dop->TDOP, dop->HDOP, dop->VDOP};
+    for (int i = 0; i < 4; ++i) {
+      if (dops[i] != 0)
+        v[kSeriesPdop + i] = dops[i] * 0.01;
+    }
+    if (dop->HPL != F32_NOTVALID)
+      v[kSeriesHpl] = dop->HPL;
+    if (dop->VPL != F32_NOTVALID)
+      v[kSeriesVpl] = dop->VPL;
+  }
+
+ private:
+  // a new epoch with every field NaN, or null without a time stamp
+  Epoch* Start(uint32_t tow, uint16_t wnc) {
+    if (tow == kTowDoNotUse || wnc == kWncDoNotUse)
+      return nullptr;
+    epochs_->emplace_back();
+    Epoch* epoch = &epochs_->back();
+    epoch->key = static_cast<uint64_t>(wnc) * 604800000ull + tow;
+    std::fill(epoch->value, epoch->value + kSeriesFields,
+              std::numeric_limits<double>::quiet_NaN());
+    return epoch;
+  }
+
+  std::vector<Epoch>* epochs_;
+};
+
+using EpochDispatcher =
+    BlockDispatcher<EpochReader,
+                    OnBlock<sbfid_PVTGeodetic_2_0, PVTGeodetic_2_2_t>,
+                    OnBlock<sbfid_DOP_2_0, DOP_2_0_t>>;
+
+ssn_error_t ScanEpochs(ssn_hsbfstream_t sbfstream, uint32_t stream_size,
+                       JobControl* control, std::vector<Epoch>* epochs) {
+  ScratchScope scratch;
+  VoidBlock_t* block =
+      static_cast<VoidBlock_t*>(scratch.arena().Allocate(MAX_SBFSIZE));
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(block);
+  EpochReader reader(epochs);
+  EpochDispatcher dispatch(&reader);
+  uint32_t blocks = 0;
+
+  ssn_error_t rerror = SSNSBFStream_rewind(sbfstream);
+  while (IsOk(rerror)) {
+    rerror = SSNSBFStream_getNextBlock(sbfstream, block);
+    if (IsEndOfStream(rerror))
+      return SSNERROR_WARNING_OK;
+    if (!IsOk(rerror))
+      break;
+
+    if (control != nullptr && ++blocks % kScanReportBlocks == 0) {
+      if (control->cancelled())
+        return CancelledError();
+      uint32_t offset = 0;
+      if (stream_size > 0 &&
+          IsOk(SSNSBFStream_getPosition(sbfstream, &offset)))
+        control->Report(0, static_cast<float>(offset * 100.0 / stream_size));
+    }
+
+    if (block->Length >= sizeof(TimeHeader_t))
+      dispatch(bytes, block->Length);
+  }
+  return rerror;
+}
+
+// sorts by time and merges the PVTGeodetic and DOP of one epoch; the first
+// value of a field wins
+void MergeEpochs(std::vector<Epoch>* epochs) {
+  std::stable_sort(epochs->begin(), epochs->end(),
+                   [](const Epoch& a, const Epoch& b) { return a.key < b.key; });
+  size_t out = 0;
+  for (size_t i = 0; i < epochs->size(); ++i) {
+    Epoch& epoch = (*epochs)[i];
+    if (out > 0 && (*epochs)[out - 1].key == epoch.key) {
+      double* into = (*epochs)[out - 1].value;
+      for (int f = 0; f < kSeriesFields; ++f) {
+        if (isnan(into[f]))
+          into[f] = epoch.value[f];
+      }
+    } else {
+      (*epochs)[out++] = epoch;
+    }
+  }
+  epochs->resize(out);
+}
+
+void BuildLevels(const std::vector<Epoch>& epochs, uint64_t origin,
+                 uint32_t shift, std::vector<Level>* levels) {
+  levels->emplace_back();
+  Level* level = &levels->back();
+  level->shift = shift;
+  for (const Epoch& epoch : epochs) {
+    uint64_t offset = epoch.key - origin;
+    uint32_t b = static_cast<uint32_t>(offset >> shift);
+    if (level->size() == 0 || level->bucket.back() != b)
+      level->Open(b);
+    size_t i = level->size() - 1;
+    ++level->epochs[i];
+    level->time_sum[i] += static_cast<double>(offset);
+    for (int f = 0; f < kSeriesFields; ++f) {
+      double v = epoch.value[f];
+      if (isnan(v))
+        continue;
+      size_t j = i * kSeriesFields + f;
+      level->min[j] = std::min(level->min[j], v);
+      level->max[j] = std::max(level->max[j], v);
+      level->sum[j] += v;
+      ++level->count[j];
+    }
+  }
+
+  while (levels->back().size() > 1 && levels->size() < kMaxLevels) {
+    levels->emplace_back();
+    const Level& below = (*levels)[levels->size() - 2];
+    Level* above = &levels->back();
+    above->shift = below.shift + 1;
+    for (size_t k = 0; k < below.size(); ++k) {
+      uint32_t b = below.bucket[k] >> 1;
+      if (above->size() == 0 || above->bucket.back() != b)
+        above->Open(b);
+      size_t i = above->size() - 1;
+      above->epochs[i] += below.epochs[k];
+      above->time_sum[i] += below.time_sum[k];
+      for (int f = 0; f < kSeriesFields; ++f) {
+        size_t j = i * kSeriesFields + f;
+        size_t from = k * kSeriesFields + f;
+        above->min[j] = std::min(above->min[j], below.min[from]);
+        above->max[j] = std::max(above->max[j], below.max[from]);
+        above->sum[j] += below.sum[from];
+        above->count[j] += below.count[from];
+      }
+    }
+  }
+}
+
+template <typename T>
+T* At(std::vector<uint64_t>* image, size_t offset) {
+  return reinterpret_cast<T*>(reinterpret_cast<uint8_t*>(image->data()) +
+                              offset);
+}
+
+// the sidecar file image of `epochs`, sorted and merged
+void BuildImage(const std::vector<Epoch>& epochs, uint64_t source_size,
+                int64_t mtime, std::vector<uint64_t>* image) {
+  SeriesHeader header = {};
+  header.magic = kSeriesMagic;
+  header.version = kSeriesVersion;
+  header.field_count = kSeriesFields;
+  header.source_size = source_size;
+  header.source_mtime = mtime;
+  header.epochs = epochs.size();
+
+  std::vector<Level> levels;
+  if (!epochs.empty()) {
+    // the largest power of two not above the shortest epoch interval keeps
+    // one epoch per level 0 bucket, unless that is finer than
+    // kMinBaseShift or the bucket numbers would not fit in 32 bits
+    uint64_t interval = std::numeric_limits<uint64_t>::max();
+    for (size_t i = 1; i < epochs.size(); ++i)
+      interval = std::min(interval, epochs[i].key - epochs[i - 1].key);
+    uint64_t span = epochs.back().key - epochs.front().key;
+    uint32_t shift = 0;
+    while (shift < 62 && (2ull << shift) <= interval)
+      ++shift;
+    shift = std::max(shift, kMinBaseShift);
+    while ((span >> shift) > 0xffffffffull)
+      ++shift;
+    header.origin = epochs.front().key;
+    header.base_shift = shift;
+    BuildLevels(epochs, header.origin, shift, &levels);
+  }
+  header.level_count = static_cast<uint32_t>(levels.size());
+
+  size_t bytes = sizeof(SeriesHeader) + levels.size() * sizeof(SeriesLevel);
+  std::vector<SeriesLevel> table(levels.size());
+  for (size_t k = 0; k < levels.size(); ++k) {
+    bytes = Align8(bytes);
+    table[k].bucket_count = static_cast<uint32_t>(levels[k].size());
+    table[k].shift = levels[k].shift;
+    table[k].offset = bytes;
+    bytes += LevelBytes(levels[k].size());
+  }
+
+  image->assign(Align8(bytes) / sizeof(uint64_t), 0);
+  memcpy(image->data(), &header, sizeof(header));
+  if (!table.empty())
+    memcpy(At<uint8_t>(image, sizeof(header)), table.data(),
+           table.size() * sizeof(SeriesLevel));
+
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  for (size_t k = 0; k < levels.size(); ++k) {
+    const Level& level = levels[k];
+    size_t n = level.size();
+    LevelView view(reinterpret_cast<const uint8_t*>(image->data()), table[k]);
+    auto out = [](const void* p) {
+      return const_cast<uint8_t*>(static_cast<const uint8_t*>(p));
+    };
+    memcpy(out(view.bucket), level.bucket.data(), n * sizeof(uint32_t));
+    memcpy(out(view.epochs), level.epochs.data(), n * sizeof(uint32_t));
+    double* time = reinterpret_cast<double*>(out(view.time));
+    for (size_t i = 0; i < n; ++i)
+      time[i] = (header.origin + level.time_sum[i] / level.epochs[i]) * 0.001;
+
+    for (int f = 0; f < kSeriesFields; ++f) {
+      double* min = reinterpret_cast<double*>(out(view.min(f)));
+      double* max = reinterpret_cast<double*>(out(view.max(f)));
+      double* mean = reinterpret_cast<double*>(out(view.mean(f)));
+      uint32_t* count = reinterpret_cast<uint32_t*>(out(view.count(f)));
+      for (size_t i = 0; i < n; ++i) {
+        size_t j = i * kSeriesFields + f;
+        count[i] = level.count[j];
+        bool empty = level.count[j] == 0;
+        min[i] = empty ? nan : level.min[j];
+        max[i] = empty ? nan : level.max[j];
+        mean[i] = empty ? nan : level.sum[j] / level.count[j];
+      }
+    }
+  }
+}
+
+}
+
+const char* SeriesFieldName(int field) {
+  return field >= 0 && field < kSeriesFields ? kFieldNames[field] : "";
+}
+
+int SeriesFieldFromName(const std::string& name) {
+  for (int field = 0; field < kSeriesFields; ++field) {
+    if (name == kFieldNames[field])
+      return field;
+  }
+  return -1;
+}
+
+std::string SeriesPyramid::SidecarPath(const std::string& path) {
+  return path + ".sbflod";
+}
+
+ssn_error_t SeriesPyramid::Load(const std::string& path,
+                                ssn_hsbfstream_t sbfstream,
+                                JobControl* control) {
+  sidecar_path_ = SidecarPath(path);
+  int64_t mtime = LastWriteTime(path);
+  uint32_t size = 0;
+  ssn_error_t rerror = SSNSBFStream_getSize(sbfstream, &size);
+  if (!IsOk(rerror))
+    return rerror;
+
+  if (map_.Open(sidecar_path_)) {
+    if (Attach(map_.data(), map_.size()) && header_->source_size == size &&
+        header_->source_mtime == mtime) {
+      origin_ = kReused;
+      return SSNERROR_WARNING_OK;
+    }
+    header_ = nullptr;
+    map_.Close();
+  }
+
+  origin_ = kBuilt;
+  std::vector<Epoch> epochs;
+  rerror = ScanEpochs(sbfstream, size, control, &epochs);
+  if (!IsOk(rerror))
+    return rerror;
+  MergeEpochs(&epochs);
+  BuildImage(epochs, size, mtime, &image_);
+  Publish();
+
+  if (control != nullptr)
+    control->Report(0, 100.0f);
+  return SSNERROR_WARNING_OK;
+}
+
+bool SeriesPyramid::Attach(const uint8_t* data, size_t size) {
+  header_ = nullptr;
+  if (data == nullptr || size < sizeof(SeriesHeader))
+    return false;
+  const SeriesHeader* header = reinterpret_cast<const SeriesHeader*>(data);
+  if (header->magic != kSeriesMagic || header->version != kSeriesVersion ||
+      header->field_count != kSeriesFields ||
+      header->level_count > kMaxLevels ||
+      size < sizeof(SeriesHeader) + header->level_count * sizeof(SeriesLevel))
+    return false;
+
+  const SeriesLevel* levels =
+      reinterpret_cast<const SeriesLevel*>(data + sizeof(SeriesHeader));
+  for (uint32_t k = 0; k < header->level_count; ++k) {
+    const SeriesLevel& level = levels[k];
+    if (level.offset % 8 != 0 || level.offset > size ||
+        LevelBytes(level.bucket_count) > size - level.offset ||
+        level.shift > 63)
+      return false;
+  }
+
+  header_ = header;
+  levels_ = levels;
+  data_ = data;
+  return true;
+}
+
+void SeriesPyramid::Publish() {
+  const char* bytes = reinterpret_cast<const char*>(image_.data());
+  size_t size = image_.size() * sizeof(uint64_t);
+
+  // write to a temporary file and rename, so a reader never maps a
+  // half-written pyramid
+  std::string temp = sidecar_path_ + ".tmp";
+  bool written;
+  {
+    std::ofstream out(fs::u8path(temp), std::ios::binary | std::ios::trunc);
+    out.write(bytes, size);
+    written = out.good();
+  }
+
+  std::error_code ec;
+  if (written)
+    fs::rename(fs::u8path(temp), fs::u8path(sidecar_path_), ec);
+  if (!written || ec) {
+    fs::remove(fs::u8path(temp), ec);
+  } else if (map_.Open(sidecar_path_) && Attach(map_.data(), map_.size())) {
+    std::vector<uint64_t>().swap(image_);
+    return;
+  }
+
+  // not persisted, serve queries from memory
+  map_.Close();
+  Attach(reinterpret_cast<const uint8_t*>(image_.data()), size);
+}
+
+bool SeriesPyramid::Query(int field, double start, double end,
+                          unsigned pixels, SeriesSlice* out) const {
+  *out = SeriesSlice();
+  if (field < 0 || field >= kSeriesFields || !(end >= start) || pixels == 0)
+    return false;
+  if (header_ == nullptr || header_->level_count == 0)
+    return true;
+
+  // ms from origin, clamped to the pyramid
+  double origin = static_cast<double>(header_->origin);
+  double last = 4294967295.0 * static_cast<double>(1ull << header_->base_shift);
+  double from = std::max(0.0, floor(start * 1000.0 - origin));
+  double to = std::min(last, floor(end * 1000.0 - origin));
+  if (to < from)
+    return true;
+  uint64_t lo = static_cast<uint64_t>(from);
+  uint64_t hi = static_cast<uint64_t>(to);
+
+  // the finest level whose buckets are at least a pixel wide
+  double span = static_cast<double>(hi - lo + 1);
+  unsigned k = 0;
+  while (k + 1 < header_->level_count &&
+         static_cast<double>(1ull << levels_[k].shift) * pixels < span)
+    ++k;
+
+  const SeriesLevel& level = levels_[k];
+  LevelView view(data_, level);
+  uint32_t first = static_cast<uint32_t>(lo >> level.shift);
+  uint32_t final = static_cast<uint32_t>(
+      std::min<uint64_t>(hi >> level.shift, 0xffffffffull));
+  const uint32_t* begin =
+      std::lower_bound(view.bucket, view.bucket + view.n, first);
+  const uint32_t* stop = std::upper_bound(begin, view.bucket + view.n, final);
+  size_t i = begin - view.bucket;
+
+  out->level = k;
+  out->bucket_seconds = static_cast<double>(1ull << level.shift) * 0.001;
+  out->rows = stop - begin;
+  out->epochs = view.epochs + i;
+  out->time = view.time + i;
+  out->min = view.min(field) + i;
+  out->max = view.max(field) + i;
+  out->mean = view.mean(field) + i;
+  out->count = view.count(field) + i;
+  return true;
+}
+
+}
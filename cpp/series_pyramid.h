@@ -0,0 +1,165 @@
+#ifndef CALCULATE_SERIES_PYRAMID_H
+#define CALCULATE_SERIES_PYRAMID_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "ssnsbfstream.h"
+
+#include "mapped_file.h"
+
+namespace calculate {
+
+class JobControl;
+
+/*
+ * Sidecar level-of-detail pyramid "<file>.sbflod" (version 2), little endian
+ *
+ *   offset 0   SeriesHeader
+ *   offset 64  SeriesLevel[level_count]
+ *   ...        per level, each array starting on an 8-byte boundary:
+ *                uint32_t bucket[bucket_count]     ascending
+ *                uint32_t epochs[bucket_count]     epochs merged into it
+ *                double   time[bucket_count]       their mean GNSS time, s
+ *                per field, in SeriesField order:
+ *                  double   min[], max[], mean[]   NaN when count is 0
+ *                  uint32_t count[]                valid values merged
+ *
+ * Buckets of level k span 2^(base_shift + k) ms counted from origin, so
+ * bucket b of level k + 1 merges buckets 2b and 2b + 1 of level k. Only
+ * buckets holding an epoch are stored. base_shift is picked so that level
+ * 0 holds one epoch per bucket, but never below 10 (1.024 s): faster
+ * files are decimated into level 0.
+ *
+ * A bucket takes 464 bytes and the levels above level 0 add at most as many
+ * buckets again, so the sidecar, or the image in memory when it cannot be
+ * written, stays under about 1 KB per second of data: some 80 MB for a day.
+ * While building, every epoch is also held once at 136 bytes.
+ */
+
+const uint32_t kSeriesMagic = 0x4c464253;  // "SBFL"
+const uint16_t kSeriesVersion = 2;
+
+#pragma pack(push, 4)
+
+typedef struct
+{
+  uint32_t  magic;          // kSeriesMagic
+  uint16_t  version;        // kSeriesVersion
+  uint16_t  field_count;    // kSeriesFields
+  uint32_t  level_count;
+  uint32_t  base_shift;
+  uint64_t  source_size;    // SSNSBFStream_getSize() of the source stream
+  int64_t   source_mtime;   // last write time of the SBF file
+  uint64_t  origin;         // ms since the GPS epoch
+  uint64_t  epochs;         // PVTGeodetic / DOP epochs
+  uint32_t  reserved[4];
+} SeriesHeader;
+
+typedef struct
+{
+  uint32_t  bucket_count;
+  uint32_t  shift;          // bucket span is 2^shift ms
+  uint64_t  offset;         // of the bucket array from the start of the file
+} SeriesLevel;
+
+#pragma pack(pop)
+
+// PVTGeodetic and DOP values, in the order of the sidecar and of
+// SeriesFieldName()
+enum SeriesField {
+  kSeriesLat,               // deg
+  kSeriesLon,               // deg
+  kSeriesHeight,            // m, ellipsoidal
+  kSeriesVn,                // m/s
+  kSeriesVe,
+  kSeriesVu,
+  kSeriesClockBias,         // ms
+  kSeriesNrSv,
+  kSeriesHAccuracy,         // m
+  kSeriesVAccuracy,
+  kSeriesPdop,
+  kSeriesTdop,
+  kSeriesHdop,
+  kSeriesVdop,
+  kSeriesHpl,               // m
+  kSeriesVpl,
+  kSeriesFields
+};
+
+// "lat", "lon", "height", "vn", ..., "hpl", "vpl"
+const char* SeriesFieldName(int field);
+// -1 for an unknown name
+int SeriesFieldFromName(const std::string& name);
+
+// Buckets of one level of one field; the arrays point into the pyramid
+// and have `rows` entries
+struct SeriesSlice {
+  unsigned level = 0;
+  double bucket_seconds = 0;
+  size_t rows = 0;
+  const uint32_t* epochs = nullptr;
+  const double* time = nullptr;
+  const double* min = nullptr;
+  const double* max = nullptr;
+  const double* mean = nullptr;
+  const uint32_t* count = nullptr;
+};
+
+// Min / max / mean per time bucket of the PVTGeodetic and DOP fields at
+// power-of-two bucket spans, so a chart of any time range gets about one
+// bucket per pixel without touching the samples.
+//
+// Built in one pass over the stream and persisted next to the block index;
+// a sidecar whose source size and modification time still match is mapped
+// as is, anything else is rebuilt. When it cannot be written the pyramid
+// lives in memory only. Immutable once loaded, so queries need no lock.
+class SeriesPyramid {
+ public:
+  enum Origin { kReused, kBuilt };
+
+  SeriesPyramid() = default;
+
+  SeriesPyramid(const SeriesPyramid&) = delete;
+  void operator=(const SeriesPyramid&) = delete;
+
+  // Maps the sidecar of `path`, or builds it from `sbfstream`, which must
+  // hold `path` loaded. The caller holds the stream's mutex; the stream
+  // position is left undefined.
+  ssn_error_t Load(const std::string& path, ssn_hsbfstream_t sbfstream,
+                   JobControl* control = nullptr);
+
+  // The buckets of `field` overlapping [start, end] (GNSS time, s) at the
+  // finest level with at most about `pixels` of them across the range.
+  // False for an unknown field or an empty or inverted range.
+  bool Query(int field, double start, double end, unsigned pixels,
+             SeriesSlice* out) const;
+
+  uint64_t epochs() const { return header_ ? header_->epochs : 0; }
+  unsigned levels() const { return header_ ? header_->level_count : 0; }
+  Origin origin() const { return origin_; }
+  bool persisted() const { return map_.is_open(); }
+  const std::string& path() const { return sidecar_path_; }
+
+  static std::string SidecarPath(const std::string& path);
+
+ private:
+  // Points header_ / levels_ into `data` after checking its layout
+  bool Attach(const uint8_t* data, size_t size);
+  void Publish();
+
+  MappedFile map_;
+  std::string sidecar_path_;
+  std::vector<uint64_t> image_;       // the file, when not mapped
+  const SeriesHeader* header_ = nullptr;
+  const SeriesLevel* levels_ = nullptr;
+  const uint8_t* data_ = nullptr;
+  Origin origin_ = kBuilt;
+};
+
+}
+
+#endif
@@ -0,0 +1,343 @@
+#include "sharded_pvt.h"
+
+#include <math.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <thread>
+
+#include "sbfdef.h"
+#include "ssnppengine.h"
+
+#include "batch_analysis.h"
+#include "metrics.h"
+#include "sbf_stream.h"
+#include "temp_space.h"
+
+namespace calculate {
+
+namespace {
+
+const double kSecondsPerWeek = 604800.0;
+
+// SDK, engine and the input/output stream pair of one PVT run. Used by one
+// thread at a time, per the rules in sbf_stream.h.
+struct PVTWorkspace {
+  explicit PVTWorkspace(JobControl* control) : control(control) {}
+
+  JobControl*       control;
+  ssn_hsdk_t        sdk;
+  ssn_hsbfstream_t  input;
+  ssn_hsbfstream_t  output;
+  EngineLease       engine;
+  bool              sdk_open = false;
+  bool              input_open = false;
+  bool              output_open = false;
+  bool              recycle = false;    // the engine's last run succeeded
+
+  ~PVTWorkspace() {
+    if (engine.open() && control != nullptr)
+      control->DetachEngine(engine.engine());
+    if (recycle)
+      engine.Recycle();
+    if (output_open)
+      SSNSBFStream_close(output);
+    if (input_open)
+      SSNSBFStream_close(input);
+    if (sdk_open)
+      CloseSdk(sdk);
+  }
+
+  ssn_error_t Open(const EngineProfilePtr& profile, unsigned part) {
+    ssn_error_t rerror;
+
+    rerror = OpenSdk(&sdk);
+    if (!IsOk(rerror))
+      return rerror;
+    sdk_open = true;
+
+    rerror = SSNSBFStream_open(sdk, &input);
+    if (!IsOk(rerror))
+      return rerror;
+    input_open = true;
+
+    rerror = SSNSBFStream_open(sdk, &output);
+    if (!IsOk(rerror))
+      return rerror;
+    output_open = true;
+
+    // every shard has to run with the same receiver configuration
+    rerror = EnginePool::Instance().Acquire(profile, &engine);
+    if (!IsOk(rerror))
+      return rerror;
+    if (control != nullptr)
+      control->AttachEngine(engine.engine(), part);
+
+    return rerror;
+  }
+
+  ssn_error_t Calculate(ssn_hsbfstream_t source, uint32_t options,
+                        double* seconds) {
+    auto begin = std::chrono::steady_clock::now();
+    SpillMeter spill(kStageCalculatePvt, { sdk, engine.sdk() });
+    StageTimer timer(kStageCalculatePvt);
+    ssn_error_t rerror = timer.Done(SSNPPEngine_calculatePVT(
+        engine.engine(), source, static_cast<ssn_ppengine_options_t>(options),
+        NULL, output));
+    recycle = IsOk(rerror);
+    *seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - begin).count();
+    return rerror;
+  }
+};
+
+void SplitGNSSTime(double gnsstime, uint32_t* tow, uint16_t* wnc) {
+  double week = floor(gnsstime / kSecondsPerWeek);
+  *wnc = static_cast<uint16_t>(week);
+  *tow = static_cast<uint32_t>(gnsstime - week * kSecondsPerWeek);
+}
+
+// Crops `stream` to the whole seconds around [start, end]
+ssn_error_t CropToSeconds(ssn_hsbfstream_t stream, double start, double end) {
+  uint32_t towstart, towend;
+  uint16_t wncstart, wncend;
+
+  SplitGNSSTime(floor(start), &towstart, &wncstart);
+  SplitGNSSTime(ceil(end), &towend, &wncend);
+  return SSNSBFStream_cropTOW(stream, towstart, wncstart, towend, wncend,
+                              SSNSBFSTREAM_CROPOPTION_DEFAULT);
+}
+
+struct Fix {
+  uint8_t mode;
+  bool valid;
+  double x, y, z;
+};
+
+// WGS84 geodetic (radians, metres) to ECEF
+void ToECEF(double lat, double lon, double alt, Fix* fix) {
+  const double a = 6378137.0;
+  const double e2 = 6.69437999014e-3;
+  double n = a / sqrt(1.0 - e2 * sin(lat) * sin(lat));
+
+  fix->x = (n + alt) * cos(lat) * cos(lon);
+  fix->y = (n + alt) * cos(lat) * sin(lon);
+  fix->z = (n * (1.0 - e2) + alt) * sin(lat);
+}
+
+// PVTGeodetic epochs of `stream` keyed by WNc:TOW
+ssn_error_t CollectFixes(ssn_hsbfstream_t stream,
+                         std::map<uint64_t, Fix>* fixes) {
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[MAX_SBFSIZE]);
+  VoidBlock_t* block = reinterpret_cast<VoidBlock_t*>(buffer.get());
+  ssn_error_t rerror = SSNSBFStream_rewind(stream);
+
+  while (IsOk(rerror)) {
+    rerror = SSNSBFStream_getNextBlockByID(stream, sbfid_PVTGeodetic_2_2,
+                                           block);
+    if (!IsOk(rerror))
+      break;
+
+    const PVTGeodetic_2_2_t* pvt =
+        reinterpret_cast<const PVTGeodetic_2_2_t*>(block);
+    Fix fix;
+    fix.mode = pvt->Mode & 0x0f;
+    fix.valid = pvt->Error == 0 && fix.mode != 0;
+    ToECEF(pvt->Lat, pvt->Lon, pvt->Alt, &fix);
+    (*fixes)[(uint64_t(pvt->WNc) << 32) | pvt->TOW] = fix;
+  }
+
+  // running off the end of the stream is the normal way out
+  int code = SSNERROR_GETCODE(rerror);
+  if (code == SSNERROR_WARNING_ENDOFSTREAM ||
+      code == SSNERROR_WARNING_ENDOFFILE ||
+      code == SSNERROR_ERROR_BLOCKNOTFOUND)
+    return SSNERROR_WARNING_OK;
+  return rerror;
+}
+
+ssn_error_t Compare(ssn_hsbfstream_t sharded, ssn_hsbfstream_t reference,
+                    PVTValidation* validation) {
+  std::map<uint64_t, Fix> ours, theirs;
+  ssn_error_t rerror;
+  double squares = 0;
+  uint32_t compared = 0;
+
+  rerror = CollectFixes(sharded, &ours);
+  if (!IsOk(rerror))
+    return rerror;
+  rerror = CollectFixes(reference, &theirs);
+  if (!IsOk(rerror))
+    return rerror;
+
+  validation->sharded_epochs = static_cast<uint32_t>(ours.size());
+  validation->reference_epochs = static_cast<uint32_t>(theirs.size());
+
+  for (const auto& entry : theirs) {
+    auto match = ours.find(entry.first);
+    if (match == ours.end()) {
+      ++validation->missing;
+      continue;
+    }
+
+    ++validation->matched;
+    const Fix& a = match->second;
+    const Fix& b = entry.second;
+    if (a.mode != b.mode)
+      ++validation->mode_mismatches;
+    if (!a.valid || !b.valid)
+      continue;
+
+    double dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+    double d2 = dx * dx + dy * dy + dz * dz;
+    squares += d2;
+    ++compared;
+    if (sqrt(d2) > validation->max_error)
+      validation->max_error = sqrt(d2);
+  }
+
+  validation->extra = validation->sharded_epochs - validation->matched;
+  validation->rms_error = compared > 0 ? sqrt(squares / compared) : 0.0;
+  return rerror;
+}
+
+}
+
+ssn_error_t RunShardedPVT(ssn_hsbfstream_t input,
+                          const ShardedPVTOptions& options,
+                          ShardedPVTResult* result,
+                          JobControl* control) {
+  ssn_error_t rerror;
+  double low, high;
+
+  rerror = SSNSBFStream_getStreamMeasurementsInterval(input, &low, &high);
+  if (!IsOk(rerror))
+    return rerror;
+
+  unsigned count = options.shards > 0 ? options.shards
+                                      : BatchAnalysis::DefaultConcurrency();
+  // shards shorter than the warm-up only add overhead
+  double span = high - low;
+  while (count > 1 && span / count < options.warmup)
+    --count;
+
+  std::vector<std::unique_ptr<PVTWorkspace>> workspaces(count);
+  result->shards.assign(count, PVTShard());
+  if (control != nullptr)
+    control->SetParts(count + (options.validate ? 1 : 0));
+
+  // copies are made up front: they read the shared input handle
+  for (unsigned k = 0; k < count; ++k) {
+    if (control != nullptr && control->cancelled())
+      return CancelledError();
+
+    PVTShard& shard = result->shards[k];
+    shard.start = low + span * k / count;
+    // +1 s so the last epoch falls inside the half-open range
+    shard.end = k + 1 == count ? high + 1.0 : low + span * (k + 1) / count;
+
+    workspaces[k].reset(new PVTWorkspace(control));
+    rerror = workspaces[k]->Open(options.profile, k);
+    if (!IsOk(rerror))
+      return rerror;
+
+    rerror = SSNSBFStream_copy(input, workspaces[k]->input);
+    if (!IsOk(rerror))
+      return rerror;
+
+    if (count > 1) {
+      double from = k == 0 ? shard.start : shard.start - options.warmup;
+      rerror = CropToSeconds(workspaces[k]->input, from, shard.end);
+      if (!IsOk(rerror))
+        return rerror;
+    }
+  }
+
+  std::unique_ptr<PVTWorkspace> reference;
+  ssn_error_t referror = SSNERROR_WARNING_OK;
+  if (options.validate) {
+    reference.reset(new PVTWorkspace(control));
+    rerror = reference->Open(options.profile, count);
+    if (!IsOk(rerror))
+      return rerror;
+  }
+
+  auto begin = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  threads.reserve(count);
+
+  for (unsigned k = 0; k < count; ++k) {
+    threads.emplace_back([&, k]() {
+      PVTShard& shard = result->shards[k];
+      PVTWorkspace* workspace = workspaces[k].get();
+
+      shard.error = workspace->Calculate(workspace->input,
+                                         options.engine_options,
+                                         &shard.seconds);
+      // drop what the engine produced during the warm-up, and the epoch
+      // the next shard starts with
+      if (IsOk(shard.error) && count > 1)
+        shard.error = SSNSBFStream_cropGNSS(workspace->output, shard.start,
+                                            shard.end - 1e-3,
+                                            SSNSBFSTREAM_CROPOPTION_DEFAULT);
+    });
+  }
+
+  // the reference is the only user of the input handle from here on
+  std::thread reference_thread;
+  if (reference)
+    reference_thread = std::thread([&]() {
+      referror = reference->Calculate(input, options.engine_options,
+                                      &result->validation.reference_seconds);
+    });
+
+  for (std::thread& thread : threads)
+    thread.join();
+  result->seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - begin).count();
+  if (reference_thread.joinable())
+    reference_thread.join();
+
+  if (control != nullptr && control->cancelled())
+    return CancelledError();
+
+  for (const PVTShard& shard : result->shards) {
+    if (!IsOk(shard.error))
+      return shard.error;
+  }
+
+  ssn_hsbfstream_t stitched = workspaces[0]->output;
+  {
+    SpillMeter spill(kStageMerge, { workspaces[0]->sdk });
+    for (unsigned k = 1; k < count; ++k) {
+      StageTimer timer(kStageMerge, "SSNSBFStream_appendStreamBlocks");
+      rerror = timer.Done(SSNSBFStream_appendStreamBlocks(
+          stitched, workspaces[k]->output, sbfid_ALL));
+      if (!IsOk(rerror))
+        return rerror;
+    }
+  }
+
+  if (!options.output.empty()) {
+    std::vector<char> filename(options.output.begin(), options.output.end());
+    filename.push_back('\0');
+    StageTimer timer(kStageWriteToFile);
+    rerror = timer.Done(SSNSBFStream_writeToFile(stitched, filename.data()));
+    if (!IsOk(rerror))
+      return rerror;
+  }
+
+  if (reference) {
+    if (!IsOk(referror))
+      return referror;
+    rerror = Compare(stitched, reference->output, &result->validation);
+    if (!IsOk(rerror))
+      return rerror;
+    result->validated = true;
+  }
+
+  return rerror;
+}
+
+}
@@ -0,0 +1,74 @@
+#ifndef CALCULATE_SHARDED_PVT_H
+#define CALCULATE_SHARDED_PVT_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "ssnsbfstream.h"
+
+#include "engine_pool.h"
+#include "job_control.h"
+
+namespace calculate {
+
+struct ShardedPVTOptions {
+  unsigned shards = 0;                // 0: one per hardware thread
+  double warmup = 300.0;              // seconds of input fed before each shard
+  uint32_t engine_options = 0;        // ssn_ppengine_options_t flags
+  EngineProfilePtr profile;           // configuration of every engine
+  std::string output;                 // stitched result file, empty to skip
+  bool validate = false;              // also run the single-engine reference
+};
+
+struct PVTShard {
+  double start = 0;                   // GNSS seconds, output is [start, end)
+  double end = 0;
+  double seconds = 0;                 // wall clock of calculatePVT
+  ssn_error_t error = SSNERROR_WARNING_OK;
+};
+
+// Sharded output against the single-engine reference, matched on the
+// PVTGeodetic epochs. Position differences are 3D ECEF distances in metres
+// over the epochs that have a fix in both outputs.
+struct PVTValidation {
+  uint32_t sharded_epochs = 0;
+  uint32_t reference_epochs = 0;
+  uint32_t matched = 0;
+  uint32_t missing = 0;               // in the reference only
+  uint32_t extra = 0;                 // in the sharded output only
+  uint32_t mode_mismatches = 0;
+  double max_error = 0;
+  double rms_error = 0;
+  double reference_seconds = 0;
+};
+
+struct ShardedPVTResult {
+  std::vector<PVTShard> shards;
+  double seconds = 0;                 // wall clock of the sharded run
+  bool validated = false;
+  PVTValidation validation;
+};
+
+// Recomputes the PVT of `input` with one SSNPPEngine per time shard.
+//
+// The measurement interval is split into equal shards. Each shard gets its
+// own SDK and stream handles, an engine configured with `profile` from the
+// EnginePool, an input cropped with SSNSBFStream_cropTOW to
+// [start - warmup, end] so the filters converge before the shard starts,
+// and runs on its own thread. The warm-up output is trimmed again and the
+// shards are stitched in order with SSNSBFStream_appendStreamBlocks; the
+// engines of a run that succeeded go back to the pool. The caller must
+// hold the input stream's mutex for the whole call.
+//
+// `control` gets one progress part per engine and cancels every engine at
+// once.
+ssn_error_t RunShardedPVT(ssn_hsbfstream_t input,
+                          const ShardedPVTOptions& options,
+                          ShardedPVTResult* result,
+                          JobControl* control = nullptr);
+
+}
+
+#endif
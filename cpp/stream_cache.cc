@@ -0,0 +1,133 @@
+#include "stream_cache.h"
+
+#include <filesystem>
+#include <system_error>
+
+namespace calculate {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// "<canonical path>|<size>|<mtime>", or the raw path if the file cannot be
+// stat'ed (loadFile will then report the actual error)
+std::string CacheKey(const std::string& path) {
+  std::error_code ec;
+  fs::path canonical = fs::canonical(fs::u8path(path), ec);
+  if (ec)
+    return path;
+
+  uintmax_t size = fs::file_size(canonical, ec);
+  if (ec)
+    return path;
+
+  fs::file_time_type mtime = fs::last_write_time(canonical, ec);
+  if (ec)
+    return path;
+
+  return canonical.u8string() + "|" + std::to_string(size) + "|" +
+         std::to_string(mtime.time_since_epoch().count());
+}
+
+}
+
+StreamCache& StreamCache::Instance() {
+  static StreamCache cache;
+  return cache;
+}
+
+ssn_error_t StreamCache::Acquire(const std::string& path,
+                                 std::shared_ptr<SbfStream>* out,
+                                 JobControl* control) {
+  std::string key = CacheKey(path);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = index_.find(key);
+    if (found != index_.end()) {
+      lru_.splice(lru_.begin(), lru_, found->second);
+      ++hits_;
+      *out = found->second->stream;
+      return SSNERROR_WARNING_OK;
+    }
+    ++misses_;
+  }
+
+  std::shared_ptr<SbfStream> stream;
+  ssn_error_t rerror = SbfStream::Open(path, &stream, control);
+  if (!IsOk(rerror))
+    return rerror;
+
+  uint64_t size = 0;
+  {
+    uint32_t stream_size = 0;
+    std::lock_guard<std::mutex> stream_lock(stream->mutex());
+    rerror = SSNSBFStream_getSize(stream->handle(), &stream_size);
+    size = stream_size;
+  }
+  // an entry charged 0 bytes could never be evicted, so fall back to the
+  // size on disk and refuse to cache a stream we cannot size at all
+  if (!IsOk(rerror)) {
+    std::error_code ec;
+    uintmax_t file_size = fs::file_size(fs::u8path(path), ec);
+    if (ec)
+      return rerror;
+    size = file_size;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // another window loaded the same file meanwhile, keep the first copy
+  auto found = index_.find(key);
+  if (found != index_.end()) {
+    lru_.splice(lru_.begin(), lru_, found->second);
+    *out = found->second->stream;
+    return SSNERROR_WARNING_OK;
+  }
+
+  lru_.push_front(Entry{key, stream, size});
+  index_[key] = lru_.begin();
+  bytes_ += size;
+  EvictLocked();
+
+  *out = stream;
+  return SSNERROR_WARNING_OK;
+}
+
+void StreamCache::SetMaxBytes(uint64_t max_bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_bytes_ = max_bytes;
+  EvictLocked();
+}
+
+void StreamCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  evictions_ += lru_.size();
+  lru_.clear();
+  index_.clear();
+  bytes_ = 0;
+}
+
+StreamCache::Stats StreamCache::GetStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats;
+  stats.hits = hits_;
+  stats.misses = misses_;
+  stats.evictions = evictions_;
+  stats.entries = lru_.size();
+  stats.bytes = bytes_;
+  stats.max_bytes = max_bytes_;
+  return stats;
+}
+
+void StreamCache::EvictLocked() {
+  while (bytes_ > max_bytes_ && !lru_.empty()) {
+    Entry& victim = lru_.back();
+    bytes_ -= victim.bytes;
+    index_.erase(victim.key);
+    lru_.pop_back();
+    ++evictions_;
+  }
+}
+
+}
@@ -0,0 +1,73 @@
+#ifndef CALCULATE_STREAM_CACHE_H
+#define CALCULATE_STREAM_CACHE_H
+
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "sbf_stream.h"
+
+namespace calculate {
+
+// Process-wide LRU cache of loaded SBF streams.
+//
+// Entries are keyed by canonical path, file size and modification time, so a
+// file that changed on disk is loaded again instead of served stale. Each
+// entry is charged with the stream size reported by SSNSBFStream_getSize; when
+// the total exceeds the budget the least recently used entries are dropped.
+// A dropped stream is closed as soon as no session is using it anymore.
+class StreamCache {
+ public:
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t entries;
+    uint64_t bytes;
+    uint64_t max_bytes;
+  };
+
+  static StreamCache& Instance();
+
+  // Returns the cached stream for `path` or loads it. Safe to call from
+  // worker threads; the load itself runs without holding the cache lock.
+  // `control` only applies to a load; a cancelled load is not cached.
+  ssn_error_t Acquire(const std::string& path,
+                      std::shared_ptr<SbfStream>* out,
+                      JobControl* control = nullptr);
+
+  void SetMaxBytes(uint64_t max_bytes);
+  void Clear();
+  Stats GetStats();
+
+ private:
+  struct Entry {
+    std::string key;
+    std::shared_ptr<SbfStream> stream;
+    uint64_t bytes;
+  };
+
+  typedef std::list<Entry> EntryList;
+
+  StreamCache() = default;
+
+  // drops LRU entries until the budget fits; caller holds mutex_
+  void EvictLocked();
+
+  std::mutex mutex_;
+  EntryList lru_;  // most recently used first
+  std::unordered_map<std::string, EntryList::iterator> index_;
+  uint64_t bytes_ = 0;
+  uint64_t max_bytes_ = 1024ull * 1024 * 1024;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t evictions_ = 0;
+};
+
+}
+
+#endif
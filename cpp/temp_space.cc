@@ -0,0 +1,321 @@
+#include "temp_space.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include "sbf_stream.h"
+
+namespace calculate {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// SSNSDK_setTempDir takes at most 255 characters
+const size_t kMaxTempDir = 255;
+const auto kSampleInterval = std::chrono::milliseconds(50);
+// what the per-process roots live in, inside the configured directory too,
+// so the sweep never looks at anything it did not create
+const char kRootName[] = "calculate-ppsdk";
+// a dead owner's directory is kept that long, against a PID seen from
+// another PID namespace sharing the temp directory
+const auto kStaleAge = std::chrono::hours(24);
+
+const void* KeyOf(const ssn_hsdk_t& sdk) {
+  return sdk.handle_data;
+}
+
+unsigned ProcessId() {
+#ifdef _WIN32
+  return static_cast<unsigned>(_getpid());
+#else
+  return static_cast<unsigned>(getpid());
+#endif
+}
+
+// true when a process with `pid` runs, or may run; only a definite no lets
+// its directory go
+bool ProcessAlive(unsigned pid) {
+#ifdef _WIN32
+  HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+  if (process == NULL)
+    return GetLastError() != ERROR_INVALID_PARAMETER;
+  DWORD code = 0;
+  bool alive = !GetExitCodeProcess(process, &code) || code == STILL_ACTIVE;
+  CloseHandle(process);
+  return alive;
+#else
+  return kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+#endif
+}
+
+// the PID of a p<digits> directory name, false for any other name
+bool ParseRootName(const std::string& name, unsigned* pid) {
+  if (name.size() < 2 || name.size() > 11 || name[0] != 'p')
+    return false;
+  uint64_t value = 0;
+  for (size_t i = 1; i < name.size(); ++i) {
+    if (name[i] < '0' || name[i] > '9')
+      return false;
+    value = value * 10 + (name[i] - '0');
+  }
+  if (value == 0 || value > 0xFFFFFFFFull)
+    return false;
+  *pid = static_cast<unsigned>(value);
+  return true;
+}
+
+uint64_t DirectorySize(const std::string& directory) {
+  std::error_code ec;
+  uint64_t total = 0;
+  fs::recursive_directory_iterator it(
+      fs::u8path(directory), fs::directory_options::skip_permission_denied,
+      ec);
+  for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+    std::error_code size_ec;
+    if (it->is_regular_file(size_ec)) {
+      uintmax_t size = it->file_size(size_ec);
+      if (!size_ec)
+        total += size;
+    }
+  }
+  return total;
+}
+
+}
+
+TempSpace& TempSpace::Instance() {
+  static TempSpace space;
+  return space;
+}
+
+TempSpace::~TempSpace() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  if (sampler_.joinable())
+    sampler_.join();
+}
+
+void TempSpace::Configure(const TempSpaceSettings& settings) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (settings.directory != settings_.directory)
+    process_root_.clear();
+  settings_ = settings;
+  room_.notify_all();
+}
+
+TempSpace::Stats TempSpace::GetStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats;
+  stats.directory = process_root_;
+  stats.bytes = bytes_;
+  stats.peak_bytes = peak_bytes_;
+  stats.max_bytes = settings_.max_bytes;
+  stats.handles = directories_.size();
+  stats.fallbacks = fallbacks_;
+  stats.waits = waits_;
+  stats.swept = swept_;
+  return stats;
+}
+
+bool TempSpace::PrepareLocked(std::string* root) {
+  if (!process_root_.empty()) {
+    *root = process_root_;
+    return true;
+  }
+
+  std::error_code ec;
+  fs::path base = (settings_.directory.empty()
+      ? fs::temp_directory_path(ec)
+      : fs::u8path(settings_.directory)) / kRootName;
+  if (ec)
+    return false;
+  fs::path own = base / ("p" + std::to_string(ProcessId()));
+  fs::create_directories(own, ec);
+  if (ec)
+    return false;
+
+  process_root_ = own.u8string();
+  Sweep(base.u8string(), process_root_);
+  *root = process_root_;
+  return true;
+}
+
+void TempSpace::Sweep(const std::string& root, const std::string& own) {
+  std::error_code ec;
+  auto cutoff = fs::file_time_type::clock::now() - kStaleAge;
+  for (fs::directory_iterator it(fs::u8path(root), ec), end;
+       !ec && it != end; it.increment(ec)) {
+    unsigned pid;
+    if (!ParseRootName(it->path().filename().u8string(), &pid) ||
+        pid == ProcessId() || it->path().u8string() == own)
+      continue;
+    std::error_code entry_ec;
+    if (it->is_symlink(entry_ec) || !it->is_directory(entry_ec) ||
+        it->last_write_time(entry_ec) > cutoff || entry_ec ||
+        ProcessAlive(pid))
+      continue;
+    if (fs::remove_all(it->path(), entry_ec) != static_cast<uintmax_t>(-1))
+      ++swept_;
+  }
+}
+
+void TempSpace::Attach(ssn_hsdk_t sdk) {
+  std::string directory;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string root;
+    if (!PrepareLocked(&root)) {
+      ++fallbacks_;
+      return;
+    }
+    directory = (fs::u8path(root) / ("h" + std::to_string(++next_)))
+        .u8string();
+  }
+
+  std::error_code ec;
+  fs::create_directories(fs::u8path(directory), ec);
+  // the SDK appends its file names to the path as given
+  std::string path = directory;
+  path.push_back(static_cast<char>(fs::path::preferred_separator));
+  bool attached = !ec && path.size() <= kMaxTempDir;
+  if (attached) {
+    std::vector<char> tempdir(path.begin(), path.end());
+    tempdir.push_back('\0');
+    attached = IsOk(SSNSDK_setTempDir(sdk, tempdir.data()));
+  }
+  if (!attached)
+    fs::remove_all(fs::u8path(directory), ec);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (attached)
+    directories_[KeyOf(sdk)] = directory;
+  else
+    ++fallbacks_;
+}
+
+void TempSpace::Detach(ssn_hsdk_t sdk) {
+  std::string directory;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = directories_.find(KeyOf(sdk));
+    if (found == directories_.end())
+      return;
+    directory = found->second;
+    directories_.erase(found);
+  }
+  std::error_code ec;
+  fs::remove_all(fs::u8path(directory), ec);
+}
+
+TempSpace::Meter* TempSpace::Begin(std::initializer_list<ssn_hsdk_t> sdks) {
+  Meter* meter = new Meter();
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (const ssn_hsdk_t& sdk : sdks) {
+    auto found = directories_.find(KeyOf(sdk));
+    if (found != directories_.end())
+      meter->directories.push_back(found->second);
+  }
+
+  auto over = [this]() {
+    return settings_.max_bytes > 0 && bytes_ > settings_.max_bytes &&
+           !meters_.empty();
+  };
+  if (over()) {
+    ++waits_;
+    room_.wait(lock, [&]() { return !over(); });
+  }
+
+  meters_.push_back(meter);
+  if (!sampler_.joinable())
+    sampler_ = std::thread(&TempSpace::Run, this);
+  wake_.notify_all();
+  return meter;
+}
+
+uint64_t TempSpace::End(Meter* meter) {
+  // what a call shorter than the sample interval still holds at its end
+  uint64_t last = 0;
+  for (const std::string& directory : meter->directories)
+    last += DirectorySize(directory);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  meters_.erase(std::find(meters_.begin(), meters_.end(), meter));
+  if (meters_.empty())
+    bytes_ = 0;
+  room_.notify_all();
+  uint64_t peak = std::max(meter->peak, last);
+  delete meter;
+  return peak;
+}
+
+void TempSpace::Sample() {
+  std::vector<std::string> directories;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const Meter* meter : meters_)
+      directories.insert(directories.end(), meter->directories.begin(),
+                         meter->directories.end());
+  }
+  std::sort(directories.begin(), directories.end());
+  directories.erase(std::unique(directories.begin(), directories.end()),
+                    directories.end());
+
+  std::unordered_map<std::string, uint64_t> sizes;
+  uint64_t total = 0;
+  for (const std::string& directory : directories) {
+    uint64_t size = DirectorySize(directory);
+    sizes[directory] = size;
+    total += size;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (Meter* meter : meters_) {
+    uint64_t bytes = 0;
+    for (const std::string& directory : meter->directories) {
+      auto found = sizes.find(directory);
+      if (found != sizes.end())
+        bytes += found->second;
+    }
+    meter->peak = std::max(meter->peak, bytes);
+  }
+  bytes_ = meters_.empty() ? 0 : total;
+  peak_bytes_ = std::max(peak_bytes_, bytes_);
+  room_.notify_all();
+}
+
+void TempSpace::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    wake_.wait(lock, [this]() { return stop_ || !meters_.empty(); });
+    if (stop_)
+      break;
+    lock.unlock();
+    Sample();
+    lock.lock();
+    wake_.wait_for(lock, kSampleInterval, [this]() { return stop_; });
+  }
+}
+
+SpillMeter::SpillMeter(MetricStage stage,
+                       std::initializer_list<ssn_hsdk_t> sdks)
+    : stage_(stage), meter_(TempSpace::Instance().Begin(sdks)) {}
+
+SpillMeter::~SpillMeter() {
+  CountSpill(stage_, TempSpace::Instance().End(meter_));
+}
+
+}
@@ -0,0 +1,125 @@
+#ifndef CALCULATE_TEMP_SPACE_H
+#define CALCULATE_TEMP_SPACE_H
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ssnsdk.h"
+
+#include "metrics.h"
+
+namespace calculate {
+
+struct TempSpaceSettings {
+  // on a fast local disk, empty for the system temp directory; the
+  // directories go in its calculate-ppsdk subdirectory either way
+  std::string directory;
+  uint64_t max_bytes = 0;             // spill budget, 0 for none
+};
+
+// Process-wide PPSDK temp space.
+//
+// Left alone, the SDK puts its temp files in the working directory, which
+// in the packaged app is often slow or synced, and every job contends on
+// the same one. Here OpenSdk() hands every SDK handle a directory of its
+// own, <root>/calculate-ppsdk/p<pid>/h<n>, through SSNSDK_setTempDir;
+// handle sets are used by one thread at a time, so that is one directory
+// per worker. CloseSdk() removes it again with whatever a failed or
+// cancelled call left behind. The p<digits> directories of processes that
+// no longer run are swept once they are a day old; nothing else under the
+// root is ever touched.
+//
+// Spill is only watched while a SpillMeter runs: a sampler thread sizes
+// the metered directories, the peak goes to the stage's metrics, and a
+// budget holds off new metered calls while the space is over it.
+class TempSpace {
+ public:
+  struct Stats {
+    std::string directory;            // root in use
+    uint64_t bytes;                   // last sampled, metered handles only
+    uint64_t peak_bytes;
+    uint64_t max_bytes;
+    uint64_t handles;                 // with a directory of their own
+    uint64_t fallbacks;               // left on the SDK default
+    uint64_t waits;                   // metered calls held off by the budget
+    uint64_t swept;                   // stale directories removed
+  };
+
+  static TempSpace& Instance();
+
+  // Applies to handles opened from now on
+  void Configure(const TempSpaceSettings& settings);
+  Stats GetStats();
+
+  // OpenSdk() / CloseSdk() only, under the SDK lifecycle lock
+  void Attach(ssn_hsdk_t sdk);
+  void Detach(ssn_hsdk_t sdk);
+
+ private:
+  friend class SpillMeter;
+
+  struct Meter {
+    std::vector<std::string> directories;
+    uint64_t peak = 0;
+  };
+
+  TempSpace() = default;
+  ~TempSpace();
+
+  // root of this process, created on first use; mutex_ held
+  bool PrepareLocked(std::string* root);
+  void Sweep(const std::string& root, const std::string& own);
+  void Sample();
+  void Run();
+
+  Meter* Begin(std::initializer_list<ssn_hsdk_t> sdks);
+  uint64_t End(Meter* meter);
+
+  std::mutex mutex_;
+  std::condition_variable wake_;      // the sampler
+  std::condition_variable room_;      // metered calls over the budget
+  TempSpaceSettings settings_;
+  std::string process_root_;          // <root>/p<pid>, once prepared
+  std::unordered_map<const void*, std::string> directories_;
+  std::vector<Meter*> meters_;
+  std::thread sampler_;
+  bool stop_ = false;
+  uint64_t next_ = 0;
+  uint64_t bytes_ = 0;
+  uint64_t peak_bytes_ = 0;
+  uint64_t fallbacks_ = 0;
+  uint64_t waits_ = 0;
+  uint64_t swept_ = 0;
+};
+
+// Watches the temp directories of `sdks` for the duration of one SDK call
+// and records the peak as spill of `stage`:
+//
+//   SpillMeter spill(kStageMerge, { work->sdk });
+//   rerror = SSNSBFStream_insertReferenceStream(...);
+//
+// With a budget set, the constructor waits while the temp space is over
+// it and other metered calls run, which are the ones that can free it.
+class SpillMeter {
+ public:
+  SpillMeter(MetricStage stage, std::initializer_list<ssn_hsdk_t> sdks);
+  ~SpillMeter();
+
+  SpillMeter(const SpillMeter&) = delete;
+  void operator=(const SpillMeter&) = delete;
+
+ private:
+  MetricStage stage_;
+  TempSpace::Meter* meter_;
+};
+
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include "tracked_timeline.h"
+
+#include <math.h>
+
+#include "metrics.h"
+#include "sbf_stream.h"
+#include "scratch_arena.h"
+
+namespace calculate {
+
+uint64_t PackSignals(const ssn_tracked_satellites_t& satellite) {
+  uint64_t mask = 0;
+  for (int sig = 0; sig < SIG_LAST; ++sig) {
+    if (satellite.signaltype[sig])
+      mask |= uint64_t(1) << sig;
+  }
+  return mask;
+}
+
+size_t TimelineEpochCount(double start, double end, double step) {
+  if (!(step > 0.0) || !(end >= start))
+    return 0;
+  return static_cast<size_t>(floor((end - start) / step + 1e-9)) + 1;
+}
+
+namespace {
+
+// What the list functions return for an epoch without the blocks they read
+// (a data gap, no MeasEpoch or PVTResiduals at that time), which is an
+// empty epoch rather than a failed timeline
+bool IsEmptyEpoch(ssn_error_t error) {
+  switch (SSNERROR_GETCODE(error)) {
+    case SSNERROR_ERROR_BLOCKNOTFOUND:
+    case SSNERROR_ERROR_NOTPRESENT:
+    case SSNERROR_WARNING_TIMEOUTOFRANGE:
+    case SSNERROR_WARNING_ENDOFSTREAM:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Calls the double-call SDK function `list` once per epoch into a scratch
+// buffer from the thread's arena, kept across epochs, and hands each
+// epoch's entries to `emit`. Epochs the SDK finds nothing for are kept
+// empty; returns the first other SDK error.
+template <typename T, typename List, typename Emit>
+ssn_error_t ForEachEpoch(ssn_hsbfstream_t sbfstream, double start, double end,
+                         double step, std::vector<double>* epochs,
+                         std::vector<uint32_t>* offsets, List list,
+                         Emit emit) {
+  ssn_error_t rerror = SSNERROR_WARNING_OK;
+  size_t count = TimelineEpochCount(start, end, step);
+  uint32_t rows = 0;
+
+  // 64 entries covers every satellite a receiver tracks in one epoch
+  ScratchScope scope;
+  size_t capacity = 64;
+  T* scratch = scope.arena().AllocateArray<T>(capacity);
+
+  epochs->clear();
+  epochs->reserve(count);
+  offsets->assign(1, 0);
+  offsets->reserve(count + 1);
+
+  for (size_t i = 0; i < count; ++i) {
+    // index * step instead of accumulating, so long ranges do not drift
+    double gnsstime = start + static_cast<double>(i) * step;
+    size_t listSize = capacity * sizeof(T);
+
+    rerror = list(sbfstream, gnsstime, &listSize, scratch);
+
+    if (SSNERROR_GETCODE(rerror) == SSNERROR_ERROR_BUFTOOSMALL) {
+      // fall back to the double-call and keep the larger buffer around
+      rerror = list(sbfstream, gnsstime, &listSize, NULL);
+      if (IsOk(rerror)) {
+        capacity = listSize / sizeof(T) + 1;
+        scratch = scope.arena().AllocateArray<T>(capacity);
+        listSize = capacity * sizeof(T);
+        rerror = list(sbfstream, gnsstime, &listSize, scratch);
+      }
+    }
+
+    if (IsEmptyEpoch(rerror)) {
+      listSize = 0;
+      rerror = SSNERROR_WARNING_OK;
+    } else if (!IsOk(rerror)) {
+      return rerror;
+    }
+
+    for (size_t n = 0; n < listSize && n < capacity; ++n) {
+      emit(scratch[n]);
+      ++rows;
+    }
+
+    epochs->push_back(gnsstime);
+    offsets->push_back(rows);
+  }
+
+  return rerror;
+}
+
+}
+
+ssn_error_t CollectTrackedTimeline(ssn_hsbfstream_t sbfstream,
+                                   double start, double end, double step,
+                                   TrackedTimeline* out) {
+  out->svid.clear();
+  out->freqnr.clear();
+  out->signals.clear();
+
+  // one SDK call per epoch; timed as a whole so the trace stays readable
+  StageTimer timer(kStageAnalyze, "listTrackedSatellites timeline");
+  return timer.Done(ForEachEpoch<ssn_tracked_satellites_t>(
+      sbfstream, start, end, step, &out->epochs, &out->offsets,
+      SSNSBFAnalyze_listTrackedSatellites,
+      [out](const ssn_tracked_satellites_t& satellite) {
+        out->svid.push_back(satellite.svid);
+        out->freqnr.push_back(satellite.freqnr);
+        out->signals.push_back(PackSignals(satellite));
+      }));
+}
+
+ssn_error_t CollectUsedTimeline(ssn_hsbfstream_t sbfstream,
+                                double start, double end, double step,
+                                UsedTimeline* out) {
+  out->satellites.clear();
+
+  StageTimer timer(kStageAnalyze, "listUsedSatellites timeline");
+  return timer.Done(ForEachEpoch<ssn_pvt_satusage_t>(
+      sbfstream, start, end, step, &out->epochs, &out->offsets,
+      SSNSBFAnalyze_listUsedSatellites,
+      [out](const ssn_pvt_satusage_t& satellite) {
+        out->satellites.push_back(satellite);
+      }));
+}
+
+}
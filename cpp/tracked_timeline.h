@@ -0,0 +1,61 @@
+#ifndef CALCULATE_TRACKED_TIMELINE_H
+#define CALCULATE_TRACKED_TIMELINE_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "ssnsbfanalyze.h"
+
+namespace calculate {
+
+// Tracked satellites for a range of epochs in columnar (CSR) form.
+//
+// Epoch i owns rows [offsets[i], offsets[i + 1]) of the per-satellite
+// columns. Bit n of signals[row] is set when SignalType_t n was tracked.
+struct TrackedTimeline {
+  std::vector<double>   epochs;
+  std::vector<uint32_t> offsets;
+  std::vector<uint8_t>  svid;
+  std::vector<uint8_t>  freqnr;
+  std::vector<uint64_t> signals;
+};
+
+// Used satellites (SSNSBFAnalyze_listUsedSatellites) for a range of epochs,
+// with the same CSR layout as TrackedTimeline
+struct UsedTimeline {
+  std::vector<double>             epochs;
+  std::vector<uint32_t>           offsets;
+  std::vector<ssn_pvt_satusage_t> satellites;
+};
+
+// upper bound on epochs per query, 24 h at 10 Hz
+const size_t kMaxTimelineEpochs = 864000;
+
+// Packs the per-signal bool array of the SDK into a bitmask
+uint64_t PackSignals(const ssn_tracked_satellites_t& satellite);
+
+// Number of epochs CollectTrackedTimeline() visits for the given range, or 0
+// when the range is empty or the step is not positive
+size_t TimelineEpochCount(double start, double end, double step);
+
+// Lists the tracked satellites at start, start + step, ... up to end.
+//
+// One scratch buffer is reused for every epoch and only grown when the SDK
+// reports it too small, so the steady state is a single
+// SSNSBFAnalyze_listTrackedSatellites call per epoch instead of the
+// size-then-fill double call. An epoch with nothing to list, in a data
+// gap say, has no rows. The caller must hold the stream's mutex.
+ssn_error_t CollectTrackedTimeline(ssn_hsbfstream_t sbfstream,
+                                   double start, double end, double step,
+                                   TrackedTimeline* out);
+
+// Same as CollectTrackedTimeline() for the satellites used in the PVT.
+// Requires PVTResiduals blocks in the stream.
+ssn_error_t CollectUsedTimeline(ssn_hsbfstream_t sbfstream,
+                                double start, double end, double step,
+                                UsedTimeline* out);
+
+}
+
+#endif
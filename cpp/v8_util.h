@@ -0,0 +1,26 @@
+#ifndef CALCULATE_V8_UTIL_H
+#define CALCULATE_V8_UTIL_H
+
+#include <node.h>
+
+namespace calculate {
+
+// Helpers for building result objects, shared by the addon's bindings
+
+inline v8::Local<v8::String> Key(v8::Isolate* isolate, const char* key) {
+  return v8::String::NewFromUtf8(isolate, key).ToLocalChecked();
+}
+
+inline void Set(v8::Isolate* isolate, v8::Local<v8::Object> target,
+                const char* key, v8::Local<v8::Value> value) {
+  target->Set(isolate->GetCurrentContext(), Key(isolate, key), value).Check();
+}
+
+inline void SetNumber(v8::Isolate* isolate, v8::Local<v8::Object> target,
+                      const char* key, double value) {
+  Set(isolate, target, key, v8::Number::New(isolate, value));
+}
+
+}
+
+#endif
@@ -1,2 +1,3 @@
 const addon = require('./build/Release/addon')
 console.log(addon.executeSync())
+addon.executeAsync().then((status) => console.log(status))
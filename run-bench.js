@@ -0,0 +1,107 @@
+// Runs build/Release/sbf_bench over a corpus of SBF files and writes one JSON
+// report. Each file gets its own process so the peak RSS is per file.
+//
+//   node run-bench.js [files or directories...] [--iterations N] [--warmup N]
+//                     [--no-pvt] [--out report.json]
+//                     [--baseline old.json] [--threshold 0.1]
+//
+// With --baseline, a stage whose p50 got slower by more than the threshold
+// (fraction, default 10%) is listed under "regressions" and the exit code is 1.
+
+const { execFileSync } = require('child_process')
+const fs = require('fs')
+const os = require('os')
+const path = require('path')
+
+const binary = path.join(
+  __dirname,
+  'build',
+  'Release',
+  process.platform === 'win32' ? 'sbf_bench.exe' : 'sbf_bench'
+)
+
+function parseArgs(argv) {
+  const args = { inputs: [], passthrough: [], threshold: 0.1 }
+  for (let i = 0; i < argv.length; i++) {
+    const arg = argv[i]
+    if (arg === '--iterations' || arg === '--warmup') args.passthrough.push(arg, argv[++i])
+    else if (arg === '--no-pvt') args.passthrough.push(arg)
+    else if (arg === '--out') args.out = argv[++i]
+    else if (arg === '--baseline') args.baseline = argv[++i]
+    else if (arg === '--threshold') args.threshold = Number(argv[++i])
+    else args.inputs.push(arg)
+  }
+  if (args.inputs.length === 0) args.inputs.push(path.join(__dirname, 'input_file.sbf'))
+  return args
+}
+
+// expands directories to the .sbf files they contain, smallest first
+function collectCorpus(inputs) {
+  const files = []
+  for (const input of inputs) {
+    if (fs.statSync(input).isDirectory()) {
+      for (const name of fs.readdirSync(input)) {
+        if (name.toLowerCase().endsWith('.sbf')) files.push(path.join(input, name))
+      }
+    } else {
+      files.push(input)
+    }
+  }
+  return files
+    .map((file) => ({ file, bytes: fs.statSync(file).size }))
+    .sort((a, b) => a.bytes - b.bytes)
+}
+
+function compare(report, baseline, threshold) {
+  const regressions = []
+  const previous = new Map(baseline.results.map((result) => [path.basename(result.file), result]))
+
+  for (const result of report.results) {
+    const old = previous.get(path.basename(result.file))
+    if (!old) continue
+    for (const [stage, timing] of Object.entries(result.stages)) {
+      const before = old.stages[stage]
+      if (!before || before.p50Ms <= 0) continue
+      const change = timing.p50Ms / before.p50Ms - 1
+      if (change > threshold) {
+        regressions.push({
+          file: path.basename(result.file),
+          stage,
+          baselineP50Ms: before.p50Ms,
+          p50Ms: timing.p50Ms,
+          change: Number(change.toFixed(3))
+        })
+      }
+    }
+  }
+  return regressions
+}
+
+function main() {
+  const args = parseArgs(process.argv.slice(2))
+  const report = {
+    date: new Date().toISOString(),
+    platform: `${process.platform}-${process.arch}`,
+    cpu: os.cpus()[0] ? os.cpus()[0].model : 'unknown',
+    results: []
+  }
+
+  for (const { file, bytes } of collectCorpus(args.inputs)) {
+    const output = execFileSync(binary, [file, ...args.passthrough], { encoding: 'utf8' })
+    report.results.push({ bytes, ...JSON.parse(output) })
+    console.error(`${path.basename(file)}: done`)
+  }
+
+  if (args.baseline) {
+    const baseline = JSON.parse(fs.readFileSync(args.baseline, 'utf8'))
+    report.regressions = compare(report, baseline, args.threshold)
+  }
+
+  const json = JSON.stringify(report, null, 2)
+  if (args.out) fs.writeFileSync(args.out, json + '\n')
+  else console.log(json)
+
+  if (report.regressions && report.regressions.length > 0) process.exitCode = 1
+}
+
+main()
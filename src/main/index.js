@@ -74,7 +74,328 @@ console.log('cwd', process.cwd(), __dirname)
 
 const addon = require(join(process.cwd(), 'build/Release/addon'))
 
-ipcMain.on('calculate', (event) => {
+// Electron hands the renderer nothing but error.message, so every handler
+// resolves { ok: true, value } or { ok: false, error } carrying the fields of
+// the addon's structured SDK errors (cpp/async_job.h) for the preload to
+// reject with.
+const errorFields = [
+  'code',
+  'error',
+  'severity',
+  'module',
+  'stage',
+  'call',
+  'kind',
+  'retryable',
+  'warnings'
+]
+
+function serializeError(error) {
+  const out = { message: error instanceof Error ? error.message : String(error) }
+  if (error !== null && typeof error === 'object') {
+    for (const field of errorFields) if (error[field] !== undefined) out[field] = error[field]
+  }
+  return out
+}
+
+function handle(channel, listener) {
+  ipcMain.handle(channel, async (...args) => {
+    try {
+      return { ok: true, value: await listener(...args) }
+    } catch (error) {
+      return { ok: false, error: serializeError(error) }
+    }
+  })
+}
+
+// The analysis runs on a libuv worker thread, so the main process (and every
+// window) keeps rendering while the SBF file is processed.
+handle('calculate', () => {
   console.log(process.cwd())
-  event.returnValue = addon.executeSync()
+  return addon.executeAsync()
+})
+
+// Long-running jobs a renderer can follow and cancel, keyed by an id the
+// renderer picks. The addon throttles progress to ~10 Hz.
+const jobs = new Map()
+
+async function runJob(event, jobId, start) {
+  if (jobId === undefined) return start({})
+  const controller = new AbortController()
+  jobs.set(jobId, controller)
+  try {
+    return await start({
+      signal: controller.signal,
+      onProgress: (percent) => event.sender.send('job:progress', jobId, percent)
+    })
+  } finally {
+    jobs.delete(jobId)
+  }
+}
+
+handle('job:cancel', (_, jobId) => {
+  const controller = jobs.get(jobId)
+  if (controller) controller.abort()
+})
+
+// Batch analysis over many files on a native thread pool. Per-file results
+// are pushed to the calling window as they complete.
+handle('analyzeMany', (event, paths, ops, options = {}, jobId) =>
+  runJob(event, jobId, ({ signal }) =>
+    addon.analyzeMany(paths, ops, {
+      ...options,
+      signal,
+      onResult: (result) => event.sender.send('analyzeMany:result', result)
+    })
+  )
+)
+
+// Block counts, CRC health and epoch gaps from a memory mapping of the file,
+// without loading it into the SDK
+handle('scanFile', (event, path, options = {}, jobId) =>
+  runJob(event, jobId, (control) => addon.scanFile(path, { ...options, ...control }))
+)
+
+// Epochs of several files aligned in one pass, e.g. rover against base:
+// common epoch count and the epochs each file misses
+handle('alignEpochs', (event, paths, options = {}, jobId) =>
+  runJob(event, jobId, async ({ signal, onProgress }) => {
+    const alignment = new addon.EpochAlignment(paths, options)
+    while ((await alignment.next()) > 0) {
+      if (signal && signal.aborted) throw new Error('Job was cancelled')
+      if (onProgress) onProgress(alignment.summary().progress)
+    }
+    return alignment.summary()
+  })
+)
+
+// PVTGeodetic / MeasEpoch of an SBF file as Arrow IPC files for analytics
+handle('exportColumnar', (event, path, options = {}, jobId) =>
+  runJob(event, jobId, (control) => addon.exportColumnar(path, { ...options, ...control }))
+)
+
+// MeasEpoch signals of an SBF file as typed arrays per signal, SIMD decoded
+handle('decodeMeasEpoch', (event, path, options = {}, jobId) =>
+  runJob(event, jobId, (control) => addon.decodeMeasEpoch(path, { ...options, ...control }))
+)
+
+// Crop / constellation / block / decimation filters of an SBF file in one pass
+handle('filterSbf', (event, path, options = {}, jobId) =>
+  runJob(event, jobId, (control) => addon.filterSbf(path, { ...options, ...control }))
+)
+
+// RINEX observation / navigation sets to one SBF file on a pool of decoders
+handle('convertRinex', (event, sets, options = {}, jobId) =>
+  runJob(event, jobId, (control) => addon.convertRinex(sets, { ...options, ...control }))
+)
+
+// Reference stations and data through the addon's BaseFinder cache, which
+// keeps station lists, reference SBF and the downloaded RINEX under
+// userData so reprocessing a site stays off the network
+addon.configureBaseFinder({ directory: join(app.getPath('userData'), 'basefinder') })
+
+handle('base:configure', (_, settings) =>
+  addon.configureBaseFinder({
+    directory: join(app.getPath('userData'), 'basefinder'),
+    ...settings
+  })
+)
+
+handle('base:stations', (event, query, jobId) =>
+  runJob(event, jobId, (control) => addon.findBaseStations(query, control))
+)
+
+handle('base:reference', (event, query, options = {}, jobId) =>
+  runJob(event, jobId, (control) => addon.createBaseReference(query, { ...options, ...control }))
+)
+
+handle('base:prefetch', (_, query, days) => addon.prefetchBaseReference(query, days))
+
+handle('base:cacheStats', () => addon.getBaseFinderCacheStats())
+
+handle('base:clearCache', () => addon.clearBaseFinderCache())
+
+// Differential PVT over many rover files, with base-data download, merge,
+// PVT and write of consecutive files overlapped
+handle('processDifferential', (event, rovers, options = {}, jobId) =>
+  runJob(event, jobId, (control) => addon.processDifferential(rovers, { ...options, ...control }))
+)
+
+// Engine profiles are compiled once and named in the `profile` option of
+// processDifferential and session:pvtSharded; configured engines are pooled
+handle('engine:registerProfile', (_, name, profile) => addon.registerEngineProfile(name, profile))
+handle('engine:configurePool', (_, options) => addon.configureEnginePool(options))
+handle('engine:clearPool', () => addon.clearEnginePool())
+handle('engine:poolStats', () => addon.getEnginePoolStats())
+
+// Loaded SBF files, kept open so follow-up queries skip the SDK init and the
+// full file parse. Renderers refer to them by id.
+const sessions = new Map()
+let nextSessionId = 1
+
+const sessionQueries = [
+  'getPVTErrorPercentages',
+  'getPVTModePercentages',
+  'getPVTStats',
+  'listTrackedSatellites',
+  'isSatelliteUsed',
+  'findBlock'
+]
+
+handle('session:open', async (event, path, jobId) => {
+  const session = new addon.SbfSession()
+  await runJob(event, jobId, (control) => session.load(path, control))
+  const id = nextSessionId++
+  sessions.set(id, session)
+  return id
+})
+
+handle('session:query', (_, id, query, ...args) => {
+  const session = sessions.get(id)
+  if (!session) throw new Error(`Unknown session ${id}`)
+  if (!sessionQueries.includes(query)) throw new Error(`Unknown query ${query}`)
+  return session[query](...args)
+})
+
+handle('session:timeline', (_, id, towStart, towEnd, step) => {
+  const session = sessions.get(id)
+  if (!session) throw new Error(`Unknown session ${id}`)
+  return addon.trackedSatellitesTimeline(session, towStart, towEnd, step)
+})
+
+handle('session:packed', (_, id, options) => {
+  const session = sessions.get(id)
+  if (!session) throw new Error(`Unknown session ${id}`)
+  return addon.analyzePacked(session, options)
+})
+
+handle('session:pvtSharded', (event, id, options, jobId) => {
+  const session = sessions.get(id)
+  if (!session) throw new Error(`Unknown session ${id}`)
+  return runJob(event, jobId, (control) =>
+    addon.calculatePVTSharded(session, { ...options, ...control })
+  )
+})
+
+// Builds (or maps) the <file>.sbfidx block index; findBlock queries seek
+// through it afterwards
+handle('session:buildIndex', (event, id, jobId) => {
+  const session = sessions.get(id)
+  if (!session) throw new Error(`Unknown session ${id}`)
+  return runJob(event, jobId, (control) => session.buildIndex(control))
+})
+
+// Builds (or maps) the <file>.sbflod LOD pyramid that session:series reads
+handle('session:buildSeries', (event, id, jobId) => {
+  const session = sessions.get(id)
+  if (!session) throw new Error(`Unknown session ${id}`)
+  return runJob(event, jobId, (control) => session.buildSeries(control))
+})
+
+handle('session:series', (_, id, field, start, end, pixelWidth) => {
+  const session = sessions.get(id)
+  if (!session) throw new Error(`Unknown session ${id}`)
+  return session.getSeries(field, start, end, pixelWidth)
+})
+
+handle('session:cacheStats', () => addon.getStreamCacheStats())
+handle('scratchStats', () => addon.getScratchStats())
+
+// PPSDK temp files go to one directory per SDK handle under `directory`
+// (default: the system temp dir), with `maxBytes` of spill across jobs
+handle('temp:configure', (_, options) => addon.configureTempSpace(options))
+handle('temp:stats', () => addon.getTempSpaceStats())
+
+// Per-stage SDK timings and counters; the Chrome trace goes to userData,
+// for chrome://tracing or the DevTools Performance panel
+handle('metrics', () => addon.getMetrics())
+handle('metrics:tracing', (_, enabled) => addon.setTracing(!!enabled))
+handle('metrics:writeTrace', async () => {
+  const path = join(app.getPath('userData'), `trace-${Date.now()}.json`)
+  const events = await addon.writeTrace(path)
+  return { path, events }
+})
+
+handle('session:close', (_, id) => {
+  for (const [replayId, replay] of replays) {
+    if (replay.sessionId !== id) continue
+    replay.replay.stop()
+    replays.delete(replayId)
+  }
+  const receiver = receivers.get(id)
+  if (receiver) receiver.stop()
+  receivers.delete(id)
+  const session = sessions.get(id)
+  if (session) session.close()
+  sessions.delete(id)
+})
+
+// Live receivers by session id. The receiver's session grows as blocks
+// arrive and takes every session:* query; stats are pushed to the window
+// that started it.
+const receivers = new Map()
+
+handle('live:start', (event, source, options = {}) => {
+  const id = nextSessionId++
+  const receiver = new addon.LiveReceiver(source, {
+    ...options,
+    onUpdate: (stats) => {
+      if (!event.sender.isDestroyed()) event.sender.send('live:update', id, stats)
+    }
+  })
+  receivers.set(id, receiver)
+  sessions.set(id, receiver.session)
+  return id
+})
+
+handle('live:stats', (_, id) => {
+  const receiver = receivers.get(id)
+  if (!receiver) throw new Error(`Unknown live session ${id}`)
+  return receiver.stats()
+})
+
+// Closes the connection; the session keeps the data received so far until
+// session:close
+handle('live:stop', (_, id) => {
+  const receiver = receivers.get(id)
+  if (receiver) receiver.stop()
+  receivers.delete(id)
+})
+
+// Timed replays of open sessions on a native thread. Frames of raw blocks
+// and replay stats are pushed to the window that started the replay at the
+// frame rate; closing the session stops its replays.
+const replays = new Map()
+let nextReplayId = 1
+
+handle('replay:start', (event, sessionId, options = {}) => {
+  const session = sessions.get(sessionId)
+  if (!session) throw new Error(`Unknown session ${sessionId}`)
+  const id = nextReplayId++
+  const replay = new addon.SbfReplay(session, {
+    ...options,
+    onFrame: (frame) => {
+      if (!event.sender.isDestroyed()) event.sender.send('replay:frame', id, frame)
+    }
+  })
+  replays.set(id, { sessionId, replay })
+  return id
+})
+
+handle('replay:control', (_, id, action, value) => {
+  const entry = replays.get(id)
+  if (!entry) throw new Error(`Unknown replay ${id}`)
+  const { replay } = entry
+  if (action === 'play') replay.play()
+  else if (action === 'pause') replay.pause()
+  else if (action === 'seek') replay.seek(value)
+  else if (action === 'speed') replay.setSpeed(value)
+  else throw new Error(`Unknown replay action ${action}`)
+  return replay.stats()
+})
+
+handle('replay:stop', (_, id) => {
+  const entry = replays.get(id)
+  if (entry) entry.replay.stop()
+  replays.delete(id)
 })
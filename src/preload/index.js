@@ -1,10 +1,83 @@
 import { contextBridge, ipcRenderer } from 'electron'
 import { electronAPI } from '@electron-toolkit/preload'
 
+// The main process resolves every call as { ok, value } or { ok, error } so
+// the structured SDK error fields (code, kind, retryable, stage, call,
+// warnings) survive IPC. A failure rejects with that plain `error` object:
+// the context bridge would strip them again from an Error.
+async function invoke(channel, ...args) {
+  const reply = await ipcRenderer.invoke(channel, ...args)
+  if (reply.ok) return reply.value
+  throw reply.error
+}
+
 // Custom APIs for renderer
 const api = {
   hello: () => 'hello world',
-  calculate: () => ipcRenderer.sendSync('calculate')
+  calculate: () => invoke('calculate'),
+  analyzeMany: (paths, ops, options, jobId) => invoke('analyzeMany', paths, ops, options, jobId),
+  onAnalyzeManyResult: (callback) => {
+    const listener = (_, result) => callback(result)
+    ipcRenderer.on('analyzeMany:result', listener)
+    return () => ipcRenderer.removeListener('analyzeMany:result', listener)
+  },
+  scanFile: (path, options, jobId) => invoke('scanFile', path, options, jobId),
+  alignEpochs: (paths, options, jobId) => invoke('alignEpochs', paths, options, jobId),
+  exportColumnar: (path, options, jobId) => invoke('exportColumnar', path, options, jobId),
+  decodeMeasEpoch: (path, options, jobId) => invoke('decodeMeasEpoch', path, options, jobId),
+  filterSbf: (path, options, jobId) => invoke('filterSbf', path, options, jobId),
+  convertRinex: (sets, options, jobId) => invoke('convertRinex', sets, options, jobId),
+  configureBaseFinder: (settings) => invoke('base:configure', settings),
+  findBaseStations: (query, jobId) => invoke('base:stations', query, jobId),
+  createBaseReference: (query, options, jobId) => invoke('base:reference', query, options, jobId),
+  prefetchBaseReference: (query, days) => invoke('base:prefetch', query, days),
+  baseFinderCacheStats: () => invoke('base:cacheStats'),
+  clearBaseFinderCache: () => invoke('base:clearCache'),
+  processDifferential: (rovers, options, jobId) =>
+    invoke('processDifferential', rovers, options, jobId),
+  registerEngineProfile: (name, profile) => invoke('engine:registerProfile', name, profile),
+  configureEnginePool: (options) => invoke('engine:configurePool', options),
+  clearEnginePool: () => invoke('engine:clearPool'),
+  enginePoolStats: () => invoke('engine:poolStats'),
+  openSession: (path, jobId) => invoke('session:open', path, jobId),
+  querySession: (id, query, ...args) => invoke('session:query', id, query, ...args),
+  trackedSatellitesTimeline: (id, towStart, towEnd, step) =>
+    invoke('session:timeline', id, towStart, towEnd, step),
+  analyzePacked: (id, options) => invoke('session:packed', id, options),
+  buildIndex: (id, jobId) => invoke('session:buildIndex', id, jobId),
+  buildSeries: (id, jobId) => invoke('session:buildSeries', id, jobId),
+  getSeries: (id, field, start, end, pixelWidth) =>
+    invoke('session:series', id, field, start, end, pixelWidth),
+  calculatePVTSharded: (id, options, jobId) => invoke('session:pvtSharded', id, options, jobId),
+  scratchStats: () => invoke('scratchStats'),
+  configureTempSpace: (options) => invoke('temp:configure', options),
+  tempSpaceStats: () => invoke('temp:stats'),
+  getMetrics: () => invoke('metrics'),
+  setTracing: (enabled) => invoke('metrics:tracing', enabled),
+  writeTrace: () => invoke('metrics:writeTrace'),
+  onJobProgress: (callback) => {
+    const listener = (_, jobId, percent) => callback(jobId, percent)
+    ipcRenderer.on('job:progress', listener)
+    return () => ipcRenderer.removeListener('job:progress', listener)
+  },
+  cancelJob: (jobId) => invoke('job:cancel', jobId),
+  startLive: (source, options) => invoke('live:start', source, options),
+  liveStats: (id) => invoke('live:stats', id),
+  onLiveUpdate: (callback) => {
+    const listener = (_, id, stats) => callback(id, stats)
+    ipcRenderer.on('live:update', listener)
+    return () => ipcRenderer.removeListener('live:update', listener)
+  },
+  stopLive: (id) => invoke('live:stop', id),
+  startReplay: (sessionId, options) => invoke('replay:start', sessionId, options),
+  controlReplay: (id, action, value) => invoke('replay:control', id, action, value),
+  onReplayFrame: (callback) => {
+    const listener = (_, id, frame) => callback(id, frame)
+    ipcRenderer.on('replay:frame', listener)
+    return () => ipcRenderer.removeListener('replay:frame', listener)
+  },
+  stopReplay: (id) => invoke('replay:stop', id),
+  closeSession: (id) => invoke('session:close', id)
 }
 
 // Use `contextBridge` APIs to expose Electron APIs to
@@ -42,9 +42,9 @@ function App() {
         </div>
       </div>
       <button
-        onClick={() => {
+        onClick={async () => {
           console.log(window.api.hello())
-          console.log(window.api.calculate())
+          console.log(await window.api.calculate())
         }}
       >
         Calculate
@@ -0,0 +1,130 @@
+// Reader for the packed analysis buffers produced by addon.analyzePacked().
+// The layout is documented in cpp/packed_result.h; every section is exposed
+// as TypedArray views over the original buffer, nothing is copied.
+
+const MAGIC = 0x52464253 // "SBFR"
+
+export const SECTION = {
+  PVT_ERROR: 1,
+  PVT_MODE: 2,
+  TRACKED_EPOCHS: 3,
+  TRACKED_SATELLITES: 4,
+  USED_EPOCHS: 5,
+  USED_SATELLITES: 6
+}
+
+const PVT_ERROR_FIELDS = [
+  'ne',
+  'nem',
+  'neea',
+  'dtl',
+  'ssrtl',
+  'nc',
+  'nemaor',
+  'popdtel',
+  'nedca',
+  'bscu',
+  'total'
+]
+
+const PVT_MODE_FIELDS = [
+  'npa',
+  'sp',
+  'dp',
+  'fl',
+  'rfia',
+  'rfla',
+  'sap',
+  'mrfia',
+  'mrfla',
+  'pppfia',
+  'pppfla'
+]
+
+function readPercentages(buffer, section, fields) {
+  const floats = new Float32Array(buffer, section.offset, fields.length)
+  const counters = new Uint32Array(buffer, section.offset + fields.length * 4, 2)
+  const out = {}
+  fields.forEach((field, i) => (out[field] = floats[i]))
+  out.checktotal = counters[0]
+  if (section.recordSize > (fields.length + 1) * 4) out.checkerror = counters[1]
+  return out
+}
+
+// { gnsstime: Float64Array, first: Uint32Array, count: Uint32Array } views,
+// strided over the 16-byte PackedEpoch records
+function readEpochs(buffer, section) {
+  const f64 = new Float64Array(buffer, section.offset, section.count * 2)
+  const u32 = new Uint32Array(buffer, section.offset, section.count * 4)
+  return {
+    length: section.count,
+    gnsstime: (i) => f64[i * 2],
+    first: (i) => u32[i * 4 + 2],
+    count: (i) => u32[i * 4 + 3]
+  }
+}
+
+function readTracked(buffer, section) {
+  const u8 = new Uint8Array(buffer, section.offset, section.count * 12)
+  const u32 = new Uint32Array(buffer, section.offset, section.count * 3)
+  return {
+    length: section.count,
+    svid: (i) => u8[i * 12],
+    freqnr: (i) => u8[i * 12 + 1],
+    // SignalType_t n is tracked when hasSignal(i, n)
+    hasSignal: (i, n) =>
+      n < 32 ? (u32[i * 3 + 1] >>> n) & 1 : (u32[i * 3 + 2] >>> (n - 32)) & 1
+  }
+}
+
+function readUsed(buffer, section) {
+  const u8 = new Uint8Array(buffer, section.offset, section.count * 8)
+  const u32 = new Uint32Array(buffer, section.offset, section.count * 2)
+  return {
+    length: section.count,
+    svid: (i) => u8[i * 8],
+    freqnr: (i) => u8[i * 8 + 1],
+    signaltype: (i) => u32[i * 2 + 1]
+  }
+}
+
+export function readPackedResult(buffer) {
+  const header = new DataView(buffer, 0, 16)
+  if (header.getUint32(0, true) !== MAGIC) throw new Error('Not a packed analysis result')
+
+  const sectionCount = header.getUint16(6, true)
+  const table = new Uint32Array(buffer, 16, sectionCount * 4)
+  const result = {}
+
+  for (let i = 0; i < sectionCount; i++) {
+    const section = {
+      type: table[i * 4],
+      offset: table[i * 4 + 1],
+      count: table[i * 4 + 2],
+      recordSize: table[i * 4 + 3]
+    }
+
+    switch (section.type) {
+      case SECTION.PVT_ERROR:
+        result.errors = readPercentages(buffer, section, PVT_ERROR_FIELDS)
+        break
+      case SECTION.PVT_MODE:
+        result.modes = readPercentages(buffer, section, PVT_MODE_FIELDS)
+        break
+      case SECTION.TRACKED_EPOCHS:
+        result.trackedEpochs = readEpochs(buffer, section)
+        break
+      case SECTION.TRACKED_SATELLITES:
+        result.trackedSatellites = readTracked(buffer, section)
+        break
+      case SECTION.USED_EPOCHS:
+        result.usedEpochs = readEpochs(buffer, section)
+        break
+      case SECTION.USED_SATELLITES:
+        result.usedSatellites = readUsed(buffer, section)
+        break
+    }
+  }
+
+  return result
+}